@@ -0,0 +1,55 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "shapes.h"
+#include <vector>
+
+// Node-by-node construction against the bulk builders, fed from the
+// columnar form of the same random tree.
+
+TEST_CASE("append_child vs bulk builders, random 10^6", "[bulk_build]") {
+    constexpr size_t size = 1000000;
+    tree<int> source;
+    shapes::random(source, size);
+
+    std::vector<int> values;
+    std::vector<int> parents;
+    std::vector<int> depths;
+    {
+        pre_order_view view{source};
+        auto traverser = std::begin(view).as_traverser();
+        std::vector<int> parent_stack;
+        int depth = 0;
+        while (true) {
+            parents.push_back(parent_stack.empty() ? -1 : parent_stack.back());
+            depths.push_back(depth);
+            values.push_back(traverser.value());
+            if (traverser.to_first_child()) {
+                parent_stack.push_back(static_cast<int>(values.size()) - 1);
+                depth++;
+                continue;
+            }
+            while (!traverser.has_next_sibling() && traverser.to_parent()) {
+                parent_stack.pop_back();
+                depth--;
+            }
+            if (!traverser.to_next_sibling()) {
+                break;
+            }
+        }
+    }
+
+    BENCHMARK("append_child") {
+        tree<int> t;
+        shapes::random(t, size);
+        return t.size();
+    };
+
+    BENCHMARK("from_parent_array") {
+        return tree<int>::from_parent_array(values, parents).size();
+    };
+
+    BENCHMARK("from_preorder_depths") {
+        return tree<int>::from_preorder_depths(values, depths).size();
+    };
+}
@@ -0,0 +1,53 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "compact_tree.h"
+#include "shapes.h"
+#include <vector>
+
+// Pointer-linked tree against the index-linked compact_tree, built with the
+// same random shape.
+
+TEST_CASE("tree vs compact_tree, random 10^6", "[compact_tree]") {
+    constexpr size_t size = 1000000;
+
+    auto build_compact = [] {
+        compact_tree<int> t;
+        std::vector<size_t> parents = shapes::random_parents(size);
+        std::vector<compact_tree<int>::iterator> nodes;
+        nodes.reserve(size);
+        nodes.push_back(t.insert(insertion::vert, t.end(), 0));
+        for (size_t i = 1; i < size; i++) {
+            nodes.push_back(t.append_child(nodes[parents[i]], static_cast<int>(i)));
+        }
+        return t;
+    };
+
+    BENCHMARK("tree build") {
+        tree<int> t;
+        shapes::random(t, size);
+        return t.size();
+    };
+    BENCHMARK("compact_tree build") {
+        return build_compact().size();
+    };
+
+    tree<int> t;
+    shapes::random(t, size);
+    compact_tree<int> compact = build_compact();
+
+    BENCHMARK("tree pre-order") {
+        long long result = 0;
+        for (int value : pre_order_view{t}) {
+            result += value;
+        }
+        return result;
+    };
+    BENCHMARK("compact_tree pre-order") {
+        long long result = 0;
+        for (int value : compact.pre_order()) {
+            result += value;
+        }
+        return result;
+    };
+}
@@ -0,0 +1,83 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "arena_allocator.h"
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Building a 10^6 tree (a root with 1024 children, the rest spread evenly
+// below them) on 1, 2, 4, ... hardware threads: concurrent_append_child
+// against append_child behind one mutex. Build throughput should grow with
+// the thread count for the former and stay flat for the latter.
+
+namespace {
+    constexpr size_t size = 1000000;
+    constexpr size_t parent_count = 1024;
+
+    std::vector<size_t> thread_counts() {
+        std::vector<size_t> result;
+        size_t hardware = std::thread::hardware_concurrency();
+        for (size_t count = 1; count <= (hardware > 0 ? hardware : 1); count *= 2) {
+            result.push_back(count);
+        }
+        return result;
+    }
+
+    // Appends the parents, then lets `thread_count` threads append the
+    // remaining nodes round-robin under them through `append`.
+    template <typename Tree, typename Append>
+    size_t build(size_t thread_count, Append append) {
+        Tree t;
+        pre_order_view view{t};
+        auto root = t.insert(insertion::vert, std::begin(view), 0);
+        std::vector<decltype(root)> parents;
+        for (size_t i = 0; i < parent_count; i++) {
+            parents.push_back(t.append_child(root, 0));
+        }
+
+        size_t per_thread = (size - 1 - parent_count) / thread_count;
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < thread_count; i++) {
+            threads.emplace_back([&, i] {
+                for (size_t j = 0; j < per_thread; j++) {
+                    append(t, parents[(i + j * thread_count) % parent_count], static_cast<int>(j));
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        return t.size();
+    }
+}
+
+TEST_CASE("parallel build, 10^6 nodes", "[concurrent_build]") {
+    using concurrent_tree = tree<int, std::allocator<tree_node<int, concurrent_links>>>;
+    using arena_tree = tree<int, concurrent_arena_allocator<tree_node<int, concurrent_links>>>;
+
+    for (size_t thread_count : thread_counts()) {
+        std::string threads = std::to_string(thread_count) + (thread_count == 1 ? " thread" : " threads");
+
+        BENCHMARK("concurrent_append_child, std::allocator, " + threads) {
+            return build<concurrent_tree>(thread_count, [](auto& t, auto parent, int value) {
+                t.concurrent_append_child(parent, value);
+            });
+        };
+
+        BENCHMARK("concurrent_append_child, concurrent_arena_allocator, " + threads) {
+            return build<arena_tree>(thread_count, [](auto& t, auto parent, int value) {
+                t.concurrent_append_child(parent, value);
+            });
+        };
+
+        std::mutex mutex;
+        BENCHMARK("append_child behind a mutex, " + threads) {
+            return build<tree<int>>(thread_count, [&mutex](auto& t, auto parent, int value) {
+                std::lock_guard lock{mutex};
+                t.append_child(parent, value);
+            });
+        };
+    }
+}
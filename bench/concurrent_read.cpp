@@ -0,0 +1,144 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "shapes.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One pre-order walk of a random 10^5 tree while a writer keeps appending and
+// erasing leaves and other threads walk as well: concurrent_links readers
+// inside read_section() against default_links readers behind a shared_mutex.
+
+namespace {
+    // Appends a leaf under a rotating node and erases the oldest of the last
+    // `window` leaves, so the tree keeps its size.
+    template <typename Tree, typename Lock>
+    class churn_writer {
+    public:
+        churn_writer(Tree& t, Lock lock)
+            : thread{[this, &t, lock] {
+                using iterator = pre_order_iterator<int, typename Tree::links_type>;
+                std::vector<iterator> parents;
+                for (auto it = std::begin(pre_order_view{t}); parents.size() < 1000; ++it) {
+                    parents.push_back(it);
+                }
+                std::deque<iterator> leaves;
+                size_t next_parent = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    lock([&] {
+                        leaves.push_back(t.append_child(parents[next_parent], 1));
+                        if (leaves.size() > 1000) {
+                            t.erase_subtree(leaves.front());
+                            leaves.pop_front();
+                        }
+                    });
+                    next_parent = (next_parent + 1) % parents.size();
+                    writes.fetch_add(1, std::memory_order_relaxed);
+                }
+            }} {}
+
+        ~churn_writer() {
+            stop = true;
+            thread.join();
+        }
+
+        std::atomic<bool> stop{false};
+        std::atomic<size_t> writes{0};
+
+    private:
+        std::thread thread;
+    };
+
+    // runs `walk` on other threads until destroyed
+    class background_readers {
+    public:
+        template <typename Walk>
+        background_readers(size_t count, Walk walk) {
+            for (size_t i = 0; i < count; i++) {
+                threads.emplace_back([this, walk] {
+                    while (!stop.load(std::memory_order_relaxed)) {
+                        walk();
+                    }
+                });
+            }
+        }
+
+        ~background_readers() {
+            stop = true;
+            for (std::thread& thread : threads) {
+                thread.join();
+            }
+        }
+
+    private:
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> threads;
+    };
+
+    size_t other_readers() {
+        size_t hardware = std::thread::hardware_concurrency();
+        return hardware > 2 ? hardware - 2 : 0;
+    }
+}
+
+TEST_CASE("concurrent reads during writes, random 10^5", "[concurrent_read]") {
+    using concurrent_tree = tree<int, std::allocator<tree_node<int, concurrent_links>>>;
+    constexpr size_t size = 100000;
+    size_t reader_count = other_readers() + 1;
+    std::string readers = std::to_string(reader_count) + (reader_count == 1 ? " reader" : " readers");
+
+    {
+        concurrent_tree t;
+        shapes::random(t, size);
+        auto walk = [&t] {
+            auto guard = t.read_section();
+            long long result = 0;
+            for (int value : pre_order_view{t}) {
+                result += value;
+            }
+            return result;
+        };
+
+        BENCHMARK("concurrent_links walk, no writer") {
+            return walk();
+        };
+
+        background_readers others{other_readers(), walk};
+        churn_writer writer{t, [](auto&& write) { write(); }};
+        BENCHMARK("concurrent_links walk, writer active, " + readers) {
+            return walk();
+        };
+    }
+
+    {
+        tree<int> t;
+        shapes::random(t, size);
+        std::shared_mutex mutex;
+        auto walk = [&t, &mutex] {
+            std::shared_lock lock{mutex};
+            long long result = 0;
+            for (int value : pre_order_view{t}) {
+                result += value;
+            }
+            return result;
+        };
+
+        BENCHMARK("shared_mutex walk, no writer") {
+            return walk();
+        };
+
+        background_readers others{other_readers(), walk};
+        churn_writer writer{t, [&mutex](auto&& write) {
+            std::unique_lock lock{mutex};
+            write();
+        }};
+        BENCHMARK("shared_mutex walk, writer active, " + readers) {
+            return walk();
+        };
+    }
+}
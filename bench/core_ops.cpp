@@ -0,0 +1,290 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "counting_allocator.h"
+#include "shapes.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <utility>
+#include <vector>
+
+// Every core tree operation on every shape of shapes.h, next to std::vector
+// and std::list doing the closest equivalent on the same parent array. Results are printed as CSV rows
+//
+//     op,container,shape,nodes,ns_per_op,allocs_per_op,bytes_per_node
+//
+// where an op is one node inserted, erased or visited, ns_per_op is the best
+// of several runs and bytes_per_node is the memory held by the container
+// after the run divided by its size. The 10^7 sizes are behind [core_large].
+
+namespace {
+    using counted_tree = tree<int, counting_allocator<tree_node<int>>>;
+    using tree_iterator = pre_order_iterator<int, counted_tree::links_type>;
+
+    // the shapes of shapes.h, as parent arrays
+    struct shape {
+        const char* name;
+        std::vector<size_t> (*parents)(size_t size);
+    };
+
+    constexpr shape all_shapes[] = {
+        {"wide", [](size_t size) { return shapes::wide_parents(size); }},
+        {"deep", [](size_t size) { return shapes::deep_parents(size); }},
+        {"balanced", [](size_t size) { return shapes::balanced_parents(size); }},
+        {"random", [](size_t size) { return shapes::random_parents(size); }},
+    };
+
+    enum class child_order {
+        append,
+        prepend
+    };
+
+    std::vector<tree_iterator> build(counted_tree& t, const std::vector<size_t>& parents, child_order order) {
+        if (order == child_order::append) {
+            return shapes::build(t, parents);
+        }
+        std::vector<tree_iterator> nodes;
+        nodes.reserve(parents.size());
+        pre_order_view view{t};
+        nodes.push_back(t.insert(insertion::vert, std::begin(view), 0));
+        for (size_t i = 1; i < parents.size(); i++) {
+            nodes.push_back(t.prepend_child(nodes[parents[i]], static_cast<int>(i)));
+        }
+        return nodes;
+    }
+
+    // a node of the std::vector and std::list baselines, which hold a shape
+    // as the same parent array the tree is built from
+    struct parented_value {
+        int value;
+        size_t parent;
+    };
+
+    struct result_row {
+        const char* op;
+        const char* container;
+        const char* shape;
+        size_t nodes;
+    };
+
+    // what a run did: ops for ns_per_op and allocs_per_op, the nodes left in
+    // the container and the live bytes owned by anything else (a copy source)
+    struct run_result {
+        size_t ops;
+        size_t remaining;
+        size_t other_bytes = 0;
+    };
+
+    // keeps traversals from being optimized away
+    volatile long long checksum;
+
+    // Runs setup() and the timed run() until enough time has been spent and
+    // prints the fastest run.
+
+    void measure(const result_row& row, const std::function<void()>& setup, const std::function<run_result()>& run) {
+        using clock = std::chrono::steady_clock;
+        constexpr int min_runs = 3;
+        constexpr int max_runs = 50;
+        constexpr auto min_total = std::chrono::milliseconds{200};
+
+        allocation_counter& counter = allocation_counter::global();
+        double best_ns = 0;
+        size_t allocations = 0;
+        size_t bytes = 0;
+        run_result result{};
+        clock::duration total{};
+        for (int i = 0; i < max_runs && (i < min_runs || total < min_total); i++) {
+            setup();
+            size_t allocations_before = counter.allocations;
+            auto start = clock::now();
+            result = run();
+            auto elapsed = clock::now() - start;
+            allocations = counter.allocations - allocations_before;
+            bytes = counter.live_bytes;
+
+            total += elapsed;
+            double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+            best_ns = i == 0 ? ns : std::min(best_ns, ns);
+        }
+
+        double ops = static_cast<double>(std::max<size_t>(result.ops, 1));
+        double bytes_per_node = result.remaining != 0
+            ? static_cast<double>(bytes - result.other_bytes) / static_cast<double>(result.remaining)
+            : 0.0;
+        std::printf("%s,%s,%s,%zu,%.2f,%.3f,%.1f\n", row.op, row.container, row.shape, row.nodes,
+                    best_ns / ops, static_cast<double>(allocations) / ops, bytes_per_node);
+        std::fflush(stdout);
+    }
+
+    void bench_tree(const char* name, const std::vector<size_t>& parents) {
+        size_t size = parents.size();
+        counted_tree t;
+        std::vector<tree_iterator> nodes;
+        auto fresh = [&] {
+            t.clear();
+            nodes = build(t, parents, child_order::append);
+        };
+        auto release = [&] {
+            nodes.clear();
+            t.clear();
+        };
+
+        measure({"append_child", "tree", name, size}, release, [&]() -> run_result {
+            nodes = build(t, parents, child_order::append);
+            return {size, t.size()};
+        });
+        measure({"prepend_child", "tree", name, size}, release, [&]() -> run_result {
+            nodes = build(t, parents, child_order::prepend);
+            return {size, t.size()};
+        });
+
+        // a new parent above every node
+        measure({"insert_vert", "tree", name, size}, fresh, [&]() -> run_result {
+            for (tree_iterator node : nodes) {
+                t.insert(insertion::vert, node, -1);
+            }
+            return {size, t.size()};
+        });
+        // a new sibling before every node but the root
+        measure({"insert_hor", "tree", name, size}, fresh, [&]() -> run_result {
+            for (size_t i = 1; i < nodes.size(); i++) {
+                t.insert(insertion::hor, nodes[i], -1);
+            }
+            return {size - 1, t.size()};
+        });
+
+        // every subtree under the root, one op per node removed
+        measure({"erase_subtree", "tree", name, size}, fresh, [&]() -> run_result {
+            pre_order_view view{t};
+            while (t.size() > 1) {
+                t.erase_subtree(std::next(std::begin(view)));
+            }
+            return {size - 1, t.size()};
+        });
+
+        fresh();
+        measure({"pre_order_forward", "tree", name, size}, [] {}, [&]() -> run_result {
+            long long sum = 0;
+            for (int value : pre_order_view{t}) {
+                sum += value;
+            }
+            checksum = sum;
+            return {size, t.size()};
+        });
+        measure({"pre_order_reverse", "tree", name, size}, [] {}, [&]() -> run_result {
+            long long sum = 0;
+            pre_order_view view{t};
+            for (auto it = view.rbegin(); it != view.rend(); ++it) {
+                sum += *it;
+            }
+            checksum = sum;
+            return {size, t.size()};
+        });
+
+        counted_tree copy;
+        size_t source_bytes = allocation_counter::global().live_bytes;
+        measure({"copy", "tree", name, size}, [&] { copy.clear(); }, [&]() -> run_result {
+            copy = counted_tree{t};
+            return {size, copy.size(), source_bytes};
+        });
+
+        measure({"clear", "tree", name, size}, fresh, [&]() -> run_result {
+            nodes.clear();
+            t.clear();
+            return {size, 0};
+        });
+    }
+
+    template <typename Sequence>
+    void bench_sequence(const char* container, const char* name, const std::vector<size_t>& parents) {
+        size_t size = parents.size();
+        Sequence sequence;
+        auto fresh = [&] {
+            sequence = Sequence(size);
+        };
+        auto release = [&] {
+            sequence = Sequence{};
+        };
+
+        measure({"append_child", container, name, size}, release, [&]() -> run_result {
+            for (size_t i = 0; i < size; i++) {
+                sequence.push_back({static_cast<int>(i), parents[i]});
+            }
+            return {size, sequence.size()};
+        });
+        if constexpr (requires { sequence.push_front(parented_value{}); }) {
+            measure({"prepend_child", container, name, size}, release, [&]() -> run_result {
+                for (size_t i = 0; i < size; i++) {
+                    sequence.push_front({static_cast<int>(i), parents[i]});
+                }
+                return {size, sequence.size()};
+            });
+        }
+        measure({"erase_subtree", container, name, size}, fresh, [&]() -> run_result {
+            sequence.erase(std::next(std::begin(sequence)), std::end(sequence));
+            return {size - 1, sequence.size()};
+        });
+
+        fresh();
+        measure({"pre_order_forward", container, name, size}, [] {}, [&]() -> run_result {
+            long long sum = 0;
+            for (const parented_value& node : sequence) {
+                sum += node.value;
+            }
+            checksum = sum;
+            return {size, sequence.size()};
+        });
+        measure({"pre_order_reverse", container, name, size}, [] {}, [&]() -> run_result {
+            long long sum = 0;
+            for (auto it = std::rbegin(sequence); it != std::rend(sequence); ++it) {
+                sum += it->value;
+            }
+            checksum = sum;
+            return {size, sequence.size()};
+        });
+
+        Sequence copy;
+        size_t source_bytes = allocation_counter::global().live_bytes;
+        measure({"copy", container, name, size}, [&] { copy = Sequence{}; }, [&]() -> run_result {
+            copy = sequence;
+            return {size, copy.size(), source_bytes};
+        });
+
+        measure({"clear", container, name, size}, fresh, [&]() -> run_result {
+            sequence = Sequence{};
+            return {size, 0};
+        });
+    }
+
+    void bench_all(size_t size) {
+        for (const shape& shape : all_shapes) {
+            std::vector<size_t> parents = shape.parents(size);
+            bench_tree(shape.name, parents);
+            bench_sequence<std::vector<parented_value, counting_allocator<parented_value>>>("vector", shape.name, parents);
+            bench_sequence<std::list<parented_value, counting_allocator<parented_value>>>("list", shape.name, parents);
+        }
+    }
+
+    void print_header() {
+        static bool printed = false;
+        if (!std::exchange(printed, true)) {
+            std::printf("op,container,shape,nodes,ns_per_op,allocs_per_op,bytes_per_node\n");
+        }
+    }
+}
+
+TEST_CASE("Core operations, 10^3 to 10^6", "[core]") {
+    print_header();
+    for (size_t size : {size_t{1000}, size_t{10000}, size_t{100000}, size_t{1000000}}) {
+        bench_all(size);
+    }
+}
+
+TEST_CASE("Core operations, 10^7", "[.][core_large]") {
+    print_header();
+    bench_all(10000000);
+}
@@ -0,0 +1,47 @@
+#ifndef BENCH_COUNTING_ALLOCATOR_H_INCLUDED
+#define BENCH_COUNTING_ALLOCATOR_H_INCLUDED
+
+#include <cstddef>
+#include <memory>
+
+// Counts every allocation made through any counting_allocator, across rebinds.
+struct allocation_counter {
+    size_t allocations = 0;
+    size_t live_bytes = 0;
+
+    static allocation_counter& global() noexcept {
+        static allocation_counter counter;
+        return counter;
+    }
+};
+
+// std::allocator that reports to allocation_counter::global().
+template <typename T>
+struct counting_allocator {
+    using value_type = T;
+
+    counting_allocator() noexcept = default;
+
+    template <typename U>
+    counting_allocator(const counting_allocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        T* result = std::allocator<T>{}.allocate(n);
+        allocation_counter& counter = allocation_counter::global();
+        counter.allocations++;
+        counter.live_bytes += n * sizeof(T);
+        return result;
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept {
+        allocation_counter::global().live_bytes -= n * sizeof(T);
+        std::allocator<T>{}.deallocate(ptr, n);
+    }
+
+    template <typename U>
+    bool operator == (const counting_allocator<U>&) const noexcept {
+        return true;
+    }
+};
+
+#endif // BENCH_COUNTING_ALLOCATOR_H_INCLUDED
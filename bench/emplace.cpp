@@ -0,0 +1,50 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include <string>
+#include <vector>
+
+// Appending 10^5 children with values built from constructor arguments:
+// append_child with a temporary against emplace_child_back constructing the
+// value in the node, for short (SSO) and long strings and small vectors.
+
+namespace {
+    constexpr size_t size = 100000;
+
+    template <typename T, typename Append>
+    size_t build(Append append) {
+        tree<T> t;
+        pre_order_view view{t};
+        auto root = t.emplace(insertion::vert, std::begin(view));
+        for (size_t i = 1; i < size; i++) {
+            append(t, root);
+        }
+        return t.size();
+    }
+}
+
+TEST_CASE("append_child against emplace_child_back, 10^5 children", "[emplace]") {
+    BENCHMARK("std::string(8), append_child") {
+        return build<std::string>([](auto& t, auto root) { t.append_child(root, std::string(8, 'a')); });
+    };
+
+    BENCHMARK("std::string(8), emplace_child_back") {
+        return build<std::string>([](auto& t, auto root) { t.emplace_child_back(root, 8, 'a'); });
+    };
+
+    BENCHMARK("std::string(64), append_child") {
+        return build<std::string>([](auto& t, auto root) { t.append_child(root, std::string(64, 'a')); });
+    };
+
+    BENCHMARK("std::string(64), emplace_child_back") {
+        return build<std::string>([](auto& t, auto root) { t.emplace_child_back(root, 64, 'a'); });
+    };
+
+    BENCHMARK("std::vector<int>(16), append_child") {
+        return build<std::vector<int>>([](auto& t, auto root) { t.append_child(root, std::vector<int>(16, 1)); });
+    };
+
+    BENCHMARK("std::vector<int>(16), emplace_child_back") {
+        return build<std::vector<int>>([](auto& t, auto root) { t.emplace_child_back(root, 16, 1); });
+    };
+}
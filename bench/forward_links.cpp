@@ -0,0 +1,78 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "shapes.h"
+
+// Full five-link nodes against nodes with only parent, next_sibling and
+// first_child, on the same append-only, forward-only workload. Without a
+// last_child link append_child walks the siblings, so a wide tree is built
+// with insert_after instead.
+
+TEST_CASE("default_links vs forward_links, random 10^6", "[forward_links]") {
+    using forward_tree = tree<int, std::allocator<tree_node<int, forward_links>>>;
+    constexpr size_t size = 1000000;
+
+    BENCHMARK("default_links build") {
+        tree<int> t;
+        shapes::random(t, size);
+        return t.size();
+    };
+    BENCHMARK("forward_links build") {
+        forward_tree t;
+        shapes::random(t, size);
+        return t.size();
+    };
+
+    tree<int> full;
+    shapes::random(full, size);
+    forward_tree forward;
+    shapes::random(forward, size);
+
+    BENCHMARK("default_links pre-order") {
+        long long result = 0;
+        for (int value : pre_order_view{full}) {
+            result += value;
+        }
+        return result;
+    };
+    BENCHMARK("forward_links pre-order") {
+        long long result = 0;
+        for (int value : pre_order_view{forward}) {
+            result += value;
+        }
+        return result;
+    };
+
+    BENCHMARK("default_links copy") {
+        return tree<int>{full}.size();
+    };
+    BENCHMARK("forward_links copy") {
+        return forward_tree{forward}.size();
+    };
+}
+
+TEST_CASE("building a wide tree with forward_links, 2 * 10^4 children", "[forward_links]") {
+    using forward_tree = tree<int, std::allocator<tree_node<int, forward_links>>>;
+    constexpr int size = 20000;
+
+    BENCHMARK("default_links append_child") {
+        tree<int> t;
+        shapes::wide(t, size);
+        return t.size();
+    };
+    BENCHMARK("forward_links append_child") {
+        forward_tree t;
+        shapes::wide(t, size);
+        return t.size();
+    };
+    BENCHMARK("forward_links insert_after") {
+        forward_tree t;
+        pre_order_view view{t};
+        auto root = t.insert(insertion::vert, std::begin(view), 0);
+        auto last = t.append_child(root, 1);
+        for (int i = 2; i < size; i++) {
+            last = t.insert_after(last, i);
+        }
+        return t.size();
+    };
+}
@@ -0,0 +1,47 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "frozen_tree.h"
+#include "shapes.h"
+
+// Read-only traversals of a pointer-linked tree against its frozen snapshot.
+
+TEST_CASE("tree vs frozen_tree traversal, random 10^6", "[frozen_tree]") {
+    tree<int> t;
+    shapes::random(t, 1000000);
+    frozen_tree<int> frozen{t};
+
+    BENCHMARK("freeze") {
+        return frozen_tree<int>{t}.size();
+    };
+
+    BENCHMARK("tree pre-order") {
+        long long result = 0;
+        for (int value : pre_order_view{t}) {
+            result += value;
+        }
+        return result;
+    };
+    BENCHMARK("frozen_tree pre-order") {
+        long long result = 0;
+        for (int value : frozen.pre_order()) {
+            result += value;
+        }
+        return result;
+    };
+
+    BENCHMARK("tree post-order") {
+        long long result = 0;
+        for (int value : post_order_view{t}) {
+            result += value;
+        }
+        return result;
+    };
+    BENCHMARK("frozen_tree post-order") {
+        long long result = 0;
+        for (int value : frozen.post_order()) {
+            result += value;
+        }
+        return result;
+    };
+}
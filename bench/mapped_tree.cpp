@@ -0,0 +1,42 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "frozen_tree.h"
+#include "mapped_tree.h"
+#include "shapes.h"
+#include <filesystem>
+#include <string>
+
+// Opening a snapshot against rebuilding the tree, and traversal straight over
+// the mapped pages.
+
+TEST_CASE("mapped_tree open and traversal, random 10^6", "[mapped_tree]") {
+    tree<int> t;
+    shapes::random(t, 1000000);
+    std::string path = (std::filesystem::temp_directory_path() / "tree_bench_snapshot.bin").string();
+    save_snapshot(t, path);
+
+    BENCHMARK("save_snapshot") {
+        save_snapshot(t, path);
+        return path.size();
+    };
+
+    BENCHMARK("rebuild frozen_tree") {
+        return frozen_tree<int>{t}.size();
+    };
+
+    BENCHMARK("open mapped_tree") {
+        return mapped_tree<int>{path}.size();
+    };
+
+    mapped_tree<int> mapped{path};
+    BENCHMARK("mapped_tree pre-order") {
+        long long result = 0;
+        for (int value : mapped.pre_order()) {
+            result += value;
+        }
+        return result;
+    };
+
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,82 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "shapes.h"
+#include <random>
+#include <vector>
+
+// 1000 ancestor tests between random nodes of a 10^4 chain: walking the
+// parent links against comparing order labels. Building a random 10^5 tree
+// with and without labels shows what keeping them costs on insertion.
+
+namespace {
+    using labelled_tree = tree<int, std::allocator<tree_node<int, labelled_links>>>;
+
+    template <typename Tree>
+    std::vector<typename pre_order_view<int, typename Tree::allocator_type>::iterator> all_nodes(Tree& t) {
+        std::vector<typename pre_order_view<int, typename Tree::allocator_type>::iterator> result;
+        pre_order_view view{t};
+        for (auto it = std::begin(view); it != std::end(view); ++it) {
+            result.push_back(it);
+        }
+        return result;
+    }
+
+    std::vector<std::pair<size_t, size_t>> random_pairs(size_t count) {
+        std::mt19937 rng{3};
+        std::uniform_int_distribution<size_t> pick{0, count - 1};
+        std::vector<std::pair<size_t, size_t>> result(1000);
+        for (auto& pair : result) {
+            pair = {pick(rng), pick(rng)};
+        }
+        return result;
+    }
+}
+
+TEST_CASE("ancestor tests, deep 10^4", "[order_labels]") {
+    labelled_tree t;
+    shapes::deep(t, 10000);
+    auto nodes = all_nodes(t);
+    auto pairs = random_pairs(nodes.size());
+
+    auto walked = [&] {
+        size_t result = 0;
+        for (auto [i, j] : pairs) {
+            auto up = nodes[j].as_traverser();
+            bool found = &up.value() == &*nodes[i];
+            while (!found && up.to_parent()) {
+                found = &up.value() == &*nodes[i];
+            }
+            result += found;
+        }
+        return result;
+    };
+    auto labelled = [&] {
+        size_t result = 0;
+        for (auto [i, j] : pairs) {
+            result += t.is_ancestor(nodes[i], nodes[j]);
+        }
+        return result;
+    };
+    REQUIRE(walked() == labelled());
+
+    BENCHMARK("parent walks") {
+        return walked();
+    };
+    BENCHMARK("order labels") {
+        return labelled();
+    };
+}
+
+TEST_CASE("building with order labels, random 10^5", "[order_labels]") {
+    BENCHMARK("default_links") {
+        tree<int> t;
+        shapes::random(t, 100000);
+        return t.size();
+    };
+    BENCHMARK("labelled_links") {
+        labelled_tree t;
+        shapes::random(t, 100000);
+        return t.size();
+    };
+}
@@ -0,0 +1,67 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "parallel_tree.h"
+#include "shapes.h"
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Scaling of parallel_reduce / parallel_for_each from one worker up to the
+// number of hardware threads, against a plain sequential pre-order fold.
+
+namespace {
+    std::vector<size_t> worker_counts() {
+        size_t max_workers = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        std::vector<size_t> counts;
+        for (size_t n = 1; n < max_workers; n *= 2) {
+            counts.push_back(n);
+        }
+        counts.push_back(max_workers);
+        return counts;
+    }
+
+    template <typename Tree>
+    void run_scaling(Tree& t) {
+        BENCHMARK("sequential reduce") {
+            long long result = 0;
+            for (int value : pre_order_view{t}) {
+                result += value;
+            }
+            return result;
+        };
+
+        for (size_t workers : worker_counts()) {
+            auto pool = std::make_unique<work_stealing_pool>(workers);
+            parallel_options options{4096, pool.get()};
+            BENCHMARK("parallel_reduce, " + std::to_string(workers) + " workers") {
+                return parallel_reduce(t, 0LL, std::plus<>{}, options);
+            };
+            BENCHMARK("parallel_for_each, " + std::to_string(workers) + " workers") {
+                parallel_for_each(t, [](int& value) { value ^= 1; }, options);
+                return t.size();
+            };
+        }
+    }
+}
+
+TEST_CASE("parallel scaling, random 10^6", "[parallel]") {
+    tree<int> t;
+    shapes::random(t, 1000000);
+    run_scaling(t);
+}
+
+TEST_CASE("parallel scaling, balanced 10^6", "[parallel]") {
+    tree<int> t;
+    shapes::balanced(t, 1000000);
+    run_scaling(t);
+}
+
+TEST_CASE("parallel scaling, random 10^7", "[parallel][.large]") {
+    tree<int> t;
+    shapes::random(t, 10000000);
+    run_scaling(t);
+}
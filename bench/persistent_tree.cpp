@@ -0,0 +1,104 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "persistent_tree.h"
+#include "counting_allocator.h"
+#include "shapes.h"
+#include <cstdio>
+#include <iterator>
+#include <vector>
+
+// One version per edit of a balanced 10^5 tree (fan-out 4): deep copy of a
+// tree and a value change against persistent_tree::set_value. The bytes kept
+// alive per version are printed before the timings. A root with 10^4
+// children shows what an edit under a wide node costs.
+
+namespace {
+    constexpr size_t size = 100000;
+    constexpr size_t fanout = 4;
+
+    using counted_persistent = persistent_tree<int, counting_allocator<int>>;
+
+    // same shape and values as shapes::balanced
+    counted_persistent balanced_persistent() {
+        counted_persistent result;
+        result = result.insert(insertion::vert, result.root(), 0);
+        std::vector<std::vector<size_t>> indices(size);
+        for (size_t i = 1; i < size; i++) {
+            size_t parent = (i - 1) / fanout;
+            indices[i] = indices[parent];
+            indices[i].push_back((i - 1) % fanout);
+            result = result.append_child(result.at(indices[parent]), static_cast<int>(i));
+        }
+        return result;
+    }
+
+    template <typename Edit>
+    size_t bytes_per_version(Edit edit) {
+        constexpr size_t versions = 100;
+        size_t before = allocation_counter::global().live_bytes;
+        std::vector<decltype(edit(0))> kept;
+        for (size_t i = 0; i < versions; i++) {
+            kept.push_back(edit(i));
+        }
+        return (allocation_counter::global().live_bytes - before) / versions;
+    }
+}
+
+TEST_CASE("versions of a balanced 10^5 tree", "[persistent_tree]") {
+    using counted_tree = tree<int, counting_allocator<tree_node<int>>>;
+    counted_tree base;
+    shapes::balanced(base, size, fanout);
+    counted_persistent persistent_base = balanced_persistent();
+    auto leaf = persistent_base.at({1, 2, 3, 0, 1, 2, 3});
+
+    auto copy_edit = [&base](size_t i) {
+        counted_tree version = base;
+        *std::next(std::begin(pre_order_view{version}), 1000) = static_cast<int>(i);
+        return version;
+    };
+    auto persistent_edit = [&persistent_base, &leaf](size_t i) {
+        return persistent_base.set_value(leaf, static_cast<int>(i));
+    };
+
+    std::printf("tree copy: %zu bytes per version\n", bytes_per_version(copy_edit));
+    std::printf("persistent_tree: %zu bytes per version\n", bytes_per_version(persistent_edit));
+
+    BENCHMARK("tree copy and edit") {
+        return copy_edit(1).size();
+    };
+
+    BENCHMARK("persistent_tree::set_value") {
+        return persistent_edit(1).size();
+    };
+
+    BENCHMARK("persistent_tree::append_child") {
+        return persistent_base.append_child(leaf, 1).size();
+    };
+}
+
+TEST_CASE("versions of a root with 10^4 children", "[persistent_tree]") {
+    constexpr size_t children = 10000;
+    counted_persistent base;
+    base = base.insert(insertion::vert, base.root(), 0);
+    for (size_t i = 1; i <= children; i++) {
+        base = base.append_child(base.root(), static_cast<int>(i));
+    }
+    auto middle = base.at({children / 2});
+
+    auto set_value = [&base, &middle](size_t i) {
+        return base.set_value(middle, static_cast<int>(i));
+    };
+    auto insert = [&base, &middle](size_t i) {
+        return base.insert(insertion::hor, middle, static_cast<int>(i));
+    };
+    std::printf("wide set_value: %zu bytes per version\n", bytes_per_version(set_value));
+    std::printf("wide insert: %zu bytes per version\n", bytes_per_version(insert));
+
+    BENCHMARK("wide persistent_tree::set_value") {
+        return set_value(1).size();
+    };
+    BENCHMARK("wide persistent_tree::insert") {
+        return insert(1).size();
+    };
+}
@@ -0,0 +1,84 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "shapes.h"
+#include <vector>
+
+// post_order_view against the usual workaround of collecting the nodes into
+// a std::vector with an explicit stack on every pass.
+
+namespace {
+    long long sum_post_order(const tree<int>& t) {
+        long long result = 0;
+        for (int value : post_order_view{t}) {
+            result = result * 31 + value;
+        }
+        return result;
+    }
+
+    long long sum_post_order_reverse(const tree<int>& t) {
+        post_order_view view{t};
+        long long result = 0;
+        for (auto it = view.rbegin(); it != view.rend(); ++it) {
+            result = result * 31 + *it;
+        }
+        return result;
+    }
+
+    long long sum_vector_workaround(const tree<int>& t) {
+        pre_order_view view{t};
+        std::vector<tree_traverser<int>> stack;
+        std::vector<const int*> order;
+        stack.push_back(std::begin(view).as_traverser());
+        // reversed pre-order with children pushed left to right is reversed post-order
+        while (!stack.empty()) {
+            tree_traverser<int> node = stack.back();
+            stack.pop_back();
+            order.push_back(&node.value());
+            if (node.to_first_child()) {
+                stack.push_back(node);
+                while (node.to_next_sibling()) {
+                    stack.push_back(node);
+                }
+            }
+        }
+
+        long long result = 0;
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            result = result * 31 + **it;
+        }
+        return result;
+    }
+
+    void bench_tree(const tree<int>& t) {
+        REQUIRE(sum_post_order(t) == sum_vector_workaround(t));
+
+        BENCHMARK("post_order_view") {
+            return sum_post_order(t);
+        };
+        BENCHMARK("post_order_view reverse") {
+            return sum_post_order_reverse(t);
+        };
+        BENCHMARK("std::vector workaround") {
+            return sum_vector_workaround(t);
+        };
+    }
+}
+
+TEST_CASE("post-order traversal, balanced 10^6", "[post_order]") {
+    tree<int> t;
+    shapes::balanced(t, 1000000);
+    bench_tree(t);
+}
+
+TEST_CASE("post-order traversal, random 10^6", "[post_order]") {
+    tree<int> t;
+    shapes::random(t, 1000000);
+    bench_tree(t);
+}
+
+TEST_CASE("post-order traversal, balanced 10^7", "[post_order]") {
+    tree<int> t;
+    shapes::balanced(t, 10000000);
+    bench_tree(t);
+}
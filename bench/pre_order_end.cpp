@@ -0,0 +1,93 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "shapes.h"
+#include <ranges>
+#include <vector>
+
+// Pre-order loops that call end() on every step. end() used to walk the
+// rightmost path of the tree; the "walked end()" loop redoes that walk on
+// every step to show what keeping the last node saves. Appending children
+// to the deepest node of a chain shows what keeping that node costs.
+
+namespace {
+    const int* walk_to_last(const tree<int>& t) {
+        auto node = std::begin(pre_order_view{t}).as_traverser();
+        while (node.to_last_child()) {}
+        return &node.value();
+    }
+
+    long long sum_walked_end(const tree<int>& t) {
+        pre_order_view view{t};
+        long long result = 0;
+        for (auto it = view.begin(); it != view.end(); ++it) {
+            result = result * 31 + *it + (&*it == walk_to_last(t));
+        }
+        return result;
+    }
+
+    long long sum_end_per_step(const tree<int>& t) {
+        pre_order_view view{t};
+        long long result = 0;
+        for (auto it = view.begin(); it != view.end(); ++it) {
+            result = result * 31 + *it;
+        }
+        return result;
+    }
+
+    long long sum_range(const tree<int>& t) {
+        long long result = 0;
+        for (int value : pre_order_range{t}) {
+            result = result * 31 + value;
+        }
+        return result;
+    }
+
+    void bench_tree(const tree<int>& t, bool walked) {
+        REQUIRE(sum_end_per_step(t) == sum_range(t));
+
+        if (walked) {
+            BENCHMARK("walked end() per step") {
+                return sum_walked_end(t);
+            };
+        }
+        BENCHMARK("pre_order_view, end() per step") {
+            return sum_end_per_step(t);
+        };
+        BENCHMARK("pre_order_range, sentinel") {
+            return sum_range(t);
+        };
+    }
+}
+
+TEST_CASE("pre-order loop calling end(), deep 3000", "[pre_order_end]") {
+    tree<int> t;
+    shapes::deep(t, 3000);
+    bench_tree(t, true);
+}
+
+TEST_CASE("pre-order loop calling end(), random 10^6", "[pre_order_end]") {
+    tree<int> t;
+    shapes::random(t, 1000000);
+    bench_tree(t, false);
+}
+
+TEST_CASE("appending 1000 children to the bottom of a deep 3000 chain", "[pre_order_end]") {
+    tree<int> t;
+    shapes::deep(t, 3000);
+    pre_order_view view{t};
+    auto deepest = std::prev(std::end(view));
+    std::vector<decltype(deepest)> children;
+    children.reserve(1000);
+
+    BENCHMARK("append_child, then erase_subtree") {
+        for (int i = 0; i < 1000; i++) {
+            children.push_back(t.append_child(deepest, i));
+        }
+        while (!children.empty()) {
+            t.erase_subtree(children.back());
+            children.pop_back();
+        }
+        return t.size();
+    };
+}
@@ -0,0 +1,134 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include <vector>
+
+// Compares the link-walking clear/count/copy of tree_storage with the
+// straightforward recursive versions they replaced. The recursive ones use
+// one stack frame per level, so deep shapes are kept shallow enough for them
+// to survive; the iterative ones are also run on a chain far deeper than that.
+
+namespace {
+    using storage = tree_storage<int>;
+    using node = tree_node<int>;
+
+    constexpr int shape_size = 50000;
+    constexpr int deep_only_size = 1000000;
+
+    node* make_deep(storage& s, int size) {
+        node* root = storage::create_node(s.alloc, 0);
+        node* curr = root;
+        for (int i = 1; i < size; i++) {
+            node* child = storage::create_node(s.alloc, i);
+            curr->push_back_child(child);
+            curr = child;
+        }
+        return root;
+    }
+
+    node* make_wide(storage& s, int size) {
+        node* root = storage::create_node(s.alloc, 0);
+        for (int i = 1; i < size; i++) {
+            root->push_back_child(storage::create_node(s.alloc, i));
+        }
+        return root;
+    }
+
+    size_t count_recursive(const node* n) {
+        size_t result = 1;
+        for (const node* child = n->first_child(); child != nullptr; child = child->next_sibling()) {
+            result += count_recursive(child);
+        }
+        return result;
+    }
+
+    void clear_recursive(storage& s, node* n) {
+        node* child = n->first_child();
+        while (child != nullptr) {
+            node* next = child->next_sibling();
+            clear_recursive(s, child);
+            child = next;
+        }
+        storage::allocator_traits::destroy(s.alloc, n);
+        storage::allocator_traits::deallocate(s.alloc, n, 1);
+    }
+
+    node* copy_recursive(storage& s, const node* n) {
+        node* result = storage::create_node(s.alloc, n->value());
+        for (const node* child = n->first_child(); child != nullptr; child = child->next_sibling()) {
+            result->push_back_child(copy_recursive(s, child));
+        }
+        return result;
+    }
+
+    template <typename Clear>
+    void bench_clear(Catch::Benchmark::Chronometer meter, storage& s, Clear clear) {
+        std::vector<node*> copies(static_cast<size_t>(meter.runs()));
+        for (node*& copy : copies) {
+            copy = s.copy_node_impl(s.root, s.node_count);
+        }
+        meter.measure([&](int i) { clear(copies[static_cast<size_t>(i)]); });
+    }
+
+    template <typename Copy>
+    void bench_copy(Catch::Benchmark::Chronometer meter, storage& s, Copy copy) {
+        std::vector<node*> copies(static_cast<size_t>(meter.runs()));
+        meter.measure([&](int i) { copies[static_cast<size_t>(i)] = copy(s.root); });
+        for (node* c : copies) {
+            s.clear_node_impl(c);
+        }
+    }
+
+    void bench_shape(storage& s) {
+        BENCHMARK("count recursive") {
+            return count_recursive(s.root);
+        };
+        BENCHMARK("count iterative") {
+            return storage::count_nodes(s.root);
+        };
+
+        BENCHMARK_ADVANCED("copy recursive")(Catch::Benchmark::Chronometer meter) {
+            bench_copy(meter, s, [&](const node* n) { return copy_recursive(s, n); });
+        };
+        BENCHMARK_ADVANCED("copy iterative")(Catch::Benchmark::Chronometer meter) {
+            bench_copy(meter, s, [&](const node* n) { return s.copy_node_impl(n, s.node_count); });
+        };
+
+        BENCHMARK_ADVANCED("clear recursive")(Catch::Benchmark::Chronometer meter) {
+            bench_clear(meter, s, [&](node* n) { clear_recursive(s, n); });
+        };
+        BENCHMARK_ADVANCED("clear iterative")(Catch::Benchmark::Chronometer meter) {
+            bench_clear(meter, s, [&](node* n) { s.clear_node_impl(n); });
+        };
+    }
+}
+
+TEST_CASE("recursive vs iterative walks, wide tree", "[recursion]") {
+    storage s;
+    s.root = make_wide(s, shape_size);
+    s.node_count = shape_size;
+    bench_shape(s);
+}
+
+TEST_CASE("recursive vs iterative walks, deep tree", "[recursion]") {
+    storage s;
+    s.root = make_deep(s, shape_size);
+    s.node_count = shape_size;
+    bench_shape(s);
+}
+
+TEST_CASE("iterative walks, very deep tree", "[recursion]") {
+    storage s;
+    s.root = make_deep(s, deep_only_size);
+    s.node_count = deep_only_size;
+
+    BENCHMARK("count iterative") {
+        return storage::count_nodes(s.root);
+    };
+    BENCHMARK_ADVANCED("copy iterative")(Catch::Benchmark::Chronometer meter) {
+        bench_copy(meter, s, [&](const node* n) { return s.copy_node_impl(n, s.node_count); });
+    };
+    BENCHMARK_ADVANCED("clear iterative")(Catch::Benchmark::Chronometer meter) {
+        bench_clear(meter, s, [&](node* n) { s.clear_node_impl(n); });
+    };
+}
@@ -0,0 +1,98 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "shapes.h"
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Traversal of an aged tree before and after relayout. The tree is built
+// randomly and then churned: random leaves are erased and new children are
+// appended to random nodes, so nodes that are neighbours in the tree end up
+// far apart on the heap. Measured are a pre-order pass, a level-order pass
+// and 10^4 walks from random nodes up to the root.
+
+namespace {
+    constexpr size_t size = 200000;
+
+    void age(tree<int>& t) {
+        std::mt19937 rng{11};
+        pre_order_view view{t};
+        std::vector<pre_order_view<int>::iterator> nodes;
+        for (auto it = std::begin(view); it != std::end(view); ++it) {
+            nodes.push_back(it);
+        }
+        int value = static_cast<int>(size);
+        for (size_t step = 0; step < 2 * size; step++) {
+            size_t i = std::uniform_int_distribution<size_t>{1, nodes.size() - 1}(rng);
+            if (step % 2 == 0 && !nodes[i].as_traverser().has_first_child()) {
+                t.erase_subtree(nodes[i]);
+                nodes[i] = nodes.back();
+                nodes.pop_back();
+            } else {
+                nodes.push_back(t.append_child(nodes[i], value++));
+            }
+        }
+    }
+
+    std::vector<tree_traverser<int>> sample_nodes(tree<int>& t) {
+        std::vector<tree_traverser<int>> all;
+        pre_order_view view{t};
+        for (auto it = std::begin(view); it != std::end(view); ++it) {
+            all.push_back(it.as_traverser());
+        }
+        std::mt19937 rng{5};
+        std::vector<tree_traverser<int>> result;
+        for (size_t i = 0; i < 10000; i++) {
+            result.push_back(all[std::uniform_int_distribution<size_t>{0, all.size() - 1}(rng)]);
+        }
+        return result;
+    }
+
+    void bench_tree(const char* name, tree<int>& t) {
+        auto samples = sample_nodes(t);
+        BENCHMARK(std::string{name} + ": pre-order") {
+            long long result = 0;
+            for (int value : pre_order_range{t}) {
+                result += value;
+            }
+            return result;
+        };
+        BENCHMARK(std::string{name} + ": level-order") {
+            long long result = 0;
+            for (int value : level_order_view{t}) {
+                result += value;
+            }
+            return result;
+        };
+        BENCHMARK(std::string{name} + ": walks to the root") {
+            long long result = 0;
+            for (tree_traverser<int> node : samples) {
+                do {
+                    result += node.value();
+                } while (node.to_parent());
+            }
+            return result;
+        };
+    }
+}
+
+TEST_CASE("traversal of an aged random 2 * 10^5 tree, before and after relayout", "[relayout]") {
+    tree<int> aged;
+    shapes::random(aged, size);
+    age(aged);
+    bench_tree("aged", aged);
+
+    for (auto [order, name] : {std::pair{layout_order::pre_order, "pre_order"},
+                               std::pair{layout_order::level_order, "level_order"},
+                               std::pair{layout_order::van_emde_boas, "van_emde_boas"}}) {
+        tree<int> t;
+        shapes::random(t, size);
+        age(t);
+        BENCHMARK(std::string{"relayout "} + name) {
+            t.relayout(order);
+        };
+        bench_tree(name, t);
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef BENCH_SHAPES_H_INCLUDED
+#define BENCH_SHAPES_H_INCLUDED
+
+#include "tree.h"
+#include <cstddef>
+#include <random>
+#include <vector>
+
+// Tree shapes shared by the benchmarks and tests. Each shape is a parent
+// array: node i hangs under node parents[i] < i, and node 0 is the root,
+// whose parent is no_parent, so the arrays can be passed to
+// tree::from_parent_array as they are. Every builder appends `size` nodes
+// valued 0..size-1 to an empty tree through the public insertion API, in
+// index order.
+namespace shapes {
+    inline constexpr size_t no_parent = ~size_t{0};
+
+
+    // root with size - 1 children
+    inline std::vector<size_t> wide_parents(size_t size) {
+        std::vector<size_t> parents(size, 0);
+        if (size != 0) {
+            parents[0] = no_parent;
+        }
+        return parents;
+    }
+
+    // a single chain
+    inline std::vector<size_t> deep_parents(size_t size) {
+        std::vector<size_t> parents(size, no_parent);
+        for (size_t i = 1; i < size; i++) {
+            parents[i] = i - 1;
+        }
+        return parents;
+    }
+
+    // complete tree with the given fan-out, filled level by level
+    inline std::vector<size_t> balanced_parents(size_t size, size_t fanout = 4) {
+        std::vector<size_t> parents(size, no_parent);
+        for (size_t i = 1; i < size; i++) {
+            parents[i] = (i - 1) / fanout;
+        }
+        return parents;
+    }
+
+    // every node hangs under a uniformly chosen earlier node
+    inline std::vector<size_t> random_parents(size_t size, unsigned seed = 42) {
+        std::mt19937 rng{seed};
+        std::vector<size_t> parents(size, no_parent);
+        for (size_t i = 1; i < size; i++) {
+            std::uniform_int_distribution<size_t> parent{0, i - 1};
+            parents[i] = parent(rng);
+        }
+        return parents;
+    }
+
+    // appends node i under node parents[i], returning an iterator to every node
+    template <typename Tree>
+    auto build(Tree& t, const std::vector<size_t>& parents) {
+        pre_order_view view{t};
+        std::vector<pre_order_iterator<typename Tree::value_type, typename Tree::links_type>> nodes;
+        nodes.reserve(parents.size());
+        if (parents.empty()) {
+            return nodes;
+        }
+        nodes.push_back(t.insert(insertion::vert, std::begin(view), 0));
+        for (size_t i = 1; i < parents.size(); i++) {
+            nodes.push_back(t.append_child(nodes[parents[i]], static_cast<int>(i)));
+        }
+        return nodes;
+    }
+
+    template <typename Tree>
+    void wide(Tree& t, size_t size) {
+        build(t, wide_parents(size));
+    }
+
+    template <typename Tree>
+    void deep(Tree& t, size_t size) {
+        build(t, deep_parents(size));
+    }
+
+    template <typename Tree>
+    void balanced(Tree& t, size_t size, size_t fanout = 4) {
+        build(t, balanced_parents(size, fanout));
+    }
+
+    template <typename Tree>
+    void random(Tree& t, size_t size, unsigned seed = 42) {
+        build(t, random_parents(size, seed));
+    }
+
+    // random shape with node i valued make_value(i), built in one pass
+    template <typename Tree, typename MakeValue>
+    Tree random_tree(size_t size, MakeValue make_value, unsigned seed = 42) {
+        std::vector<typename Tree::value_type> values;
+        values.reserve(size);
+        for (size_t i = 0; i < size; i++) {
+            values.push_back(make_value(i));
+        }
+        return Tree::from_parent_array(values, random_parents(size, seed));
+    }
+}
+
+#endif // BENCH_SHAPES_H_INCLUDED
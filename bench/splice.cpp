@@ -0,0 +1,86 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "arena_allocator.h"
+#include "shapes.h"
+#include <iterator>
+#include <utility>
+#include <vector>
+
+// Moving a 10^4-node subtree (a child of the root of a balanced 10^5 tree
+// with fan-out 10) to another tree and back: splice against erase_subtree
+// and rebuilding the subtree value by value. Splices between trees need
+// sized_links. With arena_allocator the two trees do not share an
+// allocator, so splice falls back to a bulk move. A copy holds its nodes in
+// one block, which the first splice out of it walks the subtree to share.
+
+namespace {
+    constexpr size_t size = 100000;
+
+    template <typename Tree>
+    auto big_subtree(Tree& t) {
+        return std::next(std::begin(pre_order_view{t}));
+    }
+
+    template <typename Tree>
+    void copy_subtree(Tree& dest, Tree& source) {
+        pre_order_view source_view{source};
+        pre_order_view dest_view{dest};
+        auto node = big_subtree(source).as_traverser();
+        auto parent = dest.append_child(std::begin(dest_view), node.value());
+        // rebuild the subtree below `parent` level by level from its traverser
+        std::vector<std::pair<decltype(node), decltype(parent)>> pending{{node, parent}};
+        while (!pending.empty()) {
+            auto [src, dst] = pending.back();
+            pending.pop_back();
+            if (src.to_first_child()) {
+                do {
+                    pending.push_back({src, dest.append_child(dst, src.value())});
+                } while (src.to_next_sibling());
+            }
+        }
+        source.erase_subtree(big_subtree(source));
+    }
+}
+
+TEST_CASE("subtree moves between trees, balanced 10^5", "[splice]") {
+    using sized_tree = tree<int, std::allocator<tree_node<int, sized_links>>>;
+    sized_tree source;
+    sized_tree dest;
+    shapes::balanced(source, size, 10);
+    shapes::balanced(dest, 1);
+
+    BENCHMARK("splice there and back") {
+        dest.splice_child(std::begin(pre_order_view{dest}), source, big_subtree(source));
+        source.splice_child(std::begin(pre_order_view{source}), dest, big_subtree(dest));
+        return source.size();
+    };
+
+    sized_tree copy_source{source};
+    sized_tree copy_dest;
+    shapes::balanced(copy_dest, 1);
+
+    BENCHMARK("splice there and back, copied source") {
+        copy_dest.splice_child(std::begin(pre_order_view{copy_dest}), copy_source, big_subtree(copy_source));
+        copy_source.splice_child(std::begin(pre_order_view{copy_source}), copy_dest, big_subtree(copy_dest));
+        return copy_source.size();
+    };
+
+    BENCHMARK("erase and rebuild there and back") {
+        copy_subtree(dest, source);
+        copy_subtree(source, dest);
+        return source.size();
+    };
+
+    using arena_tree = tree<int, arena_allocator<tree_node<int, sized_links>>>;
+    arena_tree arena_source;
+    arena_tree arena_dest;
+    shapes::balanced(arena_source, size, 10);
+    shapes::balanced(arena_dest, 1);
+
+    BENCHMARK("splice there and back, separate arenas") {
+        arena_dest.splice_child(std::begin(pre_order_view{arena_dest}), arena_source, big_subtree(arena_source));
+        arena_source.splice_child(std::begin(pre_order_view{arena_source}), arena_dest, big_subtree(arena_dest));
+        return arena_source.size();
+    };
+}
@@ -0,0 +1,88 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "shapes.h"
+#include <random>
+#include <string>
+#include <vector>
+
+// Change detection between two versions of a random 10^5 tree: 100 times a
+// random node of the second version changes its value, the versions are
+// compared (==, then diff), and the change is undone. Without hashes both
+// walk the trees in lock-step. With hashes, writing through the iterator
+// drops the hashes above the node and the comparison rehashes only those
+// ancestors: == stops at once on differing hashes but still walks
+// equal trees to rule out a collision, probably_equal trusts the hashes, and
+// diff descends only where hashes differ. "== on equal trees" isolates the
+// exact walk, which hashed nodes must not make slower.
+
+namespace {
+    using hashed_tree = tree<int, std::allocator<tree_node<int, hashed_links>>>;
+
+    template <typename Tree>
+    std::vector<typename pre_order_view<int, typename Tree::allocator_type>::iterator> random_nodes(Tree& t) {
+        std::vector<typename pre_order_view<int, typename Tree::allocator_type>::iterator> all;
+        pre_order_view view{t};
+        for (auto it = std::begin(view); it != std::end(view); ++it) {
+            all.push_back(it);
+        }
+        std::mt19937 rng{9};
+        std::vector<typename pre_order_view<int, typename Tree::allocator_type>::iterator> result;
+        for (int i = 0; i < 100; i++) {
+            result.push_back(all[std::uniform_int_distribution<size_t>{0, all.size() - 1}(rng)]);
+        }
+        return result;
+    }
+
+    template <typename Tree>
+    void bench_versions(const char* name) {
+        Tree original;
+        shapes::random(original, 100000);
+        Tree changed{original};
+        pre_order_view original_view{original};
+        pre_order_view changed_view{changed};
+        auto nodes = random_nodes(changed);
+
+        BENCHMARK(std::string{name} + ": ==") {
+            size_t result = 0;
+            for (auto node : nodes) {
+                for (int delta : {-1, 1}) {
+                    *node -= delta;
+                    result += original == changed;
+                }
+            }
+            return result;
+        };
+        if constexpr (Tree::links_type::template has<node_link::subtree_hash>) {
+            BENCHMARK(std::string{name} + ": probably_equal") {
+                size_t result = 0;
+                for (auto node : nodes) {
+                    for (int delta : {-1, 1}) {
+                        *node -= delta;
+                        result += original.probably_equal(changed);
+                    }
+                }
+                return result;
+            };
+        }
+        BENCHMARK(std::string{name} + ": == on equal trees") {
+            return original == changed;
+        };
+        BENCHMARK(std::string{name} + ": diff") {
+            size_t result = 0;
+            for (auto node : nodes) {
+                for (int delta : {-1, 1}) {
+                    *node -= delta;
+                    original.diff(std::begin(original_view), std::begin(changed_view),
+                                  [&result](auto, auto) { result++; });
+                }
+            }
+            return result;
+        };
+    }
+}
+
+TEST_CASE("change detection between versions, random 10^5", "[subtree_hash]") {
+    bench_versions<tree<int>>("default_links");
+    bench_versions<hashed_tree>("hashed_links");
+}
@@ -0,0 +1,105 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "tree_index.h"
+#include "shapes.h"
+#include <random>
+#include <vector>
+
+// 1000 lowest-common-ancestor and root path sum queries between random
+// nodes: walking parent links from tree traversers against tree_index, with
+// the index_of lookup of both nodes counted in. Building the index is
+// measured as well.
+
+namespace {
+    using traverser = tree_traverser<int>;
+
+    size_t depth(traverser node) {
+        size_t result = 0;
+        while (node.to_parent()) {
+            result++;
+        }
+        return result;
+    }
+
+    long long walked_queries(const std::vector<traverser>& nodes, const std::vector<std::pair<size_t, size_t>>& pairs) {
+        long long result = 0;
+        for (auto [i, j] : pairs) {
+            traverser a = nodes[i];
+            traverser b = nodes[j];
+            size_t depth_a = depth(a);
+            size_t depth_b = depth(b);
+            for (; depth_a > depth_b; depth_a--) {
+                a.to_parent();
+            }
+            for (; depth_b > depth_a; depth_b--) {
+                b.to_parent();
+            }
+            while (&a.value() != &b.value()) {
+                a.to_parent();
+                b.to_parent();
+            }
+            result += a.value();
+
+            traverser up = nodes[i];
+            long long sum = up.value();
+            while (up.to_parent()) {
+                sum += up.value();
+            }
+            result += sum;
+        }
+        return result;
+    }
+
+    long long indexed_queries(const tree_index<int, sum_monoid<long long>>& index,
+                              const std::vector<traverser>& nodes,
+                              const std::vector<std::pair<size_t, size_t>>& pairs) {
+        long long result = 0;
+        for (auto [i, j] : pairs) {
+            auto a = index.index_of(nodes[i].value());
+            auto b = index.index_of(nodes[j].value());
+            result += index[index.lca(a, b)];
+            result += index.path_from_root(a);
+        }
+        return result;
+    }
+
+    void bench_tree(tree<int>& t) {
+        std::vector<traverser> nodes;
+        pre_order_view view{t};
+        for (auto it = std::begin(view); it != std::end(view); ++it) {
+            nodes.push_back(it.as_traverser());
+        }
+        std::mt19937 rng{7};
+        std::uniform_int_distribution<size_t> pick{0, nodes.size() - 1};
+        std::vector<std::pair<size_t, size_t>> pairs(1000);
+        for (auto& pair : pairs) {
+            pair = {pick(rng), pick(rng)};
+        }
+
+        tree_index<int, sum_monoid<long long>> index{t};
+        REQUIRE(walked_queries(nodes, pairs) == indexed_queries(index, nodes, pairs));
+
+        BENCHMARK("parent walks") {
+            return walked_queries(nodes, pairs);
+        };
+        BENCHMARK("tree_index") {
+            return indexed_queries(index, nodes, pairs);
+        };
+        BENCHMARK("tree_index build") {
+            return tree_index<int, sum_monoid<long long>>{t}.size();
+        };
+    }
+}
+
+TEST_CASE("lca and path queries, random 10^5", "[tree_index]") {
+    tree<int> t;
+    shapes::random(t, 100000);
+    bench_tree(t);
+}
+
+TEST_CASE("lca and path queries, deep 10^4", "[tree_index]") {
+    tree<int> t;
+    shapes::deep(t, 10000);
+    bench_tree(t);
+}
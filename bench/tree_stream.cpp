@@ -0,0 +1,67 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "tree_stream.h"
+#include "shapes.h"
+#include <cstddef>
+#include <iostream>
+#include <span>
+#include <vector>
+
+// Streaming encoder and decoder against a naive recursive encoder that grows
+// one vector. Divide the stream size printed below by the mean time for MB/s.
+
+namespace {
+    template <typename Traverser>
+    void naive_encode(Traverser node, std::vector<std::byte>& out) {
+        auto bytes = stream_codec<int>::bytes(node.value());
+        out.insert(out.end(), bytes.begin(), bytes.end());
+        size_t children = 0;
+        if (node.to_first_child()) {
+            do {
+                children++;
+            } while (node.to_next_sibling());
+            node.to_parent();
+        }
+        auto count = std::as_bytes(std::span<const size_t, 1>{&children, 1});
+        out.insert(out.end(), count.begin(), count.end());
+        if (node.to_first_child()) {
+            do {
+                naive_encode(node, out);
+            } while (node.to_next_sibling());
+        }
+    }
+}
+
+TEST_CASE("tree_stream encode and decode, random 10^6", "[tree_stream]") {
+    tree<int> t;
+    shapes::random(t, 1000000);
+
+    std::vector<std::byte> stream;
+    encode_tree(t, [&](std::span<const std::byte> chunk) {
+        stream.insert(stream.end(), chunk.begin(), chunk.end());
+    });
+    std::cout << "tree_stream: " << stream.size() << " bytes for " << t.size() << " nodes\n";
+
+    BENCHMARK("naive recursive encode") {
+        std::vector<std::byte> out;
+        pre_order_view view{t};
+        naive_encode(std::begin(view).as_traverser(), out);
+        return out.size();
+    };
+
+    BENCHMARK("encode_tree, 64K chunks") {
+        size_t total = 0;
+        encode_tree(t, [&](std::span<const std::byte> chunk) { total += chunk.size(); });
+        return total;
+    };
+
+    BENCHMARK("tree_decoder, 64K chunks") {
+        tree_decoder<int> decoder;
+        std::span<const std::byte> input{stream};
+        for (size_t i = 0; i < input.size(); i += default_stream_chunk_size) {
+            decoder.feed(input.subspan(i, std::min(default_stream_chunk_size, input.size() - i)));
+        }
+        return decoder.take().size();
+    };
+}
@@ -0,0 +1,520 @@
+#ifndef ARENA_ALLOCATOR_H_INCLUDED
+#define ARENA_ALLOCATOR_H_INCLUDED
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace detail {
+    // Allocations of several objects at once, i.e. the node blocks of tree
+    // copies, bulk builds and relayouts. Their sizes follow the tree, so
+    // free lists would keep memory of every size ever used; each one gets
+    // memory of its own instead, which goes back to the system when freed.
+    class large_blocks {
+    public:
+        large_blocks() noexcept = default;
+
+        large_blocks(const large_blocks&) = delete;
+        large_blocks& operator = (const large_blocks&) = delete;
+
+        ~large_blocks() noexcept {
+            release();
+        }
+
+        void* allocate(std::size_t bytes, std::size_t alignment) {
+            std::size_t offset = header_size(alignment);
+            auto base = static_cast<std::byte*>(::operator new(offset + bytes, std::align_val_t{block_alignment(alignment)}));
+            auto block = new (base) header{nullptr, first, offset + bytes, alignment};
+            if (first != nullptr) {
+                first->prev = block;
+            }
+            first = block;
+            reserved += offset + bytes;
+            return base + offset;
+        }
+
+        void deallocate(void* ptr, std::size_t alignment) noexcept {
+            auto block = reinterpret_cast<header*>(static_cast<std::byte*>(ptr) - header_size(alignment));
+            if (block->prev != nullptr) {
+                block->prev->next = block->next;
+            } else {
+                first = block->next;
+            }
+            if (block->next != nullptr) {
+                block->next->prev = block->prev;
+            }
+            reserved -= block->bytes;
+            free_header(block);
+        }
+
+        void release() noexcept {
+            while (first != nullptr) {
+                free_header(std::exchange(first, first->next));
+            }
+            reserved = 0;
+        }
+
+        std::size_t reserved_bytes() const noexcept {
+            return reserved;
+        }
+
+    private:
+        struct header {
+            header* prev;
+            header* next;
+            std::size_t bytes;
+            std::size_t alignment;
+        };
+
+        static std::size_t block_alignment(std::size_t alignment) noexcept {
+            return alignment > alignof(header) ? alignment : alignof(header);
+        }
+
+        // the header sits at the start, the block follows at its alignment
+        static std::size_t header_size(std::size_t alignment) noexcept {
+            std::size_t align = block_alignment(alignment);
+            return (sizeof(header) + align - 1) / align * align;
+        }
+
+        static void free_header(header* block) noexcept {
+            ::operator delete(block, std::align_val_t{block_alignment(block->alignment)});
+        }
+
+        header* first = nullptr;
+        std::size_t reserved = 0;
+    };
+
+    // Untyped storage shared by every copy (and rebind) of an arena_allocator.
+    // Single objects are carved from large chunks with a bump pointer; freed
+    // ones are kept on per-size free lists and handed out again before
+    // touching the chunk, and only go back to the system on release() or
+    // destruction. Larger allocations are kept in large_blocks.
+    // There is a free list for every size up to max_pooled_bytes from the
+    // start, so a block may be freed to any arena_state of a shared arena
+    // and deallocate never allocates.
+    class arena_state {
+    public:
+        static constexpr std::size_t max_pooled_bytes = 512;
+
+        // objects bigger or more aligned than this go to large_blocks
+        static constexpr bool pooled(std::size_t bytes, std::size_t alignment) noexcept {
+            return alignment <= alignof(std::max_align_t) && round_up(bytes, alignment) <= max_pooled_bytes;
+        }
+
+        explicit arena_state(std::size_t chunk_size) noexcept
+            : chunk_size{chunk_size}
+            , bump{nullptr}
+            , bump_end{nullptr}
+            , free_lists{} {}
+
+        arena_state(const arena_state&) = delete;
+        arena_state& operator = (const arena_state&) = delete;
+
+        ~arena_state() noexcept {
+            release();
+        }
+
+        void* allocate(std::size_t bytes, std::size_t alignment) {
+            assert(pooled(bytes, alignment));
+            bytes = round_up(bytes, alignment);
+            // a block may be reused by any type of its size, so align it for all of them
+            alignment = size_alignment(bytes);
+            free_block*& head = free_list_for(bytes);
+            if (head != nullptr) {
+                return std::exchange(head, head->next);
+            }
+
+            std::size_t space = static_cast<std::size_t>(bump_end - bump);
+            void* ptr = bump;
+            if (bump == nullptr || std::align(alignment, bytes, ptr, space) == nullptr) {
+                new_chunk(bytes + alignment);
+                space = static_cast<std::size_t>(bump_end - bump);
+                ptr = bump;
+                std::align(alignment, bytes, ptr, space);
+            }
+
+            bump = static_cast<std::byte*>(ptr) + bytes;
+            return ptr;
+        }
+
+        void deallocate(void* ptr, std::size_t bytes, std::size_t alignment) noexcept {
+            free_block*& head = free_list_for(round_up(bytes, alignment));
+            head = new (ptr) free_block{head};
+        }
+
+        void* allocate_large(std::size_t bytes, std::size_t alignment) {
+            return large.allocate(bytes, alignment);
+        }
+
+        void deallocate_large(void* ptr, std::size_t alignment) noexcept {
+            large.deallocate(ptr, alignment);
+        }
+
+        void release() noexcept {
+            for (std::byte* chunk : chunks) {
+                ::operator delete(chunk);
+            }
+            chunks.clear();
+            large.release();
+            reserved = 0;
+            free_lists.fill(nullptr);
+            bump = nullptr;
+            bump_end = nullptr;
+        }
+
+        std::size_t reserved_bytes() const noexcept {
+            return reserved + large.reserved_bytes();
+        }
+
+    private:
+        struct free_block {
+            free_block* next;
+        };
+
+        static constexpr std::size_t round_up(std::size_t bytes, std::size_t alignment) noexcept {
+            if (bytes < sizeof(free_block)) {
+                bytes = sizeof(free_block);
+            }
+            if (alignment < alignof(free_block)) {
+                alignment = alignof(free_block);
+            }
+            return (bytes + alignment - 1) / alignment * alignment;
+        }
+
+        // the largest alignment a type of this size can have
+        static std::size_t size_alignment(std::size_t bytes) noexcept {
+            std::size_t alignment = bytes & (~bytes + 1);
+            return alignment < alignof(std::max_align_t) ? alignment : alignof(std::max_align_t);
+        }
+
+        // sizes are multiples of alignof(free_block), one list for each
+        free_block*& free_list_for(std::size_t bytes) noexcept {
+            return free_lists[bytes / alignof(free_block) - 1];
+        }
+
+        void new_chunk(std::size_t min_bytes) {
+            std::size_t bytes = min_bytes > chunk_size ? min_bytes : chunk_size;
+            chunks.reserve(chunks.size() + 1);
+            auto chunk = static_cast<std::byte*>(::operator new(bytes));
+            chunks.push_back(chunk);
+            reserved += bytes;
+            bump = chunk;
+            bump_end = chunk + bytes;
+        }
+
+        std::size_t chunk_size;
+        std::size_t reserved = 0;
+        std::byte* bump;
+        std::byte* bump_end;
+        std::vector<std::byte*> chunks;
+        std::array<free_block*, max_pooled_bytes / alignof(free_block)> free_lists;
+        large_blocks large;
+    };
+
+    // Unlike std::mutex, locking cannot throw, so deallocate and release
+    // stay noexcept. Waiters block in atomic_flag::wait rather than spin.
+    class shard_lock {
+    public:
+        void lock() noexcept {
+            while (flag.test_and_set(std::memory_order_acquire)) {
+                flag.wait(true, std::memory_order_relaxed);
+            }
+        }
+
+        void unlock() noexcept {
+            flag.clear(std::memory_order_release);
+            flag.notify_one();
+        }
+
+    private:
+        std::atomic_flag flag;
+    };
+
+    // arena_state split into independently locked shards; each thread
+    // allocates from (and frees to) the shard its id hashes to, so threads
+    // building a tree together rarely wait on each other.
+    class sharded_arena_state {
+        struct alignas(64) shard {
+            explicit shard(std::size_t chunk_size) noexcept
+                : arena{chunk_size} {}
+
+            shard_lock mutex;
+            arena_state arena;
+        };
+
+    public:
+        sharded_arena_state(std::size_t chunk_size, std::size_t shard_count)
+            : shard_count{shard_count > 0 ? shard_count : 1}
+            , shards{static_cast<shard*>(::operator new(sizeof(shard) * this->shard_count, std::align_val_t{alignof(shard)}))} {
+            for (std::size_t i = 0; i < this->shard_count; i++) {
+                new (shards + i) shard{chunk_size};
+            }
+        }
+
+        sharded_arena_state(const sharded_arena_state&) = delete;
+        sharded_arena_state& operator = (const sharded_arena_state&) = delete;
+
+        ~sharded_arena_state() noexcept {
+            for (std::size_t i = 0; i < shard_count; i++) {
+                shards[i].~shard();
+            }
+            ::operator delete(shards, std::align_val_t{alignof(shard)});
+        }
+
+        void* allocate(std::size_t bytes, std::size_t alignment) {
+            shard& local = local_shard();
+            std::lock_guard lock{local.mutex};
+            return local.arena.allocate(bytes, alignment);
+        }
+
+        // The block joins the free list of the calling thread's shard,
+        // whichever shard it came from; every shard has a list for every
+        // pooled size. Nodes freed on other threads than the ones that built
+        // them thus move between shards over time; the memory stays in this
+        // state until release() either way.
+        void deallocate(void* ptr, std::size_t bytes, std::size_t alignment) noexcept {
+            shard& local = local_shard();
+            std::lock_guard lock{local.mutex};
+            local.arena.deallocate(ptr, bytes, alignment);
+        }
+
+        // large blocks are shared by all shards: they may be freed on
+        // another thread than the one that made them
+        void* allocate_large(std::size_t bytes, std::size_t alignment) {
+            std::lock_guard lock{large_mutex};
+            return large.allocate(bytes, alignment);
+        }
+
+        void deallocate_large(void* ptr, std::size_t alignment) noexcept {
+            std::lock_guard lock{large_mutex};
+            large.deallocate(ptr, alignment);
+        }
+
+        void release() noexcept {
+            for (std::size_t i = 0; i < shard_count; i++) {
+                std::lock_guard lock{shards[i].mutex};
+                shards[i].arena.release();
+            }
+            std::lock_guard lock{large_mutex};
+            large.release();
+        }
+
+        std::size_t reserved_bytes() const noexcept {
+            std::size_t total = 0;
+            for (std::size_t i = 0; i < shard_count; i++) {
+                std::lock_guard lock{shards[i].mutex};
+                total += shards[i].arena.reserved_bytes();
+            }
+            std::lock_guard lock{large_mutex};
+            return total + large.reserved_bytes();
+        }
+
+    private:
+        shard& local_shard() const noexcept {
+            return shards[std::hash<std::thread::id>{}(std::this_thread::get_id()) % shard_count];
+        }
+
+        std::size_t shard_count;
+        shard* shards;
+        mutable shard_lock large_mutex;
+        large_blocks large;
+    };
+}
+
+// Slab allocator for tree nodes.
+// Nodes are handed out from large contiguous chunks, nodes returned by
+// erase_subtree go to a free list and are reused by later insertions.
+// The node blocks of copies, bulk builds and relayouts are allocated on
+// their own and returned to the system when freed.
+// Copies of the allocator share one arena; copying a tree gives the copy
+// a fresh arena (see select_on_container_copy_construction) and a moved-from
+// tree is left with a fresh one, so a tree normally owns its arena
+// exclusively and tree_storage can drop all nodes at once through release().
+// A tree built from an allocator the caller keeps a copy of shares the arena
+// with that copy; until the copy is gone, clear() frees node by node.
+template <typename T>
+class arena_allocator {
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    template <typename U>
+    struct rebind {
+        using other = arena_allocator<U>;
+    };
+
+    static constexpr std::size_t default_chunk_size = 64 * 1024;
+
+    template <typename>
+    friend class arena_allocator;
+
+    explicit arena_allocator(std::size_t chunk_size = default_chunk_size)
+        : state{std::make_shared<detail::arena_state>(chunk_size)}
+        , chunk_size{chunk_size} {}
+
+    // moving an allocator must leave the source equal to the result, so there is no move constructor
+    arena_allocator(const arena_allocator& other) noexcept = default;
+
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& other) noexcept
+        : state{other.state}
+        , chunk_size{other.chunk_size} {}
+
+    arena_allocator& operator = (const arena_allocator& other) noexcept = default;
+
+    // single objects come from the chunks, arrays and oversized objects get memory of their own
+    T* allocate(size_type n) {
+        if (n > 1 || !detail::arena_state::pooled(sizeof(T), alignof(T))) {
+            return static_cast<T*>(state->allocate_large(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(state->allocate(sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* ptr, size_type n) noexcept {
+        if (n > 1 || !detail::arena_state::pooled(sizeof(T), alignof(T))) {
+            state->deallocate_large(ptr, alignof(T));
+        } else {
+            state->deallocate(ptr, sizeof(T), alignof(T));
+        }
+    }
+
+    arena_allocator select_on_container_copy_construction() const {
+        return arena_allocator{chunk_size};
+    }
+
+    // true when no other allocator (or tree) shares this arena
+    bool exclusive() const noexcept {
+        return state.use_count() == 1;
+    }
+
+    // returns every chunk to the system; all memory handed out so far becomes invalid
+    void release() noexcept {
+        state->release();
+    }
+
+    std::size_t reserved_bytes() const noexcept {
+        return state->reserved_bytes();
+    }
+
+    template <typename U>
+    bool operator == (const arena_allocator<U>& other) const noexcept {
+        return state == other.state;
+    }
+
+    template <typename U>
+    bool operator != (const arena_allocator<U>& other) const noexcept {
+        return !(*this == other);
+    }
+
+private:
+    std::shared_ptr<detail::arena_state> state;
+    std::size_t chunk_size;
+};
+
+// arena_allocator that may be used from several threads at once, e.g. by
+// tree::concurrent_append_child. Same sharing and copy rules as
+// arena_allocator; the arena is split into shards (by default one per
+// hardware thread) so concurrent allocations seldom contend.
+template <typename T>
+class concurrent_arena_allocator {
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    template <typename U>
+    struct rebind {
+        using other = concurrent_arena_allocator<U>;
+    };
+
+    static constexpr std::size_t default_chunk_size = arena_allocator<T>::default_chunk_size;
+
+    template <typename>
+    friend class concurrent_arena_allocator;
+
+    explicit concurrent_arena_allocator(std::size_t chunk_size = default_chunk_size,
+                                        std::size_t shard_count = std::thread::hardware_concurrency())
+        : state{std::make_shared<detail::sharded_arena_state>(chunk_size, shard_count)}
+        , chunk_size{chunk_size}
+        , shard_count{shard_count} {}
+
+    // moving an allocator must leave the source equal to the result, so there is no move constructor
+    concurrent_arena_allocator(const concurrent_arena_allocator& other) noexcept = default;
+
+    template <typename U>
+    concurrent_arena_allocator(const concurrent_arena_allocator<U>& other) noexcept
+        : state{other.state}
+        , chunk_size{other.chunk_size}
+        , shard_count{other.shard_count} {}
+
+    concurrent_arena_allocator& operator = (const concurrent_arena_allocator& other) noexcept = default;
+
+    // single objects come from the chunks, arrays and oversized objects get memory of their own
+    T* allocate(size_type n) {
+        if (n > 1 || !detail::arena_state::pooled(sizeof(T), alignof(T))) {
+            return static_cast<T*>(state->allocate_large(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(state->allocate(sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* ptr, size_type n) noexcept {
+        if (n > 1 || !detail::arena_state::pooled(sizeof(T), alignof(T))) {
+            state->deallocate_large(ptr, alignof(T));
+        } else {
+            state->deallocate(ptr, sizeof(T), alignof(T));
+        }
+    }
+
+    concurrent_arena_allocator select_on_container_copy_construction() const {
+        return concurrent_arena_allocator{chunk_size, shard_count};
+    }
+
+    // true when no other allocator (or tree) shares this arena
+    bool exclusive() const noexcept {
+        return state.use_count() == 1;
+    }
+
+    // returns every chunk to the system; all memory handed out so far becomes invalid
+    void release() noexcept {
+        state->release();
+    }
+
+    std::size_t reserved_bytes() const noexcept {
+        return state->reserved_bytes();
+    }
+
+    template <typename U>
+    bool operator == (const concurrent_arena_allocator<U>& other) const noexcept {
+        return state == other.state;
+    }
+
+    template <typename U>
+    bool operator != (const concurrent_arena_allocator<U>& other) const noexcept {
+        return !(*this == other);
+    }
+
+private:
+    std::shared_ptr<detail::sharded_arena_state> state;
+    std::size_t chunk_size;
+    std::size_t shard_count;
+};
+
+#endif // ARENA_ALLOCATOR_H_INCLUDED
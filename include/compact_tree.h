@@ -0,0 +1,685 @@
+#ifndef COMPACT_TREE_H_INCLUDED
+#define COMPACT_TREE_H_INCLUDED
+
+#include "tree.h"
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Tree whose nodes live in one growable array and link to each other through
+// 32-bit indices instead of pointers. A node keeps four links: parent, first
+// child, next sibling and previous sibling, where the previous sibling of the
+// first child wraps around to the last child, so appending, prepending and
+// unlinking stay O(1) without a fifth link.
+// Erased slots go on a free list threaded through their first child link and
+// are reused before the array grows. Indices (and so iterators) stay valid
+// while the array grows; references to values do not.
+template <typename T, typename Allocator = std::allocator<T>>
+class compact_tree {
+public:
+    using value_type      = T;
+    using reference       = T&;
+    using const_reference = const T&;
+    using size_type       = size_t;
+    using index_type      = std::uint32_t;
+    using allocator_type  = Allocator;
+
+    static constexpr index_type npos = ~index_type{0};
+
+private:
+    struct node {
+        node() noexcept {}
+        ~node() noexcept {}
+
+        index_type parent;
+        index_type first_child;
+        index_type next_sibling;
+        // npos marks a free slot
+        index_type prev_sibling;
+        union {
+            T value;
+        };
+    };
+
+    using node_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<node>;
+    using node_traits    = std::allocator_traits<node_allocator>;
+
+public:
+    // bytes taken by one node, links included
+    static constexpr size_t node_size = sizeof(node);
+
+    template <bool Const>
+    class basic_pre_order_iterator {
+        using owner_type = std::conditional_t<Const, const compact_tree, compact_tree>;
+
+    public:
+        using value_type        = T;
+        using pointer           = std::conditional_t<Const, const T*, T*>;
+        using reference         = std::conditional_t<Const, const T&, T&>;
+        using difference_type   = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        basic_pre_order_iterator() noexcept
+            : owner{nullptr}
+            , curr{npos} {}
+
+        basic_pre_order_iterator(owner_type* owner, index_type curr) noexcept
+            : owner{owner}
+            , curr{curr} {}
+
+        template <bool OtherConst, std::enable_if_t<Const && !OtherConst, int> = 0>
+        basic_pre_order_iterator(const basic_pre_order_iterator<OtherConst>& other) noexcept
+            : owner{other.owner}
+            , curr{other.curr} {}
+
+        bool operator == (const basic_pre_order_iterator& other) const noexcept {
+            return curr == other.curr;
+        }
+
+        bool operator != (const basic_pre_order_iterator& other) const noexcept {
+            return !(*this == other);
+        }
+
+        reference operator * () const noexcept {
+            return owner->nodes[curr].value;
+        }
+
+        pointer operator -> () const noexcept {
+            return &owner->nodes[curr].value;
+        }
+
+        basic_pre_order_iterator& operator ++ () noexcept {
+            curr = owner->next_in_pre_order(curr);
+            return *this;
+        }
+
+        basic_pre_order_iterator operator ++ (int) noexcept {
+            basic_pre_order_iterator tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+
+        index_type index() const noexcept {
+            return curr;
+        }
+
+    private:
+        template <bool>
+        friend class basic_pre_order_iterator;
+
+        owner_type* owner;
+        index_type curr;
+    };
+
+    using iterator       = basic_pre_order_iterator<false>;
+    using const_iterator = basic_pre_order_iterator<true>;
+
+    template <typename Iterator>
+    class range {
+    public:
+        range(Iterator first, Iterator last) noexcept
+            : first{first}
+            , last{last} {}
+
+        Iterator begin() const noexcept {
+            return first;
+        }
+
+        Iterator end() const noexcept {
+            return last;
+        }
+
+    private:
+        Iterator first;
+        Iterator last;
+    };
+
+    compact_tree() noexcept(noexcept(Allocator{}))
+        : compact_tree{Allocator{}} {}
+
+    explicit compact_tree(const Allocator& alloc) noexcept
+        : alloc{alloc}
+        , nodes{nullptr}
+        , slot_capacity{0}
+        , slots_used{0}
+        , node_count{0}
+        , root_index{npos}
+        , free_head{npos} {}
+
+    // slots are copied one to one, so indices of the source stay valid in the copy
+    compact_tree(const compact_tree& other)
+        : compact_tree{other, Allocator(node_traits::select_on_container_copy_construction(other.alloc))} {}
+
+    compact_tree(const compact_tree& other, const Allocator& alloc)
+        : compact_tree{alloc} {
+        copy_slots(other, [](const T& value) -> const T& { return value; });
+    }
+
+    compact_tree(compact_tree&& other) noexcept
+        : alloc{std::move(other.alloc)}
+        , nodes{std::exchange(other.nodes, nullptr)}
+        , slot_capacity{std::exchange(other.slot_capacity, 0)}
+        , slots_used{std::exchange(other.slots_used, 0)}
+        , node_count{std::exchange(other.node_count, 0)}
+        , root_index{std::exchange(other.root_index, npos)}
+        , free_head{std::exchange(other.free_head, npos)} {}
+
+    // with an unequal allocator the array cannot change hands, so the values
+    // are moved into one of its own and `other` keeps its moved-from values
+    compact_tree(compact_tree&& other, const Allocator& alloc)
+        : compact_tree{alloc} {
+        if (this->alloc == other.alloc) {
+            swap_nodes(other);
+        } else {
+            copy_slots(other, [](T& value) -> T&& { return std::move(value); });
+        }
+    }
+
+    ~compact_tree() noexcept {
+        release();
+    }
+
+    // The copy is made with the allocator this tree ends up with, either its
+    // own or, if the allocator propagates, the one of `other`, so the
+    // exchange below never pairs the array with a foreign allocator.
+    compact_tree& operator = (const compact_tree& other) {
+        if (this != &other) {
+            constexpr bool propagate = node_traits::propagate_on_container_copy_assignment::value;
+            compact_tree copy{other, Allocator(propagate ? other.alloc : alloc)};
+            swap_nodes(copy);
+            std::swap(alloc, copy.alloc);
+        }
+        return *this;
+    }
+
+    compact_tree& operator = (compact_tree&& other) noexcept(
+            node_traits::propagate_on_container_move_assignment::value ||
+            node_traits::is_always_equal::value) {
+        if (this == &other) {
+            return *this;
+        }
+
+        constexpr bool propagate = node_traits::propagate_on_container_move_assignment::value;
+        if (propagate || alloc == other.alloc) {
+            compact_tree moved{std::move(other)};
+            swap_nodes(moved);
+            if constexpr (propagate) {
+                std::swap(alloc, moved.alloc);
+            }
+        } else {
+            // the array of the other tree cannot change hands, move the values instead
+            if constexpr (!node_traits::propagate_on_container_move_assignment::value &&
+                          !node_traits::is_always_equal::value) {
+                compact_tree moved{std::move(other), Allocator(alloc)};
+                swap_nodes(moved);
+                other.clear();
+            }
+        }
+        return *this;
+    }
+
+    // as with the standard containers, allocators that do not propagate on
+    // swap have to be equal
+    void swap(compact_tree& other) noexcept {
+        if constexpr (node_traits::propagate_on_container_swap::value) {
+            std::swap(alloc, other.alloc);
+        } else {
+            assert(alloc == other.alloc);
+        }
+        swap_nodes(other);
+    }
+
+    allocator_type get_allocator() const noexcept {
+        return allocator_type(alloc);
+    }
+
+    size_type size() const noexcept {
+        return node_count;
+    }
+
+    bool empty() const noexcept {
+        return root_index == npos;
+    }
+
+    // number of nodes that fit before the array has to grow
+    size_type capacity() const noexcept {
+        return slot_capacity;
+    }
+
+    void reserve(size_type count) {
+        if (count > slot_capacity) {
+            reallocate(count);
+        }
+    }
+
+    void clear() noexcept {
+        destroy_values();
+        slots_used = 0;
+        node_count = 0;
+        root_index = npos;
+        free_head = npos;
+    }
+
+    iterator begin() noexcept {
+        return iterator{this, root_index};
+    }
+
+    iterator end() noexcept {
+        return iterator{this, npos};
+    }
+
+    const_iterator begin() const noexcept {
+        return const_iterator{this, root_index};
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator{this, npos};
+    }
+
+    range<iterator> pre_order() noexcept {
+        return {begin(), end()};
+    }
+
+    range<const_iterator> pre_order() const noexcept {
+        return {begin(), end()};
+    }
+
+    // Same semantics as tree::insert: vert puts the new node in place of `it`
+    // and makes the old node its child, hor puts it before `it` among its
+    // siblings. At end() the node goes below (vert) or after (hor) the last
+    // node in pre-order.
+    iterator insert(insertion::vert_tag, const_iterator it, const T& value) {
+        return insert_vert(it.index(), value);
+    }
+
+    iterator insert(insertion::vert_tag, const_iterator it, T&& value) {
+        return insert_vert(it.index(), std::move(value));
+    }
+
+    iterator insert(insertion::hor_tag, const_iterator it, const T& value) {
+        return insert_hor(it.index(), value);
+    }
+
+    iterator insert(insertion::hor_tag, const_iterator it, T&& value) {
+        return insert_hor(it.index(), std::move(value));
+    }
+
+    iterator append_child(const_iterator parent_it, const T& value) {
+        return append(parent_it.index(), value);
+    }
+
+    iterator append_child(const_iterator parent_it, T&& value) {
+        return append(parent_it.index(), std::move(value));
+    }
+
+    iterator prepend_child(const_iterator parent_it, const T& value) {
+        return prepend(parent_it.index(), value);
+    }
+
+    iterator prepend_child(const_iterator parent_it, T&& value) {
+        return prepend(parent_it.index(), std::move(value));
+    }
+
+    void erase_subtree(const_iterator node_it) noexcept {
+        index_type node = node_it.index();
+        assert(is_live(node));
+        if (node == root_index) {
+            clear();
+            return;
+        }
+
+        unlink(node);
+        // the subtree is detached, so its pre-order ends where it leaves `node`
+        index_type curr = node;
+        while (curr != npos) {
+            index_type next = nodes[curr].first_child;
+            if (next == npos) {
+                next = curr;
+                while (next != node && nodes[next].next_sibling == npos) {
+                    next = nodes[next].parent;
+                }
+                next = next == node ? npos : nodes[next].next_sibling;
+            }
+            free_slot(curr);
+            curr = next;
+        }
+    }
+
+    index_type parent(index_type node) const noexcept {
+        return nodes[node].parent;
+    }
+
+    index_type first_child(index_type node) const noexcept {
+        return nodes[node].first_child;
+    }
+
+    index_type last_child(index_type node) const noexcept {
+        index_type first = nodes[node].first_child;
+        return first == npos ? npos : nodes[first].prev_sibling;
+    }
+
+    index_type next_sibling(index_type node) const noexcept {
+        return nodes[node].next_sibling;
+    }
+
+    index_type prev_sibling(index_type node) const noexcept {
+        index_type parent = nodes[node].parent;
+        return parent == npos || nodes[parent].first_child == node ? npos : nodes[node].prev_sibling;
+    }
+
+private:
+    bool is_live(index_type node) const noexcept {
+        return node < slots_used && nodes[node].prev_sibling != npos;
+    }
+
+    index_type next_in_pre_order(index_type node) const noexcept {
+        if (nodes[node].first_child != npos) {
+            return nodes[node].first_child;
+        }
+        while (node != npos && nodes[node].next_sibling == npos) {
+            node = nodes[node].parent;
+        }
+        return node == npos ? npos : nodes[node].next_sibling;
+    }
+
+    index_type last_in_pre_order() const noexcept {
+        index_type node = root_index;
+        while (node != npos && nodes[node].first_child != npos) {
+            node = last_child(node);
+        }
+        return node;
+    }
+
+    template <typename U>
+    iterator insert_vert(index_type old_node, U&& value) {
+        index_type new_node = allocate_slot(std::forward<U>(value));
+        if (old_node == npos) {
+            index_type last_node = last_in_pre_order();
+            if (last_node != npos) {
+                push_back_child(last_node, new_node);
+            } else {
+                make_root(new_node);
+            }
+        } else if (old_node == root_index) {
+            make_root(new_node);
+            push_back_child(new_node, old_node);
+        } else {
+            insert_before(old_node, new_node);
+            unlink(old_node);
+            push_back_child(new_node, old_node);
+        }
+        return iterator{this, new_node};
+    }
+
+    template <typename U>
+    iterator insert_hor(index_type old_node, U&& value) {
+        index_type new_node = allocate_slot(std::forward<U>(value));
+        if (old_node == npos) {
+            index_type last_node = last_in_pre_order();
+            if (last_node != npos) {
+                assert(nodes[last_node].parent != npos);
+                push_back_child(nodes[last_node].parent, new_node);
+            } else {
+                make_root(new_node);
+            }
+        } else {
+            assert(nodes[old_node].parent != npos);
+            insert_before(old_node, new_node);
+        }
+        return iterator{this, new_node};
+    }
+
+    template <typename U>
+    iterator append(index_type parent, U&& value) {
+        assert(is_live(parent));
+        index_type child = allocate_slot(std::forward<U>(value));
+        push_back_child(parent, child);
+        return iterator{this, child};
+    }
+
+    template <typename U>
+    iterator prepend(index_type parent, U&& value) {
+        assert(is_live(parent));
+        index_type child = allocate_slot(std::forward<U>(value));
+        push_front_child(parent, child);
+        return iterator{this, child};
+    }
+
+    void make_root(index_type node) noexcept {
+        nodes[node].parent = npos;
+        nodes[node].next_sibling = npos;
+        nodes[node].prev_sibling = node;
+        root_index = node;
+    }
+
+    void push_back_child(index_type parent, index_type child) noexcept {
+        nodes[child].parent = parent;
+        nodes[child].next_sibling = npos;
+        index_type first = nodes[parent].first_child;
+        if (first == npos) {
+            nodes[parent].first_child = child;
+            nodes[child].prev_sibling = child;
+        } else {
+            index_type last = nodes[first].prev_sibling;
+            nodes[last].next_sibling = child;
+            nodes[child].prev_sibling = last;
+            nodes[first].prev_sibling = child;
+        }
+    }
+
+    void push_front_child(index_type parent, index_type child) noexcept {
+        index_type first = nodes[parent].first_child;
+        if (first == npos) {
+            push_back_child(parent, child);
+            return;
+        }
+        nodes[child].parent = parent;
+        nodes[child].next_sibling = first;
+        nodes[child].prev_sibling = nodes[first].prev_sibling;
+        nodes[first].prev_sibling = child;
+        nodes[parent].first_child = child;
+    }
+
+    void insert_before(index_type sibling, index_type node) noexcept {
+        index_type parent = nodes[sibling].parent;
+        if (nodes[parent].first_child == sibling) {
+            push_front_child(parent, node);
+            return;
+        }
+        index_type prev = nodes[sibling].prev_sibling;
+        nodes[node].parent = parent;
+        nodes[node].prev_sibling = prev;
+        nodes[node].next_sibling = sibling;
+        nodes[prev].next_sibling = node;
+        nodes[sibling].prev_sibling = node;
+    }
+
+    void unlink(index_type node) noexcept {
+        index_type parent = nodes[node].parent;
+        index_type next = nodes[node].next_sibling;
+        index_type prev = nodes[node].prev_sibling;
+        index_type first = nodes[parent].first_child;
+        if (first == node) {
+            nodes[parent].first_child = next;
+            if (next != npos) {
+                nodes[next].prev_sibling = prev;
+            }
+        } else {
+            nodes[prev].next_sibling = next;
+            if (next != npos) {
+                nodes[next].prev_sibling = prev;
+            } else {
+                nodes[first].prev_sibling = prev;
+            }
+        }
+        nodes[node].parent = npos;
+        nodes[node].next_sibling = npos;
+        nodes[node].prev_sibling = node;
+    }
+
+    template <typename U>
+    index_type allocate_slot(U&& value) {
+        if (free_head == npos && slots_used == slot_capacity) {
+            // value may live in the array grow() releases, as in
+            // t.append_child(t.begin(), *t.begin()), so it is taken out first
+            T local(std::forward<U>(value));
+            grow();
+            return allocate_slot(std::move_if_noexcept(local));
+        }
+
+        index_type slot = free_head;
+        if (slot == npos) {
+            slot = slots_used;
+        }
+
+        ::new (static_cast<void*>(std::addressof(nodes[slot].value))) T(std::forward<U>(value));
+        if (slot == free_head) {
+            free_head = nodes[slot].first_child;
+        } else {
+            slots_used++;
+        }
+        nodes[slot].parent = npos;
+        nodes[slot].first_child = npos;
+        nodes[slot].next_sibling = npos;
+        nodes[slot].prev_sibling = slot;
+        node_count++;
+        return slot;
+    }
+
+    void free_slot(index_type slot) noexcept {
+        nodes[slot].value.~T();
+        // parent and sibling links stay intact for erase_subtree's walk
+        nodes[slot].prev_sibling = npos;
+        nodes[slot].first_child = free_head;
+        free_head = slot;
+        node_count--;
+    }
+
+    void grow() {
+        if (slot_capacity >= npos - 1) {
+            throw std::length_error{"compact_tree: too many nodes for 32-bit indices"};
+        }
+        size_t doubled = slot_capacity < 8 ? 16 : size_t{slot_capacity} * 2;
+        reallocate(std::min<size_t>(doubled, npos - 1));
+    }
+
+    void reallocate(size_t capacity) {
+        if (capacity >= npos) {
+            throw std::length_error{"compact_tree: too many nodes for 32-bit indices"};
+        }
+
+        node* new_nodes = allocate_nodes(capacity);
+        index_type moved = 0;
+        try {
+            for (; moved < slots_used; moved++) {
+                copy_slot(nodes[moved], new_nodes[moved], [](T& value) -> decltype(auto) { return std::move_if_noexcept(value); });
+            }
+        } catch (...) {
+            for (index_type i = 0; i < moved; i++) {
+                if (new_nodes[i].prev_sibling != npos) {
+                    new_nodes[i].value.~T();
+                }
+            }
+            node_traits::deallocate(alloc, new_nodes, capacity);
+            throw;
+        }
+
+        destroy_values();
+        if (nodes != nullptr) {
+            node_traits::deallocate(alloc, nodes, slot_capacity);
+        }
+        nodes = new_nodes;
+        slot_capacity = static_cast<index_type>(capacity);
+    }
+
+    // slots start out free, the loop constructing them compiles to nothing
+    node* allocate_nodes(size_t capacity) {
+        node* result = node_traits::allocate(alloc, capacity);
+        for (size_t i = 0; i < capacity; i++) {
+            node_traits::construct(alloc, result + i);
+            result[i].prev_sibling = npos;
+        }
+        return result;
+    }
+
+    template <typename Node, typename Source>
+    static void copy_slot(Node& from, node& to, Source source) {
+        if (from.prev_sibling != npos) {
+            ::new (static_cast<void*>(std::addressof(to.value))) T(source(from.value));
+        }
+        to.parent = from.parent;
+        to.first_child = from.first_child;
+        to.next_sibling = from.next_sibling;
+        to.prev_sibling = from.prev_sibling;
+    }
+
+    void destroy_values() noexcept {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for (index_type i = 0; i < slots_used; i++) {
+                if (nodes[i].prev_sibling != npos) {
+                    nodes[i].value.~T();
+                }
+            }
+        }
+    }
+
+    // Slots are taken over one to one; the caller starts out empty.
+    template <typename Other, typename Source>
+    void copy_slots(Other& other, Source source) {
+        if (other.slots_used == 0) {
+            return;
+        }
+
+        nodes = allocate_nodes(other.slots_used);
+        slot_capacity = other.slots_used;
+        try {
+            for (; slots_used < other.slots_used; slots_used++) {
+                copy_slot(other.nodes[slots_used], nodes[slots_used], source);
+            }
+        } catch (...) {
+            release();
+            throw;
+        }
+        node_count = other.node_count;
+        root_index = other.root_index;
+        free_head = other.free_head;
+    }
+
+    // everything but the allocator
+    void swap_nodes(compact_tree& other) noexcept {
+        using std::swap;
+        swap(nodes, other.nodes);
+        swap(slot_capacity, other.slot_capacity);
+        swap(slots_used, other.slots_used);
+        swap(node_count, other.node_count);
+        swap(root_index, other.root_index);
+        swap(free_head, other.free_head);
+    }
+
+    void release() noexcept {
+        destroy_values();
+        if (nodes != nullptr) {
+            node_traits::deallocate(alloc, nodes, slot_capacity);
+        }
+        nodes = nullptr;
+        slot_capacity = 0;
+        slots_used = 0;
+        node_count = 0;
+        root_index = npos;
+        free_head = npos;
+    }
+
+    node_allocator alloc;
+    node* nodes;
+    index_type slot_capacity;
+    index_type slots_used;
+    size_t node_count;
+    index_type root_index;
+    index_type free_head;
+};
+
+#endif // COMPACT_TREE_H_INCLUDED
@@ -0,0 +1,153 @@
+#ifndef EPOCH_RECLAMATION_H_INCLUDED
+#define EPOCH_RECLAMATION_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <utility>
+
+// Epoch-based reclamation for one writer and any number of readers.
+// A reader pins the current epoch for as long as it may hold pointers into
+// the shared structure. The writer stamps memory it unlinks with epoch() and
+// frees it once the stamp is below reclaimable_before(): by then every reader
+// that could have seen the memory has unpinned.
+// Pinning and unpinning are lock-free; a reader only waits when more threads
+// than there are slots are pinned at once.
+class epoch_domain {
+    struct alignas(64) slot {
+        // 0 when free, otherwise the epoch pinned by its reader
+        std::atomic<std::uint64_t> epoch{0};
+    };
+
+public:
+    static constexpr size_t default_slot_count = 64;
+
+    // Keeps one epoch pinned; move-only.
+    class guard {
+    public:
+        guard(guard&& other) noexcept
+            : pinned{std::exchange(other.pinned, nullptr)} {}
+
+        guard& operator = (guard&& other) noexcept {
+            if (this != &other) {
+                unpin();
+                pinned = std::exchange(other.pinned, nullptr);
+            }
+            return *this;
+        }
+
+        ~guard() noexcept {
+            unpin();
+        }
+
+    private:
+        friend class epoch_domain;
+
+        explicit guard(slot* pinned) noexcept
+            : pinned{pinned} {}
+
+        void unpin() noexcept {
+            if (pinned != nullptr) {
+                pinned->epoch.store(0, std::memory_order_release);
+                pinned = nullptr;
+            }
+        }
+
+        slot* pinned;
+    };
+
+    // slots are allocated by the first reader, so an unread domain costs nothing
+    explicit epoch_domain(size_t slot_count = default_slot_count) noexcept
+        : slots{nullptr}
+        , slot_count{slot_count > 0 ? slot_count : 1}
+        , global_epoch{1} {}
+
+    epoch_domain(const epoch_domain&) = delete;
+    epoch_domain& operator = (const epoch_domain&) = delete;
+
+    // only while no reader is pinned
+    epoch_domain(epoch_domain&& other) noexcept
+        : slots{other.slots.exchange(nullptr, std::memory_order_relaxed)}
+        , slot_count{other.slot_count}
+        , global_epoch{other.global_epoch.load(std::memory_order_relaxed)} {}
+
+    epoch_domain& operator = (epoch_domain&& other) noexcept {
+        if (this != &other) {
+            delete[] slots.exchange(other.slots.exchange(nullptr, std::memory_order_relaxed), std::memory_order_relaxed);
+            slot_count = other.slot_count;
+            global_epoch.store(other.global_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
+    ~epoch_domain() noexcept {
+        delete[] slots.load(std::memory_order_relaxed);
+    }
+
+    // Reader side: pins the current epoch until the guard goes away.
+    guard pin() const {
+        slot* table = slot_table();
+        size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id()) % slot_count;
+        while (true) {
+            for (size_t i = 0; i < slot_count; i++) {
+                slot& candidate = table[(start + i) % slot_count];
+                std::uint64_t expected = 0;
+                std::uint64_t epoch = global_epoch.load();
+                if (!candidate.epoch.compare_exchange_strong(expected, epoch)) {
+                    continue;
+                }
+                // the writer may have moved on before the slot was visible to it
+                std::uint64_t current;
+                while ((current = global_epoch.load()) != epoch) {
+                    epoch = current;
+                    candidate.epoch.store(epoch);
+                }
+                return guard{&candidate};
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    // Writer side: the stamp for memory unlinked now.
+    std::uint64_t epoch() const noexcept {
+        return global_epoch.load();
+    }
+
+    // Writer side: moves to the next epoch if every pinned reader has reached
+    // the current one. Memory stamped with an epoch below the result can be freed.
+    std::uint64_t reclaimable_before() noexcept {
+        std::uint64_t current = global_epoch.load();
+        if (slot* table = slots.load(std::memory_order_acquire)) {
+            for (size_t i = 0; i < slot_count; i++) {
+                std::uint64_t pinned = table[i].epoch.load();
+                if (pinned != 0 && pinned != current) {
+                    return current - 1;
+                }
+            }
+        }
+        global_epoch.store(current + 1);
+        return current;
+    }
+
+private:
+    slot* slot_table() const {
+        slot* table = slots.load(std::memory_order_acquire);
+        if (table == nullptr) {
+            slot* created = new slot[slot_count];
+            if (slots.compare_exchange_strong(table, created, std::memory_order_acq_rel)) {
+                table = created;
+            } else {
+                delete[] created;
+            }
+        }
+        return table;
+    }
+
+    mutable std::atomic<slot*> slots;
+    size_t slot_count;
+    std::atomic<std::uint64_t> global_epoch;
+};
+
+#endif // EPOCH_RECLAMATION_H_INCLUDED
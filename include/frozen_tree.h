@@ -0,0 +1,304 @@
+#ifndef FROZEN_TREE_H_INCLUDED
+#define FROZEN_TREE_H_INCLUDED
+
+#include "tree.h"
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+// Read-only snapshot of a tree in structure-of-arrays form.
+// Values are stored in pre-order in one contiguous array, so a node is
+// identified by its pre-order index and the subtree of a node is the range
+// [index, index + subtree_size). Links are 32-bit indices kept in separate
+// arrays, so a traversal only streams through the arrays it needs.
+template <typename T>
+class frozen_tree {
+public:
+    using value_type      = T;
+    using reference       = const T&;
+    using const_reference = const T&;
+    using size_type       = size_t;
+    using index_type      = std::uint32_t;
+
+    static constexpr index_type npos = ~index_type{0};
+
+    // Post-order over the index arrays: after a node comes the leftmost leaf
+    // of its next sibling, or its parent when it is the last child.
+    class post_order_iterator {
+    public:
+        using value_type        = T;
+        using pointer           = const T*;
+        using reference         = const T&;
+        using difference_type   = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        post_order_iterator() noexcept
+            : owner{nullptr}
+            , curr{npos} {}
+
+        post_order_iterator(const frozen_tree* owner, index_type curr) noexcept
+            : owner{owner}
+            , curr{curr} {}
+
+        bool operator == (const post_order_iterator& other) const noexcept {
+            return curr == other.curr;
+        }
+
+        bool operator != (const post_order_iterator& other) const noexcept {
+            return !(*this == other);
+        }
+
+        const T& operator * () const noexcept {
+            return owner->node_values[curr];
+        }
+
+        const T* operator -> () const noexcept {
+            return &owner->node_values[curr];
+        }
+
+        post_order_iterator& operator ++ () noexcept {
+            index_type sibling = owner->sibling_links[curr];
+            curr = sibling != npos ? owner->first_leaf(sibling) : owner->parent_links[curr];
+            return *this;
+        }
+
+        post_order_iterator operator ++ (int) noexcept {
+            post_order_iterator tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+
+        index_type index() const noexcept {
+            return curr;
+        }
+
+    private:
+        const frozen_tree* owner;
+        index_type curr;
+    };
+
+    class child_iterator {
+    public:
+        using value_type        = T;
+        using pointer           = const T*;
+        using reference         = const T&;
+        using difference_type   = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        child_iterator() noexcept
+            : owner{nullptr}
+            , curr{npos} {}
+
+        child_iterator(const frozen_tree* owner, index_type curr) noexcept
+            : owner{owner}
+            , curr{curr} {}
+
+        bool operator == (const child_iterator& other) const noexcept {
+            return curr == other.curr;
+        }
+
+        bool operator != (const child_iterator& other) const noexcept {
+            return !(*this == other);
+        }
+
+        const T& operator * () const noexcept {
+            return owner->node_values[curr];
+        }
+
+        const T* operator -> () const noexcept {
+            return &owner->node_values[curr];
+        }
+
+        child_iterator& operator ++ () noexcept {
+            curr = owner->sibling_links[curr];
+            return *this;
+        }
+
+        child_iterator operator ++ (int) noexcept {
+            child_iterator tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+
+        index_type index() const noexcept {
+            return curr;
+        }
+
+    private:
+        const frozen_tree* owner;
+        index_type curr;
+    };
+
+    template <typename Iterator>
+    class range {
+    public:
+        range(Iterator first, Iterator last) noexcept
+            : first{first}
+            , last{last} {}
+
+        Iterator begin() const noexcept {
+            return first;
+        }
+
+        Iterator end() const noexcept {
+            return last;
+        }
+
+    private:
+        Iterator first;
+        Iterator last;
+    };
+
+    frozen_tree() noexcept = default;
+
+    template <typename Allocator>
+    explicit frozen_tree(const tree<T, Allocator>& source) {
+        if (source.size() >= npos) {
+            throw std::length_error{"frozen_tree: too many nodes for 32-bit indices"};
+        }
+        if (source.empty()) {
+            return;
+        }
+
+        node_values.reserve(source.size());
+        parent_links.reserve(source.size());
+        sibling_links.reserve(source.size());
+        subtree_sizes.reserve(source.size());
+
+        pre_order_view view{source};
+        auto traverser = std::begin(view).as_traverser();
+        index_type curr = push(traverser.value(), npos);
+        while (true) {
+            if (traverser.to_first_child()) {
+                curr = push(traverser.value(), curr);
+                continue;
+            }
+
+            while (!traverser.has_next_sibling()) {
+                close(curr);
+                if (!traverser.to_parent()) {
+                    return;
+                }
+                curr = parent_links[curr];
+            }
+
+            close(curr);
+            traverser.to_next_sibling();
+            index_type sibling = push(traverser.value(), parent_links[curr]);
+            sibling_links[curr] = sibling;
+            curr = sibling;
+        }
+    }
+
+    size_type size() const noexcept {
+        return node_values.size();
+    }
+
+    bool empty() const noexcept {
+        return node_values.empty();
+    }
+
+    const T& operator [] (index_type node) const noexcept {
+        return node_values[node];
+    }
+
+    // all values in pre-order
+    std::span<const T> values() const noexcept {
+        return std::span<const T>{node_values};
+    }
+
+    // values of the subtree rooted at `node`, in pre-order
+    std::span<const T> subtree(index_type node) const noexcept {
+        return std::span<const T>{node_values}.subspan(node, subtree_sizes[node]);
+    }
+
+    std::span<const T> pre_order() const noexcept {
+        return values();
+    }
+
+    range<post_order_iterator> post_order() const noexcept {
+        return post_order(0);
+    }
+
+    // post-order of the subtree rooted at `node`
+    range<post_order_iterator> post_order(index_type node) const noexcept {
+        if (empty()) {
+            return {post_order_iterator{this, npos}, post_order_iterator{this, npos}};
+        }
+        // the node closes its own post-order, whatever follows it ends the range
+        post_order_iterator last{this, node};
+        ++last;
+        return {post_order_iterator{this, first_leaf(node)}, last};
+    }
+
+    range<child_iterator> children(index_type node) const noexcept {
+        return {child_iterator{this, first_child(node)}, child_iterator{this, npos}};
+    }
+
+    index_type root() const noexcept {
+        return empty() ? npos : 0;
+    }
+
+    index_type parent(index_type node) const noexcept {
+        return parent_links[node];
+    }
+
+    index_type next_sibling(index_type node) const noexcept {
+        return sibling_links[node];
+    }
+
+    index_type first_child(index_type node) const noexcept {
+        return subtree_sizes[node] > 1 ? node + 1 : npos;
+    }
+
+    index_type subtree_size(index_type node) const noexcept {
+        return subtree_sizes[node];
+    }
+
+    bool is_ancestor(index_type ancestor, index_type node) const noexcept {
+        return ancestor <= node && node < ancestor + subtree_sizes[ancestor];
+    }
+
+    // raw link arrays, entry i belongs to the node with pre-order index i
+    std::span<const index_type> parent_array() const noexcept {
+        return std::span<const index_type>{parent_links};
+    }
+
+    std::span<const index_type> sibling_array() const noexcept {
+        return std::span<const index_type>{sibling_links};
+    }
+
+    std::span<const index_type> subtree_size_array() const noexcept {
+        return std::span<const index_type>{subtree_sizes};
+    }
+
+private:
+    index_type push(const T& value, index_type parent) {
+        auto index = static_cast<index_type>(node_values.size());
+        node_values.push_back(value);
+        parent_links.push_back(parent);
+        sibling_links.push_back(npos);
+        subtree_sizes.push_back(1);
+        return index;
+    }
+
+    void close(index_type node) noexcept {
+        subtree_sizes[node] = static_cast<index_type>(node_values.size()) - node;
+    }
+
+    index_type first_leaf(index_type node) const noexcept {
+        while (subtree_sizes[node] > 1) {
+            node++;
+        }
+        return node;
+    }
+
+    std::vector<T> node_values;
+    std::vector<index_type> parent_links;
+    std::vector<index_type> sibling_links;
+    std::vector<index_type> subtree_sizes;
+};
+
+#endif // FROZEN_TREE_H_INCLUDED
@@ -0,0 +1,484 @@
+#ifndef LAZY_TREE_H_INCLUDED
+#define LAZY_TREE_H_INCLUDED
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+// Tree whose children are produced on demand. A node is either a leaf or
+// carries a generator, which is called with the node's value the first time
+// a traverser or iterator descends into it and appends the node's children.
+// The children stay cached until evicted; an evicted node keeps its generator
+// and is expanded again on the next descent.
+// A node counts as used when a traverser or iterator descends into it or
+// into any node below it. evict_until() collapses the least recently used
+// expanded nodes among those without expanded children, so a subtree goes
+// bottom-up and the root goes last.
+// Eviction frees the nodes below, traversers and iterators pointing there
+// become invalid.
+template <typename T, typename Allocator = std::allocator<T>>
+class lazy_tree {
+    struct node;
+
+public:
+    using value_type      = T;
+    using reference       = T&;
+    using const_reference = const T&;
+    using size_type       = size_t;
+    using allocator_type  = Allocator;
+
+    class children_builder;
+    using generator_type = std::function<void(const T&, children_builder&)>;
+
+private:
+    using generator_ptr  = std::shared_ptr<const generator_type>;
+    using node_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<node>;
+    using node_traits    = std::allocator_traits<node_allocator>;
+
+    struct node {
+        node(T&& value, generator_ptr generator)
+            : value{std::move(value)}
+            , generator{std::move(generator)} {}
+
+        T value;
+        node* parent = nullptr;
+        node* next_sibling = nullptr;
+        node* first_child = nullptr;
+        // null for leaves
+        generator_ptr generator;
+        bool expanded = false;
+        // expanded nodes among the children; an expanded node without any is
+        // an eviction candidate
+        size_t expanded_children = 0;
+        // last descent into the node, raised to the last use of a collapsed child
+        uint64_t used = 0;
+        // neighbours in the list of eviction candidates, most recently used first
+        node* newer = nullptr;
+        node* older = nullptr;
+    };
+
+public:
+    // Handed to a generator to collect the children of one node, in order.
+    // If the generator throws, the children appended so far are dropped and
+    // the node stays unexpanded.
+    class children_builder {
+    public:
+        children_builder(const children_builder&) = delete;
+        children_builder& operator = (const children_builder&) = delete;
+
+        ~children_builder() noexcept {
+            while (head != nullptr) {
+                owner.destroy_node(std::exchange(head, head->next_sibling));
+            }
+        }
+
+        // a leaf
+        void append(T value) {
+            link(owner.create_node(std::move(value), nullptr));
+        }
+
+        // a child expanded by the same generator as its parent
+        void append_lazy(T value) {
+            link(owner.create_node(std::move(value), parent_generator));
+        }
+
+        void append_lazy(T value, generator_type generator) {
+            link(owner.create_node(std::move(value), std::make_shared<const generator_type>(std::move(generator))));
+        }
+
+    private:
+        friend class lazy_tree;
+
+        children_builder(lazy_tree& owner, generator_ptr parent_generator) noexcept
+            : owner{owner}
+            , parent_generator{std::move(parent_generator)}
+            , head{nullptr}
+            , tail{nullptr}
+            , count{0} {}
+
+        void link(node* child) noexcept {
+            if (tail != nullptr) {
+                tail->next_sibling = child;
+            } else {
+                head = child;
+            }
+            tail = child;
+            count++;
+        }
+
+        lazy_tree& owner;
+        generator_ptr parent_generator;
+        node* head;
+        node* tail;
+        size_t count;
+    };
+
+    // Moves through the tree like tree_traverser; moving to (or asking for)
+    // the first child of an unexpanded node expands it.
+    class traverser {
+    public:
+        traverser next_sibling() const noexcept {
+            return traverser{owner, curr->next_sibling};
+        }
+
+        traverser first_child() const {
+            return traverser{owner, owner->descend(curr)};
+        }
+
+        traverser parent() const noexcept {
+            return traverser{owner, curr->parent};
+        }
+
+        bool has_next_sibling() noexcept {
+            return curr->next_sibling != nullptr;
+        }
+
+        bool has_first_child() {
+            return owner->descend(curr) != nullptr;
+        }
+
+        bool has_parent() noexcept {
+            return curr->parent != nullptr;
+        }
+
+        bool to_next_sibling() noexcept {
+            return to_node(curr->next_sibling);
+        }
+
+        bool to_first_child() {
+            return to_node(owner->descend(curr));
+        }
+
+        bool to_parent() noexcept {
+            return to_node(curr->parent);
+        }
+
+        T& value() noexcept {
+            return curr->value;
+        }
+
+        const T& value() const noexcept {
+            return curr->value;
+        }
+
+        // whether the node has a generator
+        bool is_lazy() const noexcept {
+            return curr->generator != nullptr;
+        }
+
+        // whether the children of a lazy node are materialized
+        bool is_expanded() const noexcept {
+            return curr->expanded;
+        }
+
+    private:
+        friend class lazy_tree;
+
+        traverser(lazy_tree* owner, node* curr) noexcept
+            : owner{owner}
+            , curr{curr} {}
+
+        bool to_node(node* next) noexcept {
+            if (next != nullptr) {
+                curr = next;
+                return true;
+            }
+            return false;
+        }
+
+        lazy_tree* owner;
+        node* curr;
+    };
+
+    // Pre-order iterator that expands every node it passes. On a tree whose
+    // generators never stop, it never reaches end().
+    class iterator {
+    public:
+        using value_type        = T;
+        using pointer           = T*;
+        using reference         = T&;
+        using difference_type   = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        iterator() noexcept
+            : owner{nullptr}
+            , curr{nullptr} {}
+
+        bool operator == (const iterator& other) const noexcept {
+            return curr == other.curr;
+        }
+
+        bool operator != (const iterator& other) const noexcept {
+            return curr != other.curr;
+        }
+
+        reference operator * () const noexcept {
+            return curr->value;
+        }
+
+        pointer operator -> () const noexcept {
+            return &curr->value;
+        }
+
+        iterator& operator ++ () {
+            if (node* child = owner->descend(curr)) {
+                curr = child;
+                return *this;
+            }
+            while (curr->next_sibling == nullptr && curr->parent != nullptr) {
+                curr = curr->parent;
+            }
+            curr = curr->next_sibling;
+            return *this;
+        }
+
+        iterator operator ++ (int) {
+            iterator result = *this;
+            ++*this;
+            return result;
+        }
+
+        traverser as_traverser() const noexcept {
+            return traverser{owner, curr};
+        }
+
+    private:
+        friend class lazy_tree;
+
+        iterator(lazy_tree* owner, node* curr) noexcept
+            : owner{owner}
+            , curr{curr} {}
+
+        lazy_tree* owner;
+        node* curr;
+    };
+
+    lazy_tree(T root_value, generator_type generator, Allocator alloc = Allocator{})
+        : alloc{std::move(alloc)}
+        , root{nullptr}
+        , node_count{1}
+        , clock{0}
+        , newest{nullptr}
+        , oldest{nullptr} {
+        root = create_node(std::move(root_value), std::make_shared<const generator_type>(std::move(generator)));
+    }
+
+    lazy_tree(const lazy_tree&) = delete;
+    lazy_tree& operator = (const lazy_tree&) = delete;
+
+    lazy_tree(lazy_tree&& other) noexcept
+        : alloc{std::move(other.alloc)}
+        , root{std::exchange(other.root, nullptr)}
+        , node_count{std::exchange(other.node_count, 0)}
+        , clock{other.clock}
+        , newest{std::exchange(other.newest, nullptr)}
+        , oldest{std::exchange(other.oldest, nullptr)} {}
+
+    lazy_tree& operator = (lazy_tree&& other) noexcept {
+        if (this != &other) {
+            release();
+            alloc = std::move(other.alloc);
+            root = std::exchange(other.root, nullptr);
+            node_count = std::exchange(other.node_count, 0);
+            clock = other.clock;
+            newest = std::exchange(other.newest, nullptr);
+            oldest = std::exchange(other.oldest, nullptr);
+        }
+        return *this;
+    }
+
+    ~lazy_tree() noexcept {
+        release();
+    }
+
+    // number of materialized nodes
+    size_type size() const noexcept {
+        return node_count;
+    }
+
+    traverser root_traverser() noexcept {
+        return traverser{this, root};
+    }
+
+    iterator begin() noexcept {
+        return iterator{this, root};
+    }
+
+    iterator end() noexcept {
+        return iterator{this, nullptr};
+    }
+
+    // Materializes the children of the node, if it is lazy and not expanded yet.
+    void expand(const traverser& node_it) {
+        descend(node_it.curr);
+    }
+
+    // Frees everything below the node; its generator runs again on the next descent.
+    void evict(const traverser& node_it) noexcept {
+        collapse(node_it.curr);
+    }
+
+    // Collapses expanded nodes without expanded children, least recently used
+    // first, until at most max_nodes nodes remain or only the root is left.
+    void evict_until(size_type max_nodes) noexcept {
+        while (node_count > max_nodes && oldest != nullptr) {
+            collapse(oldest);
+        }
+    }
+
+private:
+    template <typename... Args>
+    node* create_node(Args&&... args) {
+        node* result = node_traits::allocate(alloc, 1);
+        try {
+            node_traits::construct(alloc, result, std::forward<Args>(args)...);
+        } catch (...) {
+            node_traits::deallocate(alloc, result, 1);
+            throw;
+        }
+        return result;
+    }
+
+    void destroy_node(node* n) noexcept {
+        node_traits::destroy(alloc, n);
+        node_traits::deallocate(alloc, n, 1);
+    }
+
+    // First child of the node, expanding it if needed; the node becomes the
+    // most recently used. Its ancestors are not touched: they cannot be
+    // evicted before it, and a collapsed node hands its last use to its parent.
+    node* descend(node* n) {
+        if (n->generator == nullptr) {
+            return nullptr;
+        }
+
+        if (n->expanded) {
+            n->used = ++clock;
+            if (n->expanded_children == 0) {
+                unlink_candidate(n);
+                link_newest(n);
+            }
+        } else {
+            children_builder children{*this, n->generator};
+            (*n->generator)(n->value, children);
+            for (node* child = children.head; child != nullptr; child = child->next_sibling) {
+                child->parent = n;
+            }
+            n->first_child = std::exchange(children.head, nullptr);
+            node_count += children.count;
+            n->expanded = true;
+            n->used = ++clock;
+            if (n->parent != nullptr && n->parent->expanded_children++ == 0) {
+                unlink_candidate(n->parent);
+            }
+            link_newest(n);
+        }
+        return n->first_child;
+    }
+
+    void collapse(node* n) noexcept {
+        if (!n->expanded) {
+            return;
+        }
+        while (node* child = n->first_child) {
+            n->first_child = child->next_sibling;
+            free_subtree(child);
+        }
+        if (n->expanded_children == 0) {
+            unlink_candidate(n);
+        }
+        n->expanded_children = 0;
+        n->expanded = false;
+
+        if (node* parent = n->parent) {
+            parent->used = std::max(parent->used, n->used);
+            if (--parent->expanded_children == 0) {
+                link_by_use(parent);
+            }
+        }
+    }
+
+    // Frees the node and its descendants without recursing: the walk always
+    // frees the first child of a node, so a node whose children are gone is
+    // a leaf and the next one to go.
+    void free_subtree(node* start) noexcept {
+        node* curr = start;
+        while (true) {
+            while (curr->first_child != nullptr) {
+                curr = curr->first_child;
+            }
+
+            node* next = nullptr;
+            if (curr != start) {
+                curr->parent->first_child = curr->next_sibling;
+                next = curr->next_sibling != nullptr ? curr->next_sibling : curr->parent;
+            }
+            if (curr->expanded && curr->expanded_children == 0) {
+                unlink_candidate(curr);
+            }
+            destroy_node(curr);
+            node_count--;
+
+            if (next == nullptr) {
+                return;
+            }
+            curr = next;
+        }
+    }
+
+    void release() noexcept {
+        if (root != nullptr) {
+            free_subtree(root);
+            root = nullptr;
+        }
+    }
+
+    void link_newest(node* n) noexcept {
+        n->newer = nullptr;
+        n->older = newest;
+        if (newest != nullptr) {
+            newest->newer = n;
+        } else {
+            oldest = n;
+        }
+        newest = n;
+    }
+
+    // Links a node that just became a candidate in order of last use. When evict_until() collapses the last expanded child, that
+    // child was the oldest candidate and the parent goes to the back in O(1).
+    void link_by_use(node* n) noexcept {
+        node* newer = oldest;
+        while (newer != nullptr && newer->used < n->used) {
+            newer = newer->newer;
+        }
+        if (newer == nullptr) {
+            link_newest(n);
+            return;
+        }
+        n->newer = newer;
+        n->older = newer->older;
+        (newer->older != nullptr ? newer->older->newer : oldest) = n;
+        newer->older = n;
+    }
+
+    void unlink_candidate(node* n) noexcept {
+        (n->newer != nullptr ? n->newer->older : newest) = n->older;
+        (n->older != nullptr ? n->older->newer : oldest) = n->newer;
+        n->newer = nullptr;
+        n->older = nullptr;
+    }
+
+    node_allocator alloc;
+    node* root;
+    size_t node_count;
+    uint64_t clock;
+    node* newest;
+    node* oldest;
+};
+
+#endif // LAZY_TREE_H_INCLUDED
@@ -0,0 +1,483 @@
+#ifndef MAPPED_TREE_H_INCLUDED
+#define MAPPED_TREE_H_INCLUDED
+
+#include "tree.h"
+#include "frozen_tree.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Binary snapshot of a tree, laid out like frozen_tree: a header followed by
+// the values in pre-order and three arrays of 32-bit links, each section at
+// an aligned offset from the start of the file. The file is written in the
+// byte order and value layout of the machine that saves it; mapped_tree
+// rejects files it cannot use as they are.
+namespace detail {
+    struct snapshot_header {
+        static constexpr char magic_bytes[8] = {'T', 'R', 'E', 'E', 'S', 'N', 'A', 'P'};
+        static constexpr std::uint32_t current_version = 1;
+        static constexpr std::uint32_t native_byte_order = 0x01020304;
+
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byte_order;
+        std::uint32_t value_size;
+        std::uint32_t value_align;
+        std::uint64_t node_count;
+        std::uint64_t values_offset;
+        std::uint64_t parents_offset;
+        std::uint64_t siblings_offset;
+        std::uint64_t subtree_sizes_offset;
+        std::uint64_t file_size;
+    };
+
+    inline std::uint64_t snapshot_align(std::uint64_t offset, std::uint64_t alignment) noexcept {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    // sections start on cache line boundaries, or stricter if the value type asks for it
+    template <typename T>
+    inline constexpr std::uint64_t snapshot_alignment = alignof(T) > 64 ? alignof(T) : 64;
+}
+
+template <typename T>
+void save_snapshot(const frozen_tree<T>& source, const std::string& path) {
+    static_assert(std::is_trivially_copyable_v<T>, "snapshots store values as raw bytes");
+    using index_type = typename frozen_tree<T>::index_type;
+    constexpr std::uint64_t alignment = detail::snapshot_alignment<T>;
+
+    detail::snapshot_header header{};
+    std::memcpy(header.magic, detail::snapshot_header::magic_bytes, sizeof(header.magic));
+    header.version = detail::snapshot_header::current_version;
+    header.byte_order = detail::snapshot_header::native_byte_order;
+    header.value_size = sizeof(T);
+    header.value_align = alignof(T);
+    header.node_count = source.size();
+    header.values_offset = detail::snapshot_align(sizeof(header), alignment);
+    header.parents_offset = detail::snapshot_align(header.values_offset + source.size() * sizeof(T), alignment);
+    header.siblings_offset = detail::snapshot_align(header.parents_offset + source.size() * sizeof(index_type), alignment);
+    header.subtree_sizes_offset = detail::snapshot_align(header.siblings_offset + source.size() * sizeof(index_type), alignment);
+    header.file_size = header.subtree_sizes_offset + source.size() * sizeof(index_type);
+
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    std::uint64_t written = 0;
+    auto write_section = [&](std::uint64_t offset, const void* data, std::uint64_t bytes) {
+        static constexpr char padding[64] = {};
+        while (written < offset) {
+            std::uint64_t chunk = std::min<std::uint64_t>(offset - written, sizeof(padding));
+            out.write(padding, static_cast<std::streamsize>(chunk));
+            written += chunk;
+        }
+        out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+        written += bytes;
+    };
+
+    write_section(0, &header, sizeof(header));
+    write_section(header.values_offset, source.values().data(), source.size() * sizeof(T));
+    write_section(header.parents_offset, source.parent_array().data(), source.size() * sizeof(index_type));
+    write_section(header.siblings_offset, source.sibling_array().data(), source.size() * sizeof(index_type));
+    write_section(header.subtree_sizes_offset, source.subtree_size_array().data(), source.size() * sizeof(index_type));
+    out.close();
+    if (!out) {
+        throw std::runtime_error{"save_snapshot: cannot write " + path};
+    }
+}
+
+template <typename T, typename Allocator>
+void save_snapshot(const tree<T, Allocator>& source, const std::string& path) {
+    save_snapshot(frozen_tree<T>{source}, path);
+}
+
+// Read-only tree over a snapshot file mapped into memory. Opening only checks
+// the header, so it takes the same time for any size; pages are read in by the
+// system as traversals touch them. Indices are the pre-order indices of
+// frozen_tree.
+template <typename T>
+class mapped_tree {
+    static_assert(std::is_trivially_copyable_v<T>, "snapshots store values as raw bytes");
+
+public:
+    using value_type      = T;
+    using reference       = const T&;
+    using const_reference = const T&;
+    using size_type       = size_t;
+    using index_type      = std::uint32_t;
+
+    static constexpr index_type npos = ~index_type{0};
+
+    class child_iterator {
+    public:
+        using value_type        = T;
+        using pointer           = const T*;
+        using reference         = const T&;
+        using difference_type   = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        child_iterator() noexcept
+            : owner{nullptr}
+            , curr{npos} {}
+
+        child_iterator(const mapped_tree* owner, index_type curr) noexcept
+            : owner{owner}
+            , curr{curr} {}
+
+        bool operator == (const child_iterator& other) const noexcept {
+            return curr == other.curr;
+        }
+
+        bool operator != (const child_iterator& other) const noexcept {
+            return !(*this == other);
+        }
+
+        const T& operator * () const noexcept {
+            return owner->node_values[curr];
+        }
+
+        const T* operator -> () const noexcept {
+            return &owner->node_values[curr];
+        }
+
+        child_iterator& operator ++ () noexcept {
+            curr = owner->sibling_links[curr];
+            return *this;
+        }
+
+        child_iterator operator ++ (int) noexcept {
+            child_iterator tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+
+        index_type index() const noexcept {
+            return curr;
+        }
+
+    private:
+        const mapped_tree* owner;
+        index_type curr;
+    };
+
+    class children_range {
+    public:
+        children_range(child_iterator first, child_iterator last) noexcept
+            : first{first}
+            , last{last} {}
+
+        child_iterator begin() const noexcept {
+            return first;
+        }
+
+        child_iterator end() const noexcept {
+            return last;
+        }
+
+    private:
+        child_iterator first;
+        child_iterator last;
+    };
+
+    // Same interface as tree_traverser. Only parent, next sibling and subtree
+    // size are stored, so prev_sibling and last_child walk the siblings.
+    class traverser {
+    public:
+        traverser(const mapped_tree* owner, index_type node) noexcept
+            : owner{owner}
+            , curr{node} {}
+
+        traverser prev_sibling() const noexcept {
+            return traverser{owner, owner->prev_sibling(curr)};
+        }
+
+        traverser next_sibling() const noexcept {
+            return traverser{owner, owner->next_sibling(curr)};
+        }
+
+        traverser first_child() const noexcept {
+            return traverser{owner, owner->first_child(curr)};
+        }
+
+        traverser last_child() const noexcept {
+            return traverser{owner, owner->last_child(curr)};
+        }
+
+        traverser parent() const noexcept {
+            return traverser{owner, owner->parent(curr)};
+        }
+
+        bool has_prev_sibling() noexcept {
+            return owner->prev_sibling(curr) != npos;
+        }
+
+        bool has_next_sibling() noexcept {
+            return owner->next_sibling(curr) != npos;
+        }
+
+        bool has_first_child() noexcept {
+            return owner->first_child(curr) != npos;
+        }
+
+        bool has_last_child() noexcept {
+            return owner->first_child(curr) != npos;
+        }
+
+        bool has_parent() noexcept {
+            return owner->parent(curr) != npos;
+        }
+
+        bool to_prev_sibling() noexcept {
+            return to_node(owner->prev_sibling(curr));
+        }
+
+        bool to_next_sibling() noexcept {
+            return to_node(owner->next_sibling(curr));
+        }
+
+        bool to_first_child() noexcept {
+            return to_node(owner->first_child(curr));
+        }
+
+        bool to_last_child() noexcept {
+            return to_node(owner->last_child(curr));
+        }
+
+        bool to_parent() noexcept {
+            return to_node(owner->parent(curr));
+        }
+
+        const T& value() const noexcept {
+            return owner->node_values[curr];
+        }
+
+        index_type index() const noexcept {
+            return curr;
+        }
+
+    private:
+        bool to_node(index_type next) noexcept {
+            if (next != npos) {
+                curr = next;
+                return true;
+            } else {
+                return false;
+            }
+        }
+
+        const mapped_tree* owner;
+        index_type curr;
+    };
+
+    explicit mapped_tree(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::system_error{errno, std::generic_category(), "mapped_tree: cannot open " + path};
+        }
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error{error, std::generic_category(), "mapped_tree: cannot stat " + path};
+        }
+        mapped_size = static_cast<size_t>(info.st_size);
+        if (mapped_size < sizeof(detail::snapshot_header)) {
+            ::close(fd);
+            throw std::runtime_error{"mapped_tree: " + path + " is not a tree snapshot"};
+        }
+
+        void* data = ::mmap(nullptr, mapped_size, PROT_READ, MAP_SHARED, fd, 0);
+        int error = errno;
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            throw std::system_error{error, std::generic_category(), "mapped_tree: cannot map " + path};
+        }
+        mapping = static_cast<const std::byte*>(data);
+
+        try {
+            attach(path);
+        } catch (...) {
+            ::munmap(const_cast<std::byte*>(mapping), mapped_size);
+            throw;
+        }
+    }
+
+    mapped_tree(const mapped_tree&) = delete;
+    mapped_tree& operator = (const mapped_tree&) = delete;
+
+    mapped_tree(mapped_tree&& other) noexcept
+        : mapping{std::exchange(other.mapping, nullptr)}
+        , mapped_size{std::exchange(other.mapped_size, 0)}
+        , node_count{std::exchange(other.node_count, 0)}
+        , node_values{std::exchange(other.node_values, nullptr)}
+        , parent_links{std::exchange(other.parent_links, nullptr)}
+        , sibling_links{std::exchange(other.sibling_links, nullptr)}
+        , subtree_sizes{std::exchange(other.subtree_sizes, nullptr)} {}
+
+    mapped_tree& operator = (mapped_tree&& other) noexcept {
+        if (this != &other) {
+            unmap();
+            mapping = std::exchange(other.mapping, nullptr);
+            mapped_size = std::exchange(other.mapped_size, 0);
+            node_count = std::exchange(other.node_count, 0);
+            node_values = std::exchange(other.node_values, nullptr);
+            parent_links = std::exchange(other.parent_links, nullptr);
+            sibling_links = std::exchange(other.sibling_links, nullptr);
+            subtree_sizes = std::exchange(other.subtree_sizes, nullptr);
+        }
+        return *this;
+    }
+
+    ~mapped_tree() noexcept {
+        unmap();
+    }
+
+    size_type size() const noexcept {
+        return node_count;
+    }
+
+    bool empty() const noexcept {
+        return node_count == 0;
+    }
+
+    const T& operator [] (index_type node) const noexcept {
+        return node_values[node];
+    }
+
+    // all values in pre-order
+    std::span<const T> values() const noexcept {
+        return std::span<const T>{node_values, node_count};
+    }
+
+    std::span<const T> pre_order() const noexcept {
+        return values();
+    }
+
+    // values of the subtree rooted at `node`, in pre-order
+    std::span<const T> subtree(index_type node) const noexcept {
+        return std::span<const T>{node_values + node, subtree_sizes[node]};
+    }
+
+    children_range children(index_type node) const noexcept {
+        return {child_iterator{this, first_child(node)}, child_iterator{this, npos}};
+    }
+
+    traverser root_traverser() const noexcept {
+        return traverser{this, root()};
+    }
+
+    index_type root() const noexcept {
+        return empty() ? npos : 0;
+    }
+
+    index_type parent(index_type node) const noexcept {
+        return parent_links[node];
+    }
+
+    index_type next_sibling(index_type node) const noexcept {
+        return sibling_links[node];
+    }
+
+    index_type prev_sibling(index_type node) const noexcept {
+        index_type parent = parent_links[node];
+        if (parent == npos || parent + 1 == node) {
+            return npos;
+        }
+        index_type sibling = parent + 1;
+        while (sibling_links[sibling] != node) {
+            sibling = sibling_links[sibling];
+        }
+        return sibling;
+    }
+
+    index_type first_child(index_type node) const noexcept {
+        return subtree_sizes[node] > 1 ? node + 1 : npos;
+    }
+
+    index_type last_child(index_type node) const noexcept {
+        index_type child = first_child(node);
+        while (child != npos && sibling_links[child] != npos) {
+            child = sibling_links[child];
+        }
+        return child;
+    }
+
+    index_type subtree_size(index_type node) const noexcept {
+        return subtree_sizes[node];
+    }
+
+    bool is_ancestor(index_type ancestor, index_type node) const noexcept {
+        return ancestor <= node && node < ancestor + subtree_sizes[ancestor];
+    }
+
+private:
+    // checks the header and the section bounds, nothing past it is read
+    void attach(const std::string& path) {
+        detail::snapshot_header header;
+        std::memcpy(&header, mapping, sizeof(header));
+
+        auto reject = [&](const char* reason) {
+            throw std::runtime_error{"mapped_tree: " + path + ": " + reason};
+        };
+        if (std::memcmp(header.magic, detail::snapshot_header::magic_bytes, sizeof(header.magic)) != 0) {
+            reject("not a tree snapshot");
+        }
+        if (header.version != detail::snapshot_header::current_version) {
+            reject("unsupported snapshot version");
+        }
+        if (header.byte_order != detail::snapshot_header::native_byte_order) {
+            reject("snapshot written with another byte order");
+        }
+        if (header.value_size != sizeof(T) || header.value_align != alignof(T)) {
+            reject("snapshot holds values of another type");
+        }
+        if (header.file_size != mapped_size || header.node_count >= npos) {
+            reject("snapshot is truncated or corrupt");
+        }
+
+        auto section = [&](std::uint64_t offset, std::uint64_t element_size) {
+            if (offset % detail::snapshot_alignment<T> != 0 ||
+                offset > mapped_size ||
+                header.node_count > (mapped_size - offset) / element_size) {
+                reject("snapshot is truncated or corrupt");
+            }
+            return mapping + offset;
+        };
+        node_count = static_cast<size_t>(header.node_count);
+        node_values = std::launder(reinterpret_cast<const T*>(section(header.values_offset, sizeof(T))));
+        parent_links = reinterpret_cast<const index_type*>(section(header.parents_offset, sizeof(index_type)));
+        sibling_links = reinterpret_cast<const index_type*>(section(header.siblings_offset, sizeof(index_type)));
+        subtree_sizes = reinterpret_cast<const index_type*>(section(header.subtree_sizes_offset, sizeof(index_type)));
+    }
+
+    void unmap() noexcept {
+        if (mapping != nullptr) {
+            ::munmap(const_cast<std::byte*>(mapping), mapped_size);
+            mapping = nullptr;
+        }
+    }
+
+    const std::byte* mapping = nullptr;
+    size_t mapped_size = 0;
+    size_t node_count = 0;
+    const T* node_values = nullptr;
+    const index_type* parent_links = nullptr;
+    const index_type* sibling_links = nullptr;
+    const index_type* subtree_sizes = nullptr;
+};
+
+#endif // MAPPED_TREE_H_INCLUDED
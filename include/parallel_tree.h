@@ -0,0 +1,444 @@
+#ifndef PARALLEL_TREE_H_INCLUDED
+#define PARALLEL_TREE_H_INCLUDED
+
+#include "tree.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// Fork-join pool with one task deque per participant. A participant pops its
+// own newest task and, when it runs dry, steals the oldest task of another
+// one, which for tree walks is the largest piece of remaining work.
+// The thread calling run() takes part as worker 0. A task may call run()
+// on the pool running it, e.g. a parallel_for_each visitor walking another
+// tree: the nested run is joined by its caller, which runs and steals
+// tasks of the nested run until they are done, instead of waiting for the
+// pool. It takes up no other tasks meanwhile, so a task never starts on a
+// worker while an earlier one is still unfinished on it, except for the
+// tasks of its own nested runs.
+// A worker that finds nothing to run spins for a short while, then parks
+// until a task is spawned or the tasks it waits for are done.
+class work_stealing_pool {
+public:
+    // receives the index of the worker running it
+    using task = std::function<void(size_t)>;
+
+    explicit work_stealing_pool(size_t participants = std::thread::hardware_concurrency())
+        : pending{0}
+        , signals{0}
+        , sleepers{0}
+        , generation{0}
+        , stopping{false} {
+        participants = std::max<size_t>(participants, 1);
+        for (size_t i = 0; i < participants; i++) {
+            queues.push_back(std::make_unique<worker_queue>());
+        }
+        for (size_t i = 1; i < participants; i++) {
+            threads.emplace_back([this, i] { worker_loop(i); });
+        }
+    }
+
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator = (const work_stealing_pool&) = delete;
+
+    ~work_stealing_pool() noexcept {
+        {
+            std::lock_guard<std::mutex> lock{state_mutex};
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // number of workers, the calling thread included
+    size_t size() const noexcept {
+        return queues.size();
+    }
+
+    // Runs `root` and every task it spawns, returns once all of them are done.
+    // The first exception thrown by a task is rethrown here; tasks that were
+    // not started yet are dropped.
+    void run(task root) {
+        task_group group;
+        if (current.pool == this) {
+            // called from a task: the worker running it joins the nested tasks
+            size_t worker = current.worker;
+            spawn_to(worker, group, std::move(root));
+            work_until(worker, group.pending, &group);
+        } else {
+            std::lock_guard<std::mutex> run_lock{run_mutex};
+            spawn_to(0, group, std::move(root));
+            {
+                std::lock_guard<std::mutex> lock{state_mutex};
+                generation++;
+            }
+            wake.notify_all();
+            work_until(0, pending);
+        }
+
+        if (group.error) {
+            std::rethrow_exception(group.error);
+        }
+    }
+
+    // Queues a task on `worker`; only valid from inside a task running on it.
+    void spawn(size_t worker, task t) {
+        spawn_to(worker, *current.group, std::move(t));
+    }
+
+    // true when nothing waits in the queue of `worker`, i.e. everything it
+    // offered has been taken by others
+    bool idle(size_t worker) const noexcept {
+        worker_queue& queue = *queues[worker];
+        std::lock_guard<std::mutex> lock{queue.mutex};
+        return queue.tasks.empty();
+    }
+
+private:
+    // the tasks of one run(), which finishes when none of them is left
+    struct task_group {
+        std::atomic<size_t> pending{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+    };
+
+    struct queued_task {
+        task run;
+        task_group* group = nullptr;
+    };
+
+    struct worker_queue {
+        mutable std::mutex mutex;
+        std::deque<queued_task> tasks;
+    };
+
+    // the pool, worker and group of the task this thread is running;
+    // all null outside of tasks
+    struct running_task {
+        work_stealing_pool* pool;
+        size_t worker;
+        task_group* group;
+    };
+
+    static inline thread_local running_task current;
+
+    // failed attempts in a row to find a task before a worker parks
+    static constexpr size_t spin_limit = 64;
+
+    void spawn_to(size_t worker, task_group& group, task t) {
+        worker_queue& queue = *queues[worker];
+        std::lock_guard<std::mutex> lock{queue.mutex};
+        queue.tasks.push_back(queued_task{std::move(t), &group});
+        group.pending.fetch_add(1, std::memory_order_relaxed);
+        pending.fetch_add(1, std::memory_order_relaxed);
+        signal();
+    }
+
+    void worker_loop(size_t worker) {
+        size_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock{state_mutex};
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+            }
+            work_until(worker, pending);
+        }
+    }
+
+    // Runs tasks, only those of `only` if set, until `remaining` drops to
+    // zero. Waiting on pending means waiting for nested tasks as well.
+    void work_until(size_t worker, const std::atomic<size_t>& remaining, const task_group* only = nullptr) {
+        size_t misses = 0;
+        while (remaining.load(std::memory_order_acquire) != 0) {
+            // read before looking for a task, so one spawned after the look changes it
+            uint64_t seen = signals.load(std::memory_order_seq_cst);
+            queued_task t;
+            if (pop(worker, t, only) || steal(worker, t, only)) {
+                execute(worker, t);
+                misses = 0;
+            } else if (++misses < spin_limit) {
+                std::this_thread::yield();
+            } else {
+                park(remaining, seen);
+                misses = 0;
+            }
+        }
+    }
+
+    // Both sides go through sleepers and signals in seq_cst order: either the
+    // signalling thread sees the sleeper and notifies under the mutex, or the
+    // sleeper sees the new signal count before it waits.
+    void park(const std::atomic<size_t>& remaining, uint64_t seen) {
+        std::unique_lock<std::mutex> lock{park_mutex};
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        parked.wait(lock, [&] {
+            return remaining.load(std::memory_order_acquire) == 0 || signals.load(std::memory_order_seq_cst) != seen;
+        });
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // called when a task is queued or a count a worker may wait on drops to zero
+    void signal() {
+        signals.fetch_add(1, std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_seq_cst) != 0) {
+            std::lock_guard<std::mutex> lock{park_mutex};
+            parked.notify_all();
+        }
+    }
+
+    void execute(size_t worker, queued_task& t) {
+        task_group& group = *t.group;
+        if (!group.failed.load(std::memory_order_relaxed)) {
+            running_task outer = std::exchange(current, running_task{this, worker, &group});
+            try {
+                t.run(worker);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock{state_mutex};
+                if (!group.failed.exchange(true)) {
+                    group.error = std::current_exception();
+                }
+            }
+            current = outer;
+        }
+        t.run = nullptr;
+        bool group_done = group.pending.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        bool all_done = pending.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        if (group_done || all_done) {
+            signal();
+        }
+    }
+
+    // With `only` set, just tasks of that group are taken: the newest of
+    // them from the own queue, the oldest of them from the others.
+    bool pop(size_t worker, queued_task& t, const task_group* only = nullptr) {
+        worker_queue& queue = *queues[worker];
+        std::lock_guard<std::mutex> lock{queue.mutex};
+        auto it = std::find_if(queue.tasks.rbegin(), queue.tasks.rend(), [only](const queued_task& queued) {
+            return only == nullptr || queued.group == only;
+        });
+        if (it == queue.tasks.rend()) {
+            return false;
+        }
+        t = std::move(*it);
+        queue.tasks.erase(std::next(it).base());
+        return true;
+    }
+
+    bool steal(size_t worker, queued_task& t, const task_group* only = nullptr) {
+        for (size_t i = 1; i < queues.size(); i++) {
+            worker_queue& queue = *queues[(worker + i) % queues.size()];
+            std::lock_guard<std::mutex> lock{queue.mutex};
+            auto it = std::find_if(queue.tasks.begin(), queue.tasks.end(), [only](const queued_task& queued) {
+                return only == nullptr || queued.group == only;
+            });
+            if (it != queue.tasks.end()) {
+                t = std::move(*it);
+                queue.tasks.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<worker_queue>> queues;
+    std::vector<std::thread> threads;
+    // tasks of every group not finished yet
+    std::atomic<size_t> pending;
+    // bumped by signal(), workers parked since an older count wake up
+    std::atomic<uint64_t> signals;
+    std::atomic<size_t> sleepers;
+    std::mutex park_mutex;
+    std::condition_variable parked;
+
+    std::mutex run_mutex;
+    std::mutex state_mutex;
+    std::condition_variable wake;
+    size_t generation;
+    bool stopping;
+};
+
+// pool shared by the parallel algorithms unless one is passed explicitly
+inline work_stealing_pool& default_pool() {
+    static work_stealing_pool pool;
+    return pool;
+}
+
+struct parallel_options {
+    // nodes a task visits before it offers part of its remaining subtrees to
+    // idle workers; trees smaller than this are walked inline on one thread
+    size_t grain_size = 4096;
+    work_stealing_pool* pool = nullptr;
+};
+
+namespace detail {
+    // A task is a stack of subtree roots walked depth-first. Every grain_size
+    // nodes, if its earlier offer has been taken, the oldest half of the stack
+    // (the shallowest, so usually largest subtrees) is handed over as a new task.
+    // That half is the pre-order tail of what the task has left, so the nodes
+    // of a task come in pre-order before those of its offers, and each offer
+    // before the ones it made earlier.
+    // Visit tells the tasks apart by a part of its own: every task gets one,
+    // split off the part of the task offering it.
+    template <typename Traverser, typename Visit>
+    struct subtree_walk {
+        using part = typename Visit::part;
+
+        work_stealing_pool* pool;
+        size_t grain_size;
+        Visit* visit;
+
+        void operator () (size_t worker, std::vector<Traverser> stack, part* into) const {
+            size_t visited = 0;
+            while (!stack.empty()) {
+                Traverser node = stack.back();
+                stack.pop_back();
+                (*visit)(worker, *into, node.value());
+
+                size_t first_child = stack.size();
+                if (node.to_first_child()) {
+                    do {
+                        stack.push_back(node);
+                    } while (node.to_next_sibling());
+                    std::reverse(stack.begin() + first_child, stack.end());
+                }
+
+                if (++visited < grain_size || stack.size() < 2) {
+                    continue;
+                }
+                visited = 0;
+                if (pool->size() > 1 && pool->idle(worker)) {
+                    auto half = static_cast<std::ptrdiff_t>(stack.size() / 2);
+                    std::vector<Traverser> offered(stack.begin(), stack.begin() + half);
+                    stack.erase(stack.begin(), stack.begin() + half);
+                    part* offered_into = visit->split(*into);
+                    pool->spawn(worker, [walk = *this, offered = std::move(offered), offered_into](size_t w) mutable {
+                        walk(w, std::move(offered), offered_into);
+                    });
+                }
+            }
+        }
+    };
+
+    template <typename T, typename Allocator, typename Visit>
+    void parallel_walk(const tree<T, Allocator>& t, Visit& visit, typename Visit::part& root_part, const parallel_options& options) {
+        using traverser = tree_traverser<T, typename tree<T, Allocator>::links_type>;
+        if (t.empty()) {
+            return;
+        }
+
+        work_stealing_pool& pool = options.pool != nullptr ? *options.pool : default_pool();
+        subtree_walk<traverser, Visit> walk{&pool, std::max<size_t>(options.grain_size, 1), &visit};
+        pre_order_view view{t};
+        std::vector<traverser> stack{std::begin(view).as_traverser()};
+        pool.run([walk, stack = std::move(stack), into = &root_part](size_t worker) mutable {
+            walk(worker, std::move(stack), into);
+        });
+    }
+
+    // for visitors that do not care which task a node belongs to
+    template <typename F>
+    struct unordered_visit {
+        struct part {};
+
+        F* f;
+
+        part* split(part& into) const noexcept {
+            return &into;
+        }
+
+        template <typename V>
+        void operator () (size_t, part&, V& value) const {
+            (*f)(value);
+        }
+    };
+
+    // Every task folds its nodes into its own part, and the parts are
+    // combined in pre-order at the end.
+    template <typename R, typename Combine, typename Transform>
+    struct ordered_fold {
+        struct alignas(64) part {
+            std::optional<R> value;
+            // in the order they were offered, i.e. in reverse pre-order
+            std::vector<std::unique_ptr<part>> offers;
+        };
+
+        Combine* combine;
+        Transform* transform;
+
+        // only the task owning `into` adds to its offers
+        part* split(part& into) {
+            return into.offers.emplace_back(std::make_unique<part>()).get();
+        }
+
+        template <typename V>
+        void operator () (size_t, part& into, const V& value) const {
+            // transform may run a nested walk on this worker, so it is done
+            // before the part is touched
+            R item = (*transform)(value);
+            if (into.value) {
+                *into.value = (*combine)(std::move(*into.value), std::move(item));
+            } else {
+                into.value.emplace(std::move(item));
+            }
+        }
+
+        // without recursion, as the offers may nest as deep as the tree
+        R fold(R init, part& root) const {
+            std::vector<part*> stack{&root};
+            while (!stack.empty()) {
+                part* curr = stack.back();
+                stack.pop_back();
+                if (curr->value) {
+                    init = (*combine)(std::move(init), std::move(*curr->value));
+                }
+                for (auto& offer : curr->offers) {
+                    stack.push_back(offer.get());
+                }
+            }
+            return init;
+        }
+    };
+}
+
+// Calls f on every value of the tree, in no particular order and possibly
+// from several threads at once.
+template <typename T, typename Allocator, typename F>
+void parallel_for_each(tree<T, Allocator>& t, F f, const parallel_options& options = {}) {
+    detail::unordered_visit<F> visit{&f};
+    typename detail::unordered_visit<F>::part root_part;
+    detail::parallel_walk(t, visit, root_part, options);
+}
+
+// Folds transform(value) over the tree, starting from init. combine must be
+// associative but need not be commutative: every task folds its own run of
+// nodes and the runs are combined into init at the end, in pre-order.
+template <typename T, typename Allocator, typename R, typename Combine, typename Transform>
+R parallel_reduce(const tree<T, Allocator>& t, R init, Combine combine, Transform transform, const parallel_options& options = {}) {
+    using fold_type = detail::ordered_fold<R, Combine, Transform>;
+    fold_type fold{&combine, &transform};
+    typename fold_type::part root_part;
+    detail::parallel_walk(t, fold, root_part, options);
+    return fold.fold(std::move(init), root_part);
+}
+
+template <typename T, typename Allocator, typename R, typename Combine>
+R parallel_reduce(const tree<T, Allocator>& t, R init, Combine combine, const parallel_options& options = {}) {
+    return parallel_reduce(t, std::move(init), std::move(combine), [](const T& value) -> const T& { return value; }, options);
+}
+
+#endif // PARALLEL_TREE_H_INCLUDED
@@ -0,0 +1,643 @@
+#ifndef PERSISTENT_TREE_H_INCLUDED
+#define PERSISTENT_TREE_H_INCLUDED
+
+#include "tree.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Immutable tree. Every update leaves the tree it was called on untouched and
+// returns a new version that copies only the path from the root to the edited
+// node; all other subtrees are shared between the versions through reference
+// counting. Copying a version is O(1), an update costs O(depth * log fan-out)
+// time and memory along the copied path, whatever the size of the tree.
+// Versions may be read and updated from several threads at once.
+template <typename T, typename Allocator = std::allocator<T>>
+class persistent_tree {
+    struct node;
+    using node_ptr        = std::shared_ptr<const node>;
+    using node_allocator  = typename std::allocator_traits<Allocator>::template rebind_alloc<node>;
+    using child_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<node_ptr>;
+    using children_type   = std::vector<node_ptr, child_allocator>;
+
+    // The children of a node: an immutable sequence stored as a B-tree of
+    // chunks holding up to chunk_capacity entries each, so that a node with
+    // many children is not copied whole on every update. Updates return a new
+    // sequence that copies the O(log size) chunks on the way to the edited
+    // position and shares the rest. Chunks emptied by erasure are dropped but
+    // not merged, so the height follows the largest size the sequence had.
+    class child_sequence {
+        static constexpr size_t chunk_capacity = 32;
+
+        struct chunk;
+        using chunk_ptr = std::shared_ptr<const chunk>;
+        // a chunk below an inner chunk, with the number of children in it
+        using sub_entry = std::pair<chunk_ptr, size_t>;
+
+        using chunk_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<chunk>;
+        using sub_allocator   = typename std::allocator_traits<Allocator>::template rebind_alloc<sub_entry>;
+        using subs_type       = std::vector<sub_entry, sub_allocator>;
+
+        // Leaves hold children, inner chunks hold chunks. No chunk is empty.
+        struct chunk {
+            chunk(children_type children, subs_type subs)
+                : children{std::move(children)}
+                , subs{std::move(subs)} {}
+
+            bool leaf() const noexcept {
+                return subs.empty();
+            }
+
+            children_type children;
+            subs_type subs;
+        };
+
+    public:
+        child_sequence() noexcept = default;
+
+        size_t size() const noexcept {
+            return count;
+        }
+
+        bool empty() const noexcept {
+            return count == 0;
+        }
+
+        const node_ptr& operator [] (size_t index) const noexcept {
+            assert(index < count);
+            const chunk* curr = root.get();
+            while (!curr->leaf()) {
+                auto [i, sub_index] = locate(*curr, index);
+                curr = curr->subs[i].first.get();
+                index = sub_index;
+            }
+            return curr->children[index];
+        }
+
+        const node_ptr& front() const noexcept {
+            return (*this)[0];
+        }
+
+        const node_ptr& back() const noexcept {
+            return (*this)[count - 1];
+        }
+
+        // the sequence with `child` put before position `index`
+        child_sequence inserted(size_t index, node_ptr child, const node_allocator& alloc) const {
+            assert(index <= count);
+            if (root == nullptr) {
+                children_type children(child_allocator{alloc});
+                children.push_back(std::move(child));
+                return child_sequence{make_chunk(std::move(children), subs_type(sub_allocator{alloc}), alloc), 1};
+            }
+            auto [first, second] = insert_into(*root, index, std::move(child), alloc);
+            if (second.first == nullptr) {
+                return child_sequence{std::move(first.first), count + 1};
+            }
+            // the root split, the tree grows a level
+            subs_type subs(sub_allocator{alloc});
+            subs.push_back(std::move(first));
+            subs.push_back(std::move(second));
+            return child_sequence{make_chunk(children_type(child_allocator{alloc}), std::move(subs), alloc), count + 1};
+        }
+
+        // the sequence without the child at `index`
+        child_sequence erased(size_t index, const node_allocator& alloc) const {
+            assert(index < count);
+            chunk_ptr result = erase_from(*root, index, alloc);
+            // a root left with a single chunk gives way to it
+            while (result != nullptr && result->subs.size() == 1) {
+                result = result->subs.front().first;
+            }
+            return child_sequence{std::move(result), count - 1};
+        }
+
+        // the sequence with the child at `index` replaced by `child`
+        child_sequence replaced(size_t index, node_ptr child, const node_allocator& alloc) const {
+            assert(index < count);
+            return child_sequence{replace_in(*root, index, std::move(child), alloc), count};
+        }
+
+        // Moves the children out to `out` and leaves the sequence empty.
+        // Chunks shared with other sequences are only let go of.
+        void release_into(std::vector<node_ptr>& out) {
+            if (root != nullptr) {
+                release_chunk(std::move(root), out);
+            }
+            count = 0;
+        }
+
+    private:
+        child_sequence(chunk_ptr root, size_t count) noexcept
+            : root{std::move(root)}
+            , count{count} {}
+
+        static chunk_ptr make_chunk(children_type children, subs_type subs, const node_allocator& alloc) {
+            return std::allocate_shared<chunk>(chunk_allocator{alloc}, std::move(children), std::move(subs));
+        }
+
+        // the sub-chunk of an inner chunk that holds position `index`, and the
+        // position within it; `index` may be one past the end
+        static std::pair<size_t, size_t> locate(const chunk& c, size_t index) noexcept {
+            size_t i = 0;
+            for (; i + 1 < c.subs.size() && index >= c.subs[i].second; i++) {
+                index -= c.subs[i].second;
+            }
+            return {i, index};
+        }
+
+        // the upper half of a chunk's entries, moved out of it
+        template <typename Entries>
+        static Entries split_off(Entries& entries) {
+            auto middle = entries.begin() + static_cast<std::ptrdiff_t>(entries.size() / 2);
+            Entries upper(std::make_move_iterator(middle), std::make_move_iterator(entries.end()), entries.get_allocator());
+            entries.erase(middle, entries.end());
+            return upper;
+        }
+
+        static size_t leaf_size(const chunk& c) noexcept {
+            if (c.leaf()) {
+                return c.children.size();
+            }
+            size_t result = 0;
+            for (const sub_entry& sub : c.subs) {
+                result += sub.second;
+            }
+            return result;
+        }
+
+        // the copy of `c` with the child inserted, split in two when it
+        // outgrows chunk_capacity; the second entry is empty otherwise
+        static std::pair<sub_entry, sub_entry> insert_into(const chunk& c, size_t index, node_ptr child,
+                                                           const node_allocator& alloc) {
+            children_type children = c.children;
+            subs_type subs = c.subs;
+            size_t entries;
+            if (c.leaf()) {
+                children.insert(children.begin() + static_cast<std::ptrdiff_t>(index), std::move(child));
+                entries = children.size();
+            } else {
+                auto [i, sub_index] = locate(c, index);
+                auto [first, second] = insert_into(*c.subs[i].first, sub_index, std::move(child), alloc);
+                auto position = subs.begin() + static_cast<std::ptrdiff_t>(i);
+                *position = std::move(first);
+                if (second.first != nullptr) {
+                    subs.insert(position + 1, std::move(second));
+                }
+                entries = subs.size();
+            }
+
+            std::pair<sub_entry, sub_entry> result;
+            if (entries > chunk_capacity) {
+                children_type upper_children = c.leaf() ? split_off(children) : children_type(child_allocator{alloc});
+                subs_type upper_subs = c.leaf() ? subs_type(sub_allocator{alloc}) : split_off(subs);
+                result.second.first = make_chunk(std::move(upper_children), std::move(upper_subs), alloc);
+                result.second.second = leaf_size(*result.second.first);
+            }
+            result.first.first = make_chunk(std::move(children), std::move(subs), alloc);
+            result.first.second = leaf_size(*result.first.first);
+            return result;
+        }
+
+        // the copy of `c` without the child, nullptr once it has none left
+        static chunk_ptr erase_from(const chunk& c, size_t index, const node_allocator& alloc) {
+            children_type children = c.children;
+            subs_type subs = c.subs;
+            if (c.leaf()) {
+                children.erase(children.begin() + static_cast<std::ptrdiff_t>(index));
+                if (children.empty()) {
+                    return nullptr;
+                }
+            } else {
+                auto [i, sub_index] = locate(c, index);
+                chunk_ptr sub = erase_from(*c.subs[i].first, sub_index, alloc);
+                auto position = subs.begin() + static_cast<std::ptrdiff_t>(i);
+                if (sub == nullptr) {
+                    subs.erase(position);
+                } else {
+                    *position = {std::move(sub), position->second - 1};
+                }
+                if (subs.empty()) {
+                    return nullptr;
+                }
+            }
+            return make_chunk(std::move(children), std::move(subs), alloc);
+        }
+
+        static chunk_ptr replace_in(const chunk& c, size_t index, node_ptr child, const node_allocator& alloc) {
+            children_type children = c.children;
+            subs_type subs = c.subs;
+            if (c.leaf()) {
+                children[index] = std::move(child);
+            } else {
+                auto [i, sub_index] = locate(c, index);
+                subs[i].first = replace_in(*c.subs[i].first, sub_index, std::move(child), alloc);
+            }
+            return make_chunk(std::move(children), std::move(subs), alloc);
+        }
+
+        // recursion is bounded by the height, O(log size)
+        static void release_chunk(chunk_ptr c, std::vector<node_ptr>& out) {
+            if (c.use_count() != 1) {
+                // other sequences keep the chunk and its children alive
+                return;
+            }
+            // Sole owner, nobody else can reach the chunk any more. use_count
+            // is a relaxed load, so the fence orders the reads other threads
+            // made through their dropped references before the writes below.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            auto& owned = const_cast<chunk&>(*c);
+            std::move(owned.children.begin(), owned.children.end(), std::back_inserter(out));
+            owned.children.clear();
+            for (sub_entry& sub : owned.subs) {
+                release_chunk(std::move(sub.first), out);
+            }
+        }
+
+        chunk_ptr root;
+        size_t count = 0;
+    };
+
+    struct node {
+        node(T value, child_sequence children, size_t count)
+            : value{std::move(value)}
+            , children{std::move(children)}
+            , count{count} {}
+
+        // Drops the children without recursing, so a deep chain does not
+        // exhaust the stack: children owned by this node alone hand their own
+        // children over before they go.
+        ~node() noexcept {
+            std::vector<node_ptr> pending;
+            children.release_into(pending);
+            while (!pending.empty()) {
+                node_ptr child = std::move(pending.back());
+                pending.pop_back();
+                if (child.use_count() == 1) {
+                    // sole owner, nobody else can reach the child any more;
+                    // acquire as in child_sequence::release_chunk
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    const_cast<node&>(*child).children.release_into(pending);
+                }
+            }
+        }
+
+        T value;
+        child_sequence children;
+        // nodes in the subtree, this one included
+        size_t count;
+    };
+
+public:
+    using value_type      = T;
+    using reference       = const T&;
+    using const_reference = const T&;
+    using size_type       = size_t;
+    using allocator_type  = Allocator;
+
+    // Position in one version, like tree_traverser but read-only. A cursor
+    // stays valid as long as its version does; updates take the cursor of the
+    // version they are called on.
+    class cursor {
+    public:
+        cursor() noexcept = default;
+
+        bool has_first_child() const noexcept {
+            return !curr()->children.empty();
+        }
+
+        bool has_next_sibling() const noexcept {
+            return path.size() > 1 && path.back().index + 1 < parent_node()->children.size();
+        }
+
+        bool has_parent() const noexcept {
+            return path.size() > 1;
+        }
+
+        bool to_first_child() {
+            if (!has_first_child()) {
+                return false;
+            }
+            path.push_back({curr()->children.front().get(), 0});
+            return true;
+        }
+
+        bool to_next_sibling() noexcept {
+            if (!has_next_sibling()) {
+                return false;
+            }
+            frame& last = path.back();
+            last.index++;
+            last.target = parent_node()->children[last.index].get();
+            return true;
+        }
+
+        bool to_parent() noexcept {
+            if (!has_parent()) {
+                return false;
+            }
+            path.pop_back();
+            return true;
+        }
+
+        const T& value() const noexcept {
+            return curr()->value;
+        }
+
+        size_t child_count() const noexcept {
+            return curr()->children.size();
+        }
+
+        // nodes in the subtree under the cursor, O(1)
+        size_t subtree_size() const noexcept {
+            return curr()->count;
+        }
+
+        // child indices from the root down to the cursor, for persistent_tree::at
+        std::vector<size_t> indices() const {
+            std::vector<size_t> result;
+            for (size_t i = 1; i < path.size(); i++) {
+                result.push_back(path[i].index);
+            }
+            return result;
+        }
+
+        bool operator == (const cursor& other) const noexcept {
+            return path.empty() ? other.path.empty() : !other.path.empty() && curr() == other.curr();
+        }
+
+        bool operator != (const cursor& other) const noexcept {
+            return !(*this == other);
+        }
+
+    private:
+        friend class persistent_tree;
+
+        struct frame {
+            const node* target;
+            // position among the parent's children, 0 for the root
+            size_t index;
+        };
+
+        explicit cursor(const node* root) {
+            if (root != nullptr) {
+                path.push_back({root, 0});
+            }
+        }
+
+        const node* curr() const noexcept {
+            assert(!path.empty());
+            return path.back().target;
+        }
+
+        const node* parent_node() const noexcept {
+            return path[path.size() - 2].target;
+        }
+
+        std::vector<frame> path;
+    };
+
+    // Pre-order iterator over one version.
+    class const_iterator {
+    public:
+        using value_type        = T;
+        using pointer           = const T*;
+        using reference         = const T&;
+        using difference_type   = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        const_iterator() noexcept = default;
+
+        bool operator == (const const_iterator& other) const noexcept {
+            return position == other.position;
+        }
+
+        bool operator != (const const_iterator& other) const noexcept {
+            return position != other.position;
+        }
+
+        reference operator * () const noexcept {
+            return position.value();
+        }
+
+        pointer operator -> () const noexcept {
+            return &position.value();
+        }
+
+        const_iterator& operator ++ () {
+            if (position.to_first_child()) {
+                return *this;
+            }
+            while (!position.has_next_sibling()) {
+                if (!position.to_parent()) {
+                    position = cursor{};
+                    return *this;
+                }
+            }
+            position.to_next_sibling();
+            return *this;
+        }
+
+        const_iterator operator ++ (int) {
+            const_iterator result = *this;
+            ++*this;
+            return result;
+        }
+
+        const cursor& as_cursor() const noexcept {
+            return position;
+        }
+
+    private:
+        friend class persistent_tree;
+
+        explicit const_iterator(cursor position) noexcept
+            : position{std::move(position)} {}
+
+        cursor position;
+    };
+
+    using iterator = const_iterator;
+
+    explicit persistent_tree(Allocator alloc = Allocator{}) noexcept
+        : alloc{std::move(alloc)}
+        , root_node{nullptr} {}
+
+    size_type size() const noexcept {
+        return root_node != nullptr ? root_node->count : 0;
+    }
+
+    bool empty() const noexcept {
+        return root_node == nullptr;
+    }
+
+    allocator_type get_allocator() const noexcept {
+        return allocator_type{alloc};
+    }
+
+    // the root, or the end cursor if the tree is empty
+    cursor root() const {
+        return cursor{root_node.get()};
+    }
+
+    // The node reached by following the child indices from the root;
+    // throws std::out_of_range if there is none.
+    template <typename IndexRange>
+    cursor at(const IndexRange& indices) const {
+        cursor result = root();
+        if (result.path.empty()) {
+            throw std::out_of_range{"persistent_tree: the tree is empty"};
+        }
+        for (size_t index : indices) {
+            const node* parent = result.curr();
+            if (index >= parent->children.size()) {
+                throw std::out_of_range{"persistent_tree: no such child"};
+            }
+            result.path.push_back({parent->children[index].get(), index});
+        }
+        return result;
+    }
+
+    cursor at(std::initializer_list<size_t> indices) const {
+        return at<std::initializer_list<size_t>>(indices);
+    }
+
+    const_iterator begin() const {
+        return const_iterator{root()};
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator{};
+    }
+
+    // Same placement as tree::insert: the new node takes the place of the one
+    // under the cursor, which becomes its only child; at the end cursor the
+    // node becomes the last child of the last node in pre-order.
+    [[nodiscard]] persistent_tree insert(insertion::vert_tag, const cursor& position, T value) const {
+        if (position.path.empty()) {
+            if (empty()) {
+                return with_root(make_node(std::move(value), child_sequence{}, 1));
+            }
+            return append_child(last_node(), std::move(value));
+        }
+
+        child_sequence children = child_sequence{}.inserted(0, node_at(position, position.path.size() - 1), alloc);
+        size_t count = position.curr()->count + 1;
+        return with_root(rebuild(position, position.path.size() - 1, make_node(std::move(value), std::move(children), count), 1));
+    }
+
+    // Same placement as tree::insert: the new node becomes the previous
+    // sibling of the one under the cursor, which must not be the root; at the
+    // end cursor it becomes the next sibling of the last node in pre-order.
+    [[nodiscard]] persistent_tree insert(insertion::hor_tag, const cursor& position, T value) const {
+        if (position.path.empty()) {
+            if (empty()) {
+                return with_root(make_node(std::move(value), child_sequence{}, 1));
+            }
+            cursor last = last_node();
+            assert(last.has_parent());
+            last.to_parent();
+            return append_child(last, std::move(value));
+        }
+
+        assert(position.has_parent());
+        cursor parent = position;
+        parent.to_parent();
+        return insert_child(parent, position.path.back().index, std::move(value));
+    }
+
+    [[nodiscard]] persistent_tree append_child(const cursor& parent, T value) const {
+        assert(!parent.path.empty());
+        return insert_child(parent, parent.curr()->children.size(), std::move(value));
+    }
+
+    [[nodiscard]] persistent_tree prepend_child(const cursor& parent, T value) const {
+        assert(!parent.path.empty());
+        return insert_child(parent, 0, std::move(value));
+    }
+
+    [[nodiscard]] persistent_tree erase_subtree(const cursor& position) const {
+        assert(!position.path.empty());
+        if (!position.has_parent()) {
+            return persistent_tree{alloc};
+        }
+
+        size_t depth = position.path.size() - 2;
+        const node* parent = position.path[depth].target;
+        child_sequence children = parent->children.erased(position.path.back().index, alloc);
+        auto delta = -static_cast<std::ptrdiff_t>(position.curr()->count);
+        node_ptr replacement = make_node(parent->value, std::move(children), parent->count - position.curr()->count);
+        return with_root(rebuild(position, depth, std::move(replacement), delta));
+    }
+
+    // the value under the cursor replaced, the shape unchanged
+    [[nodiscard]] persistent_tree set_value(const cursor& position, T value) const {
+        assert(!position.path.empty());
+        const node* curr = position.curr();
+        size_t depth = position.path.size() - 1;
+        return with_root(rebuild(position, depth, make_node(std::move(value), curr->children, curr->count), 0));
+    }
+
+private:
+    persistent_tree(node_allocator alloc, node_ptr root_node) noexcept
+        : alloc{std::move(alloc)}
+        , root_node{std::move(root_node)} {}
+
+    persistent_tree with_root(node_ptr new_root) const noexcept {
+        return persistent_tree{alloc, std::move(new_root)};
+    }
+
+    node_ptr make_node(T value, child_sequence children, size_t count) const {
+        return std::allocate_shared<node>(alloc, std::move(value), std::move(children), count);
+    }
+
+    // the owning pointer of the node at the given depth of the cursor's path
+    node_ptr node_at(const cursor& position, size_t depth) const noexcept {
+        if (depth == 0) {
+            return root_node;
+        }
+        return position.path[depth - 1].target->children[position.path[depth].index];
+    }
+
+    // last node in pre-order
+    cursor last_node() const {
+        cursor result = root();
+        while (result.has_first_child()) {
+            const node* curr = result.curr();
+            result.path.push_back({curr->children.back().get(), curr->children.size() - 1});
+        }
+        return result;
+    }
+
+    persistent_tree insert_child(const cursor& parent, size_t index, T value) const {
+        const node* curr = parent.curr();
+        child_sequence children = curr->children.inserted(index, make_node(std::move(value), child_sequence{}, 1), alloc);
+        node_ptr replacement = make_node(curr->value, std::move(children), curr->count + 1);
+        return with_root(rebuild(parent, parent.path.size() - 1, std::move(replacement), 1));
+    }
+
+    // Copies the ancestors of the node at `depth` on the cursor's path so the
+    // copies lead to `replacement` instead; returns the new root. `delta` is
+    // the change in the size of the replaced subtree.
+    node_ptr rebuild(const cursor& position, size_t depth, node_ptr replacement, std::ptrdiff_t delta) const {
+        for (size_t i = depth; i > 0; i--) {
+            const node* parent = position.path[i - 1].target;
+            child_sequence children = parent->children.replaced(position.path[i].index, std::move(replacement), alloc);
+            size_t count = static_cast<size_t>(static_cast<std::ptrdiff_t>(parent->count) + delta);
+            replacement = make_node(parent->value, std::move(children), count);
+        }
+        return replacement;
+    }
+
+    node_allocator alloc;
+    node_ptr root_node;
+};
+
+#endif // PERSISTENT_TREE_H_INCLUDED
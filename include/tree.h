@@ -1,11 +1,20 @@
 #ifndef TREE_H_INCLUDED
 #define TREE_H_INCLUDED
 
+#include "epoch_reclamation.h"
+#include <atomic>
+#include <cstdint>
 #include <type_traits>
 #include <iterator>
+#include <ranges>
 #include <utility>
 #include <memory>
 #include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <vector>
 
 namespace detail {
     template <typename T, bool = std::is_copy_constructible_v<T>, bool = std::is_move_constructible_v<T>>
@@ -17,6 +26,9 @@ namespace detail {
 
         enable_special_members(const enable_special_members&) noexcept = default;
         enable_special_members(enable_special_members&&) noexcept = default;
+
+        enable_special_members& operator = (const enable_special_members&) noexcept = default;
+        enable_special_members& operator = (enable_special_members&&) noexcept = default;
     };
 
     template <typename T>
@@ -25,6 +37,9 @@ namespace detail {
 
         enable_special_members(const enable_special_members&) noexcept = delete;
         enable_special_members(enable_special_members&&) noexcept = default;
+
+        enable_special_members& operator = (const enable_special_members&) noexcept = delete;
+        enable_special_members& operator = (enable_special_members&&) noexcept = default;
     };
 
     template <typename T>
@@ -33,6 +48,9 @@ namespace detail {
 
         enable_special_members(const enable_special_members&) noexcept = default;
         enable_special_members(enable_special_members&&) noexcept = delete;
+
+        enable_special_members& operator = (const enable_special_members&) noexcept = default;
+        enable_special_members& operator = (enable_special_members&&) noexcept = delete;
     };
 
     template <typename T>
@@ -41,109 +59,480 @@ namespace detail {
 
         enable_special_members(const enable_special_members&) noexcept = delete;
         enable_special_members(enable_special_members&&) noexcept = delete;
+
+        enable_special_members& operator = (const enable_special_members&) noexcept = delete;
+        enable_special_members& operator = (enable_special_members&&) noexcept = delete;
+    };
+
+    // Allocators that can drop everything they handed out at once (see arena_allocator.h).
+    template <typename Allocator, typename = void>
+    struct supports_bulk_release : std::false_type {};
+
+    template <typename Allocator>
+    struct supports_bulk_release<Allocator, std::void_t<
+        decltype(std::declval<const Allocator&>().exclusive()),
+        decltype(std::declval<Allocator&>().release())>> : std::true_type {};
+
+    template <typename Allocator>
+    inline constexpr bool supports_bulk_release_v = supports_bulk_release<Allocator>::value;
+
+    // whether a signed or unsigned index points into [0, count)
+    template <typename Index>
+    constexpr bool index_in_range(Index index, size_t count) noexcept {
+        if constexpr (std::is_signed_v<Index>) {
+            if (index < 0) {
+                return false;
+            }
+        }
+        return static_cast<std::make_unsigned_t<Index>>(index) < count;
+    }
+
+    // Link of a node with node_link::atomic: stores publish with release,
+    // loads acquire, so a reader that reaches a node sees it fully linked.
+    template <typename Node>
+    class atomic_link {
+    public:
+        atomic_link(Node* node = nullptr) noexcept
+            : ptr{node} {}
+
+        atomic_link(const atomic_link& other) noexcept
+            : ptr{static_cast<Node*>(other)} {}
+
+        atomic_link& operator = (const atomic_link& other) noexcept {
+            return *this = static_cast<Node*>(other);
+        }
+
+        atomic_link& operator = (Node* node) noexcept {
+            ptr.store(node, std::memory_order_release);
+            return *this;
+        }
+
+        operator Node* () const noexcept {
+            return ptr.load(std::memory_order_acquire);
+        }
+
+        Node* operator -> () const noexcept {
+            return *this;
+        }
+
+        // on failure `expected` receives the current value
+        bool compare_exchange(Node*& expected, Node* desired) noexcept {
+            return ptr.compare_exchange_weak(expected, desired, std::memory_order_acq_rel, std::memory_order_acquire);
+        }
+
+    private:
+        std::atomic<Node*> ptr;
+    };
+
+    template <typename Node, bool Atomic>
+    using link_ptr = std::conditional_t<Atomic, atomic_link<Node>, Node*>;
+
+    // Node count of a tree with atomic links, which concurrent_append_child
+    // bumps from several threads. Relaxed: it orders nothing else.
+    class atomic_count {
+    public:
+        atomic_count(size_t value = 0) noexcept
+            : value{value} {}
+
+        atomic_count(const atomic_count& other) noexcept
+            : value{static_cast<size_t>(other)} {}
+
+        atomic_count& operator = (const atomic_count& other) noexcept {
+            return *this = static_cast<size_t>(other);
+        }
+
+        atomic_count& operator = (size_t count) noexcept {
+            value.store(count, std::memory_order_relaxed);
+            return *this;
+        }
+
+        operator size_t () const noexcept {
+            return value.load(std::memory_order_relaxed);
+        }
+
+        size_t operator ++ (int) noexcept {
+            return value.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        atomic_count& operator += (size_t count) noexcept {
+            value.fetch_add(count, std::memory_order_relaxed);
+            return *this;
+        }
+
+        atomic_count& operator -= (size_t count) noexcept {
+            value.fetch_sub(count, std::memory_order_relaxed);
+            return *this;
+        }
+
+    private:
+        std::atomic<size_t> value;
+    };
+
+    template <bool Atomic>
+    using count_type = std::conditional_t<Atomic, atomic_count, size_t>;
+
+    // Optional links live in bases of their own, so an elided link takes no space in the node.
+    template <typename Link, bool = true>
+    struct prev_sibling_field {
+        Link prev_sibling = nullptr;
+    };
+
+    template <typename Link>
+    struct prev_sibling_field<Link, false> {};
+
+    template <typename Link, bool = true>
+    struct last_child_field {
+        Link last_child = nullptr;
+    };
+
+    template <typename Link>
+    struct last_child_field<Link, false> {};
+
+    template <typename Link, bool = true>
+    struct next_in_level_field {
+        Link next_in_level = nullptr;
+    };
+
+    template <typename Link>
+    struct next_in_level_field<Link, false> {};
+
+    template <bool = true>
+    struct order_labels_field {
+        std::uint64_t enter_label = 0;
+        std::uint64_t exit_label = 0;
+    };
+
+    template <>
+    struct order_labels_field<false> {};
+
+    template <bool = true>
+    struct subtree_hash_field {
+        subtree_hash_field() noexcept = default;
+
+        // a node copied or assigned as a whole is linked elsewhere, without a hash
+        subtree_hash_field(const subtree_hash_field&) noexcept {}
+
+        subtree_hash_field& operator = (const subtree_hash_field&) noexcept {
+            hash_value.store(0, std::memory_order_relaxed);
+            return *this;
+        }
+
+        // 0 while there is no hash, which tree_storage never computes. Const
+        // comparisons store missing hashes, possibly from several threads at
+        // once, all writing the same value; relaxed atomics keep that defined.
+        mutable std::atomic<std::uint64_t> hash_value{0};
+    };
+
+    template <>
+    struct subtree_hash_field<false> {};
+
+    template <bool = true>
+    struct subtree_size_field {
+        size_t subtree_count = 1;
     };
+
+    template <>
+    struct subtree_size_field<false> {};
+
+    // Subtrees erased from a tree with atomic links, waiting until no reader
+    // can reach them.
+    template <typename Node, bool = true>
+    struct retired_nodes {
+        struct entry {
+            Node* node;
+            std::uint64_t epoch;
+        };
+
+        epoch_domain domain;
+        std::vector<entry> entries;
+    };
+
+    template <typename Node>
+    struct retired_nodes<Node, false> {};
+}
+
+// Links a node keeps, selected at compile time through the node type:
+// tree<T, std::allocator<tree_node<T, level_links>>>.
+// parent, next_sibling and first_child are always required. Without
+// prev_sibling or last_child the node shrinks, iterators only move forward,
+// and appending or unlinking a child walks its siblings instead.
+namespace node_link {
+    struct parent {};
+    struct prev_sibling {};
+    struct next_sibling {};
+    struct first_child {};
+    struct last_child {};
+    // next node at the same depth, kept up to date by tree on every mutation
+    struct next_in_level {};
+    // Not a link: every node carries labels ordered like entering and leaving
+    // it in a depth-first walk, for tree::is_ancestor and tree::precedes.
+    struct order_labels {};
+    // Not a link: every node caches a hash of its subtree, refreshed lazily,
+    // for tree::subtree_hash, tree::subtree_equal and tree::diff.
+    struct subtree_hash {};
+    // Not a link: every node counts the nodes of its subtree, for
+    // tree::subtree_size and O(1) splices between trees.
+    struct subtree_size {};
+    // Not a link: every link becomes atomic, so threads holding
+    // tree::read_section() can walk the tree while one writer appends and
+    // erases (see concurrent_links).
+    struct atomic {};
 }
 
-template <typename T>
-struct tree_node_impl {
-    tree_node_impl* parent;
-    tree_node_impl* prev_sibling;
-    tree_node_impl* next_sibling;
-    tree_node_impl* first_child;
-    tree_node_impl* last_child;
+template <typename... Links>
+struct links {
+    template <typename Link>
+    static constexpr bool has = (std::is_same_v<Link, Links> || ...);
+
+    // iterators can step backwards; not over atomic links, where the way back
+    // may change under a reader
+    static constexpr bool reversible = has<node_link::prev_sibling> && has<node_link::last_child> && !has<node_link::atomic>;
+};
+
+using default_links = links<
+    node_link::parent,
+    node_link::prev_sibling,
+    node_link::next_sibling,
+    node_link::first_child,
+    node_link::last_child>;
+
+// for trees that are only walked forward and appended to
+using forward_links = links<
+    node_link::parent,
+    node_link::next_sibling,
+    node_link::first_child>;
+
+using level_links = links<
+    node_link::parent,
+    node_link::prev_sibling,
+    node_link::next_sibling,
+    node_link::first_child,
+    node_link::last_child,
+    node_link::next_in_level>;
+
+// Ancestor and document order tests in O(1) for two more words per node.
+using labelled_links = links<
+    node_link::parent,
+    node_link::prev_sibling,
+    node_link::next_sibling,
+    node_link::first_child,
+    node_link::last_child,
+    node_link::order_labels>;
+
+// Subtree hashes for change detection between versions of a tree.
+using hashed_links = links<
+    node_link::parent,
+    node_link::prev_sibling,
+    node_link::next_sibling,
+    node_link::first_child,
+    node_link::last_child,
+    node_link::subtree_hash>;
+
+// Subtree sizes in O(1); inserting and erasing then update the sizes along
+// the path to the root, which costs O(depth).
+using sized_links = links<
+    node_link::parent,
+    node_link::prev_sibling,
+    node_link::next_sibling,
+    node_link::first_child,
+    node_link::last_child,
+    node_link::subtree_size>;
+
+// One writer may append_child, prepend_child, insert(insertion::hor, ...),
+// erase_subtree and clear while other threads read inside
+// tree::read_section(). Erased nodes are freed once no reader can hold them.
+// Other mutations, and size(), still need readers kept out. Iterators only
+// move forward, appending and unlinking stay O(1).
+using concurrent_links = links<
+    node_link::parent,
+    node_link::prev_sibling,
+    node_link::next_sibling,
+    node_link::first_child,
+    node_link::last_child,
+    node_link::atomic>;
+
+template <typename T, typename Links = default_links>
+struct tree_node_impl
+    : detail::prev_sibling_field<detail::link_ptr<tree_node_impl<T, Links>, Links::template has<node_link::atomic>>,
+                                 Links::template has<node_link::prev_sibling>>
+    , detail::last_child_field<detail::link_ptr<tree_node_impl<T, Links>, Links::template has<node_link::atomic>>,
+                               Links::template has<node_link::last_child>>
+    , detail::next_in_level_field<tree_node_impl<T, Links>*, Links::template has<node_link::next_in_level>>
+    , detail::order_labels_field<Links::template has<node_link::order_labels>>
+    , detail::subtree_hash_field<Links::template has<node_link::subtree_hash>>
+    , detail::subtree_size_field<Links::template has<node_link::subtree_size>> {
+    static_assert(Links::template has<node_link::parent> &&
+                  Links::template has<node_link::next_sibling> &&
+                  Links::template has<node_link::first_child>,
+                  "nodes need parent, next_sibling and first_child links");
+    static_assert(!Links::template has<node_link::next_in_level> || Links::reversible,
+                  "next_in_level links need prev_sibling and last_child links");
+    static_assert(!Links::template has<node_link::atomic> || !Links::template has<node_link::next_in_level>,
+                  "next_in_level links cannot be atomic");
+    static_assert(!Links::template has<node_link::order_labels> || Links::reversible,
+                  "order labels need prev_sibling and last_child links and no atomic ones");
+    static_assert(!Links::template has<node_link::atomic> || !Links::template has<node_link::subtree_hash>,
+                  "subtree hashes cannot be kept over atomic links");
+    static_assert(!Links::template has<node_link::atomic> || !Links::template has<node_link::subtree_size>,
+                  "subtree sizes cannot be kept over atomic links");
+
+    using links_type = Links;
+    using link_type  = detail::link_ptr<tree_node_impl<T, Links>, Links::template has<node_link::atomic>>;
+    using prev_sibling_base = detail::prev_sibling_field<link_type, Links::template has<node_link::prev_sibling>>;
+    using last_child_base   = detail::last_child_field<link_type, Links::template has<node_link::last_child>>;
+
+    static constexpr bool has_prev_sibling = Links::template has<node_link::prev_sibling>;
+    static constexpr bool has_last_child   = Links::template has<node_link::last_child>;
+    static constexpr bool atomic_links     = Links::template has<node_link::atomic>;
+
+    link_type parent;
+    link_type next_sibling;
+    link_type first_child;
     T value;
 
     template <typename U = T,
               std::enable_if_t<
-                  !std::is_same_v<tree_node_impl<T>, std::decay_t<U>> &&
+                  !std::is_same_v<tree_node_impl<T, Links>, std::decay_t<U>> &&
                   !std::is_convertible_v<U, T> &&
                   std::is_constructible_v<T, U&&>, int> = 0>
     explicit tree_node_impl(U&& value) noexcept(std::is_nothrow_constructible_v<T, U&&>)
         : parent{nullptr}
-        , prev_sibling{nullptr}
         , next_sibling{nullptr}
         , first_child{nullptr}
-        , last_child{nullptr}
         , value{std::forward<U>(value)} {}
 
     template <typename U = T,
               std::enable_if_t<
-                  !std::is_same_v<tree_node_impl<T>, std::decay_t<U>> &&
+                  !std::is_same_v<tree_node_impl<T, Links>, std::decay_t<U>> &&
                   std::is_convertible_v<U, T> &&
                   std::is_constructible_v<T, U&&>, int> = 0>
     tree_node_impl(U&& value) noexcept(std::is_nothrow_constructible_v<T, U&&>)
         : parent{nullptr}
-        , prev_sibling{nullptr}
         , next_sibling{nullptr}
         , first_child{nullptr}
-        , last_child{nullptr}
         , value{std::forward<U>(value)} {}
 
+    // the value is constructed from args in place, as by emplace
+    template <typename... Args>
+    explicit tree_node_impl(std::in_place_t, Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args&&...>)
+        : parent{nullptr}
+        , next_sibling{nullptr}
+        , first_child{nullptr}
+        , value(std::forward<Args>(args)...) {}
+
+    // links the node does not keep are ignored
     template <typename U = T,
               std::enable_if_t<
-                  !std::is_same_v<tree_node_impl<T>, std::decay_t<U>> &&
+                  !std::is_same_v<tree_node_impl<T, Links>, std::decay_t<U>> &&
                   std::is_constructible_v<T, U&&>, int> = 0>
     tree_node_impl(U&& value,
-                   tree_node_impl<T>* parent,
-                   tree_node_impl<T>* prev_sibling,
-                   tree_node_impl<T>* next_sibling,
-                   tree_node_impl<T>* first_child,
-                   tree_node_impl<T>* last_child) noexcept(std::is_nothrow_constructible_v<T, U&&>)
+                   tree_node_impl<T, Links>* parent,
+                   tree_node_impl<T, Links>* prev_sibling,
+                   tree_node_impl<T, Links>* next_sibling,
+                   tree_node_impl<T, Links>* first_child,
+                   tree_node_impl<T, Links>* last_child) noexcept(std::is_nothrow_constructible_v<T, U&&>)
         : parent{parent}
-        , prev_sibling{prev_sibling}
         , next_sibling{next_sibling}
         , first_child{first_child}
-        , last_child{last_child}
-        , value{std::forward<U>(value)} {}
+        , value{std::forward<U>(value)} {
+        set_prev_sibling(prev_sibling);
+        set_last_child(last_child);
+    }
 
     tree_node_impl(const tree_node_impl& other) noexcept(std::is_nothrow_copy_constructible_v<T>)
-        : parent{other.parent}
-        , prev_sibling{other.prev_sibling}
+        : prev_sibling_base{other}
+        , last_child_base{other}
+        , parent{other.parent}
         , next_sibling{other.next_sibling}
         , first_child{other.first_child}
-        , last_child{other.last_child}
         , value{other.value} {}
 
     tree_node_impl(tree_node_impl&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
-        : parent{other.parent}
-        , prev_sibling{other.prev_sibling}
+        : prev_sibling_base{other}
+        , last_child_base{other}
+        , parent{other.parent}
         , next_sibling{other.next_sibling}
         , first_child{other.first_child}
-        , last_child{other.last_child}
-        , value{std::move(value)} {}
+        , value{std::move(other.value)} {}
+
+    void set_prev_sibling([[maybe_unused]] tree_node_impl* node) noexcept {
+        if constexpr (has_prev_sibling) {
+            this->prev_sibling = node;
+        }
+    }
+
+    void set_last_child([[maybe_unused]] tree_node_impl* node) noexcept {
+        if constexpr (has_last_child) {
+            this->last_child = node;
+        }
+    }
+
+    // through the link when it is kept, otherwise by walking the children
+    tree_node_impl* find_last_child() const noexcept {
+        if constexpr (has_last_child) {
+            return this->last_child;
+        } else {
+            tree_node_impl* child = first_child;
+            while (child != nullptr && child->next_sibling != nullptr) {
+                child = child->next_sibling;
+            }
+            return child;
+        }
+    }
+
+    // through the link when it is kept, otherwise by walking from the first sibling
+    tree_node_impl* find_prev_sibling() const noexcept {
+        if constexpr (has_prev_sibling) {
+            return this->prev_sibling;
+        } else {
+            if (parent == nullptr || parent->first_child == this) {
+                return nullptr;
+            }
+            tree_node_impl* sibling = parent->first_child;
+            while (sibling->next_sibling != this) {
+                sibling = sibling->next_sibling;
+            }
+            return sibling;
+        }
+    }
 };
 
-template <typename T>
-struct tree_node : private tree_node_impl<T>, private detail::enable_special_members<T> {
-    using impl = tree_node_impl<T>;
+template <typename T, typename Links = default_links>
+struct tree_node : private tree_node_impl<T, Links>, private detail::enable_special_members<T> {
+    using impl = tree_node_impl<T, Links>;
+    using links_type = Links;
 
     template <typename U = T,
               std::enable_if_t<
-                  !std::is_same_v<tree_node<T>, std::decay_t<U>> &&
+                  !std::is_same_v<tree_node<T, Links>, std::decay_t<U>> &&
                   !std::is_convertible_v<U, T> &&
                   std::is_constructible_v<T, U&&>, int> = 0>
     explicit tree_node(U&& value) noexcept(std::is_nothrow_constructible_v<T, U&&>)
-        : tree_node_impl<T>{std::forward<U>(value)} {}
+        : tree_node_impl<T, Links>{std::forward<U>(value)} {}
 
     template <typename U = T,
               std::enable_if_t<
-                  !std::is_same_v<tree_node<T>, std::decay_t<U>> &&
+                  !std::is_same_v<tree_node<T, Links>, std::decay_t<U>> &&
                   std::is_convertible_v<U, T> &&
                   std::is_constructible_v<T, U&&>, int> = 0>
     tree_node(U&& value) noexcept(std::is_nothrow_constructible_v<T, U&&>)
-        : tree_node_impl<T>{std::forward<U>(value)} {}
+        : tree_node_impl<T, Links>{std::forward<U>(value)} {}
+
+    template <typename... Args>
+    explicit tree_node(std::in_place_t, Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args&&...>)
+        : tree_node_impl<T, Links>{std::in_place, std::forward<Args>(args)...} {}
 
     template <typename U = T,
               std::enable_if_t<
-                  !std::is_same_v<tree_node<T>, std::decay_t<U>> &&
+                  !std::is_same_v<tree_node<T, Links>, std::decay_t<U>> &&
                   std::is_constructible_v<T, U&&>, int> = 0>
     tree_node(U&& value,
-              tree_node<T>* parent,
-              tree_node<T>* prev_sibling,
-              tree_node<T>* next_sibling,
-              tree_node<T>* first_child,
-              tree_node<T>* last_child) noexcept(std::is_nothrow_constructible_v<T, U&&>)
-        : tree_node_impl<T>{
+              tree_node<T, Links>* parent,
+              tree_node<T, Links>* prev_sibling,
+              tree_node<T, Links>* next_sibling,
+              tree_node<T, Links>* first_child,
+              tree_node<T, Links>* last_child) noexcept(std::is_nothrow_constructible_v<T, U&&>)
+        : tree_node_impl<T, Links>{
             std::forward<U>(value),
             parent,
             prev_sibling,
@@ -153,23 +542,89 @@ struct tree_node : private tree_node_impl<T>, private detail::enable_special_mem
         } {}
 
     tree_node* prev_sibling() const noexcept {
-        return reinterpret_cast<tree_node*>(impl::prev_sibling);
+        static_assert(impl::has_prev_sibling, "node does not keep prev_sibling links");
+        return reinterpret_cast<tree_node*>(static_cast<impl*>(impl::prev_sibling));
     }
 
     tree_node* next_sibling() const noexcept {
-        return reinterpret_cast<tree_node*>(impl::next_sibling);
+        return reinterpret_cast<tree_node*>(static_cast<impl*>(impl::next_sibling));
     }
 
     tree_node* first_child() const noexcept {
-        return reinterpret_cast<tree_node*>(impl::first_child);
+        return reinterpret_cast<tree_node*>(static_cast<impl*>(impl::first_child));
     }
 
     tree_node* last_child() const noexcept {
-        return reinterpret_cast<tree_node*>(impl::last_child);
+        static_assert(impl::has_last_child, "node does not keep last_child links");
+        return reinterpret_cast<tree_node*>(static_cast<impl*>(impl::last_child));
     }
 
     tree_node* parent() const noexcept {
-        return reinterpret_cast<tree_node*>(impl::parent);
+        return reinterpret_cast<tree_node*>(static_cast<impl*>(impl::parent));
+    }
+
+    tree_node* next_in_level() const noexcept {
+        static_assert(Links::template has<node_link::next_in_level>, "node does not keep next_in_level links");
+        return reinterpret_cast<tree_node*>(impl::next_in_level);
+    }
+
+    void set_next_in_level(tree_node* node) noexcept {
+        static_assert(Links::template has<node_link::next_in_level>, "node does not keep next_in_level links");
+        impl::next_in_level = node;
+    }
+
+    // labels for entering and leaving the node, see tree_storage
+    std::uint64_t order_label(bool exit) const noexcept {
+        static_assert(Links::template has<node_link::order_labels>, "node does not keep order labels");
+        return exit ? impl::exit_label : impl::enter_label;
+    }
+
+    void set_order_label(bool exit, std::uint64_t label) noexcept {
+        static_assert(Links::template has<node_link::order_labels>, "node does not keep order labels");
+        (exit ? impl::exit_label : impl::enter_label) = label;
+    }
+
+    // cached hash of the subtree, see tree_storage
+    bool has_subtree_hash() const noexcept {
+        static_assert(Links::template has<node_link::subtree_hash>, "node does not keep subtree hashes");
+        return impl::hash_value.load(std::memory_order_relaxed) != 0;
+    }
+
+    std::uint64_t subtree_hash() const noexcept {
+        static_assert(Links::template has<node_link::subtree_hash>, "node does not keep subtree hashes");
+        return impl::hash_value.load(std::memory_order_relaxed);
+    }
+
+    void set_subtree_hash(std::uint64_t hash) const noexcept {
+        static_assert(Links::template has<node_link::subtree_hash>, "node does not keep subtree hashes");
+        assert(hash != 0);
+        impl::hash_value.store(hash, std::memory_order_relaxed);
+    }
+
+    void clear_subtree_hash() const noexcept {
+        static_assert(Links::template has<node_link::subtree_hash>, "node does not keep subtree hashes");
+        impl::hash_value.store(0, std::memory_order_relaxed);
+    }
+
+    // number of nodes in the subtree, this one included, see tree_storage
+    size_t subtree_size() const noexcept {
+        static_assert(Links::template has<node_link::subtree_size>, "node does not keep subtree sizes");
+        return impl::subtree_count;
+    }
+
+    void set_subtree_size(size_t count) noexcept {
+        static_assert(Links::template has<node_link::subtree_size>, "node does not keep subtree sizes");
+        impl::subtree_count = count;
+    }
+
+    // These two work for every link policy: O(1) when the link is kept,
+    // a walk over the siblings otherwise.
+    tree_node* find_last_child() const noexcept {
+        return reinterpret_cast<tree_node*>(impl::find_last_child());
+    }
+
+    tree_node* find_prev_sibling() const noexcept {
+        return reinterpret_cast<tree_node*>(impl::find_prev_sibling());
     }
 
     T& value() noexcept {
@@ -180,145 +635,202 @@ struct tree_node : private tree_node_impl<T>, private detail::enable_special_mem
         return impl::value;
     }
 
+    // The value as handed out by iterators and traversers, which may change
+    // it: with subtree hashes, the hashes of the node and its ancestors are
+    // dropped first, so a stored hash is never stale. O(1) amortized, since
+    // the walk stops at the first node without a hash, and no ancestor of
+    // that one has a hash either.
+    T& mutable_value() noexcept {
+        if constexpr (Links::template has<node_link::subtree_hash> && !std::is_const_v<T>) {
+            for (tree_node* node = this; node != nullptr && node->has_subtree_hash(); node = node->parent()) {
+                node->clear_subtree_hash();
+            }
+        }
+        return impl::value;
+    }
+
     void push_back_child(tree_node* child) noexcept {
         auto child_impl = static_cast<impl*>(child);
         auto self_impl = static_cast<impl*>(this);
 
-        if (self_impl->first_child == nullptr) {
-            self_impl->first_child = child;
+        impl* last = self_impl->find_last_child();
+        // the child is fully linked before it becomes reachable
+        child_impl->set_prev_sibling(last);
+        child_impl->parent = self_impl;
+        self_impl->set_last_child(child_impl);
+        if (last != nullptr) {
+            last->next_sibling = child_impl;
+        } else {
+            self_impl->first_child = child_impl;
         }
+    }
 
-        if (self_impl->last_child != nullptr) {
-            self_impl->last_child->next_sibling = child;
-            child_impl->prev_sibling = self_impl->last_child;
-        }
+    // Safe against other concurrent_push_back_child calls on the same node:
+    // the child claims the last_child slot by CAS and then links itself
+    // behind the node it displaced, which only this call writes to.
+    void concurrent_push_back_child(tree_node* child) noexcept {
+        static_assert(impl::atomic_links && impl::has_last_child,
+                      "concurrent_push_back_child needs atomic links with last_child");
+        auto child_impl = static_cast<impl*>(child);
+        auto self_impl = static_cast<impl*>(this);
 
-        self_impl->last_child = child;
-        child_impl->parent = this;
+        child_impl->parent = self_impl;
+        impl* last = self_impl->last_child;
+        do {
+            child_impl->set_prev_sibling(last);
+        } while (!self_impl->last_child.compare_exchange(last, child_impl));
+
+        if (last != nullptr) {
+            last->next_sibling = child_impl;
+        } else {
+            self_impl->first_child = child_impl;
+        }
     }
 
     void push_front_child(tree_node* child) noexcept {
         auto child_impl = static_cast<impl*>(child);
         auto self_impl = static_cast<impl*>(this);
 
-        if (self_impl->last_child == nullptr) {
-            self_impl->last_child = child_impl;
-        }
-
-        if (self_impl->first_child != nullptr) {
-            self_impl->first_child->prev_sibling = child_impl;
-            child_impl->next_sibling = self_impl->first_child;
+        impl* first = self_impl->first_child;
+        child_impl->next_sibling = first;
+        child_impl->parent = self_impl;
+        if (first != nullptr) {
+            first->set_prev_sibling(child_impl);
+        } else {
+            self_impl->set_last_child(child_impl);
         }
 
         self_impl->first_child = child_impl;
-        child_impl->parent = this;
     }
 
     void unlink_child(tree_node* child) noexcept {
         auto child_impl = static_cast<impl*>(child);
         auto self_impl = static_cast<impl*>(this);
+        impl* prev = child_impl->find_prev_sibling();
+        impl* next = child_impl->next_sibling;
 
-        if (child_impl->prev_sibling != nullptr) {
-            child_impl->prev_sibling->next_sibling = child_impl->next_sibling;
-        }
-
-        if (child_impl->next_sibling != nullptr) {
-            child_impl->next_sibling->prev_sibling = child_impl->prev_sibling;
+        if (prev != nullptr) {
+            prev->next_sibling = next;
+        } else {
+            self_impl->first_child = next;
         }
 
-        if (self_impl->first_child == child_impl) {
-            self_impl->first_child = child_impl->next_sibling;
+        if (next != nullptr) {
+            next->set_prev_sibling(prev);
+        } else {
+            self_impl->set_last_child(prev);
         }
 
-        if (self_impl->last_child == child_impl) {
-            self_impl->last_child = child_impl->prev_sibling;
+        // a reader standing in the unlinked subtree finds its way back out
+        if constexpr (!impl::atomic_links) {
+            child_impl->parent = nullptr;
+            child_impl->set_prev_sibling(nullptr);
+            child_impl->next_sibling = nullptr;
         }
-
-        child_impl->parent = nullptr;
-        child_impl->prev_sibling = nullptr;
-        child_impl->next_sibling = nullptr;
     }
 
     friend void replace(tree_node* old_node, tree_node* new_node) noexcept {
         auto old_impl = static_cast<impl*>(old_node);
         auto new_impl = static_cast<impl*>(new_node);
         impl* parent = old_impl->parent;
+        impl* prev = old_impl->find_prev_sibling();
+        impl* next = old_impl->next_sibling;
 
         new_impl->parent = parent;
-        if (parent != nullptr) {
-            if (parent->first_child == old_impl) {
-                parent->first_child = new_impl;
-            }
-            if (parent->last_child == old_impl) {
-                parent->last_child = new_impl;
-            }
-        }
+        new_impl->set_prev_sibling(prev);
+        new_impl->next_sibling = next;
 
-        new_impl->prev_sibling = old_impl->prev_sibling;
-        if (old_impl->prev_sibling != nullptr) {
-            old_impl->prev_sibling->next_sibling = new_impl;
+        if (prev != nullptr) {
+            prev->next_sibling = new_impl;
+        } else if (parent != nullptr) {
+            parent->first_child = new_impl;
         }
-        new_impl->next_sibling = old_impl->next_sibling;
-        if (old_impl->next_sibling != nullptr) {
-            old_impl->next_sibling->prev_sibling = new_impl;
+
+        if (next != nullptr) {
+            next->set_prev_sibling(new_impl);
+        } else if (parent != nullptr) {
+            parent->set_last_child(new_impl);
         }
 
-        old_impl->parent       = nullptr;
-        old_impl->prev_sibling = nullptr;
+        old_impl->parent = nullptr;
+        old_impl->set_prev_sibling(nullptr);
         old_impl->next_sibling = nullptr;
     }
 
+    // links new_node in front of old_node
     friend void insert_sibling(tree_node* old_node, tree_node* new_node) noexcept {
         auto old_impl = static_cast<impl*>(old_node);
         auto new_impl = static_cast<impl*>(new_node);
         impl* parent = old_impl->parent;
+        impl* prev = old_impl->find_prev_sibling();
 
         assert(parent != nullptr);
         new_impl->parent = parent;
-        if (parent->first_child == old_impl) {
+        new_impl->set_prev_sibling(prev);
+        new_impl->next_sibling = old_impl;
+
+        if (prev != nullptr) {
+            prev->next_sibling = new_impl;
+        } else {
             parent->first_child = new_impl;
         }
+        old_impl->set_prev_sibling(new_impl);
+    }
 
-        new_impl->prev_sibling = old_impl->prev_sibling;
-        new_impl->next_sibling = old_impl;
+    // links new_node right after old_node, O(1) for every link policy
+    friend void append_sibling(tree_node* old_node, tree_node* new_node) noexcept {
+        auto old_impl = static_cast<impl*>(old_node);
+        auto new_impl = static_cast<impl*>(new_node);
+        impl* parent = old_impl->parent;
+        impl* next = old_impl->next_sibling;
+
+        assert(parent != nullptr);
+        new_impl->parent = parent;
+        new_impl->set_prev_sibling(old_impl);
+        new_impl->next_sibling = next;
+        old_impl->next_sibling = new_impl;
 
-        if (old_impl->prev_sibling != nullptr) {
-            old_impl->prev_sibling->next_sibling = new_impl;
+        if (next != nullptr) {
+            next->set_prev_sibling(new_impl);
+        } else {
+            parent->set_last_child(new_impl);
         }
-        old_impl->prev_sibling = new_impl;
     }
 };
 
 template <typename T, typename Allocator>
 class tree;
 
-template <typename T>
+template <typename T, typename Links = default_links>
 class tree_traverser {
 public:
-    tree_traverser(tree_node<T>* node)
+    tree_traverser(tree_node<T, Links>* node)
         : curr_node{ node } {}
 
     tree_traverser(const tree_traverser& other) = default;
     tree_traverser(tree_traverser&& other) = default;
 
-    tree_traverser<T> prev_sibling() const noexcept {
-        return tree_traverser<T>{ curr_node->prev_sibling() };
+    tree_traverser& operator = (const tree_traverser& other) = default;
+    tree_traverser& operator = (tree_traverser&& other) = default;
+
+    tree_traverser<T, Links> prev_sibling() const noexcept {
+        return tree_traverser<T, Links>{ curr_node->prev_sibling() };
     }
 
-    tree_traverser<T> next_sibling() const noexcept {
-        return tree_traverser<T>{ curr_node->next_sibling() };
+    tree_traverser<T, Links> next_sibling() const noexcept {
+        return tree_traverser<T, Links>{ curr_node->next_sibling() };
     }
 
-    tree_traverser<T> first_child() const noexcept {
-        return tree_traverser<T>{ curr_node->first_child() };
+    tree_traverser<T, Links> first_child() const noexcept {
+        return tree_traverser<T, Links>{ curr_node->first_child() };
     }
 
-    tree_traverser<T> last_child() const noexcept {
-        return tree_traverser<T>{ curr_node->last_child() };
+    tree_traverser<T, Links> last_child() const noexcept {
+        return tree_traverser<T, Links>{ curr_node->last_child() };
     }
 
-    tree_traverser<T> parent() const noexcept {
-        return tree_traverser<T>{ curr_node->parent() };
+    tree_traverser<T, Links> parent() const noexcept {
+        return tree_traverser<T, Links>{ curr_node->parent() };
     }
 
     bool has_prev_sibling() noexcept {
@@ -362,7 +874,7 @@ public:
     }
 
     T& value() noexcept {
-        return curr_node->value();
+        return curr_node->mutable_value();
     }
 
     const T& value() const noexcept {
@@ -370,7 +882,7 @@ public:
     }
 
 private:
-    bool to_node(tree_node<T>* next) noexcept {
+    bool to_node(tree_node<T, Links>* next) noexcept {
         if (next) {
             curr_node = next;
             return true;
@@ -379,100 +891,116 @@ private:
         }
     }
 
-    tree_node<T>* curr_node;
+    tree_node<T, Links>* curr_node;
 };
 
-template <typename T>
+template <typename T, typename Links = default_links>
 class tree_iterator {
 public:
     using value_type = std::remove_cv_t<T>;
     using pointer = T*;
     using reference = T&;
     using difference_type = intptr_t;
-    using iterator_category = std::bidirectional_iterator_tag;
+    using iterator_category = std::conditional_t<Links::reversible, std::bidirectional_iterator_tag, std::forward_iterator_tag>;
 
     template <typename, typename>
     friend class tree;
 
     tree_iterator() noexcept
-        : curr_node{nullptr} {}
+        : curr_node{nullptr}
+        , prev_node{nullptr} {}
 
-    explicit tree_iterator(tree_node<T>* node, tree_node<T>* prev_node) noexcept
+    explicit tree_iterator(tree_node<T, Links>* node, tree_node<T, Links>* prev_node) noexcept
         : curr_node{node}
         , prev_node{prev_node} {}
 
     tree_iterator(const tree_iterator& other) noexcept = default;
     tree_iterator(tree_iterator&& other) noexcept = default;
 
-    virtual ~tree_iterator() noexcept = default;
+    tree_iterator& operator = (const tree_iterator& other) noexcept = default;
+    tree_iterator& operator = (tree_iterator&& other) noexcept = default;
 
     bool operator == (const tree_iterator& other) const noexcept {
         return curr_node == other.curr_node
             && prev_node == other.prev_node;
     }
 
+    // the ranges below end once the walk runs off the tree
+    bool operator == (std::default_sentinel_t) const noexcept {
+        return curr_node == nullptr;
+    }
+
     bool operator != (const tree_iterator& other) const noexcept {
         return !(*this == other);
     }
 
     T& operator * () const noexcept {
-        return curr_node->value();
+        return curr_node->mutable_value();
     }
 
     T* operator -> () const noexcept {
-        return &curr_node->value();
+        return &curr_node->mutable_value();
     }
 
-    tree_traverser<T> as_traverser() {
-        return tree_traverser<T>{ curr_node };
+    tree_traverser<T, Links> as_traverser() {
+        return tree_traverser<T, Links>{ curr_node };
     }
 
-    tree_traverser<const T> as_traverser() const {
-        return tree_traverser<const T>{ curr_node };
+    tree_traverser<const T, Links> as_traverser() const {
+        return tree_traverser<const T, Links>{ curr_node };
     }
 
 protected:
-    tree_node<T>* curr_node;
-    tree_node<T>* prev_node;
+    tree_node<T, Links>* curr_node;
+    // the node before curr_node, only kept for reversible links
+    tree_node<T, Links>* prev_node;
 };
 
-template <typename T>
-class pre_order_iterator : public tree_iterator<T> {
+template <typename T, typename Links = default_links>
+class pre_order_iterator : public tree_iterator<T, Links> {
 public:
-    using tree_iterator<T>::curr_node;
-    using tree_iterator<T>::prev_node;
+    using tree_iterator<T, Links>::curr_node;
+    using tree_iterator<T, Links>::prev_node;
 
     pre_order_iterator() noexcept = default;
 
-    explicit pre_order_iterator(tree_node<T>* node, tree_node<T>* prev_node) noexcept
-        : tree_iterator<T>{node, prev_node} {}
+    explicit pre_order_iterator(tree_node<T, Links>* node, tree_node<T, Links>* prev_node) noexcept
+        : tree_iterator<T, Links>{node, prev_node} {}
 
-    explicit pre_order_iterator(tree_node<T>* node) noexcept
-        : tree_iterator<T>{node, get_prev_node(node)} {}
+    explicit pre_order_iterator(tree_node<T, Links>* node) noexcept
+        : tree_iterator<T, Links>{node, get_prev_node(node)} {}
 
     pre_order_iterator(const pre_order_iterator& other) noexcept = default;
     pre_order_iterator(pre_order_iterator&& other) noexcept = default;
 
+    pre_order_iterator& operator = (const pre_order_iterator& other) noexcept = default;
+    pre_order_iterator& operator = (pre_order_iterator&& other) noexcept = default;
+
     ~pre_order_iterator() noexcept = default;
 
     pre_order_iterator& operator ++ () noexcept {
-        prev_node = curr_node;
-        if (curr_node->first_child() != nullptr) {
-            curr_node = curr_node->first_child();
-        } else {
-            while (curr_node != nullptr && curr_node->next_sibling() == nullptr) {
-                curr_node = curr_node->parent();
-            }
+        if constexpr (Links::reversible) {
+            prev_node = curr_node;
+        }
+        // every link is read once, it may change under a concurrent reader
+        if (tree_node<T, Links>* child = curr_node->first_child()) {
+            curr_node = child;
+            return *this;
+        }
 
-            if (curr_node != nullptr) {
-                curr_node = curr_node->next_sibling();
+        while (curr_node != nullptr) {
+            if (tree_node<T, Links>* sibling = curr_node->next_sibling()) {
+                curr_node = sibling;
+                return *this;
             }
+            curr_node = curr_node->parent();
         }
 
         return *this;
     }
 
     pre_order_iterator& operator -- () noexcept {
+        static_assert(Links::reversible, "pre_order_iterator needs prev_sibling and last_child links to move backwards");
         curr_node = prev_node;
         if (prev_node != nullptr) {
             if (prev_node->prev_sibling() != nullptr) {
@@ -495,298 +1023,2584 @@ public:
     }
 
     pre_order_iterator operator -- (int) noexcept {
+        static_assert(Links::reversible, "pre_order_iterator needs prev_sibling and last_child links to move backwards");
         pre_order_iterator tmp = *this;
         --(*this);
         return tmp;
     }
 
 private:
-    static tree_node<T>* get_prev_node(tree_node<T>* node) noexcept {
-        if (node->prev_sibling() != nullptr) {
-            node = node->prev_sibling();
-            while (node->last_child() != nullptr) {
-                node = node->last_child();
+    static tree_node<T, Links>* get_prev_node([[maybe_unused]] tree_node<T, Links>* node) noexcept {
+        if constexpr (Links::reversible) {
+            if (node->prev_sibling() != nullptr) {
+                node = node->prev_sibling();
+                while (node->last_child() != nullptr) {
+                    node = node->last_child();
+                }
+            } else {
+                node = node->parent();
             }
+            return node;
         } else {
-            node = node->parent();
+            return nullptr;
         }
-        return node;
     }
 };
 
-template <typename T, typename Allocator = std::allocator<tree_node<T>>>
-struct tree_storage {
-    using allocator_traits = std::allocator_traits<Allocator>;
+template <typename T, typename Links = default_links>
+class post_order_iterator : public tree_iterator<T, Links> {
+public:
+    using tree_iterator<T, Links>::curr_node;
+    using tree_iterator<T, Links>::prev_node;
 
-    tree_storage(Allocator alloc = Allocator{}) noexcept
-        : alloc{std::move(alloc)}
-        , root{nullptr} {}
+    post_order_iterator() noexcept = default;
 
-    template <typename U,
-              std::enable_if_t<
-                  !std::is_same_v<tree_storage<T>, std::decay_t<U>> &&
-                  !std::is_convertible_v<U, T> &&
-                  std::is_constructible_v<tree_node<T>, U&&>, int> = 0>
-    explicit tree_storage(U&& value, Allocator alloc = Allocator{}) noexcept(std::is_nothrow_constructible_v<tree_node<T>, U&&>)
-        : alloc{std::move(alloc)}
-        , root{create_node(this->alloc, std::forward<U>(value))} {}
+    explicit post_order_iterator(tree_node<T, Links>* node, tree_node<T, Links>* prev_node) noexcept
+        : tree_iterator<T, Links>{node, prev_node} {}
 
-    template <typename U,
-              std::enable_if_t<
-                  !std::is_same_v<tree_storage<T>, std::decay_t<U>> &&
-                  std::is_convertible_v<U, T> &&
-                  std::is_constructible_v<tree_node<T>, U&&>, int> = 0>
-    tree_storage(U&& value, Allocator alloc = Allocator{}) noexcept(std::is_nothrow_constructible_v<tree_node<T>, U&&>)
-        : alloc{std::move(alloc)}
-        , root{create_node(this->alloc, std::forward<U>(value))} {}
+    explicit post_order_iterator(tree_node<T, Links>* node) noexcept
+        : tree_iterator<T, Links>{node, get_prev_node(node)} {}
 
-    tree_storage(const tree_storage& other) noexcept(std::is_nothrow_copy_constructible_v<tree_node<T>>)
-        : alloc{other.alloc}
-        , root{create_node(this->alloc, other.root)} {}
+    post_order_iterator(const post_order_iterator& other) noexcept = default;
+    post_order_iterator(post_order_iterator&& other) noexcept = default;
 
-    tree_storage(tree_storage&& other) noexcept(std::is_nothrow_move_constructible_v<tree_node<T>>)
-        : alloc{std::move(other.alloc)}
-        , root{other.root} {}
+    post_order_iterator& operator = (const post_order_iterator& other) noexcept = default;
+    post_order_iterator& operator = (post_order_iterator&& other) noexcept = default;
 
-    virtual ~tree_storage() noexcept {
-        clear();
+    ~post_order_iterator() noexcept = default;
+
+    post_order_iterator& operator ++ () noexcept {
+        if constexpr (Links::reversible) {
+            prev_node = curr_node;
+        }
+        if (curr_node->next_sibling() != nullptr) {
+            curr_node = first_leaf(curr_node->next_sibling());
+        } else {
+            curr_node = curr_node->parent();
+        }
+
+        return *this;
     }
 
-    void clear_node_impl(tree_node<T>* node) noexcept {
-        assert(node != nullptr);
-        if (node->first_child() != nullptr) {
-            tree_node<T>* curr_node = node->first_child();
-            while (curr_node != nullptr) {
-                tree_node<T>* tmp = curr_node->next_sibling();
-                clear_node_impl(curr_node);
-                curr_node = tmp;
-            }
+    post_order_iterator& operator -- () noexcept {
+        static_assert(Links::reversible, "post_order_iterator needs prev_sibling and last_child links to move backwards");
+        curr_node = prev_node;
+        if (prev_node != nullptr) {
+            prev_node = get_prev_node(prev_node);
         }
 
-        allocator_traits::destroy(alloc, node);
-        allocator_traits::deallocate(alloc, node, 1);
+        return *this;
     }
 
-    template <typename... Args>
-    static tree_node<T>* create_node(Allocator& alloc, Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args&&...>) {
-        tree_node<T>* node = allocator_traits::allocate(alloc, 1);
-        allocator_traits::construct(alloc, node, std::forward<Args>(args)...);
-        return node;
+    post_order_iterator operator ++ (int) noexcept {
+        post_order_iterator tmp = *this;
+        ++(*this);
+        return tmp;
     }
 
-    void clear() noexcept {
-        if (root != nullptr) {
-            clear_node_impl(root);
+    post_order_iterator operator -- (int) noexcept {
+        static_assert(Links::reversible, "post_order_iterator needs prev_sibling and last_child links to move backwards");
+        post_order_iterator tmp = *this;
+        --(*this);
+        return tmp;
+    }
+
+    // first node of the subtree in post-order
+    static tree_node<T, Links>* first_leaf(tree_node<T, Links>* node) noexcept {
+        while (node->first_child() != nullptr) {
+            node = node->first_child();
         }
+        return node;
     }
 
-    Allocator alloc;
-    tree_node<T>* root;
+private:
+    static tree_node<T, Links>* get_prev_node([[maybe_unused]] tree_node<T, Links>* node) noexcept {
+        if constexpr (Links::reversible) {
+            if (node->last_child() != nullptr) {
+                return node->last_child();
+            }
+
+            while (node != nullptr && node->prev_sibling() == nullptr) {
+                node = node->parent();
+            }
+            return node != nullptr ? node->prev_sibling() : nullptr;
+        } else {
+            return nullptr;
+        }
+    }
 };
+namespace detail {
+    // Growable FIFO queue of pointers. The storage is kept between passes, so
+    // a queue that is reused performs no allocation once it is large enough.
+    template <typename T>
+    class ring_buffer {
+    public:
+        static_assert(std::is_trivially_copyable_v<T>, "ring_buffer holds trivially copyable values only");
 
-template <typename T>
-class pre_order_view;
+        ring_buffer() noexcept
+            : head{0}
+            , count{0} {}
 
-namespace insertion {
-    struct vert_tag {};
-    struct hor_tag {};
+        ring_buffer(const ring_buffer&) = delete;
+        ring_buffer& operator = (const ring_buffer&) = delete;
 
-    inline constexpr vert_tag vert;
-    inline constexpr hor_tag hor;
-}
+        bool empty() const noexcept {
+            return count == 0;
+        }
 
-template <typename T, typename Allocator = std::allocator<tree_node<T>>>
-class tree
-    : private tree_storage<T, Allocator>
-    , private detail::enable_special_members<T> {
-    using base = tree_storage<T, Allocator>;
+        size_t size() const noexcept {
+            return count;
+        }
 
-    friend class pre_order_view<T>;
+        void clear() noexcept {
+            head = 0;
+            count = 0;
+        }
 
-public:
-    using allocator_type  = Allocator;
-    using value_type      = T;
-    using node_type       = tree_node<T>;
-    using reference       = value_type&;
-    using const_reference = const value_type&;
-    using pointer         = value_type*;
-    using const_pointer   = const value_type*;
-    using size_type       = size_t;
-    using difference_type = ptrdiff_t;
+        void push_back(T value) {
+            if (count == buffer.size()) {
+                grow();
+            }
+            buffer[(head + count) & (buffer.size() - 1)] = value;
+            count++;
+        }
+
+        T pop_front() noexcept {
+            assert(count != 0);
+            T value = buffer[head];
+            head = (head + 1) & (buffer.size() - 1);
+            count--;
+            return value;
+        }
+
+    private:
+        void grow() {
+            // capacity stays a power of two so wrapping is a mask
+            std::vector<T> bigger(buffer.empty() ? 64 : buffer.size() * 2);
+            for (size_t i = 0; i < count; i++) {
+                bigger[i] = buffer[(head + i) & (buffer.size() - 1)];
+            }
+            buffer.swap(bigger);
+            head = 0;
+        }
+
+        std::vector<T> buffer;
+        size_t head;
+        size_t count;
+    };
+}
+
+// Breadth-first iterator over a queue owned by level_order_view. Copies share
+// the queue, so it is a single-pass iterator.
+template <typename T, typename Links = default_links>
+class level_order_iterator : public tree_iterator<T, Links> {
+public:
+    using tree_iterator<T, Links>::curr_node;
+    using iterator_category = std::input_iterator_tag;
+    using queue_type = detail::ring_buffer<tree_node<T, Links>*>;
+
+    level_order_iterator() noexcept = default;
+
+    explicit level_order_iterator(tree_node<T, Links>* node, queue_type* queue = nullptr) noexcept
+        : tree_iterator<T, Links>{node, nullptr}
+        , queue{queue}
+        , curr_depth{0}
+        , level_remaining{1}
+        , next_level_count{0} {}
+
+    level_order_iterator(const level_order_iterator& other) noexcept = default;
+    level_order_iterator(level_order_iterator&& other) noexcept = default;
+
+    level_order_iterator& operator = (const level_order_iterator& other) noexcept = default;
+    level_order_iterator& operator = (level_order_iterator&& other) noexcept = default;
+
+    ~level_order_iterator() noexcept = default;
+
+    level_order_iterator& operator ++ () {
+        assert(queue != nullptr);
+        for (tree_node<T, Links>* child = curr_node->first_child(); child != nullptr; child = child->next_sibling()) {
+            queue->push_back(child);
+            next_level_count++;
+        }
+
+        if (--level_remaining == 0) {
+            curr_depth++;
+            level_remaining = next_level_count;
+            next_level_count = 0;
+        }
+
+        curr_node = queue->empty() ? nullptr : queue->pop_front();
+        return *this;
+    }
+
+    level_order_iterator operator ++ (int) {
+        level_order_iterator tmp = *this;
+        ++(*this);
+        return tmp;
+    }
+
+    // depth of the current node, the root being at 0
+    size_t depth() const noexcept {
+        return curr_depth;
+    }
+
+private:
+    queue_type* queue;
+    size_t curr_depth;
+    size_t level_remaining;
+    size_t next_level_count;
+};
+
+// Breadth-first iterator for nodes with next_in_level links: a pointer chase
+// along each level, moving to the first child found on a level at its end.
+template <typename T, typename Links = level_links>
+class level_link_iterator : public tree_iterator<T, Links> {
+public:
+    using tree_iterator<T, Links>::curr_node;
+    using iterator_category = std::forward_iterator_tag;
+
+    level_link_iterator() noexcept = default;
+
+    explicit level_link_iterator(tree_node<T, Links>* node) noexcept
+        : tree_iterator<T, Links>{node, nullptr}
+        , level_head{node}
+        , curr_depth{0} {}
+
+    level_link_iterator(const level_link_iterator& other) noexcept = default;
+    level_link_iterator(level_link_iterator&& other) noexcept = default;
+
+    level_link_iterator& operator = (const level_link_iterator& other) noexcept = default;
+    level_link_iterator& operator = (level_link_iterator&& other) noexcept = default;
+
+    ~level_link_iterator() noexcept = default;
+
+    level_link_iterator& operator ++ () noexcept {
+        if (curr_node->next_in_level() != nullptr) {
+            curr_node = curr_node->next_in_level();
+        } else {
+            tree_node<T, Links>* parent = level_head;
+            while (parent != nullptr && parent->first_child() == nullptr) {
+                parent = parent->next_in_level();
+            }
+            curr_node = parent != nullptr ? parent->first_child() : nullptr;
+            level_head = curr_node;
+            curr_depth++;
+        }
+
+        return *this;
+    }
+
+    level_link_iterator operator ++ (int) noexcept {
+        level_link_iterator tmp = *this;
+        ++(*this);
+        return tmp;
+    }
+
+    // depth of the current node, the root being at 0
+    size_t depth() const noexcept {
+        return curr_depth;
+    }
+
+private:
+    tree_node<T, Links>* level_head;
+    size_t curr_depth;
+};
+
+// Orders tree::relayout can place the nodes in.
+enum class layout_order {
+    pre_order,     // every subtree is contiguous, matching pre_order_view
+    level_order,   // every level is contiguous, matching level_order_view
+    van_emde_boas, // recursive blocks of subtrees, good for root-to-leaf paths at any block size
+};
+
+template <typename T, typename Allocator = std::allocator<tree_node<T>>>
+struct tree_storage {
+    using allocator_traits = std::allocator_traits<Allocator>;
+    using node_type        = typename allocator_traits::value_type;
+
+    // Nodes allocated together by one sized allocation (see copy_node_impl).
+    // Such nodes cannot be handed back to the allocator one by one, so the
+    // block is returned once the last of its nodes is released. Nodes spliced
+    // to another tree keep their block: both trees then list it, and the one
+    // that frees its last node returns it. A block whose nodes are all gone
+    // may stay listed by the other tree until that one prunes it.
+    //
+    // Each tree keeps its own table, so freeing a node never synchronizes
+    // with other trees. The price is a deliberate exception to O(1) splices
+    // between trees: a node does not know its block, so the blocks a spliced
+    // subtree uses are found by walking it, unless the destination lists
+    // every block of the source already. Listing all of the source's blocks
+    // would skip the walk, but the destination would then keep blocks it has
+    // no nodes in, and the source could no longer free those in bulk.
+    struct node_block {
+        node_type* nodes = nullptr;
+        size_t size = 0;
+        std::atomic<size_t> live{0};
+    };
+
+    tree_storage(Allocator alloc = Allocator{}) noexcept
+        : alloc{std::move(alloc)}
+        , root{nullptr}
+        , node_count{0} {}
+
+    template <typename U,
+              std::enable_if_t<
+                  !std::is_same_v<tree_storage<T, Allocator>, std::decay_t<U>> &&
+                  !std::is_convertible_v<U, T> &&
+                  std::is_constructible_v<node_type, U&&>, int> = 0>
+    explicit tree_storage(U&& value, Allocator alloc = Allocator{}) noexcept(std::is_nothrow_constructible_v<node_type, U&&>)
+        : alloc{std::move(alloc)}
+        , root{create_node(this->alloc, std::forward<U>(value))}
+        , node_count{1} {
+        reset_cached_state();
+    }
+
+    template <typename U,
+              std::enable_if_t<
+                  !std::is_same_v<tree_storage<T, Allocator>, std::decay_t<U>> &&
+                  std::is_convertible_v<U, T> &&
+                  std::is_constructible_v<node_type, U&&>, int> = 0>
+    tree_storage(U&& value, Allocator alloc = Allocator{}) noexcept(std::is_nothrow_constructible_v<node_type, U&&>)
+        : alloc{std::move(alloc)}
+        , root{create_node(this->alloc, std::forward<U>(value))}
+        , node_count{1} {
+        reset_cached_state();
+    }
+
+    // The copy is made in a single pre-order pass into one allocation of
+    // node_count nodes, so the clone is laid out contiguously in pre-order.
+    tree_storage(const tree_storage& other)
+        : alloc{allocator_traits::select_on_container_copy_construction(other.alloc)}
+        , root{nullptr}
+        , node_count{0} {
+        if (other.root != nullptr) {
+            node_count = other.node_count;
+            root = copy_node_impl(static_cast<const node_type*>(other.root), node_count);
+            if constexpr (has_level_links) {
+                relink_levels(root);
+            }
+            reset_cached_state();
+        }
+    }
+
+    tree_storage(tree_storage&& other) noexcept
+        : alloc{std::move(other.alloc)}
+        , root{std::exchange(other.root, nullptr)}
+        , node_count{std::exchange(other.node_count, 0)}
+        , pre_order_last{std::exchange(other.pre_order_last, nullptr)}
+        , blocks{std::move(other.blocks)}
+        , retired{std::move(other.retired)} {
+        other.blocks.clear();
+        renew_allocator(other.alloc, alloc);
+    }
+
+    virtual ~tree_storage() noexcept {
+        // nobody reads a tree being destroyed, so retiring is not needed
+        free_retired();
+        release_nodes();
+    }
+
+    // Existing nodes are reused in place wherever both trees have a node at the
+    // same position; only the difference in shape is allocated or released.
+    tree_storage& operator = (const tree_storage& other) {
+        if (this == &other) {
+            return *this;
+        }
+
+        if constexpr (allocator_traits::propagate_on_container_copy_assignment::value) {
+            if (alloc != other.alloc) {
+                clear();
+            }
+            alloc = other.alloc;
+        }
+
+        // through a const pointer, so the values are copied rather than moved
+        assign_node_impl(static_cast<const node_type*>(other.root), other.node_count);
+        if constexpr (has_level_links) {
+            relink_levels(root);
+        }
+        return *this;
+    }
+
+    tree_storage& operator = (tree_storage&& other) noexcept(
+            allocator_traits::propagate_on_container_move_assignment::value ||
+            allocator_traits::is_always_equal::value) {
+        if (this == &other) {
+            return *this;
+        }
+
+        constexpr bool propagate = allocator_traits::propagate_on_container_move_assignment::value;
+        if (propagate || alloc == other.alloc) {
+            clear();
+            free_retired();
+            if constexpr (propagate) {
+                alloc = std::move(other.alloc);
+                renew_allocator(other.alloc, alloc);
+            }
+            root = std::exchange(other.root, nullptr);
+            node_count = std::exchange(other.node_count, 0);
+            pre_order_last = std::exchange(other.pre_order_last, nullptr);
+            blocks = std::move(other.blocks);
+            other.blocks.clear();
+            if constexpr (has_atomic_links) {
+                retired = std::move(other.retired);
+            }
+        } else {
+            // nodes of the other tree cannot change hands, move the values instead
+            if constexpr (!allocator_traits::propagate_on_container_move_assignment::value &&
+                          !allocator_traits::is_always_equal::value) {
+                assign_node_impl(static_cast<node_type*>(other.root), other.node_count);
+                other.clear();
+                if constexpr (has_level_links) {
+                    relink_levels(root);
+                }
+            }
+        }
+        return *this;
+    }
+
+    // The allocator a moved-from tree keeps would share the arena with the
+    // tree it moved to and keep that one from releasing its nodes in bulk,
+    // so it gets a fresh arena instead.
+    static void renew_allocator(Allocator& moved_from, const Allocator& moved_to) noexcept {
+        if constexpr (detail::supports_bulk_release_v<Allocator>) {
+            try {
+                moved_from = allocator_traits::select_on_container_copy_construction(moved_to);
+            } catch (...) {
+                // both keep the arena, clear() then frees node by node
+            }
+        }
+    }
+
+    // None of the walks below recurse: they move through the parent and sibling
+    // links, so chain-shaped trees of any depth neither overflow the stack nor
+    // need a side stack.
+
+    // With atomic links readers may still stand in the subtree, so it is only
+    // freed once the epoch has moved past every reader that could reach it.
+    void clear_node_impl(node_type* node) noexcept {
+        if constexpr (has_atomic_links) {
+            // erase_subtree and clear are noexcept; running out of memory here terminates
+            retired.entries.push_back({node, retired.domain.epoch()});
+            free_unreachable();
+        } else {
+            free_node_impl(node);
+        }
+    }
+
+    void free_node_impl(node_type* node) noexcept {
+        consume_node_impl(node, [this](node_type* curr_node) noexcept {
+            allocator_traits::destroy(alloc, curr_node);
+            deallocate_node(curr_node);
+        });
+    }
+
+    // frees the retired subtrees no reader can reach any more
+    void free_unreachable() noexcept {
+        if constexpr (has_atomic_links) {
+            std::uint64_t before = retired.domain.reclaimable_before();
+            auto it = retired.entries.begin();
+            for (; it != retired.entries.end() && it->epoch < before; ++it) {
+                free_node_impl(it->node);
+            }
+            retired.entries.erase(retired.entries.begin(), it);
+        }
+    }
+
+    // frees every retired subtree; only while no reader is pinned
+    void free_retired() noexcept {
+        if constexpr (has_atomic_links) {
+            for (const auto& entry : retired.entries) {
+                free_node_impl(entry.node);
+            }
+            retired.entries.clear();
+        }
+    }
+
+    // destroys values only, memory is expected to be released in bulk afterwards
+    void destroy_node_impl(node_type* node) noexcept {
+        consume_node_impl(node, [this](node_type* curr_node) noexcept {
+            allocator_traits::destroy(alloc, curr_node);
+        });
+    }
+
+    // Copies the subtree of `count` nodes in pre-order into one sized allocation.
+    node_type* copy_node_impl(const node_type* node, size_t count) {
+        return clone_node_impl(node, count);
+    }
+
+    // Same, but moves the values out of the subtree, which is left to be
+    // freed; like std::move_if_noexcept, values whose move may throw are
+    // copied, so a failure leaves the subtree as it was.
+    node_type* move_node_impl(node_type* node, size_t count) {
+        return clone_node_impl(node, count);
+    }
+
+    node_type* copy_node_impl(const node_type* node) {
+        return copy_node_impl(node, count_nodes(node));
+    }
+
+    // a const SrcNode has its values copied, a mutable one has them moved
+    // when that cannot throw and copied otherwise
+    template <typename SrcNode>
+    node_type* clone_node_impl(SrcNode* node, size_t count) {
+        using source_value = std::conditional_t<
+            std::is_const_v<SrcNode> || (!std::is_nothrow_move_constructible_v<T> && std::is_copy_constructible_v<T>),
+            const T&, T&&>;
+
+        assert(node != nullptr);
+        assert(count == count_nodes(node));
+        std::shared_ptr<node_block> record = reserve_block();
+        node_type* block = allocator_traits::allocate(alloc, count);
+        size_t constructed = 0;
+
+        try {
+            allocator_traits::construct(alloc, block, static_cast<source_value>(node->value()));
+            constructed++;
+
+            SrcNode* src_node = node;
+            node_type* dst_node = block;
+            while (true) {
+                if (src_node->first_child() != nullptr) {
+                    src_node = src_node->first_child();
+                    node_type* child = block + constructed;
+                    allocator_traits::construct(alloc, child, static_cast<source_value>(src_node->value()));
+                    constructed++;
+                    dst_node->push_back_child(child);
+                    dst_node = child;
+                    continue;
+                }
+
+                while (src_node != node && src_node->next_sibling() == nullptr) {
+                    src_node = src_node->parent();
+                    dst_node = dst_node->parent();
+                }
+
+                if (src_node == node) {
+                    break;
+                }
+
+                src_node = src_node->next_sibling();
+                node_type* sibling = block + constructed;
+                allocator_traits::construct(alloc, sibling, static_cast<source_value>(src_node->value()));
+                constructed++;
+                append_sibling(dst_node, sibling);
+                dst_node = sibling;
+            }
+        } catch (...) {
+            for (size_t i = 0; i < constructed; i++) {
+                allocator_traits::destroy(alloc, block + i);
+            }
+            allocator_traits::deallocate(alloc, block, count);
+            throw;
+        }
+
+        add_block(std::move(record), block, count);
+        return block;
+    }
+
+    // Constructs `count` unlinked nodes from consecutive values into one sized
+    // allocation; the block is not registered until the nodes are linked.
+    template <typename Iterator>
+    node_type* construct_block(Iterator value_it, size_t count) {
+        node_type* block = allocator_traits::allocate(alloc, count);
+        size_t constructed = 0;
+        try {
+            for (; constructed < count; ++constructed, ++value_it) {
+                allocator_traits::construct(alloc, block + constructed, *value_it);
+            }
+        } catch (...) {
+            destroy_block(block, constructed, count);
+            throw;
+        }
+        return block;
+    }
+
+    void destroy_block(node_type* block, size_t constructed, size_t count) noexcept {
+        for (size_t i = 0; i < constructed; i++) {
+            allocator_traits::destroy(alloc, block + i);
+        }
+        allocator_traits::deallocate(alloc, block, count);
+    }
+
+    // Moves every node into one new block in the given order and links the
+    // copies like the originals; the old nodes are freed. Nodes are first
+    // numbered in pre-order with their parent's number, so the target position
+    // of every node, and of its parent, is known without a map from addresses.
+    // All three orders place parents before children, so the copies are linked
+    // by prepending each one to its parent's copy in reverse pre-order, which
+    // does not walk the siblings even without last_child links.
+    // The values are moved if that cannot throw and copied otherwise; if a
+    // copy throws, the tree is left as it was.
+    void relayout_impl(layout_order order) {
+        if (root == nullptr) {
+            return;
+        }
+
+        size_t count = node_count;
+        std::vector<node_type*> nodes;
+        std::vector<size_t> parents;
+        nodes.reserve(count);
+        parents.reserve(count);
+        {
+            node_type* curr_node = root;
+            size_t curr = 0;
+            nodes.push_back(curr_node);
+            parents.push_back(count);
+            while (true) {
+                if (node_type* child = curr_node->first_child()) {
+                    parents.push_back(curr);
+                    curr = nodes.size();
+                    nodes.push_back(child);
+                    curr_node = child;
+                    continue;
+                }
+                while (curr_node != root && curr_node->next_sibling() == nullptr) {
+                    curr_node = curr_node->parent();
+                    curr = parents[curr];
+                }
+                if (curr_node == root) {
+                    break;
+                }
+                curr_node = curr_node->next_sibling();
+                parents.push_back(parents[curr]);
+                curr = nodes.size();
+                nodes.push_back(curr_node);
+            }
+        }
+
+        std::vector<size_t> positions = layout_positions(order, parents);
+
+        std::shared_ptr<node_block> record = reserve_block();
+        node_type* block = allocator_traits::allocate(alloc, count);
+        size_t built = 0;
+        try {
+            for (; built < count; built++) {
+                allocator_traits::construct(alloc, block + positions[built], std::in_place,
+                                            std::move_if_noexcept(nodes[built]->value()));
+            }
+        } catch (...) {
+            for (size_t i = 0; i < built; i++) {
+                allocator_traits::destroy(alloc, block + positions[i]);
+            }
+            allocator_traits::deallocate(alloc, block, count);
+            throw;
+        }
+
+        for (size_t i = count; i-- > 1; ) {
+            block[positions[parents[i]]].push_front_child(block + positions[i]);
+        }
+        if constexpr (has_order_labels) {
+            for (size_t i = 0; i < count; i++) {
+                block[positions[i]].set_order_label(false, nodes[i]->order_label(false));
+                block[positions[i]].set_order_label(true, nodes[i]->order_label(true));
+            }
+        }
+        if constexpr (has_subtree_hashes) {
+            for (size_t i = 0; i < count; i++) {
+                if (nodes[i]->has_subtree_hash()) {
+                    block[positions[i]].set_subtree_hash(nodes[i]->subtree_hash());
+                }
+            }
+        }
+        if constexpr (has_subtree_sizes) {
+            for (size_t i = 0; i < count; i++) {
+                block[positions[i]].set_subtree_size(nodes[i]->subtree_size());
+            }
+        }
+
+        for (node_type* node : nodes) {
+            allocator_traits::destroy(alloc, node);
+            deallocate_node(node);
+        }
+        add_block(std::move(record), block, count);
+        root = block;
+        if constexpr (node_type::links_type::reversible) {
+            pre_order_last = block + positions[count - 1];
+        }
+        if constexpr (has_level_links) {
+            relink_levels(root);
+        }
+    }
+
+    // Position in the new block of every node, given by its pre-order number.
+    // parents[i] is the pre-order number of the parent of node i.
+    static std::vector<size_t> layout_positions(layout_order order, const std::vector<size_t>& parents) {
+        size_t count = parents.size();
+        std::vector<size_t> positions(count);
+        if (order == layout_order::pre_order) {
+            for (size_t i = 0; i < count; i++) {
+                positions[i] = i;
+            }
+            return positions;
+        }
+
+        // subtree sizes and depths; children follow their parent in pre-order
+        std::vector<size_t> sizes(count, 1);
+        for (size_t i = count; i-- > 1; ) {
+            sizes[parents[i]] += sizes[i];
+        }
+        std::vector<size_t> depths(count, 0);
+        for (size_t i = 1; i < count; i++) {
+            depths[i] = depths[parents[i]] + 1;
+        }
+
+        if (order == layout_order::level_order) {
+            // the children of one node are consecutive: first at i + 1, the next at i + size
+            std::vector<size_t> queue{0};
+            queue.reserve(count);
+            for (size_t head = 0; head < queue.size(); head++) {
+                size_t node = queue[head];
+                positions[node] = head;
+                for (size_t child = node + 1; child < node + sizes[node]; child += sizes[child]) {
+                    queue.push_back(child);
+                }
+            }
+            return positions;
+        }
+
+        std::vector<size_t> heights(count, 1);
+        for (size_t i = count; i-- > 1; ) {
+            heights[parents[i]] = std::max(heights[parents[i]], heights[i] + 1);
+        }
+        size_t next = 0;
+        van_emde_boas_positions(0, heights[0], sizes, depths, positions, next);
+        return positions;
+    }
+
+    // Lays out the top `height` levels of the subtree at `node`: the upper half
+    // of those levels first, then each subtree hanging below it, every part
+    // laid out the same way. Recursion only halves the height, so it is
+    // O(log height) deep.
+    static void van_emde_boas_positions(size_t node, size_t height, const std::vector<size_t>& sizes,
+                                        const std::vector<size_t>& depths, std::vector<size_t>& positions, size_t& next) {
+        if (height == 1) {
+            positions[node] = next++;
+            return;
+        }
+
+        size_t top = (height + 1) / 2;
+        van_emde_boas_positions(node, top, sizes, depths, positions, next);
+        // nodes `top` levels below `node`, skipping over the subtrees of those found
+        size_t bottom_depth = depths[node] + top;
+        for (size_t i = node + 1; i < node + sizes[node]; ) {
+            if (depths[i] == bottom_depth) {
+                van_emde_boas_positions(i, height - top, sizes, depths, positions, next);
+                i += sizes[i];
+            } else {
+                i++;
+            }
+        }
+    }
+
+    // Builds the whole tree from values and the index of each node's parent.
+    // Node i keeps position i in the block, children are linked in index order.
+    template <typename ValueIterator, typename ParentIterator>
+    void build_from_parents(ValueIterator value_it, ParentIterator parent_it, size_t count) {
+        assert(root == nullptr);
+        size_t root_index = count;
+        ParentIterator first_parent = parent_it;
+        for (size_t i = 0; i < count; ++i, ++parent_it) {
+            if (!detail::index_in_range(*parent_it, count)) {
+                if (root_index != count) {
+                    throw std::invalid_argument{"tree::from_parent_array: more than one root"};
+                }
+                root_index = i;
+            }
+        }
+        if (count != 0 && root_index == count) {
+            throw std::invalid_argument{"tree::from_parent_array: no root"};
+        }
+        if (count == 0) {
+            return;
+        }
+
+        std::shared_ptr<node_block> record = reserve_block();
+        node_type* block = construct_block(value_it, count);
+        if constexpr (node_type::links_type::template has<node_link::last_child>) {
+            parent_it = first_parent;
+            for (size_t i = 0; i < count; ++i, ++parent_it) {
+                if (i != root_index) {
+                    block[static_cast<size_t>(*parent_it)].push_back_child(block + i);
+                }
+            }
+        } else {
+            // without last_child links appending walks the siblings, prepending
+            // from the highest index down does not
+            std::vector<node_type*> parents;
+            try {
+                parents.reserve(count);
+            } catch (...) {
+                destroy_block(block, count, count);
+                throw;
+            }
+            for (parent_it = first_parent; parents.size() < count; ++parent_it) {
+                parents.push_back(parents.size() != root_index ? block + static_cast<size_t>(*parent_it) : nullptr);
+            }
+            for (size_t i = count; i-- > 0; ) {
+                if (parents[i] != nullptr) {
+                    parents[i]->push_front_child(block + i);
+                }
+            }
+        }
+
+        // n - 1 parent links reach every node from the root unless some form a cycle
+        if (count_nodes(block + root_index) != count) {
+            destroy_block(block, count, count);
+            throw std::invalid_argument{"tree::from_parent_array: parent links form a cycle"};
+        }
+
+        add_block(std::move(record), block, count);
+        root = block + root_index;
+        node_count = count;
+        reset_cached_state();
+        if constexpr (has_level_links) {
+            relink_levels(root);
+        }
+    }
+
+    // Builds the whole tree from values listed in pre-order with their depths.
+    // The root has depth 0 and every later node is at most one level deeper
+    // than the node before it; nodes keep their pre-order position in the block.
+    template <typename ValueIterator, typename DepthIterator>
+    void build_from_depths(ValueIterator value_it, DepthIterator depth_it, size_t count) {
+        assert(root == nullptr);
+        if (count == 0) {
+            return;
+        }
+
+        DepthIterator first_depth = depth_it;
+        size_t prev_depth = 0;
+        for (size_t i = 0; i < count; ++i, ++depth_it) {
+            bool valid = i == 0
+                ? *depth_it == 0
+                : *depth_it > 0 && static_cast<size_t>(*depth_it) <= prev_depth + 1;
+            if (!valid) {
+                throw std::invalid_argument{"tree::from_preorder_depths: depths do not describe a pre-order"};
+            }
+            prev_depth = static_cast<size_t>(*depth_it);
+        }
+
+        std::shared_ptr<node_block> record = reserve_block();
+        node_type* block = construct_block(value_it, count);
+        depth_it = first_depth;
+        ++depth_it;
+        prev_depth = 0;
+        for (size_t i = 1; i < count; ++i, ++depth_it) {
+            auto depth = static_cast<size_t>(*depth_it);
+            node_type* prev = block + i - 1;
+            if (depth > prev_depth) {
+                prev->push_back_child(block + i);
+            } else {
+                // the ancestor of the previous node at this depth is the previous sibling
+                for (size_t up = prev_depth; up > depth; up--) {
+                    prev = prev->parent();
+                }
+                append_sibling(prev, block + i);
+            }
+            prev_depth = depth;
+        }
+
+        add_block(std::move(record), block, count);
+        root = block;
+        node_count = count;
+        reset_cached_state();
+        if constexpr (has_level_links) {
+            relink_levels(root);
+        }
+    }
+
+    static size_t count_nodes(const node_type* node) noexcept {
+        assert(node != nullptr);
+        size_t result = 0;
+        const node_type* curr_node = node;
+        while (curr_node != nullptr) {
+            result++;
+            if (curr_node->first_child() != nullptr) {
+                curr_node = curr_node->first_child();
+                continue;
+            }
+
+            while (curr_node != node && curr_node->next_sibling() == nullptr) {
+                curr_node = curr_node->parent();
+            }
+            curr_node = curr_node != node ? curr_node->next_sibling() : nullptr;
+        }
+        return result;
+    }
+
+    static constexpr bool has_level_links  = node_type::links_type::template has<node_link::next_in_level>;
+    static constexpr bool has_atomic_links = node_type::links_type::template has<node_link::atomic>;
+    static constexpr bool has_order_labels = node_type::links_type::template has<node_link::order_labels>;
+    static constexpr bool has_subtree_hashes = node_type::links_type::template has<node_link::subtree_hash>;
+    static constexpr bool has_subtree_sizes = node_type::links_type::template has<node_link::subtree_size>;
+
+    // Level links. Nodes at one depth form a singly linked list in breadth-first
+    // order. Neighbours on a level are found structurally, by climbing from the
+    // node and descending into the nearest sibling subtrees down to its depth,
+    // so the cost depends on the distance to the nearest node on the same level.
+
+    // Links every level of the subtree into the level lists of the tree around
+    // it. The subtree's own levels must already be linked among themselves.
+    static void link_levels_impl(node_type* node) noexcept {
+        node_type* first = node;
+        node_type* last  = node;
+        while (first != nullptr) {
+            node_type* next_first = nullptr;
+            node_type* next_last  = nullptr;
+            for (node_type* curr_node = first; ; curr_node = curr_node->next_in_level()) {
+                if (curr_node->first_child() != nullptr) {
+                    if (next_first == nullptr) {
+                        next_first = curr_node->first_child();
+                    }
+                    next_last = curr_node->last_child();
+                }
+                if (curr_node == last) {
+                    break;
+                }
+            }
+
+            node_type* prev = level_prev(first);
+            last->set_next_in_level(prev != nullptr ? prev->next_in_level() : level_next(last));
+            if (prev != nullptr) {
+                prev->set_next_in_level(first);
+            }
+
+            first = next_first;
+            last  = next_last;
+        }
+    }
+
+    // Takes every level of the subtree out of the level lists of the tree
+    // around it, leaving the subtree's own levels linked among themselves.
+    static void unlink_levels_impl(node_type* node) noexcept {
+        node_type* first = node;
+        node_type* last  = node;
+        while (first != nullptr) {
+            node_type* prev = level_prev(first);
+            if (prev != nullptr) {
+                prev->set_next_in_level(last->next_in_level());
+            }
+
+            node_type* next_first = nullptr;
+            node_type* next_last  = nullptr;
+            for (node_type* curr_node = first; ; curr_node = curr_node->next_in_level()) {
+                if (curr_node->first_child() != nullptr) {
+                    if (next_first == nullptr) {
+                        next_first = curr_node->first_child();
+                    }
+                    next_last = curr_node->last_child();
+                }
+                if (curr_node == last) {
+                    break;
+                }
+            }
+            last->set_next_in_level(nullptr);
+
+            first = next_first;
+            last  = next_last;
+        }
+    }
+
+    // Relinks all levels from scratch, one level at a time from the one above.
+    static void relink_levels(node_type* root) noexcept {
+        if (root != nullptr) {
+            root->set_next_in_level(nullptr);
+        }
+
+        node_type* head = root;
+        while (head != nullptr) {
+            node_type* next_head = nullptr;
+            node_type* tail = nullptr;
+            for (node_type* curr_node = head; curr_node != nullptr; curr_node = curr_node->next_in_level()) {
+                for (node_type* child = curr_node->first_child(); child != nullptr; child = child->next_sibling()) {
+                    if (tail != nullptr) {
+                        tail->set_next_in_level(child);
+                    } else {
+                        next_head = child;
+                    }
+                    tail = child;
+                }
+            }
+            if (tail != nullptr) {
+                tail->set_next_in_level(nullptr);
+            }
+            head = next_head;
+        }
+    }
+
+    // nearest node at the same depth to the left of `node`
+    static node_type* level_prev(node_type* node) noexcept {
+        size_t up = 0;
+        for (node_type* curr_node = node; curr_node != nullptr; curr_node = curr_node->parent(), up++) {
+            for (node_type* sibling = curr_node->prev_sibling(); sibling != nullptr; sibling = sibling->prev_sibling()) {
+                if (node_type* found = rightmost_at_depth(sibling, up)) {
+                    return found;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    // nearest node at the same depth to the right of `node`
+    static node_type* level_next(node_type* node) noexcept {
+        size_t up = 0;
+        for (node_type* curr_node = node; curr_node != nullptr; curr_node = curr_node->parent(), up++) {
+            for (node_type* sibling = curr_node->next_sibling(); sibling != nullptr; sibling = sibling->next_sibling()) {
+                if (node_type* found = leftmost_at_depth(sibling, up)) {
+                    return found;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    static node_type* rightmost_at_depth(node_type* node, size_t depth) noexcept {
+        node_type* curr_node = node;
+        size_t curr_depth = 0;
+        while (true) {
+            if (curr_depth == depth) {
+                return curr_node;
+            }
+
+            if (curr_node->last_child() != nullptr) {
+                curr_node = curr_node->last_child();
+                curr_depth++;
+                continue;
+            }
+
+            while (curr_node != node && curr_node->prev_sibling() == nullptr) {
+                curr_node = curr_node->parent();
+                curr_depth--;
+            }
+            if (curr_node == node) {
+                return nullptr;
+            }
+            curr_node = curr_node->prev_sibling();
+        }
+    }
+
+    static node_type* leftmost_at_depth(node_type* node, size_t depth) noexcept {
+        node_type* curr_node = node;
+        size_t curr_depth = 0;
+        while (true) {
+            if (curr_depth == depth) {
+                return curr_node;
+            }
+
+            if (curr_node->first_child() != nullptr) {
+                curr_node = curr_node->first_child();
+                curr_depth++;
+                continue;
+            }
+
+            while (curr_node != node && curr_node->next_sibling() == nullptr) {
+                curr_node = curr_node->parent();
+                curr_depth--;
+            }
+            if (curr_node == node) {
+                return nullptr;
+            }
+            curr_node = curr_node->next_sibling();
+        }
+    }
+
+    // Order labels. A depth-first walk meets every node twice, when it enters
+    // the node and when it leaves it; each of these tokens has a label, and
+    // labels grow along the walk. So a node is an ancestor of another when its
+    // labels enclose the other's, and comes first in pre-order when it is
+    // entered first. The tokens are not stored anywhere: the next and previous
+    // token are found through the links.
+    //
+    // New tokens take labels from the gap between their neighbours. When the
+    // gap is too small, an aligned range of labels around them is relabelled
+    // evenly: ranges of 2^1, 2^2, ... labels are tried until one holds fewer
+    // than (2 / 1.375)^bits tokens (Bender et al., "Two simplified algorithms
+    // for maintaining order in a list"). That is O(log n) relabelled tokens
+    // per insertion amortized; most insertions find a gap and relabel nothing.
+    // Erasing leaves the remaining labels as they are.
+    struct order_token {
+        node_type* node;
+        bool exit;
+
+        bool operator == (const order_token& other) const noexcept = default;
+    };
+
+    // labels lie in [1, label_limit); 0 stands for "before the first token"
+    static constexpr std::uint64_t label_limit = std::uint64_t{1} << 62;
+
+    // the node is null past the last token
+    static order_token next_token(order_token token) noexcept {
+        if (!token.exit) {
+            if (node_type* child = token.node->first_child()) {
+                return {child, false};
+            }
+            return {token.node, true};
+        }
+        if (node_type* sibling = token.node->next_sibling()) {
+            return {sibling, false};
+        }
+        return {token.node->parent(), true};
+    }
+
+    // the node is null before the first token
+    static order_token prev_token(order_token token) noexcept {
+        if (token.exit) {
+            if (node_type* child = token.node->last_child()) {
+                return {child, true};
+            }
+            return {token.node, false};
+        }
+        if (node_type* sibling = token.node->prev_sibling()) {
+            return {sibling, true};
+        }
+        return {token.node->parent(), false};
+    }
+
+    // Labels the tokens from first to last, which are new or moved here, in
+    // between the labelled tokens around them. Tokens of other pending runs
+    // must hold their predecessor's label, so that labels never decrease.
+    static void label_tokens_impl(order_token first, order_token last) noexcept {
+        order_token before = prev_token(first);
+        order_token after = next_token(last);
+        std::uint64_t low = before.node != nullptr ? before.node->order_label(before.exit) : 0;
+        std::uint64_t high = after.node != nullptr ? after.node->order_label(after.exit) : label_limit;
+
+        size_t count = 0;
+        for (order_token token = first; ; token = next_token(token)) {
+            token.node->set_order_label(token.exit, low);
+            count++;
+            if (token == last) {
+                break;
+            }
+        }
+        if (high - low > count) {
+            spread_labels(first, count, low, high);
+            return;
+        }
+
+        // both walks only ever widen, each token is counted once
+        order_token region_first = first;
+        size_t total = count;
+        for (unsigned bits = 1; ; bits++) {
+            std::uint64_t base = low & ~((std::uint64_t{1} << bits) - 1);
+            std::uint64_t end = base + (std::uint64_t{1} << bits);
+            while (before.node != nullptr && before.node->order_label(before.exit) >= base) {
+                region_first = before;
+                total++;
+                before = prev_token(before);
+            }
+            while (after.node != nullptr && after.node->order_label(after.exit) < end) {
+                total++;
+                after = next_token(after);
+            }
+            if (end == label_limit || static_cast<double>(total) < std::ldexp(1.0, bits) / std::pow(1.375, bits)) {
+                spread_labels(region_first, total, base, end);
+                return;
+            }
+        }
+    }
+
+    // gives `count` tokens from `first` on evenly spaced labels in (low, high)
+    static void spread_labels(order_token first, size_t count, std::uint64_t low, std::uint64_t high) noexcept {
+        std::uint64_t step = (high - low) / (count + 1);
+        assert(step > 0);
+        std::uint64_t label = low;
+        for (order_token token = first; count > 0; count--, token = next_token(token)) {
+            label += step;
+            token.node->set_order_label(token.exit, label);
+        }
+    }
+
+    // Subtree hashes. A node's hash mixes the hash of its value with the
+    // hashes of its children in order. Mutations, and handing a value out
+    // for writing (see tree_node::mutable_value), only drop the cached
+    // hashes on the path from the node to the root; they are recomputed and
+    // stored when next asked for, also by const calls, descending only into
+    // subtrees whose hash was dropped. So a node without a hash has no
+    // ancestor with one.
+
+    // Drops the hash of `node` and those of its ancestors, up to the first
+    // one already without a hash. `node` itself may be newly linked and so
+    // never have had one.
+    static void forget_hashes(node_type* node) noexcept {
+        if (node == nullptr) {
+            return;
+        }
+        node->clear_subtree_hash();
+        for (node = node->parent(); node != nullptr && node->has_subtree_hash(); node = node->parent()) {
+            node->clear_subtree_hash();
+        }
+    }
+
+    // Computes and stores the missing hashes in the subtree at `node`
+    // children first, skipping every subtree that still has its hash.
+    static std::uint64_t refresh_hashes(const node_type* node) {
+        auto descend = [](const node_type* curr_node) noexcept {
+            while (const node_type* child = first_unhashed(curr_node->first_child())) {
+                curr_node = child;
+            }
+            return curr_node;
+        };
+
+        if (node->has_subtree_hash()) {
+            return node->subtree_hash();
+        }
+        const node_type* curr_node = descend(node);
+        while (true) {
+            // every child of curr_node has its hash by now
+            std::uint64_t hash = value_hash(curr_node);
+            for (const node_type* child = curr_node->first_child(); child != nullptr; child = child->next_sibling()) {
+                hash = combine_hash(hash, child->subtree_hash());
+            }
+            curr_node->set_subtree_hash(hash);
+            if (curr_node == node) {
+                return hash;
+            }
+            const node_type* next = first_unhashed(curr_node->next_sibling());
+            curr_node = next != nullptr ? descend(next) : curr_node->parent();
+        }
+    }
+
+    static std::uint64_t value_hash(const node_type* node) {
+        return mix_hash(std::hash<std::remove_cv_t<T>>{}(node->value()));
+    }
+
+    static std::uint64_t combine_hash(std::uint64_t hash, std::uint64_t child_hash) noexcept {
+        return mix_hash(hash + 0x9e3779b97f4a7c15 + child_hash);
+    }
+
+    // `node` or the first of its next siblings without a hash
+    static const node_type* first_unhashed(const node_type* node) noexcept {
+        while (node != nullptr && node->has_subtree_hash()) {
+            node = node->next_sibling();
+        }
+        return node;
+    }
+
+    // the splitmix64 finalizer, so that similar trees get unrelated hashes;
+    // 0 marks a node without a hash, so it is never returned
+    static std::uint64_t mix_hash(std::uint64_t hash) noexcept {
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111eb;
+        hash ^= hash >> 31;
+        return hash != 0 ? hash : 1;
+    }
+
+    // Subtree sizes. Every node counts the nodes of its subtree, itself
+    // included; a new node counts one. Linking or unlinking a subtree adds
+    // its size to, or takes it from, every ancestor, so a size is read in
+    // O(1) and kept up to date in O(depth).
+
+    // Adds `count` to the sizes of the ancestors of `node`.
+    static void add_to_sizes_above(node_type* node, size_t count) noexcept {
+        for (node = node->parent(); node != nullptr; node = node->parent()) {
+            node->set_subtree_size(node->subtree_size() + count);
+        }
+    }
+
+    static void take_from_sizes_above(node_type* node, size_t count) noexcept {
+        for (node = node->parent(); node != nullptr; node = node->parent()) {
+            node->set_subtree_size(node->subtree_size() - count);
+        }
+    }
+
+    // Sets every size in the subtree at `node` from its shape, children
+    // first, in one walk; for nodes linked without keeping sizes up to date.
+    static void recount_sizes(node_type* node) noexcept {
+        node_type* curr_node = node;
+        curr_node->set_subtree_size(1);
+        while (true) {
+            if (node_type* child = curr_node->first_child()) {
+                curr_node = child;
+                curr_node->set_subtree_size(1);
+                continue;
+            }
+
+            // a node is complete once the walk leaves it
+            while (curr_node != node && curr_node->next_sibling() == nullptr) {
+                node_type* parent = curr_node->parent();
+                parent->set_subtree_size(parent->subtree_size() + curr_node->subtree_size());
+                curr_node = parent;
+            }
+            if (curr_node == node) {
+                return;
+            }
+            node_type* parent = curr_node->parent();
+            parent->set_subtree_size(parent->subtree_size() + curr_node->subtree_size());
+            curr_node = curr_node->next_sibling();
+            curr_node->set_subtree_size(1);
+        }
+    }
+
+    // O(1) with subtree sizes, a walk over the subtree otherwise
+    static size_t subtree_count(const node_type* node) noexcept {
+        if constexpr (has_subtree_sizes) {
+            return node->subtree_size();
+        } else {
+            return count_nodes(node);
+        }
+    }
+
+    // Constructs the value from args right in the node's memory; the memory is
+    // given back if the constructor throws.
+    template <typename... Args>
+    static node_type* create_node(Allocator& alloc, Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args&&...>) {
+        node_type* node = allocator_traits::allocate(alloc, 1);
+        if constexpr (std::is_nothrow_constructible_v<T, Args&&...>) {
+            allocator_traits::construct(alloc, node, std::in_place, std::forward<Args>(args)...);
+        } else {
+            try {
+                allocator_traits::construct(alloc, node, std::in_place, std::forward<Args>(args)...);
+            } catch (...) {
+                allocator_traits::deallocate(alloc, node, 1);
+                throw;
+            }
+        }
+        return node;
+    }
+
+    void deallocate_node(node_type* node) noexcept {
+        auto it = find_block(node);
+        if (it != blocks.end()) {
+            node_block& block = **it;
+            if (block.live.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                allocator_traits::deallocate(alloc, block.nodes, block.size);
+                blocks.erase(it);
+            }
+            return;
+        }
+
+        allocator_traits::deallocate(alloc, node, 1);
+    }
+
+    // The block holding `node`, or blocks.end() if it was allocated on its own.
+    // A dead block may still cover the address, which is then reused memory.
+    typename std::vector<std::shared_ptr<node_block>>::iterator find_block(const node_type* node) noexcept {
+        if (blocks.empty()) {
+            return blocks.end();
+        }
+        auto it = std::upper_bound(blocks.begin(), blocks.end(), node,
+            [](const node_type* lhs, const std::shared_ptr<node_block>& rhs) noexcept {
+                return std::less<const node_type*>{}(lhs, rhs->nodes);
+            });
+        if (it != blocks.begin()) {
+            --it;
+            if (std::less<const node_type*>{}(node, (*it)->nodes + (*it)->size) && !is_dead(**it)) {
+                return it;
+            }
+        }
+        return blocks.end();
+    }
+
+    static bool is_dead(const node_block& block) noexcept {
+        return block.live.load(std::memory_order_acquire) == 0;
+    }
+
+    // Lists here the blocks of `other` that hold nodes of the subtree at
+    // `node`, so those nodes can move from `other` to this tree and be freed
+    // by it. Both allocators must compare equal. O(b) for the b blocks of
+    // `other` when this tree lists all of them already; otherwise the
+    // subtree is walked, O(k log b) for k nodes (see node_block).
+    void share_blocks(tree_storage& other, const node_type* node) {
+        bool listed = std::all_of(other.blocks.begin(), other.blocks.end(),
+            [this](const std::shared_ptr<node_block>& block) noexcept {
+                auto it = find_block(block->nodes);
+                return is_dead(*block) || (it != blocks.end() && *it == block);
+            });
+        if (listed) {
+            return;
+        }
+
+        std::vector<std::shared_ptr<node_block>> used;
+        const node_type* curr_node = node;
+        while (curr_node != nullptr) {
+            auto it = other.find_block(curr_node);
+            // nodes of one block mostly follow each other in pre-order
+            if (it != other.blocks.end() && (used.empty() || used.back() != *it)) {
+                used.push_back(*it);
+            }
+            if (curr_node->first_child() != nullptr) {
+                curr_node = curr_node->first_child();
+                continue;
+            }
+
+            while (curr_node != node && curr_node->next_sibling() == nullptr) {
+                curr_node = curr_node->parent();
+            }
+            curr_node = curr_node != node ? curr_node->next_sibling() : nullptr;
+        }
+        if (used.empty()) {
+            return;
+        }
+
+        auto by_address = [](const std::shared_ptr<node_block>& lhs, const std::shared_ptr<node_block>& rhs) noexcept {
+            return std::less<const node_type*>{}(lhs->nodes, rhs->nodes);
+        };
+        std::sort(used.begin(), used.end(), by_address);
+        used.erase(std::unique(used.begin(), used.end()), used.end());
+
+        // dead blocks go, their memory may be reused by a live one
+        std::vector<std::shared_ptr<node_block>> merged;
+        merged.reserve(blocks.size() + used.size());
+        for (const auto& block : blocks) {
+            if (!is_dead(*block)) {
+                merged.push_back(block);
+            }
+        }
+        auto listed_end = static_cast<ptrdiff_t>(merged.size());
+        for (auto& block : used) {
+            // live blocks do not overlap, so one at the same address is the same block
+            if (!std::binary_search(merged.begin(), merged.begin() + listed_end, block, by_address)) {
+                merged.push_back(std::move(block));
+            }
+        }
+        std::inplace_merge(merged.begin(), merged.begin() + listed_end, merged.end(), by_address);
+        blocks = std::move(merged);
+    }
+
+    void clear() noexcept {
+        if (root == nullptr) {
+            return;
+        }
+
+        if constexpr (has_atomic_links) {
+            // readers may still be walking the old nodes
+            node_type* old_root = root;
+            root = nullptr;
+            node_count = 0;
+            pre_order_last = nullptr;
+            clear_node_impl(old_root);
+            return;
+        }
+
+        release_nodes();
+    }
+
+    // Frees the whole tree at once; with atomic links only while no reader is pinned.
+    void release_nodes() noexcept {
+        if (root == nullptr) {
+            return;
+        }
+
+        if constexpr (detail::supports_bulk_release_v<Allocator>) {
+            // nobody else allocates from this arena, so every node can go at once
+            if (alloc.exclusive()) {
+                if constexpr (!std::is_trivially_destructible_v<node_type>) {
+                    destroy_node_impl(root);
+                }
+                alloc.release();
+                blocks.clear();
+                root = nullptr;
+                node_count = 0;
+                pre_order_last = nullptr;
+                return;
+            }
+        }
+
+        if (std::is_trivially_destructible_v<node_type> && !blocks.empty()) {
+            // every node lives in a block, the blocks can go without visiting
+            // the nodes; not when another tree holds nodes of them as well
+            size_t block_nodes = 0;
+            bool shared = false;
+            for (const auto& block : blocks) {
+                block_nodes += block->live.load(std::memory_order_acquire);
+                shared = shared || (block.use_count() > 1 && !is_dead(*block));
+            }
+            if (!shared && block_nodes == node_count) {
+                for (const auto& block : blocks) {
+                    if (!is_dead(*block)) {
+                        allocator_traits::deallocate(alloc, block->nodes, block->size);
+                    }
+                }
+                blocks.clear();
+                root = nullptr;
+                node_count = 0;
+                pre_order_last = nullptr;
+                return;
+            }
+        }
+
+        free_node_impl(root);
+        root = nullptr;
+        node_count = 0;
+        pre_order_last = nullptr;
+    }
+
+    // Last node in pre-order of the subtree: down along the last children.
+    static node_type* last_descendant(node_type* node) noexcept {
+        while (node_type* last = node->find_last_child()) {
+            node = last;
+        }
+        return node;
+    }
+
+    // For the bulk operations that replace the whole tree: walks the rightmost
+    // path for the last node, spreads the order labels evenly, drops the
+    // subtree hashes of nodes whose values were assigned and counts the
+    // subtree sizes.
+    void reset_cached_state() noexcept {
+        if constexpr (node_type::links_type::reversible) {
+            pre_order_last = root != nullptr ? last_descendant(root) : nullptr;
+        }
+        if constexpr (has_subtree_sizes) {
+            if (root != nullptr) {
+                recount_sizes(root);
+            }
+        }
+        if constexpr (has_order_labels) {
+            if (root != nullptr) {
+                order_token first{root, false};
+                spread_labels(first, 2 * count_nodes(root), 0, label_limit);
+            }
+        }
+        if constexpr (has_subtree_hashes) {
+            node_type* curr_node = root;
+            while (curr_node != nullptr) {
+                curr_node->clear_subtree_hash();
+                if (curr_node->first_child() != nullptr) {
+                    curr_node = curr_node->first_child();
+                    continue;
+                }
+
+                while (curr_node != root && curr_node->next_sibling() == nullptr) {
+                    curr_node = curr_node->parent();
+                }
+                curr_node = curr_node != root ? curr_node->next_sibling() : nullptr;
+            }
+        }
+    }
+
+    Allocator alloc;
+    detail::link_ptr<node_type, has_atomic_links> root;
+    detail::count_type<has_atomic_links> node_count;
+    // last node in pre-order, only kept for reversible links (see tree)
+    node_type* pre_order_last = nullptr;
+    std::vector<std::shared_ptr<node_block>> blocks;
+    [[no_unique_address]] detail::retired_nodes<node_type, has_atomic_links> retired;
+
+private:
+    // The record of a block about to be allocated, made up front so that
+    // registering the block afterwards cannot throw.
+    std::shared_ptr<node_block> reserve_block() {
+        blocks.reserve(blocks.size() + 1);
+        return std::make_shared<node_block>();
+    }
+
+    void add_block(std::shared_ptr<node_block> record, node_type* nodes, size_t size) noexcept {
+        // blocks that died in another tree may overlap the new one
+        std::erase_if(blocks, [](const std::shared_ptr<node_block>& block) noexcept {
+            return is_dead(*block);
+        });
+        record->nodes = nodes;
+        record->size = size;
+        record->live.store(size, std::memory_order_relaxed);
+        auto it = std::upper_bound(blocks.begin(), blocks.end(), nodes,
+            [](const node_type* lhs, const std::shared_ptr<node_block>& rhs) noexcept {
+                return std::less<const node_type*>{}(lhs, rhs->nodes);
+            });
+        blocks.insert(it, std::move(record));
+    }
+
+    // Makes this tree a copy of the subtree at `src_root` (moving the values out
+    // of it when it is mutable) by walking both trees in lock-step. Nodes present
+    // in both get their value assigned, missing ones are created and surplus
+    // ones are released.
+    template <typename SrcNode>
+    void assign_node_impl(SrcNode* src_root, size_t count) {
+        using source_value = std::conditional_t<std::is_const_v<SrcNode>, const T&, T&&>;
+
+        if (src_root == nullptr) {
+            clear();
+            return;
+        }
+
+        if (root == nullptr) {
+            root = copy_node_impl(src_root, count);
+            node_count = count;
+            reset_cached_state();
+            return;
+        }
+
+        try {
+            SrcNode* src_node = src_root;
+            node_type* dst_node = root;
+            dst_node->value() = static_cast<source_value>(src_node->value());
+
+            while (true) {
+                if (src_node->first_child() != nullptr) {
+                    src_node = src_node->first_child();
+                    if (dst_node->first_child() != nullptr) {
+                        dst_node = dst_node->first_child();
+                        dst_node->value() = static_cast<source_value>(src_node->value());
+                    } else {
+                        node_type* child = create_node(alloc, static_cast<source_value>(src_node->value()));
+                        dst_node->push_back_child(child);
+                        dst_node = child;
+                    }
+                    continue;
+                }
+
+                while (dst_node->first_child() != nullptr) {
+                    node_type* child = dst_node->first_child();
+                    dst_node->unlink_child(child);
+                    clear_node_impl(child);
+                }
+
+                while (src_node != src_root && src_node->next_sibling() == nullptr) {
+                    while (dst_node->next_sibling() != nullptr) {
+                        node_type* sibling = dst_node->next_sibling();
+                        dst_node->parent()->unlink_child(sibling);
+                        clear_node_impl(sibling);
+                    }
+                    src_node = src_node->parent();
+                    dst_node = dst_node->parent();
+                }
+
+                if (src_node == src_root) {
+                    break;
+                }
+
+                src_node = src_node->next_sibling();
+                if (dst_node->next_sibling() != nullptr) {
+                    dst_node = dst_node->next_sibling();
+                    dst_node->value() = static_cast<source_value>(src_node->value());
+                } else {
+                    node_type* sibling = create_node(alloc, static_cast<source_value>(src_node->value()));
+                    append_sibling(dst_node, sibling);
+                    dst_node = sibling;
+                }
+            }
+        } catch (...) {
+            node_count = count_nodes(root);
+            reset_cached_state();
+            throw;
+        }
+
+        node_count = count;
+        reset_cached_state();
+    }
+
+    // Hands every node of the subtree to `release` children first. Each released
+    // node is unlinked from its parent beforehand, so the parent becomes a leaf
+    // once its last child is gone and the walk can continue from it.
+    template <typename F>
+    static void consume_node_impl(node_type* node, F&& release) noexcept {
+        assert(node != nullptr);
+        node_type* curr_node = node;
+        while (true) {
+            while (curr_node->first_child() != nullptr) {
+                curr_node = curr_node->first_child();
+            }
+
+            if (curr_node == node) {
+                release(curr_node);
+                return;
+            }
+
+            node_type* parent = curr_node->parent();
+            parent->unlink_child(curr_node);
+            release(curr_node);
+            curr_node = parent;
+        }
+    }
+};
+
+template <typename T, typename Allocator = std::allocator<tree_node<T>>>
+class pre_order_view;
+
+template <typename T, typename Allocator = std::allocator<tree_node<T>>>
+class post_order_view;
+
+template <typename T, typename Allocator = std::allocator<tree_node<T>>>
+class level_order_view;
+
+template <typename T, typename Allocator = std::allocator<tree_node<T>>>
+class pre_order_range;
+
+template <typename T, typename Allocator = std::allocator<tree_node<T>>>
+class post_order_range;
+
+// Result of tree::shape_stats().
+struct tree_shape_stats {
+    size_t nodes = 0;
+    size_t leaves = 0;
+    size_t height = 0;                    // depth of the deepest node, the root being at 0
+    size_t max_fanout = 0;
+    std::vector<size_t> depth_histogram;  // [d] is the number of nodes at depth d
+    std::vector<size_t> fanout_histogram; // [k] is the number of nodes with k children
+};
+
+namespace insertion {
+    struct vert_tag {};
+    struct hor_tag {};
+
+    inline constexpr vert_tag vert;
+    inline constexpr hor_tag hor;
+}
+
+template <typename T, typename Allocator = std::allocator<tree_node<T>>>
+class tree
+    : private tree_storage<T, Allocator>
+    , private detail::enable_special_members<T> {
+    using base = tree_storage<T, Allocator>;
+
+    friend class pre_order_view<T, Allocator>;
+    friend class post_order_view<T, Allocator>;
+    friend class level_order_view<T, Allocator>;
+    friend class pre_order_range<T, Allocator>;
+    friend class post_order_range<T, Allocator>;
+
+public:
+    using allocator_type  = Allocator;
+    using value_type      = T;
+    using node_type       = typename base::node_type;
+    using links_type      = typename node_type::links_type;
+    using reference       = value_type&;
+    using const_reference = const value_type&;
+    using pointer         = value_type*;
+    using const_pointer   = const value_type*;
+    using size_type       = size_t;
+    using difference_type = ptrdiff_t;
 
     tree()
-        : base{}
-        , node_count{0} {};
+        : base{} {};
 
     explicit tree(Allocator alloc) noexcept
-        : base{std::move(alloc)}
-        , node_count{0} {};
+        : base{std::move(alloc)} {};
+
+    // Builds a tree in one linear pass and a single allocation from a range of
+    // values and a range holding, for each value, the index of its parent.
+    // The root is the one entry whose parent index lies outside the range
+    // (e.g. -1); siblings keep the order of their indices.
+    // Throws std::invalid_argument unless the indices describe a single tree.
+    template <typename ValueRange, typename ParentRange>
+    static tree from_parent_array(const ValueRange& values, const ParentRange& parents, Allocator alloc = Allocator{}) {
+        size_t count = checked_size(values, parents);
+        tree result{std::move(alloc)};
+        result.build_from_parents(std::begin(values), std::begin(parents), count);
+        return result;
+    }
+
+    // Builds a tree in one linear pass and a single allocation from values
+    // listed in pre-order and the depth of each of them (the root has depth 0).
+    // Throws std::invalid_argument if a depth is more than one level below its predecessor.
+    template <typename ValueRange, typename DepthRange>
+    static tree from_preorder_depths(const ValueRange& values, const DepthRange& depths, Allocator alloc = Allocator{}) {
+        size_t count = checked_size(values, depths);
+        tree result{std::move(alloc)};
+        result.build_from_depths(std::begin(values), std::begin(depths), count);
+        return result;
+    }
 
     size_type size() const noexcept {
-        return node_count;
+        return base::node_count;
     }
 
     bool empty() const noexcept {
         return base::root == nullptr;
     }
 
+    allocator_type get_allocator() const noexcept {
+        return base::alloc;
+    }
+
+    // Bytes this tree holds: the object itself, its nodes and the table of
+    // copy blocks. A block stays whole until its last node is erased, so its
+    // erased nodes still count, except for blocks another tree holds nodes
+    // of since a splice. Allocator bookkeeping is not included.
+    size_type memory_footprint() const noexcept {
+        size_type erased_block_nodes = 0;
+        size_type block_records = 0;
+        for (const auto& block : base::blocks) {
+            if (block.use_count() == 1) {
+                erased_block_nodes += block->size - block->live.load(std::memory_order_acquire);
+                block_records++;
+            }
+        }
+        return sizeof(*this)
+            + (base::node_count + erased_block_nodes) * sizeof(node_type)
+            + base::blocks.capacity() * sizeof(std::shared_ptr<typename base::node_block>)
+            + block_records * sizeof(typename base::node_block);
+    }
+
+    // Depth and fan-out histograms, gathered in one pre-order walk.
+    tree_shape_stats shape_stats() const {
+        tree_shape_stats result;
+        if (base::root == nullptr) {
+            return result;
+        }
+
+        // children seen so far by every node on the path from the root
+        std::vector<size_t> open_children;
+        auto enter = [&](size_t depth) {
+            if (result.depth_histogram.size() <= depth) {
+                result.depth_histogram.resize(depth + 1, 0);
+            }
+            result.depth_histogram[depth]++;
+            result.nodes++;
+            open_children.push_back(0);
+        };
+        auto leave = [&] {
+            size_t children = open_children.back();
+            open_children.pop_back();
+            if (result.fanout_histogram.size() <= children) {
+                result.fanout_histogram.resize(children + 1, 0);
+            }
+            result.fanout_histogram[children]++;
+            result.leaves += children == 0;
+            result.max_fanout = std::max(result.max_fanout, children);
+        };
+
+        const node_type* node = base::root;
+        size_t depth = 0;
+        enter(depth);
+        while (true) {
+            if (node->first_child() != nullptr) {
+                node = node->first_child();
+                open_children.back()++;
+                enter(++depth);
+                continue;
+            }
+
+            while (true) {
+                leave();
+                if (node == base::root) {
+                    result.height = result.depth_histogram.size() - 1;
+                    return result;
+                }
+                if (node->next_sibling() != nullptr) {
+                    node = node->next_sibling();
+                    open_children.back()++;
+                    enter(depth);
+                    break;
+                }
+                node = node->parent();
+                depth--;
+            }
+        }
+    }
+
     void clear() noexcept {
         base::clear();
     }
 
+    // For trees with concurrent_links: while the returned guard lives, the
+    // calling thread may walk the tree, and nothing it can reach is freed.
+    epoch_domain::guard read_section() const
+        requires links_type::template has<node_link::atomic> {
+        return base::retired.domain.pin();
+    }
+
+    // For trees with concurrent_links: frees erased nodes no reader can reach
+    // any more. Erasing does this too; call it when a writer goes quiet.
+    void reclaim() noexcept
+        requires links_type::template has<node_link::atomic> {
+        base::free_unreachable();
+    }
+
+    template <typename Iterator>
+    Iterator insert(insertion::vert_tag, Iterator it, const T& value) noexcept(std::is_nothrow_constructible_v<T, const T&>) {
+        return emplace(insertion::vert, it, value);
+    }
+
+    template <typename Iterator>
+    Iterator insert(insertion::vert_tag, Iterator it, T&& value) noexcept(std::is_nothrow_constructible_v<T, T&&>) {
+        return emplace(insertion::vert, it, std::move(value));
+    }
+
+    template <typename Iterator>
+    Iterator insert(insertion::hor_tag, Iterator it, const T& value) noexcept(std::is_nothrow_constructible_v<T, const T&>) {
+        return emplace(insertion::hor, it, value);
+    }
+
+    template <typename Iterator>
+    Iterator insert(insertion::hor_tag, Iterator it, T&& value) noexcept(std::is_nothrow_constructible_v<T, T&&>) {
+        return emplace(insertion::hor, it, std::move(value));
+    }
+
+    template <typename Iterator>
+    Iterator append_child(Iterator parent_it, const T& value) noexcept(std::is_nothrow_constructible_v<T, const T&>) {
+        return emplace_child_back(parent_it, value);
+    }
+
+    template <typename Iterator>
+    Iterator append_child(Iterator parent_it, T&& value) noexcept(std::is_nothrow_constructible_v<T, T&&>) {
+        return emplace_child_back(parent_it, std::move(value));
+    }
+
+    // Links the new node right after `sibling_it`, which must not be the root.
+    // O(1) for every link policy: with forward_links, where append_child walks
+    // the parent's children to find the last one, building a wide tree by
+    // inserting after the previous child stays linear.
+    template <typename Iterator>
+    Iterator insert_after(Iterator sibling_it, const T& value) noexcept(std::is_nothrow_constructible_v<T, const T&>)
+        requires (!links_type::template has<node_link::atomic>) {
+        return emplace_after(sibling_it, value);
+    }
+
+    template <typename Iterator>
+    Iterator insert_after(Iterator sibling_it, T&& value) noexcept(std::is_nothrow_constructible_v<T, T&&>)
+        requires (!links_type::template has<node_link::atomic>) {
+        return emplace_after(sibling_it, std::move(value));
+    }
+
+    template <typename Iterator>
+    Iterator prepend_child(Iterator parent_it, const T& value) noexcept(std::is_nothrow_constructible_v<T, const T&>) {
+        return emplace_child_front(parent_it, value);
+    }
+
+    template <typename Iterator>
+    Iterator prepend_child(Iterator parent_it, T&& value) noexcept(std::is_nothrow_constructible_v<T, T&&>) {
+        return emplace_child_front(parent_it, std::move(value));
+    }
+
+    // The emplace functions place the new node like insert, append_child and
+    // prepend_child, and construct its value from args directly in the node.
+    template <typename Iterator, typename... Args>
+    Iterator emplace(insertion::vert_tag, Iterator it, Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args&&...>) {
+        node_type* new_node = base::create_node(base::alloc, std::forward<Args>(args)...);
+        insert_node_vert(it.curr_node, new_node);
+        base::node_count++;
+        return Iterator{new_node};
+    }
+
+    template <typename Iterator, typename... Args>
+    Iterator emplace(insertion::hor_tag, Iterator it, Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args&&...>) {
+        node_type* new_node = base::create_node(base::alloc, std::forward<Args>(args)...);
+        insert_node_hor(it.curr_node, new_node);
+        base::node_count++;
+        return Iterator{new_node};
+    }
+
+    template <typename Iterator, typename... Args>
+    Iterator emplace_child_back(Iterator parent_it, Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args&&...>) {
+        assert(parent_it.curr_node != nullptr);
+        node_type* node = base::create_node(base::alloc, std::forward<Args>(args)...);
+        parent_it.curr_node->push_back_child(node);
+        link_levels(node);
+        label_linked(node);
+        forget_hashes_above(node);
+        track_linked(node);
+        count_linked(node);
+        base::node_count++;
+        return Iterator{node};
+    }
+
+    template <typename Iterator, typename... Args>
+    Iterator emplace_child_front(Iterator parent_it, Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args&&...>) {
+        assert(parent_it.curr_node != nullptr);
+        node_type* node = base::create_node(base::alloc, std::forward<Args>(args)...);
+        parent_it.curr_node->push_front_child(node);
+        link_levels(node);
+        label_linked(node);
+        forget_hashes_above(node);
+        track_linked(node);
+        count_linked(node);
+        base::node_count++;
+        return Iterator{node};
+    }
+
+    template <typename Iterator, typename... Args>
+    Iterator emplace_after(Iterator sibling_it, Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args&&...>)
+        requires (!links_type::template has<node_link::atomic>) {
+        assert(sibling_it.curr_node != nullptr && sibling_it.curr_node->parent() != nullptr);
+        node_type* node = base::create_node(base::alloc, std::forward<Args>(args)...);
+        append_sibling(sibling_it.curr_node, node);
+        link_levels(node);
+        label_linked(node);
+        forget_hashes_above(node);
+        track_linked(node);
+        count_linked(node);
+        base::node_count++;
+        return Iterator{node};
+    }
+
+    // For trees with concurrent_links: any number of threads may append
+    // children, to the same parent or not, at the same time, provided the
+    // allocator is thread-safe (std::allocator, concurrent_arena_allocator).
+    // No other mutation may run meanwhile; readers may.
+    template <typename Iterator>
+    Iterator concurrent_append_child(Iterator parent_it, const T& value)
+        requires links_type::template has<node_link::atomic> {
+        assert(parent_it.curr_node != nullptr);
+        node_type* node = base::create_node(base::alloc, value);
+        parent_it.curr_node->concurrent_push_back_child(node);
+        base::node_count++;
+        return Iterator{node};
+    }
+
+    template <typename Iterator>
+    Iterator concurrent_append_child(Iterator parent_it, T&& value)
+        requires links_type::template has<node_link::atomic> {
+        assert(parent_it.curr_node != nullptr);
+        node_type* node = base::create_node(base::alloc, std::move(value));
+        parent_it.curr_node->concurrent_push_back_child(node);
+        base::node_count++;
+        return Iterator{node};
+    }
+
+    template <typename Iterator>
+    void erase_subtree(Iterator node_it) noexcept {
+        assert(node_it.curr_node != nullptr);
+        node_type* node   = node_it.curr_node;
+        node_type* parent = node->parent();
+
+        if constexpr (base::has_level_links) {
+            base::unlink_levels_impl(node);
+        }
+        track_unlinking(*this, node);
+        forget_hashes_above(node);
+        count_unlinking(node);
+
+        if (parent != nullptr) {
+            parent->unlink_child(node);
+        } else {
+            base::root = nullptr;
+        }
+
+        base::node_count -= base::subtree_count(node);
+        base::clear_node_impl(node);
+    }
+
+    // Moves the subtree at `subtree_it` to the place insert would put a new
+    // node at `dest_it`, and returns it. The nodes are relinked in O(1); with
+    // level links, linking the levels walks the subtree. dest_it must not lie
+    // inside the subtree.
+    template <typename Iterator>
+    Iterator splice(insertion::vert_tag, Iterator dest_it, Iterator subtree_it)
+        requires (!links_type::template has<node_link::atomic>) {
+        node_type* old_node = dest_it.curr_node;
+        node_type* node = take_subtree(*this, subtree_it.curr_node, old_node);
+        insert_node_vert(old_node, node);
+        return Iterator{node};
+    }
+
+    template <typename Iterator>
+    Iterator splice(insertion::hor_tag, Iterator dest_it, Iterator subtree_it)
+        requires (!links_type::template has<node_link::atomic>) {
+        node_type* old_node = dest_it.curr_node;
+        node_type* node = take_subtree(*this, subtree_it.curr_node, old_node);
+        insert_node_hor(old_node, node);
+        return Iterator{node};
+    }
+
+    // Same as splice, but the subtree becomes the last child of `parent_it`.
+    template <typename Iterator>
+    Iterator splice_child(Iterator parent_it, Iterator subtree_it)
+        requires (!links_type::template has<node_link::atomic>) {
+        return splice_child_impl(parent_it, *this, subtree_it);
+    }
+
+    // For trees with subtree sizes: moves the subtree at `subtree_it` out of
+    // `source`, which may be this tree, like the splice above. Both sizes
+    // change by the stored size of the subtree, so when the allocators
+    // compare equal the nodes change hands in O(1), with one exception: if
+    // source holds node blocks this tree does not list yet, the subtree is
+    // walked to find the blocks it uses (see node_block). With unequal
+    // allocators the subtree is moved into one new allocation of this tree
+    // and freed in source; if that throws, source is left as it was.
+    // Without subtree sizes, keeping both counts exact would need a walk
+    // over the subtree, so trees of other links only splice within themselves.
+    template <typename Iterator>
+    Iterator splice(insertion::vert_tag, Iterator dest_it, tree& source, Iterator subtree_it)
+        requires (!links_type::template has<node_link::atomic> && links_type::template has<node_link::subtree_size>) {
+        node_type* old_node = dest_it.curr_node;
+        node_type* node = take_subtree(source, subtree_it.curr_node, old_node);
+        insert_node_vert(old_node, node);
+        return Iterator{node};
+    }
+
+    template <typename Iterator>
+    Iterator splice(insertion::hor_tag, Iterator dest_it, tree& source, Iterator subtree_it)
+        requires (!links_type::template has<node_link::atomic> && links_type::template has<node_link::subtree_size>) {
+        node_type* old_node = dest_it.curr_node;
+        node_type* node = take_subtree(source, subtree_it.curr_node, old_node);
+        insert_node_hor(old_node, node);
+        return Iterator{node};
+    }
+
+    template <typename Iterator>
+    Iterator splice_child(Iterator parent_it, tree& source, Iterator subtree_it)
+        requires (!links_type::template has<node_link::atomic> && links_type::template has<node_link::subtree_size>) {
+        return splice_child_impl(parent_it, source, subtree_it);
+    }
+
+    // Moves every node into one new allocation laid out in `order`, so a tree
+    // scattered over the heap by long runs of insertions and erasures is
+    // walked with good locality again. O(n) time and O(n) extra memory while
+    // it runs. Invalidates all iterators; T must be move or copy constructible.
+    void relayout(layout_order order = layout_order::pre_order)
+        requires (!links_type::template has<node_link::atomic>) {
+        base::relayout_impl(order);
+    }
+
+    // For trees with order labels: O(1) tests on two nodes of this tree.
+    // True when `ancestor_it` is `node_it` or one of its ancestors.
+    template <typename Iterator>
+    bool is_ancestor(Iterator ancestor_it, Iterator node_it) const noexcept
+        requires links_type::template has<node_link::order_labels> {
+        const node_type* ancestor = ancestor_it.curr_node;
+        const node_type* node = node_it.curr_node;
+        return ancestor->order_label(false) <= node->order_label(false)
+            && node->order_label(true) <= ancestor->order_label(true);
+    }
+
+    // True when `lhs_it` comes before `rhs_it` in pre-order.
     template <typename Iterator>
-    Iterator insert(insertion::vert_tag, Iterator it, const T& value) noexcept(std::is_nothrow_constructible_v<T, const T&>) {
-        tree_node<T>* old_node = it.curr_node;
-        tree_node<T>* new_node = base::create_node(base::alloc, value);
-        insert_node_vert(old_node, new_node);
-        node_count++;
-        return Iterator{new_node};
+    bool precedes(Iterator lhs_it, Iterator rhs_it) const noexcept
+        requires links_type::template has<node_link::order_labels> {
+        return lhs_it.curr_node->order_label(false) < rhs_it.curr_node->order_label(false);
     }
 
+    // For trees with subtree sizes: the number of nodes in the subtree at
+    // `node_it`, the node included. O(1).
     template <typename Iterator>
-    Iterator insert(insertion::vert_tag, Iterator it, T&& value) noexcept(std::is_nothrow_constructible_v<T, T&&>) {
-        tree_node<T>* old_node = it.curr_node;
-        tree_node<T>* new_node = base::create_node(base::alloc, std::move(value));
-        insert_node_vert(old_node, new_node);
-        node_count++;
-        return Iterator{new_node};
+    size_type subtree_size(Iterator node_it) const noexcept
+        requires links_type::template has<node_link::subtree_size> {
+        assert(node_it.curr_node != nullptr);
+        return node_it.curr_node->subtree_size();
     }
 
+    // For trees with subtree hashes: the hash of the subtree at `node_it`.
+    // Recomputes and stores only the hashes dropped since they were last
+    // stored, so O(1) when nothing below the node changed. Const calls from
+    // several threads may do so at once (see subtree_hash_field).
     template <typename Iterator>
-    Iterator insert(insertion::hor_tag, Iterator it, const T& value) noexcept(std::is_nothrow_constructible_v<T, const T&>) {
-        tree_node<T>* old_node = it.curr_node;
-        tree_node<T>* new_node = base::create_node(base::alloc, value);
-        insert_node_hor(old_node, new_node);
-        node_count++;
-        return Iterator{new_node};
+    std::uint64_t subtree_hash(Iterator node_it) const
+        requires links_type::template has<node_link::subtree_hash> {
+        assert(node_it.curr_node != nullptr);
+        return base::refresh_hashes(node_it.curr_node);
+    }
+
+    // Stores every hash dropped since the last call up front; comparisons
+    // and diff refresh the hashes they need themselves.
+    void update_hashes() const
+        requires links_type::template has<node_link::subtree_hash> {
+        if (base::root != nullptr) {
+            base::refresh_hashes(base::root);
+        }
     }
 
+    // Iterators and traversers drop the hashes above a node when they hand
+    // out its value for writing. Only a reference kept across a comparison
+    // and written through afterwards goes unnoticed; call this after such a
+    // write. O(depth).
     template <typename Iterator>
-    Iterator insert(insertion::hor_tag, Iterator it, T&& value) noexcept(std::is_nothrow_constructible_v<T, T&&>) {
-        tree_node<T>* old_node = it.curr_node;
-        tree_node<T>* new_node = base::create_node(base::alloc, std::move(value));
-        insert_node_hor(old_node, new_node);
-        node_count++;
-        return Iterator{new_node};
+    void value_changed(Iterator node_it) noexcept
+        requires links_type::template has<node_link::subtree_hash> {
+        assert(node_it.curr_node != nullptr);
+        base::forget_hashes(node_it.curr_node);
     }
 
+    // True when the subtrees at `lhs_it` and `rhs_it`, of this tree or of any
+    // other of the same type, have equal values in the same shape. Exact, like
+    // ==: with subtree hashes, differing hashes settle it after refreshing
+    // those that changed, equal ones are confirmed node by node.
     template <typename Iterator>
-    Iterator append_child(Iterator parent_it, const T& value) noexcept(std::is_nothrow_constructible_v<T, const T&>) {
-        assert(parent_it.curr_node != nullptr);
-        tree_node<T>* node = base::create_node(base::alloc, value);
-        parent_it.curr_node->push_back_child(node);
-        node_count++;
-        return Iterator{node};
+    bool subtree_equal(Iterator lhs_it, Iterator rhs_it) const {
+        assert(lhs_it.curr_node != nullptr && rhs_it.curr_node != nullptr);
+        return nodes_equal(lhs_it.curr_node, rhs_it.curr_node);
     }
 
+    // subtree_equal by hash alone: O(1) when nothing below either node
+    // changed since the last comparison, O(changed nodes and their
+    // ancestors) otherwise, and wrong only when two different subtrees
+    // collide, with a chance of about 2^-64.
     template <typename Iterator>
-    Iterator append_child(Iterator parent_it, T&& value) noexcept(std::is_nothrow_constructible_v<T, T&&>) {
-        assert(parent_it.curr_node != nullptr);
-        tree_node<T>* node = base::create_node(base::alloc, std::move(value));
-        parent_it.curr_node->push_back_child(node);
-        node_count++;
-        return Iterator{node};
+    bool probably_equal(Iterator lhs_it, Iterator rhs_it) const
+        requires links_type::template has<node_link::subtree_hash> {
+        assert(lhs_it.curr_node != nullptr && rhs_it.curr_node != nullptr);
+        return base::refresh_hashes(lhs_it.curr_node) == base::refresh_hashes(rhs_it.curr_node);
+    }
+
+    // == by hash alone, for whole trees, with the cost of probably_equal
+    // above. The call for change detection between versions.
+    bool probably_equal(const tree& other) const
+        requires links_type::template has<node_link::subtree_hash> {
+        node_type* lhs_root = base::root;
+        node_type* rhs_root = other.root;
+        if (lhs_root == nullptr || rhs_root == nullptr) {
+            return lhs_root == rhs_root;
+        }
+        return base::refresh_hashes(lhs_root) == base::refresh_hashes(rhs_root);
+    }
+
+    // Exact. With subtree hashes, the hashes dropped by mutations are
+    // refreshed along the paths to the root, and trees whose hashes differ
+    // are told apart without a walk: O(1) when one side is unchanged since
+    // the last comparison, O(changed nodes and their ancestors) otherwise.
+    // Trees with equal hashes, like all trees without hashes, are compared
+    // node by node, each node read once, since equal hashes may still be a
+    // collision. Callers that accept a 2^-64 chance of one call
+    // probably_equal, which is O(1) for equal trees too.
+    friend bool operator == (const tree& lhs, const tree& rhs) {
+        node_type* lhs_root = lhs.root;
+        node_type* rhs_root = rhs.root;
+        if (lhs_root == nullptr || rhs_root == nullptr) {
+            return lhs_root == rhs_root;
+        }
+        return nodes_equal(lhs_root, rhs_root);
+    }
+
+    // Walks the subtrees at `lhs_it` and `rhs_it` in lock-step, pairing
+    // children by position, and calls on_difference(lhs, rhs) in pre-order
+    // for every pair of nodes that differ in value or in number of children;
+    // nothing below such a pair is visited. With subtree hashes, the hashes
+    // of both subtrees are refreshed first and pairs with equal hashes are
+    // taken as equal (see probably_equal) and skipped, so only the paths to
+    // the differences and their siblings are walked.
+    template <typename Iterator, typename F>
+    void diff(Iterator lhs_it, Iterator rhs_it, F&& on_difference) const {
+        assert(lhs_it.curr_node != nullptr && rhs_it.curr_node != nullptr);
+        if constexpr (base::has_subtree_hashes) {
+            base::refresh_hashes(lhs_it.curr_node);
+            base::refresh_hashes(rhs_it.curr_node);
+        }
+        std::vector<std::pair<node_type*, node_type*>> pending{{lhs_it.curr_node, rhs_it.curr_node}};
+        while (!pending.empty()) {
+            auto [lhs, rhs] = pending.back();
+            pending.pop_back();
+            if constexpr (base::has_subtree_hashes) {
+                // a value handed out by on_difference drops its hash
+                if (lhs->has_subtree_hash() && lhs->subtree_hash() == rhs->subtree_hash()) {
+                    continue;
+                }
+            }
+
+            size_t first_child = pending.size();
+            node_type* lhs_child = lhs->first_child();
+            node_type* rhs_child = rhs->first_child();
+            for (; lhs_child != nullptr && rhs_child != nullptr;
+                 lhs_child = lhs_child->next_sibling(), rhs_child = rhs_child->next_sibling()) {
+                pending.emplace_back(lhs_child, rhs_child);
+            }
+            if (!(lhs->value() == rhs->value()) || lhs_child != rhs_child) {
+                pending.resize(first_child);
+                on_difference(Iterator{lhs}, Iterator{rhs});
+                continue;
+            }
+            // the first child is popped first
+            std::reverse(pending.begin() + static_cast<ptrdiff_t>(first_child), pending.end());
+        }
+    }
+
+private:
+    // Equal hashes may still be a collision, so only differing ones are
+    // taken as an answer.
+    static bool nodes_equal(const node_type* lhs, const node_type* rhs) {
+        if constexpr (base::has_subtree_hashes) {
+            if (base::refresh_hashes(lhs) != base::refresh_hashes(rhs)) {
+                return false;
+            }
+        }
+        return lock_step_equal(lhs, rhs);
+    }
+
+    // Reads every node once: the next siblings of a pair are kept aside when
+    // the pair is compared, instead of being reached again by climbing back
+    // through the parents, which a large subtree has pushed out of the cache
+    // by then. The stack holds at most one pair per level.
+    static bool lock_step_equal(const node_type* lhs, const node_type* rhs) {
+        std::vector<std::pair<const node_type*, const node_type*>> siblings;
+        const node_type* lhs_node = lhs;
+        const node_type* rhs_node = rhs;
+        while (true) {
+            if (!(lhs_node->value() == rhs_node->value())) {
+                return false;
+            }
+            if (lhs_node != lhs) {
+                const node_type* lhs_next = lhs_node->next_sibling();
+                const node_type* rhs_next = rhs_node->next_sibling();
+                if ((lhs_next == nullptr) != (rhs_next == nullptr)) {
+                    return false;
+                }
+                if (lhs_next != nullptr) {
+                    siblings.emplace_back(lhs_next, rhs_next);
+                }
+            }
+
+            const node_type* lhs_child = lhs_node->first_child();
+            const node_type* rhs_child = rhs_node->first_child();
+            if ((lhs_child == nullptr) != (rhs_child == nullptr)) {
+                return false;
+            }
+            if (lhs_child != nullptr) {
+                lhs_node = lhs_child;
+                rhs_node = rhs_child;
+                continue;
+            }
+            if (siblings.empty()) {
+                return true;
+            }
+            std::tie(lhs_node, rhs_node) = siblings.back();
+            siblings.pop_back();
+        }
     }
 
     template <typename Iterator>
-    Iterator prepend_child(Iterator parent_it, T&& value) noexcept(std::is_nothrow_constructible_v<T, T&&>) {
+    Iterator splice_child_impl(Iterator parent_it, tree& source, Iterator subtree_it) {
         assert(parent_it.curr_node != nullptr);
-        tree_node<T>* node = base::create_node(base::alloc, std::move(value));
-        parent_it.curr_node->push_front_child(node);
-        node_count++;
+        node_type* node = take_subtree(source, subtree_it.curr_node, parent_it.curr_node);
+        parent_it.curr_node->push_back_child(node);
+        link_levels(node);
+        label_linked(node);
+        forget_hashes_above(node);
+        track_linked(node);
+        count_linked(node);
         return Iterator{node};
     }
 
-    template <typename Iterator>
-    void erase_subtree(Iterator node_it) noexcept {
-        assert(node_it.curr_node != nullptr);
-        tree_node<T>* node   = node_it.curr_node;
-        tree_node<T>* parent = node->parent();
+    // Unlinks the subtree from source and returns it ready to be linked into
+    // this tree: the same nodes when they can change hands, a moved copy
+    // otherwise. Only trees with subtree sizes take subtrees of other trees.
+    node_type* take_subtree(tree& source, node_type* node, [[maybe_unused]] node_type* dest_node) {
+        assert(node != nullptr);
+        base& from = source;
+        bool same_tree = &source == this;
+        assert(base::has_subtree_sizes || same_tree);
+        assert(!same_tree || dest_node == nullptr || !is_ancestor_or_self(node, dest_node));
+
+        node_type* result = node;
+        size_t moved_count = 0;
+        if constexpr (base::has_subtree_sizes) {
+            if (!same_tree) {
+                moved_count = node->subtree_size();
+                if (base::alloc == from.alloc) {
+                    base::share_blocks(from, node);
+                } else {
+                    result = base::move_node_impl(node, moved_count);
+                    base::recount_sizes(result);
+                    if constexpr (base::has_level_links) {
+                        base::relink_levels(result);
+                    }
+                }
+            }
+        }
+        base::node_count += moved_count;
 
-        parent->unlink_child(node);
+        if constexpr (base::has_level_links) {
+            from.unlink_levels_impl(node);
+        }
+        track_unlinking(from, node);
+        forget_hashes_above(node);
+        count_unlinking(node);
+        if (node_type* parent = node->parent()) {
+            parent->unlink_child(node);
+        } else {
+            from.root = nullptr;
+        }
 
-        node_count -= count_nodes(node);
-        base::clear_node_impl(node);
+        from.node_count -= moved_count;
+        if (result != node) {
+            from.clear_node_impl(node);
+        }
+        return result;
     }
 
-private:
-    void insert_node_vert(tree_node<T>* old_node, tree_node<T>* new_node) noexcept {
+    static bool is_ancestor_or_self(const node_type* ancestor, const node_type* node) noexcept {
+        for (; node != nullptr; node = node->parent()) {
+            if (node == ancestor) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void insert_node_vert(node_type* old_node, node_type* new_node) noexcept {
         if (old_node != nullptr) {
-            tree_node<T>* parent = old_node->parent();
+            // the old subtree moves one level down
+            if constexpr (base::has_level_links) {
+                base::unlink_levels_impl(old_node);
+            }
+
+            node_type* parent = old_node->parent();
             if (parent != nullptr) {
                 replace(old_node, new_node);
             } else {
                 base::root = new_node;
             }
+            // old_node is the last child of new_node, the last node stays the same
+            bool had_children = new_node->first_child() != nullptr;
             new_node->push_back_child(old_node);
+            if constexpr (base::has_subtree_sizes) {
+                size_t added = new_node->subtree_size();
+                new_node->set_subtree_size(added + old_node->subtree_size());
+                base::add_to_sizes_above(new_node, added);
+            }
+            if constexpr (base::has_level_links) {
+                // a spliced new_node brings levels of its own, which must
+                // be joined with old_node's before linking them into the tree
+                if (had_children) {
+                    base::relink_levels(new_node);
+                }
+            }
         } else {
-            tree_node<T>* last_node = find_last_node();
+            node_type* last_node = find_last_node();
             if (last_node != nullptr) {
                 last_node->push_back_child(new_node);
             } else {
                 base::root = new_node;
             }
+            track_linked(new_node);
+            count_linked(new_node);
         }
+        link_levels(new_node);
+        label_linked(new_node, old_node);
+        // a spliced new_node has a hash, without old_node below it
+        forget_hashes_above(old_node != nullptr ? old_node : new_node);
     }
 
-    void insert_node_hor(tree_node<T>* old_node, tree_node<T>* new_node) noexcept {
+    void insert_node_hor(node_type* old_node, node_type* new_node) noexcept {
         if (old_node != nullptr) {
-            tree_node<T>* parent = old_node->parent();
+            node_type* parent = old_node->parent();
             assert(parent != nullptr);
             insert_sibling(old_node, new_node);
         } else {
-            tree_node<T>* last_node = find_last_node();
+            node_type* last_node = find_last_node();
             if (last_node != nullptr) {
-                tree_node<T>* parent = last_node->parent();
+                node_type* parent = last_node->parent();
                 parent->push_back_child(new_node);
             } else {
                 base::root = new_node;
             }
+            track_linked(new_node);
         }
+        link_levels(new_node);
+        label_linked(new_node);
+        forget_hashes_above(new_node);
+        count_linked(new_node);
     }
 
-    tree_node<T>* find_last_node() const noexcept {
-        if (base::root != nullptr) {
-            tree_node<T>* node = base::root;
-            while (node->last_child() != nullptr) {
-                node = node->last_child();
+    void link_levels(node_type* node) noexcept {
+        if constexpr (base::has_level_links) {
+            base::link_levels_impl(node);
+        }
+    }
+
+    // Labels the tokens the subtree at `node` brought in. When `kept` is the
+    // node it was inserted above, kept's own subtree keeps its labels; the new
+    // tokens are those before it and the exit of `node` after it.
+    void label_linked([[maybe_unused]] node_type* node, [[maybe_unused]] node_type* kept = nullptr) noexcept {
+        if constexpr (base::has_order_labels) {
+            using token = typename base::order_token;
+            if (kept == nullptr) {
+                base::label_tokens_impl(token{node, false}, token{node, true});
+            } else {
+                node->set_order_label(true, kept->order_label(true));
+                base::label_tokens_impl(token{node, false}, base::prev_token(token{kept, false}));
+                base::label_tokens_impl(token{node, true}, token{node, true});
             }
-            return node;
-        } else {
-            return nullptr;
         }
     }
 
-    size_t count_nodes(const tree_node<T>* node) const noexcept {
-        size_t result = 1;
-        const tree_node<T>* curr = node->first_child();
-        while (curr != nullptr) {
-            result += count_nodes(curr);
-            curr = curr->next_sibling();
+    // Called when the subtree at `node` is linked in or before it is unlinked:
+    // the hashes of its ancestors no longer hold.
+    static void forget_hashes_above([[maybe_unused]] node_type* node) noexcept {
+        if constexpr (base::has_subtree_hashes) {
+            base::forget_hashes(node->parent());
         }
-        return result;
     }
 
-    size_t node_count;
+    // Called once the subtree at `node` is linked in, and before it is
+    // unlinked: its ancestors gain or lose its nodes.
+    static void count_linked([[maybe_unused]] node_type* node) noexcept {
+        if constexpr (base::has_subtree_sizes) {
+            base::add_to_sizes_above(node, node->subtree_size());
+        }
+    }
+
+    static void count_unlinking([[maybe_unused]] node_type* node) noexcept {
+        if constexpr (base::has_subtree_sizes) {
+            base::take_from_sizes_above(node, node->subtree_size());
+        }
+    }
+
+    // With reversible links the tree keeps its last node in pre-order, so that
+    // pre_order_view::end() and inserting at the end need no walk. That node
+    // ends the rightmost path: the root, its last child and so on. A node is
+    // on that path when it and its ancestors have no next sibling.
+    // O(1) when the node is the last node, has a next sibling, or was just
+    // linked below or after the last node. Otherwise the walk climbs until
+    // it meets the last node or an ancestor with a next sibling, which for
+    // a node linked below the middle of the rightmost path is O(depth).
+    static bool on_rightmost_path(const base& owner, const node_type* node) noexcept {
+        if (node->next_sibling() == nullptr && node->prev_sibling() != nullptr &&
+            node->prev_sibling() == owner.pre_order_last) {
+            // linked after the last node, which was a leaf on the path
+            return true;
+        }
+        while (node != owner.pre_order_last) {
+            if (node->next_sibling() != nullptr) {
+                return false;
+            }
+            node = node->parent();
+            if (node == nullptr) {
+                return true;
+            }
+        }
+        return true;
+    }
+
+    // Called once the subtree at `node` is linked in: the subtree ends the
+    // pre-order if it hangs off the rightmost path as a last child.
+    void track_linked([[maybe_unused]] node_type* node) noexcept {
+        if constexpr (links_type::reversible) {
+            if (on_rightmost_path(*this, node)) {
+                base::pre_order_last = base::last_descendant(node);
+            }
+        }
+    }
+
+    // Called before the subtree at `node` is unlinked from `owner`: if the
+    // subtree ended the pre-order, now the node before it does.
+    static void track_unlinking([[maybe_unused]] base& owner, [[maybe_unused]] node_type* node) noexcept {
+        if constexpr (links_type::reversible) {
+            if (on_rightmost_path(owner, node)) {
+                node_type* prev = node->prev_sibling();
+                owner.pre_order_last = prev != nullptr ? base::last_descendant(prev) : node->parent();
+            }
+        }
+    }
+
+    template <typename ValueRange, typename IndexRange>
+    static size_t checked_size(const ValueRange& values, const IndexRange& indices) {
+        auto count = std::distance(std::begin(values), std::end(values));
+        if (count != std::distance(std::begin(indices), std::end(indices))) {
+            throw std::invalid_argument{"tree: value and index ranges differ in size"};
+        }
+        return static_cast<size_t>(count);
+    }
+
+    // O(1) with reversible links, a walk down the rightmost path otherwise
+    node_type* find_last_node() const noexcept {
+        if constexpr (links_type::reversible) {
+            return base::pre_order_last;
+        } else {
+            return base::root != nullptr ? base::last_descendant(base::root) : nullptr;
+        }
+    }
 };
 
-template <typename T>
+template <typename T, typename Allocator>
 class pre_order_view {
 public:
-    using iterator               = pre_order_iterator<T>;
-    using const_iterator         = pre_order_iterator<const T>;
+    using links_type             = typename tree<T, Allocator>::links_type;
+    using node_type              = typename tree<T, Allocator>::node_type;
+    using iterator               = pre_order_iterator<T, links_type>;
+    using const_iterator         = pre_order_iterator<const T, links_type>;
     using reverse_iterator       = std::reverse_iterator<iterator>;
     using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
-    using value_type      = typename tree<T>::value_type;
-    using reference       = typename tree<T>::reference;
-    using const_reference = typename tree<T>::const_reference;
-    using pointer         = typename tree<T>::pointer;
-    using const_pointer   = typename tree<T>::const_pointer;
-    using size_type       = typename tree<T>::size_type;
-    using difference_type = typename tree<T>::difference_type;
+    using value_type      = typename tree<T, Allocator>::value_type;
+    using reference       = typename tree<T, Allocator>::reference;
+    using const_reference = typename tree<T, Allocator>::const_reference;
+    using pointer         = typename tree<T, Allocator>::pointer;
+    using const_pointer   = typename tree<T, Allocator>::const_pointer;
+    using size_type       = typename tree<T, Allocator>::size_type;
+    using difference_type = typename tree<T, Allocator>::difference_type;
 
-    pre_order_view(const tree<T>& tree)
+    pre_order_view(const tree<T, Allocator>& tree)
         : viewable{tree} {}
 
     iterator begin() const noexcept {
@@ -794,7 +3608,7 @@ public:
     }
 
     iterator end() const noexcept {
-        return iterator{nullptr, viewable.find_last_node()};
+        return iterator{nullptr, last_node()};
     }
 
     const_iterator cbegin() const noexcept {
@@ -802,7 +3616,7 @@ public:
     }
 
     const_iterator cend() const noexcept {
-        return const_iterator{nullptr, viewable.find_last_node()};
+        return const_iterator{nullptr, last_node()};
     }
 
     reverse_iterator rbegin() const noexcept {
@@ -846,7 +3660,248 @@ public:
     }
 
 private:
-    const tree<T>& viewable;
+    // end() only remembers the last node when iterators can step back to it;
+    // the tree keeps that node, so end() is O(1)
+    node_type* last_node() const noexcept {
+        if constexpr (links_type::reversible) {
+            return viewable.find_last_node();
+        } else {
+            return nullptr;
+        }
+    }
+
+    const tree<T, Allocator>& viewable;
+};
+
+
+template <typename T, typename Allocator>
+class post_order_view {
+public:
+    using links_type             = typename tree<T, Allocator>::links_type;
+    using node_type              = typename tree<T, Allocator>::node_type;
+    using iterator               = post_order_iterator<T, links_type>;
+    using const_iterator         = post_order_iterator<const T, links_type>;
+    using reverse_iterator       = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    using value_type      = typename tree<T, Allocator>::value_type;
+    using reference       = typename tree<T, Allocator>::reference;
+    using const_reference = typename tree<T, Allocator>::const_reference;
+    using pointer         = typename tree<T, Allocator>::pointer;
+    using const_pointer   = typename tree<T, Allocator>::const_pointer;
+    using size_type       = typename tree<T, Allocator>::size_type;
+    using difference_type = typename tree<T, Allocator>::difference_type;
+
+    post_order_view(const tree<T, Allocator>& tree)
+        : viewable{tree} {}
+
+    iterator begin() const noexcept {
+        return iterator{first_node(), nullptr};
+    }
+
+    // the root closes the post-order, so end() needs no walk
+    iterator end() const noexcept {
+        return iterator{nullptr, last_node()};
+    }
+
+    const_iterator cbegin() const noexcept {
+        return const_iterator{first_node(), nullptr};
+    }
+
+    const_iterator cend() const noexcept {
+        return const_iterator{nullptr, last_node()};
+    }
+
+    reverse_iterator rbegin() const noexcept {
+        return std::make_reverse_iterator(end());
+    }
+
+    reverse_iterator rend() const noexcept {
+        return std::make_reverse_iterator(begin());
+    }
+
+    const_reverse_iterator crbegin() const noexcept {
+        return std::make_reverse_iterator(cend());
+    }
+
+    const_reverse_iterator crend() const noexcept {
+        return std::make_reverse_iterator(cbegin());
+    }
+
+    reference front() noexcept {
+        return *begin();
+    }
+
+    const_reference front() const noexcept {
+        return *begin();
+    }
+
+    reference back() noexcept {
+        return viewable.root->mutable_value();
+    }
+
+    const_reference back() const noexcept {
+        return viewable.root->value();
+    }
+
+    size_type size() const noexcept {
+        return viewable.size();
+    }
+
+    bool empty() const noexcept {
+        return viewable.empty();
+    }
+
+private:
+    node_type* first_node() const noexcept {
+        return viewable.root != nullptr ? iterator::first_leaf(viewable.root) : nullptr;
+    }
+
+    node_type* last_node() const noexcept {
+        return links_type::reversible ? viewable.root : nullptr;
+    }
+
+    const tree<T, Allocator>& viewable;
+};
+
+
+// Breadth-first view. Trees whose nodes keep next_in_level links are walked
+// along those links; other trees go through a queue that belongs to the view
+// and is reused by every pass, so only one pass per view may run at a time.
+template <typename T, typename Allocator>
+class level_order_view {
+public:
+    using links_type     = typename tree<T, Allocator>::links_type;
+    using node_type      = typename tree<T, Allocator>::node_type;
+    using iterator       = std::conditional_t<
+        links_type::template has<node_link::next_in_level>,
+        level_link_iterator<T, links_type>,
+        level_order_iterator<T, links_type>>;
+    using const_iterator = iterator;
+
+    using value_type      = typename tree<T, Allocator>::value_type;
+    using reference       = typename tree<T, Allocator>::reference;
+    using const_reference = typename tree<T, Allocator>::const_reference;
+    using pointer         = typename tree<T, Allocator>::pointer;
+    using const_pointer   = typename tree<T, Allocator>::const_pointer;
+    using size_type       = typename tree<T, Allocator>::size_type;
+    using difference_type = typename tree<T, Allocator>::difference_type;
+
+    level_order_view(const tree<T, Allocator>& tree)
+        : viewable{tree} {}
+
+    iterator begin() const {
+        if constexpr (links_type::template has<node_link::next_in_level>) {
+            return iterator{viewable.root};
+        } else {
+            queue.clear();
+            return iterator{viewable.root, &queue};
+        }
+    }
+
+    iterator end() const noexcept {
+        return iterator{nullptr};
+    }
+
+    const_iterator cbegin() const {
+        return begin();
+    }
+
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+    reference front() noexcept {
+        return viewable.root->mutable_value();
+    }
+
+    const_reference front() const noexcept {
+        return viewable.root->value();
+    }
+
+    size_type size() const noexcept {
+        return viewable.size();
+    }
+
+    bool empty() const noexcept {
+        return viewable.empty();
+    }
+
+private:
+    const tree<T, Allocator>& viewable;
+    mutable detail::ring_buffer<node_type*> queue;
+};
+
+// Forward views for std::ranges and range-for loops. They end in
+// std::default_sentinel rather than in an end iterator, so the end of the walk
+// is a single null test. They only point to the tree, so they are cheap to
+// copy, and their iterators stay valid after the view is gone.
+template <typename T, typename Allocator>
+class pre_order_range : public std::ranges::view_interface<pre_order_range<T, Allocator>> {
+public:
+    using links_type = typename tree<T, Allocator>::links_type;
+    using iterator   = pre_order_iterator<T, links_type>;
+    using sentinel   = std::default_sentinel_t;
+    using size_type  = typename tree<T, Allocator>::size_type;
+
+    pre_order_range(const tree<T, Allocator>& tree) noexcept
+        : viewable{&tree} {}
+
+    iterator begin() const noexcept {
+        return iterator{viewable->root, nullptr};
+    }
+
+    sentinel end() const noexcept {
+        return std::default_sentinel;
+    }
+
+    size_type size() const noexcept {
+        return viewable->size();
+    }
+
+    bool empty() const noexcept {
+        return viewable->empty();
+    }
+
+private:
+    const tree<T, Allocator>* viewable;
+};
+
+template <typename T, typename Allocator>
+class post_order_range : public std::ranges::view_interface<post_order_range<T, Allocator>> {
+public:
+    using links_type = typename tree<T, Allocator>::links_type;
+    using iterator   = post_order_iterator<T, links_type>;
+    using sentinel   = std::default_sentinel_t;
+    using size_type  = typename tree<T, Allocator>::size_type;
+
+    post_order_range(const tree<T, Allocator>& tree) noexcept
+        : viewable{&tree} {}
+
+    iterator begin() const noexcept {
+        return iterator{viewable->root != nullptr ? iterator::first_leaf(viewable->root) : nullptr, nullptr};
+    }
+
+    sentinel end() const noexcept {
+        return std::default_sentinel;
+    }
+
+    size_type size() const noexcept {
+        return viewable->size();
+    }
+
+    bool empty() const noexcept {
+        return viewable->empty();
+    }
+
+private:
+    const tree<T, Allocator>* viewable;
 };
 
+template <typename T, typename Allocator>
+inline constexpr bool std::ranges::enable_borrowed_range<pre_order_range<T, Allocator>> = true;
+
+template <typename T, typename Allocator>
+inline constexpr bool std::ranges::enable_borrowed_range<post_order_range<T, Allocator>> = true;
+
 #endif // TREE_H_INCLUDED
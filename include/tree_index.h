@@ -0,0 +1,397 @@
+#ifndef TREE_INDEX_H_INCLUDED
+#define TREE_INDEX_H_INCLUDED
+
+#include "tree.h"
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+// Default monoid of tree_index: sums the weights.
+template <typename W>
+struct sum_monoid {
+    using value_type = W;
+
+    W identity() const {
+        return W{};
+    }
+
+    W operator () (const W& lhs, const W& rhs) const {
+        return lhs + rhs;
+    }
+};
+
+// Query index over a tree that does not change between queries. Nodes are
+// identified by their pre-order index, as in frozen_tree; index_of maps a value
+// held by the tree to it. Every node carries a weight, projected from its value
+// when the index is built, and paths are folded with the monoid, which needs
+// identity() and an associative operator () but neither inverses nor
+// commutativity: path(a, b) combines the weights in order from a to b.
+//
+// - depth, parent, is_ancestor: O(1) from cached arrays.
+// - lca: O(1). The lowest common ancestor of a and b (a < b) is the parent of
+//   the shallowest node in (a, b] of the pre-order, the usual Euler tour
+//   reduction with the pre-order standing in for the tour. The minimum is
+//   found by blocks of 64: bit masks of a monotonic stack answer within a
+//   block and a sparse table over the block minima answers across blocks.
+// - path_from_root: O(1) from folds kept for every node.
+// - path: O(log n). Heavy-light decomposition splits the path into chains;
+//   whole chain prefixes are kept folded and the one partial chain is folded
+//   by a segment tree.
+//
+// Building is O(n). The index refers to the values of the tree, so after the
+// tree changes it has to be rebuilt.
+template <typename T, typename Monoid = sum_monoid<T>>
+class tree_index {
+public:
+    using value_type  = T;
+    using weight_type = typename Monoid::value_type;
+    using size_type   = size_t;
+    using index_type  = std::uint32_t;
+
+    static constexpr index_type npos = ~index_type{0};
+
+    tree_index() = default;
+
+    template <typename Allocator, typename Weight = std::identity>
+    explicit tree_index(const tree<T, Allocator>& source, Weight weight = {}, Monoid monoid = {})
+        : monoid{std::move(monoid)} {
+        rebuild(source, std::move(weight));
+    }
+
+    template <typename Allocator, typename Weight = std::identity>
+    void rebuild(const tree<T, Allocator>& source, Weight weight = {}) {
+        if (source.size() >= npos) {
+            throw std::length_error{"tree_index: too many nodes for 32-bit indices"};
+        }
+        clear();
+        if (source.empty()) {
+            return;
+        }
+
+        size_t count = source.size();
+        node_values.reserve(count);
+        parents.reserve(count);
+        depths.reserve(count);
+        weights.reserve(count);
+        positions.reserve(count);
+        value_indices.reserve(count);
+
+        pre_order_view view{source};
+        auto traverser = std::begin(view).as_traverser();
+        index_type curr = push(traverser.value(), npos, weight);
+        while (true) {
+            if (traverser.to_first_child()) {
+                curr = push(traverser.value(), curr, weight);
+                continue;
+            }
+            while (!traverser.has_next_sibling()) {
+                if (!traverser.to_parent()) {
+                    build();
+                    return;
+                }
+                curr = parents[curr];
+            }
+            traverser.to_next_sibling();
+            curr = push(traverser.value(), parents[curr], weight);
+        }
+    }
+
+    size_type size() const noexcept {
+        return node_values.size();
+    }
+
+    bool empty() const noexcept {
+        return node_values.empty();
+    }
+
+    index_type root() const noexcept {
+        return empty() ? npos : 0;
+    }
+
+    // pre-order index of a value held by the tree (e.g. *it), npos for any other object
+    index_type index_of(const T& value) const {
+        auto it = value_indices.find(&value);
+        return it != value_indices.end() ? it->second : npos;
+    }
+
+    const T& operator [] (index_type node) const noexcept {
+        return *node_values[node];
+    }
+
+    const weight_type& weight(index_type node) const noexcept {
+        return weights[node];
+    }
+
+    index_type parent(index_type node) const noexcept {
+        return parents[node];
+    }
+
+    // the root is at depth 0
+    index_type depth(index_type node) const noexcept {
+        return depths[node];
+    }
+
+    index_type subtree_size(index_type node) const noexcept {
+        return subtree_sizes[node];
+    }
+
+    bool is_ancestor(index_type ancestor, index_type node) const noexcept {
+        return ancestor <= node && node < ancestor + subtree_sizes[ancestor];
+    }
+
+    index_type lca(index_type a, index_type b) const noexcept {
+        if (a == b) {
+            return a;
+        }
+        if (a > b) {
+            std::swap(a, b);
+        }
+        return parents[shallowest(a + 1, b)];
+    }
+
+    index_type distance(index_type a, index_type b) const noexcept {
+        return depths[a] + depths[b] - 2 * depths[lca(a, b)];
+    }
+
+    // weights from the root down to node, both included
+    const weight_type& path_from_root(index_type node) const noexcept {
+        return root_folds[node];
+    }
+
+    // weights from a to b along the tree, both included
+    weight_type path(index_type a, index_type b) const {
+        index_type top = lca(a, b);
+
+        // a up to top, against the order of positions
+        weight_type up = monoid.identity();
+        index_type node = a;
+        while (heads[node] != heads[top]) {
+            up = monoid(up, chain_up_folds[node]);
+            node = parents[heads[node]];
+        }
+        up = monoid(up, fold_up(positions[top], positions[node] + 1));
+
+        // below top down to b, along the order of positions
+        weight_type down = monoid.identity();
+        node = b;
+        while (heads[node] != heads[top]) {
+            down = monoid(chain_down_folds[node], down);
+            node = parents[heads[node]];
+        }
+        down = monoid(fold_down(positions[top] + 1, positions[node] + 1), down);
+
+        return monoid(up, down);
+    }
+
+    void clear() noexcept {
+        node_values.clear();
+        parents.clear();
+        depths.clear();
+        weights.clear();
+        subtree_sizes.clear();
+        heads.clear();
+        positions.clear();
+        root_folds.clear();
+        chain_down_folds.clear();
+        chain_up_folds.clear();
+        down_tree.clear();
+        up_tree.clear();
+        stack_masks.clear();
+        block_minima.clear();
+        block_count = 0;
+        value_indices.clear();
+    }
+
+private:
+    static constexpr index_type block_bits = 64;
+
+    template <typename Weight>
+    index_type push(const T& value, index_type parent, Weight& weight) {
+        auto index = static_cast<index_type>(node_values.size());
+        node_values.push_back(&value);
+        parents.push_back(parent);
+        depths.push_back(parent != npos ? depths[parent] + 1 : 0);
+        weights.push_back(static_cast<weight_type>(std::invoke(weight, value)));
+        value_indices.emplace(&value, index);
+        return index;
+    }
+
+    void build() {
+        auto count = static_cast<index_type>(node_values.size());
+
+        // subtree sizes and heavy children, children come after their parent
+        subtree_sizes.assign(count, 1);
+        for (index_type i = count; i-- > 1; ) {
+            subtree_sizes[parents[i]] += subtree_sizes[i];
+        }
+        std::vector<index_type> heavy(count, npos);
+        for (index_type i = 1; i < count; i++) {
+            index_type& child = heavy[parents[i]];
+            if (child == npos || subtree_sizes[i] > subtree_sizes[child]) {
+                child = i;
+            }
+        }
+
+        // chains get consecutive positions, from their head down
+        heads.resize(count);
+        positions.resize(count);
+        root_folds.resize(count, monoid.identity());
+        chain_down_folds.resize(count, monoid.identity());
+        chain_up_folds.resize(count, monoid.identity());
+        index_type next_position = 0;
+        for (index_type i = 0; i < count; i++) {
+            index_type parent = parents[i];
+            root_folds[i] = parent != npos ? monoid(root_folds[parent], weights[i]) : weights[i];
+            if (parent != npos && heavy[parent] == i) {
+                heads[i] = heads[parent];
+                chain_down_folds[i] = monoid(chain_down_folds[parent], weights[i]);
+                chain_up_folds[i] = monoid(weights[i], chain_up_folds[parent]);
+                continue;
+            }
+            heads[i] = i;
+            chain_down_folds[i] = weights[i];
+            chain_up_folds[i] = weights[i];
+            for (index_type node = i; node != npos; node = heavy[node]) {
+                positions[node] = next_position++;
+            }
+        }
+
+        // segment trees over the positions, folded in both directions
+        down_tree.resize(2 * size_t{count}, monoid.identity());
+        up_tree.resize(2 * size_t{count}, monoid.identity());
+        for (index_type i = 0; i < count; i++) {
+            down_tree[count + positions[i]] = weights[i];
+            up_tree[count + positions[i]] = weights[i];
+        }
+        for (index_type i = count; i-- > 1; ) {
+            down_tree[i] = monoid(down_tree[2 * i], down_tree[2 * i + 1]);
+            up_tree[i] = monoid(up_tree[2 * i + 1], up_tree[2 * i]);
+        }
+
+        build_minima();
+    }
+
+    // stack_masks[i] has a bit for every j <= i in the block of i that is
+    // shallower than every node in (j, i]; the lowest such j >= l is the
+    // shallowest node in [l, i].
+    void build_minima() {
+        auto count = static_cast<index_type>(node_values.size());
+        stack_masks.resize(count);
+        for (index_type start = 0; start < count; start += block_bits) {
+            std::uint64_t mask = 0;
+            for (index_type i = start; i < count && i - start < block_bits; i++) {
+                while (mask != 0) {
+                    index_type top = start + block_bits - 1 - static_cast<index_type>(std::countl_zero(mask));
+                    if (depths[top] < depths[i]) {
+                        break;
+                    }
+                    mask &= ~(std::uint64_t{1} << (top - start));
+                }
+                mask |= std::uint64_t{1} << (i - start);
+                stack_masks[i] = mask;
+            }
+        }
+
+        // level k holds the shallowest node of blocks [b, b + 2^k)
+        index_type blocks = (count + block_bits - 1) / block_bits;
+        block_count = blocks;
+        auto levels = static_cast<index_type>(std::bit_width(blocks));
+        block_minima.resize(size_t{levels} * blocks);
+        for (index_type b = 0; b < blocks; b++) {
+            block_minima[b] = in_block(b * block_bits, std::min(count, (b + 1) * block_bits) - 1);
+        }
+        for (index_type k = 1; k < levels; k++) {
+            index_type* level = block_minima.data() + size_t{k} * blocks;
+            const index_type* below = level - blocks;
+            for (index_type b = 0; b + (index_type{1} << k) <= blocks; b++) {
+                level[b] = shallower(below[b], below[b + (index_type{1} << (k - 1))]);
+            }
+        }
+    }
+
+    index_type shallower(index_type a, index_type b) const noexcept {
+        return depths[b] < depths[a] ? b : a;
+    }
+
+    index_type in_block(index_type first, index_type last) const noexcept {
+        std::uint64_t mask = stack_masks[last] & (~std::uint64_t{0} << (first % block_bits));
+        return last - last % block_bits + static_cast<index_type>(std::countr_zero(mask));
+    }
+
+    // the shallowest node in [first, last] of the pre-order
+    index_type shallowest(index_type first, index_type last) const noexcept {
+        index_type first_block = first / block_bits;
+        index_type last_block = last / block_bits;
+        if (first_block == last_block) {
+            return in_block(first, last);
+        }
+
+        index_type result = shallower(
+            in_block(first, first_block * block_bits + block_bits - 1),
+            in_block(last_block * block_bits, last));
+        if (last_block - first_block > 1) {
+            index_type span = last_block - first_block - 1;
+            auto k = static_cast<index_type>(std::bit_width(span) - 1);
+            const index_type* level = block_minima.data() + size_t{k} * block_count;
+            result = shallower(result, shallower(level[first_block + 1], level[last_block - (index_type{1} << k)]));
+        }
+        return result;
+    }
+
+    // weights at positions [first, last), in order
+    weight_type fold_down(index_type first, index_type last) const {
+        auto count = static_cast<index_type>(node_values.size());
+        weight_type left = monoid.identity();
+        weight_type right = monoid.identity();
+        for (first += count, last += count; first < last; first /= 2, last /= 2) {
+            if (first & 1) {
+                left = monoid(left, down_tree[first++]);
+            }
+            if (last & 1) {
+                right = monoid(down_tree[--last], right);
+            }
+        }
+        return monoid(left, right);
+    }
+
+    // weights at positions [first, last), last to first
+    weight_type fold_up(index_type first, index_type last) const {
+        auto count = static_cast<index_type>(node_values.size());
+        weight_type left = monoid.identity();
+        weight_type right = monoid.identity();
+        for (first += count, last += count; first < last; first /= 2, last /= 2) {
+            if (first & 1) {
+                left = monoid(up_tree[first++], left);
+            }
+            if (last & 1) {
+                right = monoid(right, up_tree[--last]);
+            }
+        }
+        return monoid(right, left);
+    }
+
+    [[no_unique_address]] Monoid monoid;
+    std::vector<const T*> node_values;
+    std::vector<index_type> parents;
+    std::vector<index_type> depths;
+    std::vector<weight_type> weights;
+    std::vector<index_type> subtree_sizes;
+    // heavy-light decomposition: the chain head and position of every node
+    std::vector<index_type> heads;
+    std::vector<index_type> positions;
+    std::vector<weight_type> root_folds;
+    // from the chain head down to the node, and from the node up to the head
+    std::vector<weight_type> chain_down_folds;
+    std::vector<weight_type> chain_up_folds;
+    std::vector<weight_type> down_tree;
+    std::vector<weight_type> up_tree;
+    std::vector<std::uint64_t> stack_masks;
+    std::vector<index_type> block_minima;
+    index_type block_count = 0;
+    std::unordered_map<const T*, index_type> value_indices;
+};
+
+#endif // TREE_INDEX_H_INCLUDED
@@ -0,0 +1,110 @@
+#ifndef TREE_STATS_H_INCLUDED
+#define TREE_STATS_H_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+// Counters kept by a stats_allocator. Node counts are in elements of the
+// allocator's value_type, which for a tree is its node type.
+struct allocation_stats {
+    std::size_t allocations = 0;     // calls to allocate
+    std::size_t deallocations = 0;   // calls to deallocate, bulk releases included
+    std::size_t allocated_nodes = 0;
+    std::size_t freed_nodes = 0;
+    std::size_t peak_live_nodes = 0;
+
+    std::size_t live_nodes() const noexcept {
+        return allocated_nodes - freed_nodes;
+    }
+};
+
+// Opt-in instrumentation for trees: wraps the node allocator and counts what
+// goes through it, e.g. tree<T, stats_allocator<std::allocator<tree_node<T>>>>.
+// Trees with a plain allocator pay nothing. Copies of the allocator share one
+// set of counters; copying a tree gives the copy counters of its own.
+template <typename Allocator>
+class stats_allocator {
+    using base_traits = std::allocator_traits<Allocator>;
+
+public:
+    using value_type = typename base_traits::value_type;
+    using size_type = typename base_traits::size_type;
+    using difference_type = typename base_traits::difference_type;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    template <typename U>
+    struct rebind {
+        using other = stats_allocator<typename base_traits::template rebind_alloc<U>>;
+    };
+
+    template <typename>
+    friend class stats_allocator;
+
+    explicit stats_allocator(Allocator base = Allocator{})
+        : base{std::move(base)}
+        , counters{std::make_shared<allocation_stats>()} {}
+
+    stats_allocator(const stats_allocator& other) noexcept = default;
+
+    template <typename Other>
+    stats_allocator(const stats_allocator<Other>& other) noexcept
+        : base{other.base}
+        , counters{other.counters} {}
+
+    stats_allocator& operator = (const stats_allocator& other) noexcept = default;
+
+    value_type* allocate(size_type n) {
+        value_type* result = base_traits::allocate(base, n);
+        counters->allocations++;
+        counters->allocated_nodes += n;
+        counters->peak_live_nodes = std::max(counters->peak_live_nodes, counters->live_nodes());
+        return result;
+    }
+
+    void deallocate(value_type* ptr, size_type n) noexcept {
+        counters->deallocations++;
+        counters->freed_nodes += n;
+        base_traits::deallocate(base, ptr, n);
+    }
+
+    stats_allocator select_on_container_copy_construction() const {
+        return stats_allocator{base_traits::select_on_container_copy_construction(base)};
+    }
+
+    // bulk release is passed through when the wrapped allocator supports it
+    bool exclusive() const noexcept
+        requires requires (const Allocator& a) { a.exclusive(); } {
+        return base.exclusive();
+    }
+
+    void release() noexcept
+        requires requires (Allocator& a) { a.release(); } {
+        base.release();
+        counters->deallocations++;
+        counters->freed_nodes = counters->allocated_nodes;
+    }
+
+    const allocation_stats& stats() const noexcept {
+        return *counters;
+    }
+
+    const Allocator& base_allocator() const noexcept {
+        return base;
+    }
+
+    template <typename Other>
+    bool operator == (const stats_allocator<Other>& other) const noexcept {
+        return counters == other.counters && base == other.base;
+    }
+
+private:
+    Allocator base;
+    std::shared_ptr<allocation_stats> counters;
+};
+
+#endif // TREE_STATS_H_INCLUDED
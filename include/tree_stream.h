@@ -0,0 +1,346 @@
+#ifndef TREE_STREAM_H_INCLUDED
+#define TREE_STREAM_H_INCLUDED
+
+#include "tree.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Pre-order byte stream of a tree. After a four byte header every node is
+// written as a varint token followed by its value; the token is one more than
+// the number of subtrees closed since the previous node, so 1 makes the node a
+// child of the previous one, 2 its sibling, and so on. Token 0 ends the stream.
+// Values are encoded by stream_codec<T>: fixed-size codecs write the bytes as
+// they are, variable-size ones are prefixed with their length as a varint.
+
+// Raw bytes of trivially copyable values, in the byte order of the machine.
+// Specialize for other value types.
+template <typename T, typename = void>
+struct stream_codec {
+    static_assert(std::is_trivially_copyable_v<T>, "values that are not trivially copyable need a stream_codec specialization");
+
+    static constexpr bool fixed_size = true;
+    static constexpr size_t size = sizeof(T);
+
+    static std::span<const std::byte, sizeof(T)> bytes(const T& value) noexcept {
+        return std::as_bytes(std::span<const T, 1>{&value, 1});
+    }
+
+    static T decode(std::span<const std::byte> bytes) noexcept {
+        std::array<std::byte, sizeof(T)> raw;
+        std::memcpy(raw.data(), bytes.data(), sizeof(T));
+        return std::bit_cast<T>(raw);
+    }
+};
+
+template <>
+struct stream_codec<std::string> {
+    static constexpr bool fixed_size = false;
+
+    static std::span<const std::byte> bytes(const std::string& value) noexcept {
+        return std::as_bytes(std::span<const char>{value.data(), value.size()});
+    }
+
+    static std::string decode(std::span<const std::byte> bytes) {
+        return std::string(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+};
+
+namespace detail {
+    inline constexpr std::array<std::byte, 4> stream_header = {
+        std::byte{'T'}, std::byte{'R'}, std::byte{'S'}, std::byte{1}};
+
+    // Collects output into a fixed-size buffer handed to the sink whenever it fills up.
+    template <typename Sink>
+    class chunk_writer {
+    public:
+        chunk_writer(Sink& sink, size_t chunk_size)
+            : sink{sink}
+            , buffer(chunk_size > 0 ? chunk_size : 1)
+            , used{0} {}
+
+        void put(std::span<const std::byte> bytes) {
+            while (!bytes.empty()) {
+                size_t n = std::min(bytes.size(), buffer.size() - used);
+                std::memcpy(buffer.data() + used, bytes.data(), n);
+                used += n;
+                bytes = bytes.subspan(n);
+                if (used == buffer.size()) {
+                    flush();
+                }
+            }
+        }
+
+        void put_varint(std::uint64_t value) {
+            std::array<std::byte, 10> bytes;
+            size_t n = 0;
+            while (value >= 0x80) {
+                bytes[n++] = static_cast<std::byte>(value | 0x80);
+                value >>= 7;
+            }
+            bytes[n++] = static_cast<std::byte>(value);
+            if (buffer.size() - used >= n) {
+                std::memcpy(buffer.data() + used, bytes.data(), n);
+                used += n;
+                if (used == buffer.size()) {
+                    flush();
+                }
+            } else {
+                put(std::span<const std::byte>{bytes.data(), n});
+            }
+        }
+
+        void flush() {
+            if (used != 0) {
+                sink(std::span<const std::byte>{buffer.data(), used});
+                used = 0;
+            }
+        }
+
+    private:
+        Sink& sink;
+        std::vector<std::byte> buffer;
+        size_t used;
+    };
+}
+
+inline constexpr size_t default_stream_chunk_size = 64 * 1024;
+
+// Writes the tree to `sink`, a callable taking std::span<const std::byte>, in
+// chunks of chunk_size bytes (the last one may be shorter). Memory use does
+// not depend on the size of the tree.
+template <typename T, typename Allocator, typename Sink>
+void encode_tree(const tree<T, Allocator>& source, Sink&& sink, size_t chunk_size = default_stream_chunk_size) {
+    using codec = stream_codec<T>;
+    detail::chunk_writer<std::remove_reference_t<Sink>> out{sink, chunk_size};
+    out.put(detail::stream_header);
+
+    auto put_node = [&out](std::uint64_t closed, const T& value) {
+        out.put_varint(closed + 1);
+        auto bytes = codec::bytes(value);
+        if constexpr (!codec::fixed_size) {
+            out.put_varint(bytes.size());
+        }
+        out.put(bytes);
+    };
+
+    if (!source.empty()) {
+        pre_order_view view{source};
+        auto traverser = std::begin(view).as_traverser();
+        put_node(0, traverser.value());
+        while (true) {
+            if (traverser.to_first_child()) {
+                put_node(0, traverser.value());
+                continue;
+            }
+
+            std::uint64_t closed = 1;
+            while (!traverser.has_next_sibling() && traverser.to_parent()) {
+                closed++;
+            }
+            if (!traverser.to_next_sibling()) {
+                break;
+            }
+            put_node(closed, traverser.value());
+        }
+    }
+
+    out.put_varint(0);
+    out.flush();
+}
+
+// Push-style decoder: feed() takes the stream in chunks of any size, split
+// anywhere, and adds every complete node to the tree right away. Besides the
+// tree it keeps the path from the root to the last node and at most one
+// value that straddles two chunks.
+template <typename T, typename Allocator = std::allocator<tree_node<T>>>
+class tree_decoder {
+public:
+    explicit tree_decoder(Allocator alloc = Allocator{})
+        : result{std::move(alloc)}
+        , state{state_type::header}
+        , varint_value{0}
+        , varint_shift{0}
+        , closed{0}
+        , value_size{0} {}
+
+    // Throws std::runtime_error if the bytes do not continue a valid stream;
+    // the decoder is unusable afterwards.
+    void feed(std::span<const std::byte> chunk) {
+        while (!chunk.empty()) {
+            switch (state) {
+            case state_type::header:
+                if (!collect(chunk, detail::stream_header.size())) {
+                    return;
+                }
+                if (!std::equal(pending.begin(), pending.end(), detail::stream_header.begin())) {
+                    fail("not a tree stream");
+                }
+                pending.clear();
+                state = state_type::token;
+                break;
+
+            case state_type::token: {
+                std::uint64_t token;
+                if (!read_varint(chunk, token)) {
+                    return;
+                }
+                if (token == 0) {
+                    state = state_type::done;
+                    break;
+                }
+                closed = token - 1;
+                if (path.empty() ? (closed != 0 || !result.empty()) : closed >= path.size()) {
+                    fail("node closes more subtrees than are open");
+                }
+                if constexpr (codec::fixed_size) {
+                    value_size = codec::size;
+                    state = state_type::value;
+                } else {
+                    state = state_type::value_size;
+                }
+                break;
+            }
+
+            case state_type::value_size: {
+                std::uint64_t size;
+                if (!read_varint(chunk, size)) {
+                    return;
+                }
+                value_size = static_cast<size_t>(size);
+                state = state_type::value;
+                break;
+            }
+
+            case state_type::value:
+                if (pending.empty() && chunk.size() >= value_size) {
+                    // the whole value is in this chunk, no copy needed
+                    add_node(chunk.first(value_size));
+                    chunk = chunk.subspan(value_size);
+                } else {
+                    if (!collect(chunk, value_size)) {
+                        return;
+                    }
+                    add_node(pending);
+                    pending.clear();
+                }
+                state = state_type::token;
+                break;
+
+            case state_type::done:
+                fail("data after the end of the stream");
+            }
+        }
+    }
+
+    // true once the end of the stream has been read
+    bool done() const noexcept {
+        return state == state_type::done;
+    }
+
+    // the tree decoded so far; complete once done()
+    tree<T, Allocator>& get() noexcept {
+        return result;
+    }
+
+    tree<T, Allocator> take() {
+        if (!done()) {
+            throw std::runtime_error{"tree_decoder: stream is incomplete"};
+        }
+        path.clear();
+        return std::move(result);
+    }
+
+private:
+    using codec    = stream_codec<T>;
+    using links_type = typename tree<T, Allocator>::links_type;
+    using iterator   = pre_order_iterator<T, links_type>;
+
+    enum class state_type {
+        header,
+        token,
+        value_size,
+        value,
+        done
+    };
+
+    [[noreturn]] void fail(const char* reason) {
+        throw std::runtime_error{std::string{"tree_decoder: "} + reason};
+    }
+
+    // appends bytes from the chunk until `pending` holds `size` of them
+    bool collect(std::span<const std::byte>& chunk, size_t size) {
+        size_t n = std::min(chunk.size(), size - pending.size());
+        pending.insert(pending.end(), chunk.begin(), chunk.begin() + static_cast<std::ptrdiff_t>(n));
+        chunk = chunk.subspan(n);
+        return pending.size() == size;
+    }
+
+    // a varint may be split between chunks, the part read so far is kept
+    bool read_varint(std::span<const std::byte>& chunk, std::uint64_t& result) {
+        while (!chunk.empty()) {
+            auto byte = std::to_integer<std::uint64_t>(chunk.front());
+            chunk = chunk.subspan(1);
+            // the tenth byte holds the 64th bit and must end the varint
+            if (varint_shift == 63 && byte > 1) {
+                fail(byte & 0x80 ? "varint is too long" : "varint does not fit in 64 bits");
+            }
+            varint_value |= (byte & 0x7f) << varint_shift;
+            varint_shift += 7;
+            if ((byte & 0x80) == 0) {
+                result = std::exchange(varint_value, 0);
+                varint_shift = 0;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // A node that closes nothing is the first child of the last node. One
+    // that closes subtrees follows the last child of the parent, which is
+    // the node on the path at its depth, so no siblings are walked even
+    // without last_child links.
+    void add_node(std::span<const std::byte> bytes) {
+        T value = codec::decode(bytes);
+        if (path.empty()) {
+            pre_order_view view{result};
+            path.push_back(result.insert(insertion::vert, std::begin(view), std::move(value)));
+            return;
+        }
+
+        if (closed == 0) {
+            path.push_back(result.append_child(path.back(), std::move(value)));
+            return;
+        }
+        size_t depth = path.size() - closed;
+        if constexpr (links_type::template has<node_link::atomic>) {
+            // no insert_after over atomic links, which keep last_child anyway
+            path.resize(depth);
+            path.push_back(result.append_child(path.back(), std::move(value)));
+        } else {
+            iterator prev_sibling = path[depth];
+            path.resize(depth);
+            path.push_back(result.insert_after(prev_sibling, std::move(value)));
+        }
+    }
+
+    tree<T, Allocator> result;
+    std::vector<iterator> path;
+    std::vector<std::byte> pending;
+    state_type state;
+    std::uint64_t varint_value;
+    unsigned varint_shift;
+    std::uint64_t closed;
+    size_t value_size;
+};
+
+#endif // TREE_STREAM_H_INCLUDED
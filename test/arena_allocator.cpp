@@ -0,0 +1,343 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "arena_allocator.h"
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("arena_allocator hands out nodes from shared chunks", "[arena_allocator]") {
+    arena_allocator<tree_node<int>> alloc{1024};
+    arena_allocator<tree_node<int>> copy{alloc};
+    REQUIRE(alloc == copy);
+    REQUIRE(!alloc.exclusive());
+
+    tree_node<int>* first = alloc.allocate(1);
+    tree_node<int>* second = copy.allocate(1);
+    REQUIRE(first != second);
+    REQUIRE(alloc.reserved_bytes() == 1024);
+
+    // freed nodes are reused before the chunk grows
+    alloc.deallocate(first, 1);
+    REQUIRE(copy.allocate(1) == first);
+
+    arena_allocator<tree_node<int>> other = alloc.select_on_container_copy_construction();
+    REQUIRE(other != alloc);
+    REQUIRE(other.exclusive());
+
+    arena_allocator<int> rebound{alloc};
+    REQUIRE(rebound == alloc);
+}
+
+TEST_CASE("arena_allocator returns node blocks when they are freed", "[arena_allocator][tree]") {
+    using allocator = arena_allocator<tree_node<int>>;
+    tree<int, allocator> _1;
+    pre_order_view view{_1};
+    auto root = _1.insert(insertion::vert, std::begin(view), 0);
+    for (int i = 1; i <= 40; i++) {
+        _1.append_child(root, i);
+    }
+
+    // every relayout makes a block of the same size
+    _1.relayout();
+    const std::size_t reserved = _1.get_allocator().reserved_bytes();
+    for (int i = 0; i < 2000; i++) {
+        _1.relayout();
+    }
+    REQUIRE(_1.get_allocator().reserved_bytes() == reserved);
+
+    // and here of a new size each time
+    for (int i = 0; i < 2000; i++) {
+        _1.append_child(std::begin(view), i);
+        _1.relayout();
+    }
+    REQUIRE(_1.size() == 2041);
+    REQUIRE(_1.get_allocator().reserved_bytes() <= allocator::default_chunk_size + 2 * 2041 * sizeof(tree_node<int>) + 1024);
+}
+
+TEST_CASE("tree allocates nodes from arena", "[arena_allocator][tree]") {
+    using allocator = arena_allocator<tree_node<int>>;
+    tree<int, allocator> _1;
+    pre_order_view view{_1};
+
+    _1.insert(insertion::vert, std::begin(view), 1);
+    _1.append_child(std::begin(view), 2);
+    _1.append_child(std::begin(view), 3);
+    {
+        auto it = std::find(std::begin(view), std::end(view), 2);
+        _1.append_child(it, 4);
+        _1.append_child(it, 5);
+    }
+
+    {
+        std::array required_order = {1, 2, 4, 5, 3};
+        REQUIRE(_1.size() == 5);
+        REQUIRE(std::equal(std::begin(view), std::end(view), std::begin(required_order)));
+    }
+
+    {
+        auto it = std::find(std::begin(view), std::end(view), 2);
+        _1.erase_subtree(it);
+        _1.append_child(std::begin(view), 6);
+
+        std::array required_order = {1, 3, 6};
+        REQUIRE(_1.size() == 3);
+        REQUIRE(std::equal(std::begin(view), std::end(view), std::begin(required_order)));
+    }
+
+    {
+        // the copy gets an arena of its own
+        tree<int, allocator> copy{_1};
+        pre_order_view copy_view{copy};
+        REQUIRE(copy.size() == 3);
+        REQUIRE(std::equal(std::begin(view), std::end(view), std::begin(copy_view), std::end(copy_view)));
+    }
+
+    _1.clear();
+    REQUIRE(_1.empty());
+    REQUIRE(_1.size() == 0);
+
+    _1.insert(insertion::vert, std::begin(view), 7);
+    REQUIRE(_1.size() == 1);
+    REQUIRE(view.front() == 7);
+}
+
+TEST_CASE("tree destroys non-trivial values before arena release", "[arena_allocator][tree]") {
+    // every node holds a copy of `tracker`, so its use count tells how many
+    // values are still alive
+    auto tracker = std::make_shared<int>(0);
+    using value = std::shared_ptr<int>;
+    using allocator = arena_allocator<tree_node<value>>;
+    {
+        tree<value, allocator> _1;
+        pre_order_view view{_1};
+
+        _1.insert(insertion::vert, std::begin(view), tracker);
+        _1.append_child(std::begin(view), tracker);
+        _1.append_child(std::begin(view), tracker);
+        REQUIRE(_1.size() == 3);
+        REQUIRE(tracker.use_count() == 4);
+
+        _1.clear();
+        REQUIRE(_1.empty());
+        REQUIRE(tracker.use_count() == 1);
+
+        _1.insert(insertion::vert, std::begin(view), tracker);
+        _1.append_child(std::begin(view), tracker);
+        REQUIRE(tracker.use_count() == 3);
+    }
+    REQUIRE(tracker.use_count() == 1);
+}
+
+TEST_CASE("concurrent_arena_allocator serves several threads at once", "[arena_allocator]") {
+    using allocator = concurrent_arena_allocator<tree_node<int>>;
+    allocator alloc{1024, 4};
+    REQUIRE(alloc.exclusive());
+    REQUIRE(alloc.select_on_container_copy_construction() != alloc);
+    REQUIRE(concurrent_arena_allocator<int>{alloc} == alloc);
+
+    constexpr int per_thread = 1000;
+    std::atomic<int> corrupted{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&alloc, &corrupted, t] {
+            std::vector<int*> blocks;
+            for (int i = 0; i < per_thread; i++) {
+                int* block = concurrent_arena_allocator<int>{alloc}.allocate(1);
+                *block = t * per_thread + i;
+                blocks.push_back(block);
+            }
+            for (int i = 0; i < per_thread; i++) {
+                if (*blocks[i] != t * per_thread + i) {
+                    corrupted++;
+                }
+                if (i % 2 == 0) {
+                    concurrent_arena_allocator<int>{alloc}.deallocate(blocks[i], 1);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(corrupted == 0);
+    REQUIRE(alloc.reserved_bytes() >= 4 * per_thread * sizeof(int));
+}
+
+TEST_CASE("Threads build a tree together with concurrent_append_child", "[arena_allocator][tree]") {
+    using allocator = concurrent_arena_allocator<tree_node<int, concurrent_links>>;
+    using iterator = pre_order_iterator<int, concurrent_links>;
+    tree<int, allocator> _1{allocator{4096, 4}};
+    pre_order_view view{_1};
+
+    auto root = _1.insert(insertion::vert, std::begin(view), -1);
+    std::vector<iterator> parents;
+    for (int i = 0; i < 8; i++) {
+        parents.push_back(_1.append_child(root, -1));
+    }
+
+    // every thread appends to every parent, so the parents are contended
+    constexpr int thread_count = 4;
+    constexpr int per_thread = 2000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; t++) {
+        threads.emplace_back([&_1, &parents, t] {
+            for (int i = 0; i < per_thread; i++) {
+                auto leaf = _1.concurrent_append_child(parents[static_cast<size_t>(i) % parents.size()], t * per_thread + i);
+                if (i % 16 == 0) {
+                    _1.concurrent_append_child(leaf, 0);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    constexpr size_t appended = thread_count * per_thread + thread_count * (per_thread / 16);
+    REQUIRE(_1.size() == 1 + parents.size() + appended);
+    REQUIRE(static_cast<size_t>(std::distance(std::begin(view), std::end(view))) == _1.size());
+
+    // every appended leaf hangs under its parent exactly once
+    std::vector<int> seen;
+    for (iterator parent : parents) {
+        auto child = parent.as_traverser();
+        REQUIRE(child.to_first_child());
+        size_t count = 1;
+        seen.push_back(child.value());
+        while (child.to_next_sibling()) {
+            seen.push_back(child.value());
+            count++;
+        }
+        REQUIRE(count == thread_count * per_thread / parents.size());
+    }
+    std::sort(seen.begin(), seen.end());
+    REQUIRE(std::adjacent_find(seen.begin(), seen.end()) == seen.end());
+    REQUIRE(seen.size() == thread_count * per_thread);
+}
+
+TEST_CASE("Nodes built on one thread are freed and reused on others", "[arena_allocator][tree]") {
+    using allocator = concurrent_arena_allocator<tree_node<int, concurrent_links>>;
+    using iterator = pre_order_iterator<int, concurrent_links>;
+    tree<int, allocator> _1{allocator{1024, 8}};
+    pre_order_view view{_1};
+
+    std::vector<iterator> parents;
+    std::thread{[&_1, &view, &parents] {
+        auto root = _1.insert(insertion::vert, std::begin(view), -1);
+        for (int i = 0; i < 16; i++) {
+            parents.push_back(_1.append_child(root, i));
+            for (int j = 0; j < 50; j++) {
+                _1.append_child(parents.back(), j);
+            }
+        }
+    }}.join();
+    REQUIRE(_1.size() == 1 + 16 * 51);
+
+    // each thread likely hashes to another shard than the builder
+    for (int t = 0; t < 8; t++) {
+        std::thread{[&_1, &parents, t] {
+            _1.erase_subtree(parents[static_cast<size_t>(t)]);
+            _1.reclaim();
+            for (int j = 0; j < 50; j++) {
+                _1.append_child(parents[static_cast<size_t>(t + 8)], j);
+            }
+        }}.join();
+    }
+    _1.reclaim();
+    REQUIRE(_1.size() == 1 + 8 * 101);
+    REQUIRE(static_cast<size_t>(std::distance(std::begin(view), std::end(view))) == _1.size());
+
+    std::thread{[&_1] { _1.clear(); }}.join();
+    REQUIRE(_1.size() == 0);
+}
+
+TEST_CASE("Subtrees spliced between arenas are moved into the destination arena", "[arena_allocator][tree::splice]") {
+    using allocator = arena_allocator<tree_node<std::string, sized_links>>;
+    tree<std::string, allocator> source;
+    tree<std::string, allocator> dest;
+    REQUIRE(source.get_allocator() != dest.get_allocator());
+    pre_order_view source_view{source};
+    pre_order_view dest_view{dest};
+
+    auto root = source.insert(insertion::vert, std::begin(source_view), "root");
+    auto child = source.append_child(root, std::string(64, 'c'));
+    source.append_child(child, std::string(64, 'g'));
+    source.append_child(root, "leaf");
+
+    auto moved = dest.splice(insertion::vert, std::end(dest_view), source, child);
+    REQUIRE(*moved == std::string(64, 'c'));
+    REQUIRE(dest.size() == 2);
+    REQUIRE(source.size() == 2);
+    REQUIRE(dest.get_allocator().reserved_bytes() > 0);
+
+    std::array source_order = {std::string{"root"}, std::string{"leaf"}};
+    REQUIRE(std::equal(std::begin(source_view), std::end(source_view), std::begin(source_order), std::end(source_order)));
+    REQUIRE(*std::next(std::begin(dest_view)) == std::string(64, 'g'));
+}
+
+namespace {
+    // copies and moves may throw; one of them does once `countdown` reaches 0
+    struct fragile {
+        static inline int countdown = -1;
+
+        explicit fragile(std::string text)
+            : text{std::move(text)} {}
+
+        fragile(const fragile& other)
+            : text{other.text} {
+            tick();
+        }
+
+        fragile(fragile&& other)
+            : text{std::move(other.text)} {
+            tick();
+        }
+
+        fragile& operator = (const fragile&) = default;
+        fragile& operator = (fragile&&) = default;
+
+        static void tick() {
+            if (countdown >= 0 && countdown-- == 0) {
+                throw std::runtime_error{"fragile"};
+            }
+        }
+
+        std::string text;
+    };
+}
+
+TEST_CASE("A splice between arenas that throws leaves the source as it was", "[arena_allocator][tree::splice]") {
+    using allocator = arena_allocator<tree_node<fragile, sized_links>>;
+    tree<fragile, allocator> source;
+    tree<fragile, allocator> dest;
+    pre_order_view source_view{source};
+    pre_order_view dest_view{dest};
+
+    auto root = source.insert(insertion::vert, std::begin(source_view), fragile{"root"});
+    auto child = source.append_child(root, fragile{std::string(64, 'c')});
+    source.append_child(child, fragile{std::string(64, 'g')});
+    source.append_child(child, fragile{std::string(64, 'h')});
+
+    // the values are copied, so the two already done leave nothing moved from
+    fragile::countdown = 2;
+    REQUIRE_THROWS_AS(dest.splice(insertion::vert, std::end(dest_view), source, child), std::runtime_error);
+    fragile::countdown = -1;
+    REQUIRE(dest.empty());
+    REQUIRE(source.size() == 4);
+    std::vector<std::string> texts;
+    for (const fragile& value : source_view) {
+        texts.push_back(value.text);
+    }
+    REQUIRE(texts == std::vector<std::string>{"root", std::string(64, 'c'), std::string(64, 'g'), std::string(64, 'h')});
+
+    auto moved = dest.splice(insertion::vert, std::end(dest_view), source, child);
+    REQUIRE(moved->text == std::string(64, 'c'));
+    REQUIRE(dest.size() == 3);
+    REQUIRE(source.size() == 1);
+}
@@ -0,0 +1,238 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "compact_tree.h"
+#include "arena_allocator.h"
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace {
+    struct payload {
+        std::int32_t tag;
+        float weight;
+    };
+
+    // propagates on copy but not on move, so moves between unequal ones take the values over
+    template <typename T>
+    struct tagged_allocator {
+        using value_type = T;
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::false_type;
+        using is_always_equal = std::false_type;
+
+        explicit tagged_allocator(int tag) noexcept
+            : tag{tag} {}
+
+        template <typename U>
+        tagged_allocator(const tagged_allocator<U>& other) noexcept
+            : tag{other.tag} {}
+
+        T* allocate(size_t n) {
+            return std::allocator<T>{}.allocate(n);
+        }
+
+        void deallocate(T* ptr, size_t n) noexcept {
+            std::allocator<T>{}.deallocate(ptr, n);
+        }
+
+        template <typename U>
+        bool operator == (const tagged_allocator<U>& other) const noexcept {
+            return tag == other.tag;
+        }
+
+        template <typename U>
+        bool operator != (const tagged_allocator<U>& other) const noexcept {
+            return !(*this == other);
+        }
+
+        int tag;
+    };
+
+    template <typename Tree, typename Range>
+    bool same_order(const Tree& t, const Range& required_order) {
+        return std::equal(t.begin(), t.end(), std::begin(required_order), std::end(required_order));
+    }
+}
+
+TEST_CASE("compact_tree nodes take at most half of a tree_node", "[compact_tree]") {
+    REQUIRE(2 * compact_tree<payload>::node_size <= sizeof(tree_node<payload>));
+    REQUIRE(compact_tree<payload>::node_size == 4 * sizeof(std::uint32_t) + sizeof(payload));
+}
+
+TEST_CASE("Nodes are inserted into compact_tree", "[compact_tree::insert]") {
+    compact_tree<int> _1;
+    REQUIRE(_1.empty());
+    REQUIRE(_1.begin() == _1.end());
+
+    // same sequence as the tree::insert test
+    _1.insert(insertion::vert, _1.end(), 1);
+    REQUIRE(same_order(_1, std::array{1}));
+
+    _1.insert(insertion::vert, _1.begin(), 2);
+    REQUIRE(same_order(_1, std::array{2, 1}));
+
+    _1.insert(insertion::vert, _1.end(), 3);
+    REQUIRE(same_order(_1, std::array{2, 1, 3}));
+
+    _1.insert(insertion::hor, std::find(_1.begin(), _1.end(), 1), 4);
+    REQUIRE(same_order(_1, std::array{2, 4, 1, 3}));
+
+    _1.insert(insertion::hor, _1.end(), 5);
+    REQUIRE(same_order(_1, std::array{2, 4, 1, 3, 5}));
+
+    _1.insert(insertion::vert, std::find(_1.begin(), _1.end(), 1), 6);
+    REQUIRE(same_order(_1, std::array{2, 4, 6, 1, 3, 5}));
+
+    auto it = std::find(_1.begin(), _1.end(), 6);
+    REQUIRE(_1.parent(it.index()) == _1.begin().index());
+    REQUIRE(_1.size() == 6);
+}
+
+TEST_CASE("Nodes are appended, prepended and erased in compact_tree", "[compact_tree::append_child, compact_tree::erase_subtree]") {
+    compact_tree<std::string> _1;
+    auto root = _1.insert(insertion::vert, _1.end(), "1");
+    _1.append_child(root, "3");
+    _1.prepend_child(root, "2");
+    _1.append_child(root, "4");
+    auto it = std::find(_1.begin(), _1.end(), "3");
+    _1.append_child(it, "6");
+    _1.prepend_child(it, "5");
+    REQUIRE(same_order(_1, std::array{"1", "2", "3", "5", "6", "4"}));
+
+    REQUIRE(_1.first_child(root.index()) == std::find(_1.begin(), _1.end(), "2").index());
+    REQUIRE(_1.last_child(root.index()) == std::find(_1.begin(), _1.end(), "4").index());
+    REQUIRE(_1.prev_sibling(_1.first_child(root.index())) == compact_tree<std::string>::npos);
+    REQUIRE(_1.prev_sibling(_1.last_child(root.index())) == it.index());
+
+    size_t capacity = _1.capacity();
+    _1.erase_subtree(it);
+    REQUIRE(same_order(_1, std::array{"1", "2", "4"}));
+    REQUIRE(_1.size() == 3);
+
+    // freed slots are reused before the array grows
+    _1.append_child(root, "7");
+    _1.append_child(root, "8");
+    _1.append_child(root, "9");
+    REQUIRE(same_order(_1, std::array{"1", "2", "4", "7", "8", "9"}));
+    REQUIRE(_1.capacity() == capacity);
+
+    _1.erase_subtree(std::find(_1.begin(), _1.end(), "4"));
+    _1.erase_subtree(std::find(_1.begin(), _1.end(), "9"));
+    _1.erase_subtree(std::find(_1.begin(), _1.end(), "2"));
+    REQUIRE(same_order(_1, std::array{"1", "7", "8"}));
+    REQUIRE(_1.last_child(root.index()) == std::find(_1.begin(), _1.end(), "8").index());
+
+    _1.erase_subtree(_1.begin());
+    REQUIRE(_1.empty());
+    REQUIRE(_1.size() == 0);
+}
+
+TEST_CASE("compact_tree grows, copies and moves", "[compact_tree]") {
+    compact_tree<std::unique_ptr<int>> _1;
+    auto root = _1.insert(insertion::vert, _1.end(), std::make_unique<int>(0));
+    for (int i = 1; i < 1000; i++) {
+        auto child = _1.append_child(root, std::make_unique<int>(i));
+        _1.append_child(child, std::make_unique<int>(-i));
+    }
+    REQUIRE(_1.size() == 1999);
+    REQUIRE(_1.capacity() >= 1999);
+
+    int expected = 0;
+    for (auto it = ++_1.begin(); it != _1.end(); ++it, ++it) {
+        expected++;
+        REQUIRE(**it == expected);
+    }
+
+    compact_tree<std::unique_ptr<int>> _2{std::move(_1)};
+    REQUIRE(_1.empty());
+    REQUIRE(_2.size() == 1999);
+
+    compact_tree<int> _3;
+    auto root3 = _3.insert(insertion::vert, _3.end(), 1);
+    _3.append_child(root3, 2);
+    _3.append_child(_3.append_child(root3, 3), 4);
+
+    compact_tree<int> _4{_3};
+    REQUIRE(same_order(_4, std::array{1, 2, 3, 4}));
+    _4.erase_subtree(std::find(_4.begin(), _4.end(), 3));
+    REQUIRE(same_order(_3, std::array{1, 2, 3, 4}));
+
+    _3 = _4;
+    REQUIRE(same_order(_3, std::array{1, 2}));
+    _3.clear();
+    REQUIRE(_3.empty());
+    _3.insert(insertion::vert, _3.end(), 5);
+    REQUIRE(same_order(_3, std::array{5}));
+}
+
+TEST_CASE("compact_tree takes values from its own nodes while growing", "[compact_tree]") {
+    // each insertion happens at full capacity, with a value living in the array being replaced
+    compact_tree<std::string> _1;
+    std::string value(64, 'a');
+    _1.insert(insertion::vert, _1.end(), value);
+    for (int op = 0; op < 4; op++) {
+        while (_1.size() < _1.capacity()) {
+            _1.append_child(_1.begin(), std::string(64, 'b'));
+        }
+        const std::string& root_value = *_1.begin();
+        switch (op) {
+        case 0: _1.append_child(_1.begin(), root_value); break;
+        case 1: _1.prepend_child(_1.begin(), root_value); break;
+        case 2: _1.insert(insertion::hor, ++_1.begin(), root_value); break;
+        case 3: _1.insert(insertion::vert, ++_1.begin(), root_value); break;
+        }
+        REQUIRE(std::count(_1.begin(), _1.end(), value) == op + 2);
+    }
+}
+
+TEST_CASE("compact_tree assignment follows the allocator propagation traits", "[compact_tree][arena_allocator]") {
+    using allocator = arena_allocator<std::string>;
+    allocator arena_1;
+    allocator arena_2;
+    compact_tree<std::string, allocator> _1{arena_1};
+    compact_tree<std::string, allocator> _2{arena_2};
+    _1.insert(insertion::vert, _1.end(), "0");
+    auto root = _2.insert(insertion::vert, _2.end(), "1");
+    _2.append_child(root, "2");
+
+    // arena_allocator does not propagate on copy, the copy stays in its own arena
+    _1 = _2;
+    REQUIRE(_1.get_allocator() == arena_1);
+    REQUIRE(same_order(_1, std::array{"1", "2"}));
+    REQUIRE(same_order(_2, std::array{"1", "2"}));
+
+    // but does on move and swap
+    _1 = std::move(_2);
+    REQUIRE(_1.get_allocator() == arena_2);
+    REQUIRE(same_order(_1, std::array{"1", "2"}));
+    REQUIRE(_2.empty());
+
+    compact_tree<std::string, allocator> _3{arena_1};
+    _3.insert(insertion::vert, _3.end(), "3");
+    _1.swap(_3);
+    REQUIRE(_1.get_allocator() == arena_1);
+    REQUIRE(_3.get_allocator() == arena_2);
+    REQUIRE(same_order(_1, std::array{"3"}));
+    REQUIRE(same_order(_3, std::array{"1", "2"}));
+
+    using tagged = tagged_allocator<std::string>;
+    compact_tree<std::string, tagged> _4{tagged{4}};
+    compact_tree<std::string, tagged> _5{tagged{5}};
+    auto root5 = _5.insert(insertion::vert, _5.end(), std::string(64, 'a'));
+    _5.append_child(root5, std::string(64, 'b'));
+
+    // the allocators differ and do not propagate, so the values are moved one by one
+    _4 = std::move(_5);
+    REQUIRE(_4.get_allocator() == tagged{4});
+    REQUIRE(same_order(_4, std::array{std::string(64, 'a'), std::string(64, 'b')}));
+    REQUIRE(_5.empty());
+
+    _5.insert(insertion::vert, _5.end(), "5");
+    _4 = _5;
+    REQUIRE(_4.get_allocator() == tagged{5});
+    REQUIRE(same_order(_4, std::array{"5"}));
+}
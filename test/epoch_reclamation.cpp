@@ -0,0 +1,133 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "tree_stats.h"
+#include "epoch_reclamation.h"
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+    using concurrent_tree = tree<int, stats_allocator<std::allocator<tree_node<int, concurrent_links>>>>;
+    using concurrent_iterator = pre_order_iterator<int, concurrent_links>;
+}
+
+TEST_CASE("epoch_domain holds back memory a pinned reader may reach", "[epoch_reclamation]") {
+    epoch_domain domain{4};
+
+    // without readers every call moves on
+    std::uint64_t stamp = domain.epoch();
+    REQUIRE(domain.reclaimable_before() == stamp);
+    REQUIRE(domain.reclaimable_before() > stamp);
+
+    stamp = domain.epoch();
+    {
+        auto guard = domain.pin();
+        std::uint64_t before = domain.reclaimable_before();
+        REQUIRE(before <= stamp);
+        // the reader holds the epoch after the stamp, no further
+        for (int i = 0; i < 10; i++) {
+            REQUIRE(domain.reclaimable_before() <= stamp);
+        }
+    }
+    domain.reclaimable_before();
+    REQUIRE(domain.reclaimable_before() > stamp);
+
+    // more readers than slots wait for a slot instead of failing
+    std::vector<epoch_domain::guard> guards;
+    for (int i = 0; i < 4; i++) {
+        guards.push_back(domain.pin());
+    }
+    std::thread late{[&domain] { auto guard = domain.pin(); }};
+    guards.pop_back();
+    late.join();
+}
+
+TEST_CASE("Trees with concurrent_links free erased nodes after their readers", "[epoch_reclamation]") {
+    concurrent_tree t;
+    pre_order_view view{t};
+    auto root = t.insert(insertion::vert, std::begin(view), 0);
+    auto first = t.append_child(root, 1);
+    t.append_child(first, 2);
+    t.prepend_child(root, -1);
+    t.append_child(root, 3);
+    REQUIRE(std::equal(std::begin(view), std::end(view), std::begin({0, -1, 1, 2, 3})));
+
+    const allocation_stats& stats = t.get_allocator().stats();
+    {
+        auto guard = t.read_section();
+        auto reader = std::next(std::begin(view), 2);
+        REQUIRE(*reader == 1);
+
+        t.erase_subtree(first);
+        t.reclaim();
+        REQUIRE(t.size() == 3);
+        REQUIRE(stats.live_nodes() == 5);
+
+        // the reader finds its way out of the erased subtree
+        REQUIRE(*++reader == 2);
+        REQUIRE(*++reader == 3);
+        REQUIRE(++reader == std::end(view));
+    }
+    t.reclaim();
+    t.reclaim();
+    REQUIRE(stats.live_nodes() == 3);
+    REQUIRE(std::equal(std::begin(view), std::end(view), std::begin({0, -1, 3})));
+
+    concurrent_tree copy{t};
+    t.clear();
+    REQUIRE(t.empty());
+    REQUIRE(copy.size() == 3);
+}
+
+TEST_CASE("Readers walk a tree with concurrent_links while it is written", "[epoch_reclamation]") {
+    concurrent_tree t;
+    pre_order_view view{t};
+    auto root = t.insert(insertion::vert, std::begin(view), 1);
+
+    // Catch assertions are not thread-safe, readers only record what they saw
+    std::atomic<bool> done{false};
+    std::atomic<bool> bad_value{false};
+    std::atomic<size_t> walks{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; i++) {
+        readers.emplace_back([&] {
+            while (!done.load()) {
+                auto guard = t.read_section();
+                for (int value : pre_order_view{t}) {
+                    if (value <= 0) {
+                        bad_value = true;
+                    }
+                }
+                walks++;
+            }
+        });
+    }
+
+    std::mt19937 rng{5};
+    std::vector<concurrent_iterator> children;
+    for (int i = 0; i < 20000; i++) {
+        if (children.size() > 50 && rng() % 3 == 0) {
+            size_t victim = rng() % children.size();
+            t.erase_subtree(children[victim]);
+            children.erase(children.begin() + static_cast<std::ptrdiff_t>(victim));
+        } else if (!children.empty() && rng() % 2 == 0) {
+            t.append_child(children[rng() % children.size()], i + 2);
+        } else {
+            children.push_back(rng() % 2 == 0 ? t.append_child(root, i + 2) : t.prepend_child(root, i + 2));
+        }
+    }
+    while (walks.load() < 100) {
+        std::this_thread::yield();
+    }
+    done = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    REQUIRE(!bad_value.load());
+    t.reclaim();
+    t.reclaim();
+    REQUIRE(t.get_allocator().stats().live_nodes() == t.size());
+}
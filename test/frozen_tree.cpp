@@ -0,0 +1,72 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "frozen_tree.h"
+#include <array>
+#include <algorithm>
+#include <vector>
+
+TEST_CASE("frozen_tree keeps tree structure in arrays", "[frozen_tree]") {
+    tree<int> _1;
+    pre_order_view view{_1};
+
+    REQUIRE(frozen_tree<int>{_1}.empty());
+
+    _1.insert(insertion::vert, std::begin(view), 1);
+    _1.append_child(std::begin(view), 2);
+    _1.append_child(std::begin(view), 3);
+    _1.append_child(std::begin(view), 4);
+    _1.append_child(std::find(std::begin(view), std::end(view), 2), 5);
+    _1.append_child(std::find(std::begin(view), std::end(view), 2), 6);
+    _1.append_child(std::find(std::begin(view), std::end(view), 4), 7);
+    _1.append_child(std::find(std::begin(view), std::end(view), 7), 8);
+
+    frozen_tree<int> frozen{_1};
+    REQUIRE(frozen.size() == 8);
+
+    {
+        std::array required_order = {1, 2, 5, 6, 3, 4, 7, 8};
+        auto values = frozen.pre_order();
+        REQUIRE(std::equal(values.begin(), values.end(), std::begin(required_order), std::end(required_order)));
+        REQUIRE(std::equal(values.begin(), values.end(), std::begin(view), std::end(view)));
+    }
+
+    {
+        std::array required_order = {5, 6, 2, 3, 8, 7, 4, 1};
+        auto post_order = frozen.post_order();
+        REQUIRE(std::equal(post_order.begin(), post_order.end(), std::begin(required_order), std::end(required_order)));
+    }
+
+    {
+        // pre-order indices: 1:0 2:1 5:2 6:3 3:4 4:5 7:6 8:7
+        REQUIRE(frozen.root() == 0);
+        REQUIRE(frozen.parent(0) == frozen_tree<int>::npos);
+        REQUIRE(frozen.parent(2) == 1);
+        REQUIRE(frozen.parent(7) == 6);
+        REQUIRE(frozen.next_sibling(1) == 4);
+        REQUIRE(frozen.next_sibling(5) == frozen_tree<int>::npos);
+        REQUIRE(frozen.first_child(5) == 6);
+        REQUIRE(frozen.first_child(4) == frozen_tree<int>::npos);
+        REQUIRE(frozen.is_ancestor(5, 7));
+        REQUIRE(!frozen.is_ancestor(1, 4));
+
+        std::array required_children = {2, 3, 4};
+        auto children = frozen.children(0);
+        REQUIRE(std::equal(children.begin(), children.end(), std::begin(required_children), std::end(required_children)));
+    }
+
+    {
+        std::array required_subtree = {4, 7, 8};
+        auto subtree = frozen.subtree(5);
+        REQUIRE(subtree.size() == 3);
+        REQUIRE(std::equal(subtree.begin(), subtree.end(), std::begin(required_subtree), std::end(required_subtree)));
+
+        std::array required_post_order = {5, 6, 2};
+        auto post_order = frozen.post_order(1);
+        REQUIRE(std::equal(post_order.begin(), post_order.end(), std::begin(required_post_order), std::end(required_post_order)));
+
+        std::array required_leaf = {3};
+        auto leaf = frozen.post_order(4);
+        REQUIRE(std::equal(leaf.begin(), leaf.end(), std::begin(required_leaf), std::end(required_leaf)));
+    }
+}
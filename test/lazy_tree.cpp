@@ -0,0 +1,168 @@
+#include <catch2/catch.hpp>
+
+#include "lazy_tree.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    // node n has children 10n+1 .. 10n+fanout while below `limit`
+    struct counting_generator {
+        int* calls;
+        int fanout;
+        int limit;
+
+        void operator () (const int& value, lazy_tree<int>::children_builder& children) const {
+            (*calls)++;
+            for (int i = 1; i <= fanout; i++) {
+                int child = value * 10 + i;
+                if (child * 10 < limit) {
+                    children.append_lazy(child);
+                } else {
+                    children.append(child);
+                }
+            }
+        }
+    };
+}
+
+TEST_CASE("lazy_tree expands nodes only when descending into them", "[lazy_tree]") {
+    int calls = 0;
+    lazy_tree<int> t{0, counting_generator{&calls, 3, 1000}};
+    REQUIRE(t.size() == 1);
+    REQUIRE(calls == 0);
+
+    auto root = t.root_traverser();
+    REQUIRE(root.is_lazy());
+    REQUIRE(!root.is_expanded());
+
+    auto it = root;
+    REQUIRE(it.to_first_child());
+    REQUIRE(calls == 1);
+    REQUIRE(it.value() == 1);
+    REQUIRE(t.size() == 4);
+    REQUIRE(root.is_expanded());
+
+    // the expansion is cached
+    REQUIRE(root.first_child().value() == 1);
+    REQUIRE(root.has_first_child());
+    REQUIRE(calls == 1);
+
+    // siblings and parents never expand anything
+    REQUIRE(it.to_next_sibling());
+    REQUIRE(it.value() == 2);
+    REQUIRE(it.to_parent());
+    REQUIRE(it.value() == 0);
+    REQUIRE(calls == 1);
+
+    // full pre-order walk: 1 + 3 + 9 + 27 nodes, 13 of them lazy
+    std::vector<int> values(t.begin(), t.end());
+    REQUIRE(values.size() == 40);
+    REQUIRE(values[0] == 0);
+    REQUIRE(values[1] == 1);
+    REQUIRE(values[2] == 11);
+    REQUIRE(values[3] == 111);
+    REQUIRE(values.back() == 333);
+    REQUIRE(calls == 13);
+    REQUIRE(t.size() == 40);
+
+    // leaves have no generator
+    auto leaf = t.root_traverser();
+    while (leaf.to_first_child()) {}
+    REQUIRE(leaf.value() == 111);
+    REQUIRE(!leaf.is_lazy());
+    REQUIRE(!leaf.has_first_child());
+}
+
+TEST_CASE("lazy_tree evicts materialized subtrees", "[lazy_tree]") {
+    int calls = 0;
+    lazy_tree<int> t{0, counting_generator{&calls, 3, 1000}};
+    for (int value : t) {
+        (void)value;
+    }
+    REQUIRE(t.size() == 40);
+
+    auto first = t.root_traverser().first_child();
+    t.evict(first);
+    REQUIRE(t.size() == 28);
+    REQUIRE(!first.is_expanded());
+
+    // expanded again on the next descent
+    REQUIRE(first.first_child().value() == 11);
+    REQUIRE(calls == 14);
+    REQUIRE(t.size() == 31);
+
+    // least recently used first: the subtree under 2 goes before the one under 1
+    t.evict_until(20);
+    REQUIRE(t.size() == 19);
+    REQUIRE(first.is_expanded());
+    REQUIRE(t.root_traverser().is_expanded());
+
+    t.evict_until(0);
+    REQUIRE(t.size() == 1);
+    REQUIRE(!t.root_traverser().is_expanded());
+
+    std::vector<int> values(t.begin(), t.end());
+    REQUIRE(values.size() == 40);
+}
+
+TEST_CASE("lazy_tree evicts from the bottom after a plain walk", "[lazy_tree]") {
+    int calls = 0;
+    lazy_tree<int> t{0, counting_generator{&calls, 3, 1000}};
+    for (int value : t) {
+        (void)value;
+    }
+    REQUIRE(t.size() == 40);
+
+    // the root is descended into first, but every node below was used later
+    t.evict_until(t.size() - 1);
+    REQUIRE(t.size() == 37);
+    REQUIRE(t.root_traverser().is_expanded());
+
+    // the oldest node without expanded children is 11, then 12 and 13, then 1
+    t.evict_until(28);
+    REQUIRE(t.size() == 28);
+    auto first = t.root_traverser();
+    REQUIRE(first.to_first_child());
+    REQUIRE(!first.is_expanded());
+    REQUIRE(first.next_sibling().is_expanded());
+    REQUIRE(calls == 13);
+}
+
+TEST_CASE("lazy_tree supports per-node generators and failing generators", "[lazy_tree]") {
+    using tree_type = lazy_tree<std::string>;
+    bool fail = true;
+    tree_type t{"/", [&fail](const std::string& dir, tree_type::children_builder& children) {
+        children.append(dir + "file");
+        children.append_lazy(dir + "sub/", [&fail](const std::string& sub, tree_type::children_builder& grandchildren) {
+            grandchildren.append(sub + "a");
+            if (fail) {
+                throw std::runtime_error{"unreadable"};
+            }
+            grandchildren.append(sub + "b");
+        });
+    }};
+
+    auto sub = t.root_traverser().first_child().next_sibling();
+    REQUIRE(sub.value() == "/sub/");
+    REQUIRE_THROWS_AS(sub.first_child(), std::runtime_error);
+    REQUIRE(!sub.is_expanded());
+    REQUIRE(t.size() == 3);
+
+    fail = false;
+    std::vector<std::string> values(t.begin(), t.end());
+    REQUIRE(values == std::vector<std::string>{"/", "/file", "/sub/", "/sub/a", "/sub/b"});
+
+    // a long chain is freed without recursion
+    lazy_tree<int> chain{0, [](const int& value, lazy_tree<int>::children_builder& children) {
+        if (value < 100000) {
+            children.append_lazy(value + 1);
+        }
+    }};
+    size_t count = 0;
+    for (int value : chain) {
+        (void)value;
+        count++;
+    }
+    REQUIRE(count == 100001);
+}
@@ -0,0 +1,128 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "frozen_tree.h"
+#include "mapped_tree.h"
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace {
+    // removes the file when the test is done with it
+    struct temp_file {
+        explicit temp_file(const char* name)
+            : path{(std::filesystem::temp_directory_path() / name).string()} {}
+
+        ~temp_file() {
+            std::error_code error;
+            std::filesystem::remove(path, error);
+        }
+
+        std::string path;
+    };
+}
+
+TEST_CASE("mapped_tree reads a saved snapshot", "[mapped_tree]") {
+    tree<int> _1;
+    pre_order_view view{_1};
+    _1.insert(insertion::vert, std::begin(view), 1);
+    _1.append_child(std::begin(view), 2);
+    _1.append_child(std::begin(view), 3);
+    _1.append_child(std::begin(view), 4);
+    _1.append_child(std::find(std::begin(view), std::end(view), 2), 5);
+    _1.append_child(std::find(std::begin(view), std::end(view), 2), 6);
+    _1.append_child(std::find(std::begin(view), std::end(view), 4), 7);
+    _1.append_child(std::find(std::begin(view), std::end(view), 7), 8);
+
+    temp_file file{"tree_test_snapshot.bin"};
+    save_snapshot(_1, file.path);
+    mapped_tree<int> mapped{file.path};
+    frozen_tree<int> frozen{_1};
+
+    REQUIRE(mapped.size() == 8);
+    {
+        auto values = mapped.pre_order();
+        REQUIRE(std::equal(values.begin(), values.end(), std::begin(view), std::end(view)));
+    }
+
+    for (mapped_tree<int>::index_type i = 0; i < mapped.size(); i++) {
+        REQUIRE(mapped[i] == frozen[i]);
+        REQUIRE(mapped.parent(i) == frozen.parent(i));
+        REQUIRE(mapped.next_sibling(i) == frozen.next_sibling(i));
+        REQUIRE(mapped.first_child(i) == frozen.first_child(i));
+        REQUIRE(mapped.subtree_size(i) == frozen.subtree_size(i));
+    }
+
+    {
+        // pre-order indices: 1:0 2:1 5:2 6:3 3:4 4:5 7:6 8:7
+        std::array children = {2, 3, 4};
+        auto range = mapped.children(0);
+        REQUIRE(std::equal(range.begin(), range.end(), std::begin(children), std::end(children)));
+        REQUIRE(mapped.last_child(0) == 5);
+        REQUIRE(mapped.prev_sibling(5) == 4);
+        REQUIRE(mapped.prev_sibling(1) == mapped_tree<int>::npos);
+
+        auto subtree = mapped.subtree(5);
+        std::array subtree_values = {4, 7, 8};
+        REQUIRE(std::equal(subtree.begin(), subtree.end(), std::begin(subtree_values), std::end(subtree_values)));
+    }
+
+    {
+        // walked the way frozen_tree walks a tree through tree_traverser
+        auto traverser = mapped.root_traverser();
+        REQUIRE(traverser.value() == 1);
+        REQUIRE(!traverser.has_parent());
+        REQUIRE(traverser.to_last_child());
+        REQUIRE(traverser.value() == 4);
+        REQUIRE(traverser.to_prev_sibling());
+        REQUIRE(traverser.value() == 3);
+        REQUIRE(!traverser.has_first_child());
+        REQUIRE(traverser.to_prev_sibling());
+        REQUIRE(traverser.first_child().value() == 5);
+        REQUIRE(traverser.first_child().next_sibling().value() == 6);
+        REQUIRE(!traverser.to_prev_sibling());
+        REQUIRE(traverser.to_parent());
+        REQUIRE(traverser.index() == 0);
+    }
+
+    mapped_tree<int> moved{std::move(mapped)};
+    REQUIRE(moved.size() == 8);
+    REQUIRE(mapped.empty());
+}
+
+TEST_CASE("mapped_tree opens empty snapshots and rejects bad files", "[mapped_tree]") {
+    temp_file file{"tree_test_snapshot_errors.bin"};
+
+    save_snapshot(tree<int>{}, file.path);
+    {
+        mapped_tree<int> mapped{file.path};
+        REQUIRE(mapped.empty());
+        REQUIRE(mapped.root() == mapped_tree<int>::npos);
+        REQUIRE(mapped.pre_order().empty());
+    }
+
+    // values of another size
+    REQUIRE_THROWS_AS(mapped_tree<double>{file.path}, std::runtime_error);
+
+    {
+        tree<int> _1;
+        pre_order_view view{_1};
+        _1.insert(insertion::vert, std::begin(view), 1);
+        _1.append_child(std::begin(view), 2);
+        save_snapshot(_1, file.path);
+        std::filesystem::resize_file(file.path, std::filesystem::file_size(file.path) - 1);
+        REQUIRE_THROWS_AS(mapped_tree<int>{file.path}, std::runtime_error);
+    }
+
+    {
+        std::ofstream out{file.path, std::ios::binary | std::ios::trunc};
+        out << std::string(256, 'x');
+    }
+    REQUIRE_THROWS_AS(mapped_tree<int>{file.path}, std::runtime_error);
+
+    REQUIRE_THROWS_AS(mapped_tree<int>{file.path + ".missing"}, std::system_error);
+}
@@ -0,0 +1,165 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "parallel_tree.h"
+#include "../bench/shapes.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+    tree<int> random_tree(size_t size) {
+        return shapes::random_tree<tree<int>>(size, [](size_t i) { return static_cast<int>(i); });
+    }
+}
+
+TEST_CASE("parallel_for_each visits every node once", "[parallel]") {
+    work_stealing_pool pool{4};
+    tree<int> _1;
+
+    parallel_for_each(_1, [](int&) { FAIL("empty tree has no nodes"); }, {1, &pool});
+
+    _1 = random_tree(20000);
+    for (size_t grain_size : {size_t{1}, size_t{64}, size_t{100000}}) {
+        parallel_for_each(_1, [](int& value) { value += 1; }, {grain_size, &pool});
+    }
+
+    std::vector<int> values{std::begin(pre_order_view{_1}), std::end(pre_order_view{_1})};
+    std::sort(values.begin(), values.end());
+    std::vector<int> expected(20000);
+    std::iota(expected.begin(), expected.end(), 3);
+    REQUIRE(values == expected);
+}
+
+TEST_CASE("parallel_reduce folds the whole tree", "[parallel]") {
+    work_stealing_pool pool{4};
+    tree<int> _1;
+
+    REQUIRE(parallel_reduce(_1, 5LL, std::plus<>{}, {1, &pool}) == 5);
+
+    _1 = random_tree(20000);
+    const long long sum = 20000LL * 19999 / 2;
+    for (size_t grain_size : {size_t{1}, size_t{64}, size_t{100000}}) {
+        REQUIRE(parallel_reduce(_1, 0LL, std::plus<>{}, {grain_size, &pool}) == sum);
+        REQUIRE(parallel_reduce(_1, 0, [](int a, int b) { return std::max(a, b); }, {grain_size, &pool}) == 19999);
+        REQUIRE(parallel_reduce(_1, size_t{0}, std::plus<>{}, [](int) { return size_t{1}; }, {grain_size, &pool}) == _1.size());
+    }
+
+    // the default pool
+    REQUIRE(parallel_reduce(_1, 0LL, std::plus<>{}) == sum);
+}
+
+TEST_CASE("parallel_reduce combines in pre-order", "[parallel]") {
+    work_stealing_pool pool{4};
+    tree<int> _1 = random_tree(20000);
+    const std::vector<int> expected{std::begin(pre_order_view{_1}), std::end(pre_order_view{_1})};
+
+    // concatenation is associative but not commutative
+    auto concat = [](std::vector<int> lhs, std::vector<int> rhs) {
+        lhs.insert(lhs.end(), rhs.begin(), rhs.end());
+        return lhs;
+    };
+    auto single = [](int value) { return std::vector<int>{value}; };
+    for (size_t grain_size : {size_t{1}, size_t{16}, size_t{100000}}) {
+        std::vector<int> values = parallel_reduce(_1, std::vector<int>{-1}, concat, single, {grain_size, &pool});
+        REQUIRE(values.size() == expected.size() + 1);
+        REQUIRE(values.front() == -1);
+        REQUIRE(std::equal(expected.begin(), expected.end(), values.begin() + 1));
+    }
+}
+
+TEST_CASE("Parked workers wake up for tasks spawned later", "[parallel]") {
+    work_stealing_pool pool{4};
+    std::atomic<int> done{0};
+
+    // the other workers find nothing for long enough to park
+    pool.run([&](size_t worker) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{50});
+        for (int i = 0; i < 100; i++) {
+            pool.spawn(worker, [&](size_t) {
+                std::this_thread::sleep_for(std::chrono::microseconds{100});
+                done++;
+            });
+        }
+        // and so does a worker joining a nested run
+        pool.run([&](size_t nested_worker) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{50});
+            pool.spawn(nested_worker, [&](size_t) { done++; });
+        });
+    });
+    REQUIRE(done == 101);
+}
+
+TEST_CASE("parallel_for_each rethrows the first exception", "[parallel]") {
+    work_stealing_pool pool{4};
+    tree<int> _1 = random_tree(20000);
+
+    std::atomic<int> visited{0};
+    auto f = [&visited](int& value) {
+        visited++;
+        if (value == 12345) {
+            throw std::runtime_error{"bad node"};
+        }
+    };
+    REQUIRE_THROWS_AS(parallel_for_each(_1, f, {16, &pool}), std::runtime_error);
+    REQUIRE(visited <= 20000);
+
+    // the pool stays usable
+    REQUIRE(parallel_reduce(_1, 0LL, std::plus<>{}, {16, &pool}) == 20000LL * 19999 / 2);
+}
+
+TEST_CASE("Parallel algorithms can be nested on one pool", "[parallel]") {
+    work_stealing_pool pool{4};
+    tree<int> outer = random_tree(20000);
+    tree<int> inner = random_tree(5000);
+    const long long inner_sum = 5000LL * 4999 / 2;
+
+    // every visitor runs a whole walk of its own on the pool running it
+    std::atomic<int> mismatches{0};
+    parallel_for_each(outer, [&](int& value) {
+        if (value % 1000 == 0 &&
+                parallel_reduce(inner, 0LL, std::plus<>{}, {64, &pool}) != inner_sum) {
+            mismatches++;
+        }
+    }, {16, &pool});
+    REQUIRE(mismatches == 0);
+
+    long long total = parallel_reduce(outer, 0LL, std::plus<>{}, [&](int value) {
+        return value % 2000 == 0 ? parallel_reduce(inner, 0LL, std::plus<>{}, {64, &pool}) : 0LL;
+    }, {16, &pool});
+    REQUIRE(total == 10 * inner_sum);
+
+    // a worker joining a nested walk must not take up outer visits, which
+    // would re-enter the part it is folding into
+    std::atomic<long long> nested_total{0};
+    parallel_for_each(outer, [&](int& value) {
+        if (value % 100 == 0) {
+            nested_total += parallel_reduce(inner, 0LL, std::plus<>{}, [&](int inner_value) {
+                return inner_value % 500 == 0 ? parallel_reduce(inner, 0LL, std::plus<>{}, {32, &pool}) : 1LL;
+            }, {8, &pool});
+        }
+    }, {4, &pool});
+    REQUIRE(nested_total == 200 * (10 * inner_sum + 4990));
+
+    long long outer_total = parallel_reduce(outer, 0LL, std::plus<>{}, [&](int value) {
+        return value % 100 == 0 ? parallel_reduce(inner, 0LL, std::plus<>{}, {8, &pool}) : 1LL;
+    }, {4, &pool});
+    REQUIRE(outer_total == 200 * inner_sum + 19800);
+
+    // a nested exception reaches the outer call
+    auto f = [&](int& value) {
+        if (value == 777) {
+            parallel_for_each(inner, [](int& inner_value) {
+                if (inner_value == 4321) {
+                    throw std::runtime_error{"bad inner node"};
+                }
+            }, {16, &pool});
+        }
+    };
+    REQUIRE_THROWS_AS(parallel_for_each(outer, f, {16, &pool}), std::runtime_error);
+    REQUIRE(parallel_reduce(outer, 0LL, std::plus<>{}, {16, &pool}) == 20000LL * 19999 / 2);
+}
@@ -0,0 +1,215 @@
+#include <catch2/catch.hpp>
+
+#include "persistent_tree.h"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("persistent_tree updates leave earlier versions intact", "[persistent_tree]") {
+    persistent_tree<int> empty;
+    REQUIRE(empty.empty());
+    REQUIRE(empty.begin() == empty.end());
+
+    auto v1 = empty.insert(insertion::vert, empty.root(), 1);
+    auto v2 = v1.append_child(v1.root(), 2).append_child(v1.root(), 3);
+    // v1 did not change, so the second append saw only its own root
+    REQUIRE(v2.size() == 2);
+    REQUIRE(v1.size() == 1);
+
+    auto v3 = v1.append_child(v1.root(), 2);
+    v3 = v3.append_child(v3.root(), 3);
+    v3 = v3.append_child(v3.at({0}), 4);
+    v3 = v3.prepend_child(v3.at({0}), 5);
+
+    {
+        std::array required_order = {1, 2, 5, 4, 3};
+        REQUIRE(v3.size() == 5);
+        REQUIRE(std::equal(v3.begin(), v3.end(), required_order.begin(), required_order.end()));
+    }
+
+    auto v4 = v3.erase_subtree(v3.at({0}));
+    auto v5 = v3.set_value(v3.at({0, 1}), 40);
+
+    {
+        std::array required_order = {1, 3};
+        REQUIRE(v4.size() == 2);
+        REQUIRE(std::equal(v4.begin(), v4.end(), required_order.begin(), required_order.end()));
+    }
+    {
+        std::array required_order = {1, 2, 5, 40, 3};
+        REQUIRE(v5.size() == 5);
+        REQUIRE(std::equal(v5.begin(), v5.end(), required_order.begin(), required_order.end()));
+    }
+    {
+        std::array required_order = {1, 2, 5, 4, 3};
+        REQUIRE(std::equal(v3.begin(), v3.end(), required_order.begin(), required_order.end()));
+    }
+
+    REQUIRE(v3.erase_subtree(v3.root()).empty());
+    REQUIRE_THROWS_AS(v3.at({0, 2}), std::out_of_range);
+    REQUIRE(v3.at({0, 1}).indices() == std::vector<size_t>{0, 1});
+    REQUIRE(v3.at({0}).subtree_size() == 3);
+}
+
+TEST_CASE("persistent_tree inserts like tree", "[persistent_tree]") {
+    persistent_tree<int> t;
+    t = t.insert(insertion::vert, t.root(), 1);
+    // at the end: below / beside the last node in pre-order
+    t = t.insert(insertion::vert, persistent_tree<int>::cursor{}, 2);
+    t = t.insert(insertion::hor, persistent_tree<int>::cursor{}, 3);
+    // at a node: above it / before it
+    t = t.insert(insertion::vert, t.at({1}), 4);
+    t = t.insert(insertion::hor, t.at({0}), 5);
+
+    std::array required_order = {1, 5, 2, 4, 3};
+    REQUIRE(t.size() == 5);
+    REQUIRE(std::equal(t.begin(), t.end(), required_order.begin(), required_order.end()));
+    REQUIRE(t.at({2}).child_count() == 1);
+
+    t = t.insert(insertion::vert, t.root(), 0);
+    REQUIRE(*t.begin() == 0);
+    REQUIRE(t.root().child_count() == 1);
+    REQUIRE(t.size() == 6);
+}
+
+TEST_CASE("persistent_tree versions share untouched subtrees", "[persistent_tree]") {
+    persistent_tree<std::string> base;
+    base = base.insert(insertion::vert, base.root(), "root");
+    for (int i = 0; i < 4; i++) {
+        base = base.append_child(base.root(), "child " + std::to_string(i));
+        for (int j = 0; j < 4; j++) {
+            base = base.append_child(base.at({static_cast<size_t>(i)}), "leaf");
+        }
+    }
+    REQUIRE(base.size() == 21);
+
+    auto edited = base.set_value(base.at({2, 3}), "edited");
+    REQUIRE(base.at({2, 3}).value() == "leaf");
+    REQUIRE(edited.at({2, 3}).value() == "edited");
+
+    // only the path root -> child 2 -> leaf was copied
+    REQUIRE(&edited.root().value() != &base.root().value());
+    REQUIRE(&edited.at({2}).value() != &base.at({2}).value());
+    REQUIRE(&edited.at({2, 0}).value() == &base.at({2, 0}).value());
+    for (size_t i : {0, 1, 3}) {
+        REQUIRE(&edited.at({i}).value() == &base.at({i}).value());
+    }
+
+    // a copy is another handle on the same version
+    auto copy = edited;
+    REQUIRE(&copy.at({2, 3}).value() == &edited.at({2, 3}).value());
+}
+
+TEST_CASE("persistent_tree edits nodes with many children", "[persistent_tree]") {
+    // the children of the root against a vector, through enough edits to
+    // split, empty and collapse the chunks holding them
+    persistent_tree<int> t;
+    t = t.insert(insertion::vert, t.root(), -1);
+    std::vector<int> model;
+    std::vector<std::pair<persistent_tree<int>, std::vector<int>>> kept;
+
+    auto children = [](const persistent_tree<int>& version) {
+        std::vector<int> result;
+        auto child = version.root();
+        if (child.to_first_child()) {
+            do {
+                result.push_back(child.value());
+            } while (child.to_next_sibling());
+        }
+        return result;
+    };
+
+    unsigned state = 3;
+    auto next = [&state](size_t bound) {
+        state = state * 1103515245u + 12345u;
+        return static_cast<size_t>((state >> 16) % bound);
+    };
+    for (int step = 0; step < 6000; step++) {
+        size_t op = step < 3000 ? next(4) : next(6);
+        if (model.empty() || op == 0) {
+            t = t.append_child(t.root(), step);
+            model.push_back(step);
+        } else if (op == 1) {
+            t = t.prepend_child(t.root(), step);
+            model.insert(model.begin(), step);
+        } else if (op == 2) {
+            size_t index = next(model.size());
+            t = t.insert(insertion::hor, t.at({index}), step);
+            model.insert(model.begin() + static_cast<std::ptrdiff_t>(index), step);
+        } else if (op == 3) {
+            size_t index = next(model.size());
+            t = t.set_value(t.at({index}), -step);
+            model[index] = -step;
+        } else {
+            size_t index = next(model.size());
+            t = t.erase_subtree(t.at({index}));
+            model.erase(model.begin() + static_cast<std::ptrdiff_t>(index));
+        }
+        REQUIRE(t.size() == model.size() + 1);
+        if (step % 500 == 0) {
+            REQUIRE(children(t) == model);
+            kept.emplace_back(t, model);
+        }
+    }
+    REQUIRE(children(t) == model);
+    while (!model.empty()) {
+        size_t index = next(model.size());
+        t = t.erase_subtree(t.at({index}));
+        model.erase(model.begin() + static_cast<std::ptrdiff_t>(index));
+        if (model.size() % 100 == 0) {
+            REQUIRE(children(t) == model);
+        }
+    }
+    REQUIRE(t.size() == 1);
+    for (const auto& [version, version_model] : kept) {
+        REQUIRE(children(version) == version_model);
+        REQUIRE(version.root().child_count() == version_model.size());
+    }
+}
+
+TEST_CASE("persistent_tree releases deep versions without recursion", "[persistent_tree]") {
+    persistent_tree<int> chain;
+    chain = chain.insert(insertion::vert, chain.root(), 0);
+    for (int i = 1; i < 200000; i++) {
+        chain = chain.insert(insertion::vert, chain.root(), i);
+    }
+    REQUIRE(chain.size() == 200000);
+
+    auto shorter = chain.erase_subtree(chain.at({0}));
+    REQUIRE(shorter.size() == 1);
+    chain = persistent_tree<int>{};
+    REQUIRE(shorter.size() == 1);
+}
+
+TEST_CASE("persistent_tree versions are updated from several threads", "[persistent_tree]") {
+    persistent_tree<int> base;
+    base = base.insert(insertion::vert, base.root(), 0);
+    for (int i = 1; i <= 8; i++) {
+        base = base.append_child(base.root(), i);
+    }
+
+    std::vector<persistent_tree<int>> results(4);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < results.size(); t++) {
+        threads.emplace_back([&base, &results, t] {
+            persistent_tree<int> version = base;
+            for (size_t i = 0; i < 1000; i++) {
+                version = version.append_child(version.at({i % 8}), static_cast<int>(t));
+            }
+            results[t] = version;
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    REQUIRE(base.size() == 9);
+    for (size_t t = 0; t < results.size(); t++) {
+        REQUIRE(results[t].size() == 1009);
+        REQUIRE(results[t].at({3}).child_count() == 125);
+        REQUIRE(results[t].at({3, 0}).value() == static_cast<int>(t));
+    }
+}
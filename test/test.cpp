@@ -2,9 +2,12 @@
 #include <catch2/catch.hpp>
 
 #include "tree.h"
+#include <any>
 #include <vector>
 #include <array>
 #include <algorithm>
+#include <string>
+#include <utility>
 
 struct no_copy {
     no_copy() = default;
@@ -22,6 +25,24 @@ struct no_move {
     int dummy;
 };
 
+// neither copyable nor movable, so it can only be constructed in place
+struct pinned {
+    pinned(int id, std::string name)
+        : id{id}
+        , name{std::move(name)} {}
+
+    pinned(const pinned&) = delete;
+    pinned& operator = (const pinned&) = delete;
+
+    int id;
+    std::string name;
+};
+
+template <typename Tree>
+concept splices_between_trees = requires (Tree& t, pre_order_iterator<typename Tree::value_type, typename Tree::links_type> it) {
+    t.splice_child(it, t, it);
+};
+
 TEST_CASE("Tree node constructed", "[tree_node]") {
     // compile-time checks
     static_assert(
@@ -79,6 +100,14 @@ TEST_CASE("Tree node constructed", "[tree_node]") {
     REQUIRE(node.next_sibling() == nullptr);
     REQUIRE(node.first_child() == nullptr);
     REQUIRE(node.last_child() == nullptr);
+
+    tree_node<std::string> string_node{std::string(64, 's')};
+    tree_node<std::string> moved_node{std::move(string_node)};
+    REQUIRE(moved_node.value() == std::string(64, 's'));
+
+    tree_node<std::string> in_place_node{std::in_place, 3, 'x'};
+    REQUIRE(in_place_node.value() == "xxx");
+    REQUIRE(in_place_node.parent() == nullptr);
 }
 
 TEST_CASE("tree_node are pushed as childs to back", "[tree_node::push_back_child]") {
@@ -302,6 +331,77 @@ TEST_CASE("pre_order_iterator iterates over nodes", "[pre_order_iterator]") {
     }
 }
 
+TEST_CASE("post_order_iterator iterates over nodes", "[post_order_iterator]") {
+    tree_node<int> root{1};
+    tree_node<int> child1{2};
+    tree_node<int> child2{3};
+    tree_node<int> child3{4};
+
+    tree_node<int> grandchild_1_1{5};
+    tree_node<int> grandchild_1_2{6};
+    tree_node<int> grandchild_1_3{7};
+
+    tree_node<int> grandchild_2_1{8};
+    tree_node<int> grandchild_2_2{9};
+
+    tree_node<int> grandchild_3_1{10};
+
+    root.push_back_child(&child1);
+    root.push_back_child(&child2);
+    root.push_back_child(&child3);
+
+    child1.push_back_child(&grandchild_1_1);
+    child1.push_back_child(&grandchild_1_2);
+    child1.push_back_child(&grandchild_1_3);
+
+    child2.push_back_child(&grandchild_2_1);
+    child2.push_back_child(&grandchild_2_2);
+
+    child3.push_back_child(&grandchild_3_1);
+
+    std::array<int, 10> required_order = {5, 6, 7, 2, 8, 9, 3, 10, 4, 1};
+
+    {
+        post_order_iterator<int> it{&grandchild_1_1, nullptr};
+        for (size_t i = 0; i < 10; i++) {
+            REQUIRE(*it == required_order[i]);
+            it++;
+        }
+        REQUIRE(it == post_order_iterator<int>{nullptr, &root});
+    }
+
+    {
+        post_order_iterator<int> it{&grandchild_1_1, nullptr};
+        for (size_t i = 0; i < 10; i++) {
+            REQUIRE(*it == required_order[i]);
+            ++it;
+        }
+    }
+
+    {
+        post_order_iterator<int> it{nullptr, &root};
+        for (size_t i = 0; i < 10; i++) {
+            --it;
+            REQUIRE(*it == required_order[required_order.size() - 1 - i]);
+        }
+        REQUIRE(it == post_order_iterator<int>{&grandchild_1_1, nullptr});
+    }
+
+    {
+        post_order_iterator<int> it{nullptr, &root};
+        for (size_t i = 0; i < 10; i++) {
+            it--;
+            REQUIRE(*it == required_order[required_order.size() - 1 - i]);
+        }
+    }
+
+    {
+        post_order_iterator<int> it{&grandchild_2_1};
+        REQUIRE(*(--it) == 2);
+        REQUIRE(*(++it) == 8);
+    }
+}
+
 TEST_CASE("Tree constructed", "[tree]") {
     // compile-time checks
     static_assert(
@@ -503,6 +603,41 @@ TEST_CASE("Nodes are appended and prepended to tree", "[tree::append, tree::prep
     }
 }
 
+TEST_CASE("Nodes are emplaced into tree", "[tree::emplace]") {
+    tree<pinned> _1;
+    pre_order_view view{_1};
+    auto ids = [&view] {
+        std::vector<int> result;
+        for (const pinned& value : view) {
+            result.push_back(value.id);
+        }
+        return result;
+    };
+
+    auto root = _1.emplace(insertion::vert, std::begin(view), 1, "root");
+    _1.emplace_child_back(root, 3, "back");
+    auto front = _1.emplace_child_front(root, 2, "front");
+    _1.emplace(insertion::hor, front, 4, "before front");
+    _1.emplace(insertion::vert, front, 5, "above front");
+    _1.emplace(insertion::vert, std::end(view), 6, std::string(64, 'l'));
+
+    REQUIRE(_1.size() == 6);
+    REQUIRE(ids() == std::vector{1, 4, 5, 2, 3, 6});
+    REQUIRE(root->name == "root");
+    REQUIRE(front->name == "front");
+
+    // lvalues are copied by every insertion function
+    tree<std::string> _2;
+    pre_order_view strings{_2};
+    const std::string value(64, 'v');
+    auto string_root = _2.insert(insertion::vert, std::begin(strings), value);
+    _2.append_child(string_root, value);
+    _2.prepend_child(string_root, value);
+    REQUIRE(_2.size() == 3);
+    REQUIRE(value == std::string(64, 'v'));
+    REQUIRE(std::all_of(std::begin(strings), std::end(strings), [&value](const std::string& s) { return s == value; }));
+}
+
 TEST_CASE("Tree nodes are erased", "[tree::erase_subtree]") {
     tree<int> _1;
     pre_order_view view{_1};
@@ -553,3 +688,1377 @@ TEST_CASE("Tree nodes are erased", "[tree::erase_subtree]") {
         REQUIRE(_1.empty());
     }
 }
+
+TEST_CASE("Subtrees are spliced within and between trees", "[tree::splice]") {
+    auto find = [](auto& view, int value) {
+        return std::find(std::begin(view), std::end(view), value);
+    };
+    using sized_tree = tree<int, std::allocator<tree_node<int, sized_links>>>;
+    auto build = [](auto& t) {
+        pre_order_view view{t};
+        auto root = t.insert(insertion::vert, std::begin(view), 1);
+        auto two = t.append_child(root, 2);
+        t.append_child(two, 3);
+        t.append_child(two, 4);
+        auto five = t.append_child(root, 5);
+        t.append_child(five, 6);
+    };
+
+    {
+        tree<int> _1;
+        build(_1);
+        pre_order_view view{_1};
+
+        auto moved = _1.splice_child(find(view, 5), find(view, 2));
+        REQUIRE(*moved == 2);
+        std::array required_order = {1, 5, 6, 2, 3, 4};
+        REQUIRE(_1.size() == 6);
+        REQUIRE(std::equal(std::begin(view), std::end(view), std::begin(required_order), std::end(required_order)));
+
+        _1.splice(insertion::hor, find(view, 6), find(view, 4));
+        _1.splice(insertion::vert, find(view, 5), find(view, 3));
+        std::array reordered = {1, 3, 5, 4, 6, 2};
+        REQUIRE(_1.size() == 6);
+        REQUIRE(std::equal(std::begin(view), std::end(view), std::begin(reordered), std::end(reordered)));
+
+        // keeping both counts exact needs subtree sizes
+        STATIC_REQUIRE(!splices_between_trees<tree<int>>);
+        STATIC_REQUIRE(splices_between_trees<sized_tree>);
+    }
+
+    {
+        // equal allocators: the nodes themselves change trees
+        sized_tree source;
+        sized_tree dest;
+        build(source);
+        pre_order_view source_view{source};
+        pre_order_view dest_view{dest};
+
+        int* node_value = &*find(source_view, 2);
+        auto moved = dest.splice(insertion::vert, std::end(dest_view), source, find(source_view, 2));
+        REQUIRE(&*moved == node_value);
+        REQUIRE(source.size() == 3);
+        REQUIRE(dest.size() == 3);
+
+        dest.splice_child(moved, source, find(source_view, 6));
+        std::array dest_order = {2, 3, 4, 6};
+        std::array source_order = {1, 5};
+        REQUIRE(dest.size() == 4);
+        REQUIRE(source.size() == 2);
+        REQUIRE(std::equal(std::begin(dest_view), std::end(dest_view), std::begin(dest_order), std::end(dest_order)));
+        REQUIRE(std::equal(std::begin(source_view), std::end(source_view), std::begin(source_order), std::end(source_order)));
+
+        dest.splice_child(std::begin(dest_view), source, std::begin(source_view));
+        REQUIRE(source.empty());
+        REQUIRE(source.size() == 0);
+        REQUIRE(dest.size() == 6);
+        REQUIRE(dest.subtree_size(moved) == 6);
+
+        // within one tree
+        dest.splice(insertion::hor, find(dest_view, 3), dest, find(dest_view, 5));
+        REQUIRE(dest.size() == 6);
+        REQUIRE(dest.subtree_size(moved) == 6);
+        REQUIRE(dest.subtree_size(find(dest_view, 1)) == 1);
+    }
+
+    {
+        // a copy keeps its nodes in one block, which the nodes take along
+        using string_tree = tree<std::string, std::allocator<tree_node<std::string, sized_links>>>;
+        string_tree original;
+        pre_order_view original_view{original};
+        auto root = original.insert(insertion::vert, std::begin(original_view), std::string(32, 'r'));
+        auto child = original.append_child(root, std::string(32, 'c'));
+        original.append_child(child, std::string(32, 'g'));
+        auto source = std::make_unique<string_tree>(original);
+        pre_order_view source_view{*source};
+
+        string_tree dest;
+        pre_order_view dest_view{dest};
+        dest.insert(insertion::vert, std::begin(dest_view), "root");
+        std::string* block_value = &*std::next(std::begin(source_view));
+        auto moved = dest.splice_child(std::begin(dest_view), *source, std::next(std::begin(source_view)));
+        REQUIRE(&*moved == block_value);
+        REQUIRE(*moved == std::string(32, 'c'));
+        REQUIRE(dest.size() == 3);
+        REQUIRE(source->size() == 1);
+        REQUIRE(original.size() == 3);
+        REQUIRE(*std::next(std::begin(dest_view), 2) == std::string(32, 'g'));
+
+        // back and forth, and the block outlives the tree it was made for
+        moved = source->splice_child(std::begin(source_view), dest, moved);
+        REQUIRE(&*moved == block_value);
+        moved = dest.splice_child(std::begin(dest_view), *source, moved);
+        REQUIRE(&*moved == block_value);
+        source.reset();
+        dest.erase_subtree(std::next(std::begin(dest_view), 2));
+        REQUIRE(dest.size() == 2);
+        REQUIRE(*moved == std::string(32, 'c'));
+        dest.append_child(moved, "fresh");
+        REQUIRE(dest.size() == 3);
+    }
+
+    {
+        // only the blocks holding nodes of the subtree are shared
+        sized_tree original;
+        build(original);
+        sized_tree source{original};
+        pre_order_view source_view{source};
+        auto added = source.append_child(std::begin(source_view), 7);
+        source.append_child(added, 8);
+
+        sized_tree dest;
+        pre_order_view dest_view{dest};
+        dest.insert(insertion::vert, std::begin(dest_view), 0);
+        dest.splice_child(std::begin(dest_view), source, added);
+        REQUIRE(dest.size() == 3);
+        REQUIRE(source.size() == 6);
+        REQUIRE(dest.memory_footprint() == sizeof(dest) + 3 * sizeof(sized_tree::node_type));
+
+        dest.splice_child(std::begin(dest_view), source, find(source_view, 5));
+        REQUIRE(dest.size() == 5);
+        REQUIRE(source.size() == 4);
+        REQUIRE(dest.memory_footprint() > sizeof(dest) + 5 * sizeof(sized_tree::node_type));
+
+        // the block is listed here now, so moving more of it needs no walk
+        dest.splice_child(std::begin(dest_view), source, find(source_view, 2));
+        REQUIRE(dest.size() == 8);
+        REQUIRE(source.size() == 1);
+        REQUIRE(dest.subtree_size(std::begin(dest_view)) == 8);
+    }
+
+    {
+        using sized_level_links = links<
+            node_link::parent,
+            node_link::prev_sibling,
+            node_link::next_sibling,
+            node_link::first_child,
+            node_link::last_child,
+            node_link::next_in_level,
+            node_link::subtree_size>;
+        using level_tree = tree<int, std::allocator<tree_node<int, sized_level_links>>>;
+        level_tree source;
+        build(source);
+        level_tree dest;
+        pre_order_view source_view{source};
+        pre_order_view dest_view{dest};
+        dest.append_child(dest.insert(insertion::vert, std::begin(dest_view), 10), 20);
+
+        dest.splice_child(find(dest_view, 20), source, find(source_view, 2));
+        dest.splice(insertion::hor, find(dest_view, 20), dest, find(dest_view, 4));
+        // the spliced subtree has levels of its own above the node it is put over
+        dest.splice(insertion::vert, find(dest_view, 20), source, find(source_view, 5));
+        dest.splice(insertion::vert, find(dest_view, 4), dest, find(dest_view, 2));
+
+        tree<int> plain;
+        pre_order_view plain_view{plain};
+        auto root = plain.insert(insertion::vert, std::begin(plain_view), 10);
+        auto two = plain.append_child(root, 2);
+        plain.append_child(two, 3);
+        plain.append_child(two, 4);
+        auto five = plain.append_child(root, 5);
+        plain.append_child(five, 6);
+        plain.append_child(five, 20);
+
+        level_order_view dest_levels{dest};
+        level_order_view plain_levels{plain};
+        level_order_view source_levels{source};
+        std::array source_order = {1};
+        REQUIRE(dest.size() == plain.size());
+        REQUIRE(std::equal(std::begin(dest_levels), std::end(dest_levels), std::begin(plain_levels), std::end(plain_levels)));
+        REQUIRE(std::equal(std::begin(source_levels), std::end(source_levels), std::begin(source_order), std::end(source_order)));
+    }
+}
+
+TEST_CASE("Deep trees are counted, copied and cleared without recursion", "[tree::erase_subtree, tree::clear]") {
+    constexpr int depth = 500000;
+
+    tree<int> _1;
+    pre_order_view view{_1};
+    auto it = _1.insert(insertion::vert, std::begin(view), 0);
+    auto half = it;
+    for (int i = 1; i < depth; i++) {
+        it = _1.append_child(it, i);
+        if (i == depth / 2) {
+            half = it;
+        }
+    }
+    REQUIRE(_1.size() == depth);
+
+    {
+        tree<int> copy{_1};
+        pre_order_view copy_view{copy};
+        REQUIRE(copy.size() == depth);
+        REQUIRE(std::equal(std::begin(view), std::end(view), std::begin(copy_view), std::end(copy_view)));
+    }
+
+    _1.erase_subtree(half);
+    REQUIRE(_1.size() == depth / 2);
+    REQUIRE(view.back() == depth / 2 - 1);
+
+    _1.clear();
+    REQUIRE(_1.empty());
+    REQUIRE(_1.size() == 0);
+}
+
+TEST_CASE("Wide trees are copied", "[tree]") {
+    tree<int> _1;
+    pre_order_view view{_1};
+    _1.insert(insertion::vert, std::begin(view), 1);
+    _1.append_child(std::begin(view), 2);
+    _1.append_child(std::begin(view), 3);
+    _1.append_child(std::begin(view), 4);
+    {
+        auto it = std::find(std::begin(view), std::end(view), 3);
+        _1.append_child(it, 5);
+        _1.append_child(it, 6);
+    }
+
+    tree<int> copy{_1};
+    pre_order_view copy_view{copy};
+    std::array required_order = {1, 2, 3, 5, 6, 4};
+    REQUIRE(copy.size() == 6);
+    REQUIRE(std::equal(std::begin(copy_view), std::end(copy_view), std::begin(required_order)));
+
+    // the copy does not share nodes with the source
+    _1.erase_subtree(std::find(std::begin(view), std::end(view), 3));
+    REQUIRE(copy.size() == 6);
+    REQUIRE(std::equal(std::begin(copy_view), std::end(copy_view), std::begin(required_order)));
+}
+
+TEST_CASE("Tree copies are laid out contiguously in pre-order", "[tree]") {
+    tree<int> _1;
+    pre_order_view view{_1};
+    _1.insert(insertion::vert, std::begin(view), 1);
+    _1.append_child(std::begin(view), 2);
+    _1.append_child(std::begin(view), 3);
+    _1.append_child(std::find(std::begin(view), std::end(view), 2), 4);
+    _1.append_child(std::find(std::begin(view), std::end(view), 3), 5);
+
+    tree<int> copy{_1};
+    pre_order_view copy_view{copy};
+    const int* prev = nullptr;
+    for (const int& value : copy_view) {
+        if (prev != nullptr) {
+            REQUIRE(reinterpret_cast<const char*>(&value) - reinterpret_cast<const char*>(prev) == sizeof(tree_node<int>));
+        }
+        prev = &value;
+    }
+
+    // nodes of the block are released one by one and new ones mixed in
+    copy.erase_subtree(std::find(std::begin(copy_view), std::end(copy_view), 2));
+    copy.append_child(std::begin(copy_view), 6);
+    std::array required_order = {1, 3, 5, 6};
+    REQUIRE(copy.size() == 4);
+    REQUIRE(std::equal(std::begin(copy_view), std::end(copy_view), std::begin(required_order)));
+}
+
+TEST_CASE("Trees are copy and move assigned", "[tree]") {
+    static_assert(
+        std::is_copy_assignable_v<tree<int>>,
+        "tree should propagate copy assignment presence");
+    static_assert(
+        !std::is_copy_assignable_v<tree<no_copy>>,
+        "tree should propagate copy assignment presence");
+    static_assert(
+        std::is_move_assignable_v<tree<no_copy>>,
+        "tree should propagate move assignment presence");
+
+    tree<int> _1;
+    pre_order_view view{_1};
+    _1.insert(insertion::vert, std::begin(view), 1);
+    _1.append_child(std::begin(view), 2);
+    _1.append_child(std::begin(view), 3);
+    _1.append_child(std::find(std::begin(view), std::end(view), 2), 4);
+    _1.append_child(std::find(std::begin(view), std::end(view), 2), 5);
+
+    tree<int> _2;
+    pre_order_view view_2{_2};
+    _2.insert(insertion::vert, std::begin(view_2), 10);
+    _2.append_child(std::begin(view_2), 20);
+    _2.append_child(std::begin(view_2), 30);
+    _2.append_child(std::begin(view_2), 40);
+    _2.append_child(std::find(std::begin(view_2), std::end(view_2), 30), 50);
+    _2.append_child(std::find(std::begin(view_2), std::end(view_2), 50), 60);
+
+    {
+        // the nodes at the positions shared by both shapes are kept
+        const int* root = &view_2.front();
+        _2 = _1;
+        std::array required_order = {1, 2, 4, 5, 3};
+        REQUIRE(_2.size() == 5);
+        REQUIRE(&view_2.front() == root);
+        REQUIRE(std::equal(std::begin(view_2), std::end(view_2), std::begin(required_order), std::end(required_order)));
+    }
+
+    {
+        tree<int> _3;
+        pre_order_view view_3{_3};
+        _3.insert(insertion::vert, std::begin(view_3), 7);
+        _3.append_child(std::begin(view_3), 8);
+        _2 = _3;
+        std::array required_order = {7, 8};
+        REQUIRE(_2.size() == 2);
+        REQUIRE(std::equal(std::begin(view_2), std::end(view_2), std::begin(required_order), std::end(required_order)));
+    }
+
+    {
+        _2 = std::move(_1);
+        std::array required_order = {1, 2, 4, 5, 3};
+        REQUIRE(_2.size() == 5);
+        REQUIRE(_1.empty());
+        REQUIRE(_1.size() == 0);
+        REQUIRE(std::equal(std::begin(view_2), std::end(view_2), std::begin(required_order), std::end(required_order)));
+    }
+
+    {
+        _2 = tree<int>{};
+        REQUIRE(_2.empty());
+        REQUIRE(_2.size() == 0);
+    }
+
+    {
+        // copying over existing nodes leaves the source intact
+        tree<std::string> source;
+        pre_order_view source_view{source};
+        source.append_child(source.insert(insertion::vert, std::begin(source_view), std::string(32, 'a')), std::string(32, 'b'));
+        tree<std::string> target;
+        pre_order_view target_view{target};
+        target.insert(insertion::vert, std::begin(target_view), std::string{"c"});
+        target = source;
+        REQUIRE(std::equal(std::begin(source_view), std::end(source_view), std::begin(target_view), std::end(target_view)));
+        REQUIRE(source_view.front() == std::string(32, 'a'));
+    }
+}
+
+TEST_CASE("Trees are built from parent arrays and pre-order depths", "[tree::from_parent_array, tree::from_preorder_depths]") {
+    std::array required_order = {1, 2, 5, 6, 3, 4, 7, 8};
+
+    {
+        auto _1 = tree<int>::from_parent_array(std::vector{1, 2, 3, 4, 5, 6, 7, 8}, std::vector{-1, 0, 0, 0, 1, 1, 3, 6});
+        pre_order_view view{_1};
+        REQUIRE(_1.size() == 8);
+        REQUIRE(std::equal(std::begin(view), std::end(view), std::begin(required_order), std::end(required_order)));
+    }
+
+    {
+        // the root does not have to come first, nor parents before their children
+        std::array values = {8, 7, 1, 2, 3, 4, 5, 6};
+        std::array<size_t, 8> parents = {1, 5, ~size_t{0}, 2, 2, 2, 3, 3};
+        auto _1 = tree<int>::from_parent_array(values, parents);
+        pre_order_view view{_1};
+        REQUIRE(_1.size() == 8);
+        REQUIRE(std::equal(std::begin(view), std::end(view), std::begin(required_order), std::end(required_order)));
+
+        _1.erase_subtree(std::find(std::begin(view), std::end(view), 4));
+        _1.append_child(std::begin(view), 9);
+        std::array order_after_erase = {1, 2, 5, 6, 3, 9};
+        REQUIRE(_1.size() == 6);
+        REQUIRE(std::equal(std::begin(view), std::end(view), std::begin(order_after_erase), std::end(order_after_erase)));
+    }
+
+    {
+        std::array depths = {0, 1, 2, 2, 1, 1, 2, 3};
+        auto _1 = tree<int>::from_preorder_depths(required_order, depths);
+        pre_order_view view{_1};
+        REQUIRE(_1.size() == 8);
+        REQUIRE(std::equal(std::begin(view), std::end(view), std::begin(required_order), std::end(required_order)));
+
+        const int* prev = nullptr;
+        for (const int& value : view) {
+            if (prev != nullptr) {
+                REQUIRE(reinterpret_cast<const char*>(&value) - reinterpret_cast<const char*>(prev) == sizeof(tree_node<int>));
+            }
+            prev = &value;
+        }
+
+        using level_tree = tree<int, std::allocator<tree_node<int, level_links>>>;
+        auto _2 = level_tree::from_preorder_depths(required_order, depths);
+        level_order_view level_view{_2};
+        std::array level_order = {1, 2, 3, 4, 5, 6, 7, 8};
+        REQUIRE(std::equal(std::begin(level_view), std::end(level_view), std::begin(level_order), std::end(level_order)));
+    }
+
+    REQUIRE(tree<int>::from_parent_array(std::vector<int>{}, std::vector<int>{}).empty());
+    REQUIRE(tree<int>::from_preorder_depths(std::vector<int>{}, std::vector<int>{}).empty());
+
+    REQUIRE_THROWS_AS(tree<int>::from_parent_array(std::vector{1, 2}, std::vector{-1}), std::invalid_argument);
+    REQUIRE_THROWS_AS(tree<int>::from_parent_array(std::vector{1, 2}, std::vector{-1, -1}), std::invalid_argument);
+    REQUIRE_THROWS_AS(tree<int>::from_parent_array(std::vector{1, 2}, std::vector{1, 0}), std::invalid_argument);
+    REQUIRE_THROWS_AS(tree<int>::from_parent_array(std::vector{1, 2, 3}, std::vector{-1, 2, 1}), std::invalid_argument);
+    REQUIRE_THROWS_AS(tree<int>::from_preorder_depths(std::vector{1, 2}, std::vector{0, 2}), std::invalid_argument);
+    REQUIRE_THROWS_AS(tree<int>::from_preorder_depths(std::vector{1, 2}, std::vector{1, 2}), std::invalid_argument);
+    REQUIRE_THROWS_AS(tree<int>::from_preorder_depths(std::vector{1, 2, 3}, std::vector{0, 1, 0}), std::invalid_argument);
+}
+
+TEST_CASE("Tree is viewed in post-order", "[post_order_view]") {
+    tree<int> _1;
+    pre_order_view view{_1};
+    post_order_view post_view{_1};
+    REQUIRE(std::begin(post_view) == std::end(post_view));
+
+    _1.insert(insertion::vert, std::begin(view), 1);
+    REQUIRE(post_view.front() == 1);
+    REQUIRE(post_view.back() == 1);
+
+    _1.append_child(std::begin(view), 2);
+    _1.append_child(std::begin(view), 3);
+    _1.append_child(std::begin(view), 4);
+    _1.append_child(std::find(std::begin(view), std::end(view), 2), 5);
+    _1.append_child(std::find(std::begin(view), std::end(view), 2), 6);
+    _1.append_child(std::find(std::begin(view), std::end(view), 4), 7);
+
+    std::array required_order = {5, 6, 2, 3, 7, 4, 1};
+    REQUIRE(post_view.size() == 7);
+    REQUIRE(post_view.front() == 5);
+    REQUIRE(post_view.back() == 1);
+    REQUIRE(std::equal(std::begin(post_view), std::end(post_view), std::begin(required_order), std::end(required_order)));
+    REQUIRE(std::equal(std::rbegin(post_view), std::rend(post_view), std::rbegin(required_order), std::rend(required_order)));
+
+    // post-order iterators are accepted by the insertion API as well
+    auto it = std::find(std::begin(post_view), std::end(post_view), 3);
+    _1.append_child(it, 8);
+    std::array new_order = {5, 6, 2, 8, 3, 7, 4, 1};
+    REQUIRE(std::equal(std::begin(post_view), std::end(post_view), std::begin(new_order), std::end(new_order)));
+}
+
+TEST_CASE("Tree is viewed in level-order", "[level_order_view]") {
+    tree<int> _1;
+    pre_order_view view{_1};
+    level_order_view level_view{_1};
+    REQUIRE(std::begin(level_view) == std::end(level_view));
+
+    _1.insert(insertion::vert, std::begin(view), 1);
+    _1.append_child(std::begin(view), 2);
+    _1.append_child(std::begin(view), 3);
+    _1.append_child(std::begin(view), 4);
+    _1.append_child(std::find(std::begin(view), std::end(view), 2), 5);
+    _1.append_child(std::find(std::begin(view), std::end(view), 2), 6);
+    _1.append_child(std::find(std::begin(view), std::end(view), 4), 7);
+    _1.append_child(std::find(std::begin(view), std::end(view), 7), 8);
+
+    std::array required_order = {1, 2, 3, 4, 5, 6, 7, 8};
+    std::array required_depth = {0, 1, 1, 1, 2, 2, 2, 3};
+    REQUIRE(level_view.front() == 1);
+
+    // the queue is reused by the second pass
+    for (int pass = 0; pass < 2; pass++) {
+        size_t i = 0;
+        for (auto it = std::begin(level_view); it != std::end(level_view); ++it, ++i) {
+            REQUIRE(i < required_order.size());
+            REQUIRE(*it == required_order[i]);
+            REQUIRE(it.depth() == static_cast<size_t>(required_depth[i]));
+        }
+        REQUIRE(i == required_order.size());
+    }
+}
+
+TEST_CASE("Level links are kept up to date", "[level_order_view][level_links]") {
+    using level_tree = tree<int, std::allocator<tree_node<int, level_links>>>;
+    static_assert(
+        std::is_same_v<level_order_view<int, level_tree::allocator_type>::iterator, level_link_iterator<int, level_links>>,
+        "trees with level links should be walked along the links");
+
+    tree<int> plain;
+    level_tree linked;
+    pre_order_view plain_view{plain};
+    pre_order_view linked_view{linked};
+    level_order_view plain_levels{plain};
+    level_order_view linked_levels{linked};
+
+    auto apply = [&](auto&& op) {
+        op(plain, plain_view);
+        op(linked, linked_view);
+
+        REQUIRE(plain.size() == linked.size());
+        REQUIRE(std::equal(std::begin(plain_levels), std::end(plain_levels), std::begin(linked_levels), std::end(linked_levels)));
+
+        auto plain_it = std::begin(plain_levels);
+        for (auto it = std::begin(linked_levels); it != std::end(linked_levels); ++it, ++plain_it) {
+            REQUIRE(it.depth() == plain_it.depth());
+        }
+    };
+    auto find = [](auto& view, int value) {
+        return std::find(std::begin(view), std::end(view), value);
+    };
+
+    apply([](auto& t, auto& v) { t.insert(insertion::vert, std::begin(v), 1); });
+    apply([](auto& t, auto& v) { t.append_child(std::begin(v), 2); });
+    apply([](auto& t, auto& v) { t.append_child(std::begin(v), 3); });
+    apply([](auto& t, auto& v) { t.append_child(std::begin(v), 4); });
+    apply([&](auto& t, auto& v) { t.append_child(find(v, 4), 5); });
+    apply([&](auto& t, auto& v) { t.append_child(find(v, 2), 6); });
+    apply([&](auto& t, auto& v) { t.prepend_child(find(v, 3), 7); });
+    apply([&](auto& t, auto& v) { t.append_child(find(v, 5), 8); });
+    apply([&](auto& t, auto& v) { t.append_child(find(v, 6), 9); });
+    apply([&](auto& t, auto& v) { t.insert(insertion::hor, find(v, 3), 10); });
+    apply([&](auto& t, auto& v) { t.insert(insertion::vert, find(v, 6), 11); });
+    apply([&](auto& t, auto& v) { t.insert(insertion::vert, std::begin(v), 12); });
+    apply([&](auto& t, auto& v) { t.insert(insertion::vert, std::end(v), 13); });
+    apply([&](auto& t, auto& v) { t.insert(insertion::hor, std::end(v), 14); });
+    apply([&](auto& t, auto& v) { t.erase_subtree(find(v, 11)); });
+    apply([&](auto& t, auto& v) { t.append_child(find(v, 7), 15); });
+    apply([&](auto& t, auto& v) { t.erase_subtree(find(v, 3)); });
+    apply([&](auto& t, auto& v) { t.append_child(find(v, 10), 16); });
+
+    {
+        level_tree copy{linked};
+        level_order_view copy_levels{copy};
+        REQUIRE(std::equal(std::begin(plain_levels), std::end(plain_levels), std::begin(copy_levels), std::end(copy_levels)));
+    }
+
+    apply([&](auto& t, auto& v) { t.erase_subtree(std::begin(v)); });
+    REQUIRE(linked.empty());
+}
+
+TEST_CASE("Trees with elided links behave like full trees", "[tree][forward_links]") {
+    using forward_tree = tree<int, std::allocator<tree_node<int, forward_links>>>;
+    static_assert(sizeof(tree_node<void*, forward_links>) == 4 * sizeof(void*));
+    static_assert(sizeof(tree_node<void*>) == 6 * sizeof(void*));
+
+    // a value constructible from anything does not take in a copied node
+    tree_node_impl<std::any, forward_links> any_node{std::any{7}};
+    tree_node_impl<std::any, forward_links> any_copy{any_node};
+    REQUIRE(std::any_cast<int>(any_copy.value) == 7);
+    static_assert(std::is_same_v<
+        pre_order_view<int, forward_tree::allocator_type>::iterator::iterator_category,
+        std::forward_iterator_tag>);
+    static_assert(std::is_same_v<
+        pre_order_view<int>::iterator::iterator_category,
+        std::bidirectional_iterator_tag>);
+
+    tree<int> full;
+    forward_tree forward;
+    pre_order_view full_view{full};
+    pre_order_view forward_view{forward};
+
+    auto same_shape = [](const tree<int>& lhs, const forward_tree& rhs) {
+        pre_order_view lhs_pre{lhs};
+        pre_order_view rhs_pre{rhs};
+        post_order_view lhs_post{lhs};
+        post_order_view rhs_post{rhs};
+        level_order_view lhs_levels{lhs};
+        level_order_view rhs_levels{rhs};
+        return lhs.size() == rhs.size()
+            && std::equal(std::begin(lhs_pre), std::end(lhs_pre), std::begin(rhs_pre), std::end(rhs_pre))
+            && std::equal(std::begin(lhs_post), std::end(lhs_post), std::begin(rhs_post), std::end(rhs_post))
+            && std::equal(std::begin(lhs_levels), std::end(lhs_levels), std::begin(rhs_levels), std::end(rhs_levels));
+    };
+    auto apply = [&](auto&& op) {
+        op(full, full_view);
+        op(forward, forward_view);
+        REQUIRE(same_shape(full, forward));
+    };
+    auto find = [](auto& view, int value) {
+        return std::find(std::begin(view), std::end(view), value);
+    };
+
+    apply([](auto& t, auto& v) { t.insert(insertion::vert, std::begin(v), 1); });
+    apply([](auto& t, auto& v) { t.append_child(std::begin(v), 2); });
+    apply([](auto& t, auto& v) { t.append_child(std::begin(v), 3); });
+    apply([](auto& t, auto& v) { t.append_child(std::begin(v), 4); });
+    apply([&](auto& t, auto& v) { t.append_child(find(v, 4), 5); });
+    apply([&](auto& t, auto& v) { t.append_child(find(v, 2), 6); });
+    apply([&](auto& t, auto& v) { t.prepend_child(find(v, 3), 7); });
+    apply([&](auto& t, auto& v) { t.prepend_child(find(v, 3), 8); });
+    apply([&](auto& t, auto& v) { t.insert(insertion::hor, find(v, 3), 10); });
+    apply([&](auto& t, auto& v) { t.insert(insertion::hor, find(v, 2), 11); });
+    apply([&](auto& t, auto& v) { t.insert(insertion::vert, find(v, 6), 12); });
+    apply([&](auto& t, auto& v) { t.insert(insertion::vert, find(v, 4), 13); });
+    apply([&](auto& t, auto& v) { t.insert(insertion::vert, std::end(v), 14); });
+    apply([&](auto& t, auto& v) { t.insert(insertion::hor, std::end(v), 15); });
+    apply([&](auto& t, auto& v) { t.erase_subtree(find(v, 7)); });
+    apply([&](auto& t, auto& v) { t.erase_subtree(find(v, 10)); });
+    apply([&](auto& t, auto& v) { t.erase_subtree(find(v, 15)); });
+    apply([&](auto& t, auto& v) { t.insert(insertion::vert, std::begin(v), 16); });
+    apply([&](auto& t, auto& v) { t.insert_after(find(v, 2), 17); });
+    apply([&](auto& t, auto& v) { t.insert_after(find(v, 3), 18); });
+    // after the last child, so the new node ends the pre-order
+    apply([&](auto& t, auto& v) { t.insert_after(find(v, 1), 19); });
+    apply([&](auto& t, auto& v) { t.insert(insertion::vert, std::end(v), 20); });
+
+    {
+        forward_tree copy{forward};
+        REQUIRE(same_shape(full, copy));
+
+        forward_tree assigned;
+        assigned.insert(insertion::vert, std::begin(pre_order_view{assigned}), 0);
+        assigned = forward;
+        REQUIRE(same_shape(full, assigned));
+
+        // the shorter shape is assigned over the longer one
+        full.erase_subtree(find(full_view, 2));
+        forward.erase_subtree(find(forward_view, 2));
+        assigned = forward;
+        REQUIRE(same_shape(full, assigned));
+    }
+
+    {
+        std::vector<int> values = {1, 2, 3, 4, 5, 6};
+        std::vector<int> parents = {-1, 0, 0, 1, 1, 0};
+        std::vector<int> depths = {0, 1, 2, 2, 1, 1};
+        REQUIRE(same_shape(tree<int>::from_parent_array(values, parents), forward_tree::from_parent_array(values, parents)));
+        REQUIRE(same_shape(tree<int>::from_preorder_depths(values, depths), forward_tree::from_preorder_depths(values, depths)));
+    }
+
+    apply([&](auto& t, auto& v) { t.erase_subtree(std::begin(v)); });
+    REQUIRE(forward.empty());
+}
+
+TEST_CASE("The last node in pre-order is kept through every mutation", "[pre_order_view][tree]") {
+    // subtree sizes for the splices between the trees
+    using sized_tree = tree<int, std::allocator<tree_node<int, sized_links>>>;
+    sized_tree a;
+    sized_tree b;
+    pre_order_view view_a{a};
+    pre_order_view view_b{b};
+
+    // end() comes from the kept node, so walking back from it checks that node
+    auto check = [](sized_tree& t) {
+        pre_order_view view{t};
+        std::vector<int> forward(std::begin(view), std::end(view));
+        std::vector<int> backward(std::rbegin(view), std::rend(view));
+        std::reverse(backward.begin(), backward.end());
+        REQUIRE(forward.size() == t.size());
+        REQUIRE(forward == backward);
+        if (!forward.empty()) {
+            REQUIRE(view.back() == forward.back());
+        }
+    };
+    auto nodes = [](auto& view) {
+        std::vector<decltype(std::begin(view))> result;
+        for (auto it = std::begin(view); it != std::end(view); ++it) {
+            result.push_back(it);
+        }
+        return result;
+    };
+
+    unsigned state = 12345;
+    auto next = [&state](unsigned bound) {
+        state = state * 1103515245u + 12345u;
+        return (state >> 16) % bound;
+    };
+
+    int value = 0;
+    for (int step = 0; step < 3000; step++) {
+        bool on_a = next(2) == 0;
+        sized_tree& t = on_a ? a : b;
+        sized_tree& other = on_a ? b : a;
+        auto& view = on_a ? view_a : view_b;
+        auto& other_view = on_a ? view_b : view_a;
+
+        if (t.empty()) {
+            t.insert(insertion::vert, std::end(view), value++);
+            check(t);
+            continue;
+        }
+
+        auto all = nodes(view);
+        auto node = all[next(static_cast<unsigned>(all.size()))];
+        bool is_root = node == std::begin(view);
+        switch (next(11)) {
+        case 0: t.insert(insertion::vert, node, value++); break;
+        case 1: t.insert(insertion::vert, std::end(view), value++); break;
+        case 2:
+            if (!is_root) {
+                t.insert(insertion::hor, node, value++);
+            }
+            break;
+        case 3:
+            if (t.size() > 1) {
+                t.insert(insertion::hor, std::end(view), value++);
+            }
+            break;
+        case 4: t.append_child(node, value++); break;
+        case 5: t.prepend_child(node, value++); break;
+        case 6:
+            if (next(4) == 0) {
+                t.erase_subtree(node);
+            }
+            break;
+        case 7: {
+            // within the tree, to a place outside the subtree
+            auto dest = all[next(static_cast<unsigned>(all.size()))];
+            auto up = dest.as_traverser();
+            bool inside = &up.value() == &*node;
+            while (!inside && up.to_parent()) {
+                inside = &up.value() == &*node;
+            }
+            if (!inside && !is_root) {
+                t.splice_child(dest, t, node);
+            }
+            break;
+        }
+        case 8:
+            if (!other.empty()) {
+                auto dest = nodes(other_view);
+                other.splice_child(dest[next(static_cast<unsigned>(dest.size()))], t, node);
+                check(other);
+            }
+            break;
+        case 9:
+            if (!other.empty()) {
+                other.splice(insertion::vert, std::end(other_view), t, node);
+                check(other);
+            }
+            break;
+        case 10:
+            if (next(8) == 0) {
+                sized_tree copy{t};
+                check(copy);
+                other = std::move(copy);
+                check(other);
+            }
+            break;
+        }
+        check(t);
+        if (t.size() > 200) {
+            t.clear();
+            check(t);
+        }
+    }
+}
+
+TEST_CASE("Trees are walked as std::ranges", "[pre_order_range][post_order_range]") {
+    static_assert(sizeof(pre_order_view<int>::iterator) == 2 * sizeof(void*));
+    static_assert(std::ranges::view<pre_order_range<int>>);
+    static_assert(std::ranges::forward_range<pre_order_range<int>>);
+    static_assert(std::ranges::borrowed_range<pre_order_range<int>>);
+    static_assert(std::ranges::view<post_order_range<int>>);
+    static_assert(std::ranges::forward_range<post_order_range<int>>);
+    static_assert(std::sentinel_for<std::default_sentinel_t, pre_order_view<int>::iterator>);
+
+    tree<int> _1;
+    pre_order_range range{_1};
+    REQUIRE(range.empty());
+    REQUIRE(range.begin() == range.end());
+
+    pre_order_view view{_1};
+    _1.insert(insertion::vert, std::begin(view), 1);
+    _1.append_child(std::begin(view), 2);
+    _1.append_child(std::begin(view), 3);
+    _1.append_child(std::find(std::begin(view), std::end(view), 2), 4);
+    _1.append_child(std::find(std::begin(view), std::end(view), 3), 5);
+
+    std::vector<int> visited;
+    for (int& value : range) {
+        visited.push_back(value);
+    }
+    REQUIRE(visited == std::vector<int>{1, 2, 4, 3, 5});
+    REQUIRE(range.size() == 5);
+    REQUIRE(range.front() == 1);
+    REQUIRE(std::ranges::distance(range) == 5);
+
+    auto odd = range | std::views::filter([](int value) { return value % 2 != 0; });
+    REQUIRE(std::ranges::equal(odd, std::array{1, 3, 5}));
+
+    auto it = std::ranges::find(range, 3);
+    REQUIRE(it != range.end());
+    _1.append_child(it, 6);
+    REQUIRE(std::ranges::equal(range, std::array{1, 2, 4, 3, 5, 6}));
+    REQUIRE(std::ranges::equal(post_order_range{_1}, std::array{4, 2, 5, 6, 3, 1}));
+    REQUIRE(std::ranges::max(post_order_range{_1}) == 6);
+}
+
+TEST_CASE("Order labels answer ancestor and pre-order tests through mutations", "[tree][order_labels]") {
+    // with subtree sizes for the splices between the trees
+    using sized_labelled_links = links<
+        node_link::parent,
+        node_link::prev_sibling,
+        node_link::next_sibling,
+        node_link::first_child,
+        node_link::last_child,
+        node_link::order_labels,
+        node_link::subtree_size>;
+    using labelled_tree = tree<int, std::allocator<tree_node<int, sized_labelled_links>>>;
+    using iterator = pre_order_view<int, labelled_tree::allocator_type>::iterator;
+
+    labelled_tree a;
+    labelled_tree b;
+    pre_order_view view_a{a};
+    pre_order_view view_b{b};
+
+    auto nodes = [](auto& view) {
+        std::vector<iterator> result;
+        for (auto it = std::begin(view); it != std::end(view); ++it) {
+            result.push_back(it);
+        }
+        return result;
+    };
+
+    unsigned state = 99;
+    auto next = [&state](unsigned bound) {
+        state = state * 1103515245u + 12345u;
+        return (state >> 16) % bound;
+    };
+
+    // compares the labels with the pre-order and with walks up the parents
+    auto consistent = [&](labelled_tree& t) {
+        pre_order_view view{t};
+        auto all = nodes(view);
+        for (size_t i = 0; i + 1 < all.size(); i++) {
+            if (!t.precedes(all[i], all[i + 1]) || t.precedes(all[i + 1], all[i])) {
+                return false;
+            }
+        }
+        for (int pair = 0; pair < 20 && !all.empty(); pair++) {
+            auto x = all[next(static_cast<unsigned>(all.size()))];
+            auto y = all[next(static_cast<unsigned>(all.size()))];
+            auto up = y.as_traverser();
+            bool walked = &up.value() == &*x;
+            while (!walked && up.to_parent()) {
+                walked = &up.value() == &*x;
+            }
+            if (t.is_ancestor(x, y) != walked) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    int value = 0;
+    for (int step = 0; step < 2000; step++) {
+        bool on_a = next(2) == 0;
+        labelled_tree& t = on_a ? a : b;
+        labelled_tree& other = on_a ? b : a;
+        auto& view = on_a ? view_a : view_b;
+        auto& other_view = on_a ? view_b : view_a;
+
+        if (t.empty()) {
+            t.insert(insertion::vert, std::end(view), value++);
+            continue;
+        }
+
+        auto all = nodes(view);
+        auto node = all[next(static_cast<unsigned>(all.size()))];
+        bool is_root = node == std::begin(view);
+        switch (next(8)) {
+        case 0: t.insert(insertion::vert, node, value++); break;
+        case 1: t.insert(insertion::vert, std::end(view), value++); break;
+        case 2:
+            if (!is_root) {
+                t.insert(insertion::hor, node, value++);
+            }
+            break;
+        case 3: t.append_child(node, value++); break;
+        case 4: t.prepend_child(node, value++); break;
+        case 5:
+            if (next(4) == 0) {
+                t.erase_subtree(node);
+            }
+            break;
+        case 6:
+            if (!other.empty()) {
+                auto dest = nodes(other_view);
+                other.splice(insertion::vert, dest[next(static_cast<unsigned>(dest.size()))], t, node);
+                REQUIRE(consistent(other));
+            }
+            break;
+        case 7:
+            if (next(8) == 0) {
+                labelled_tree copy{t};
+                REQUIRE(consistent(copy));
+                other = std::move(copy);
+            }
+            break;
+        }
+        REQUIRE(consistent(t));
+        if (t.size() > 150) {
+            t.clear();
+        }
+    }
+
+    // inserting at one spot over and over wears the gap out and forces relabelling
+    labelled_tree dense;
+    pre_order_view dense_view{dense};
+    auto root = dense.insert(insertion::vert, std::begin(dense_view), 0);
+    auto last = dense.append_child(root, 1);
+    auto first = dense.append_child(root, 2);
+    for (int i = 3; i < 3000; i++) {
+        last = dense.insert(insertion::hor, last, i);
+        first = dense.insert(insertion::vert, first, i);
+    }
+    REQUIRE(consistent(dense));
+    REQUIRE(dense.is_ancestor(root, first));
+    REQUIRE(dense.precedes(last, first));
+    REQUIRE_FALSE(dense.is_ancestor(last, first));
+}
+
+TEST_CASE("Trees are laid out again in one block", "[tree::relayout]") {
+    auto build = [](auto& t) {
+        pre_order_view view{t};
+        using iterator = decltype(std::begin(view));
+        std::vector<iterator> nodes{t.insert(insertion::vert, std::begin(view), 0)};
+        unsigned state = 5;
+        for (int i = 1; i < 400; i++) {
+            state = state * 1103515245u + 12345u;
+            nodes.push_back(t.append_child(nodes[(state >> 16) % nodes.size()], i));
+        }
+        // erasing leaves gaps in the heap between the survivors
+        for (int i = 0; i < 40; i++) {
+            auto it = std::find(std::begin(view), std::end(view), i * 7 + 3);
+            if (it != std::end(view)) {
+                t.erase_subtree(it);
+            }
+        }
+    };
+    auto sequences = [](auto& t) {
+        pre_order_view pre{t};
+        post_order_view post{t};
+        level_order_view level{t};
+        return std::array{
+            std::vector<int>(std::begin(pre), std::end(pre)),
+            std::vector<int>(std::rbegin(pre), std::rend(pre)),
+            std::vector<int>(std::begin(post), std::end(post)),
+            std::vector<int>(std::begin(level), std::end(level)),
+        };
+    };
+    // addresses of the values in the order given by the view
+    auto addresses = [](auto view) {
+        std::vector<const char*> result;
+        for (auto it = std::begin(view); it != std::end(view); ++it) {
+            result.push_back(reinterpret_cast<const char*>(&*it));
+        }
+        return result;
+    };
+
+    for (layout_order order : {layout_order::pre_order, layout_order::level_order, layout_order::van_emde_boas}) {
+        tree<int> t;
+        build(t);
+        auto before = sequences(t);
+        size_t size = t.size();
+
+        t.relayout(order);
+        REQUIRE(sequences(t) == before);
+        REQUIRE(t.size() == size);
+
+        auto pre = addresses(pre_order_view{t});
+        auto [low, high] = std::minmax_element(pre.begin(), pre.end());
+        REQUIRE(static_cast<size_t>(*high - *low) == (size - 1) * sizeof(tree_node<int>));
+        auto in_order = order == layout_order::level_order ? addresses(level_order_view{t}) : pre;
+        if (order != layout_order::van_emde_boas) {
+            for (size_t i = 1; i < in_order.size(); i++) {
+                REQUIRE(static_cast<size_t>(in_order[i] - in_order[i - 1]) == sizeof(tree_node<int>));
+            }
+        }
+
+        // the new block is released node by node like any other
+        pre_order_view view{t};
+        t.erase_subtree(std::next(std::begin(view)));
+        t.append_child(std::begin(view), -1);
+        REQUIRE(std::find(std::begin(view), std::end(view), -1) != std::end(view));
+        tree<int> copy{t};
+        REQUIRE(std::equal(std::begin(view), std::end(view), std::begin(pre_order_view{copy}), std::end(pre_order_view{copy})));
+    }
+
+    // van Emde Boas order on a complete binary tree of height 4: the top two
+    // levels, then each subtree of two levels below them
+    {
+        tree<int> t;
+        pre_order_view view{t};
+        std::vector<decltype(std::begin(view))> nodes{t.insert(insertion::vert, std::begin(view), 0)};
+        for (int i = 1; i < 15; i++) {
+            nodes.push_back(t.append_child(nodes[static_cast<size_t>(i - 1) / 2], i));
+        }
+        t.relayout(layout_order::van_emde_boas);
+        auto base = reinterpret_cast<const char*>(&*std::begin(view));
+        std::vector<int> by_address(15);
+        for (int value : view) {
+            auto it = std::find(std::begin(view), std::end(view), value);
+            by_address[static_cast<size_t>(reinterpret_cast<const char*>(&*it) - base) / sizeof(tree_node<int>)] = value;
+        }
+        REQUIRE(by_address == std::vector<int>{0, 1, 2, 3, 7, 8, 4, 9, 10, 5, 11, 12, 6, 13, 14});
+    }
+
+    // level links and order labels come along
+    {
+        using level_tree = tree<int, std::allocator<tree_node<int, level_links>>>;
+        level_tree t;
+        build(t);
+        auto before = sequences(t);
+        t.relayout(layout_order::van_emde_boas);
+        REQUIRE(sequences(t) == before);
+    }
+    {
+        using labelled_tree = tree<int, std::allocator<tree_node<int, labelled_links>>>;
+        labelled_tree t;
+        build(t);
+        t.relayout(layout_order::level_order);
+        pre_order_view view{t};
+        auto leaf = std::begin(view);
+        while (leaf.as_traverser().has_first_child()) {
+            ++leaf;
+        }
+        REQUIRE(t.is_ancestor(std::begin(view), leaf));
+        REQUIRE(t.precedes(std::begin(view), leaf));
+        REQUIRE_FALSE(t.is_ancestor(leaf, std::begin(view)));
+    }
+
+    // without last_child links the children are linked without walking their siblings
+    {
+        using forward_tree = tree<int, std::allocator<tree_node<int, forward_links>>>;
+        auto forward_sequences = [](forward_tree& t) {
+            pre_order_view pre{t};
+            post_order_view post{t};
+            level_order_view level{t};
+            return std::array{
+                std::vector<int>(std::begin(pre), std::end(pre)),
+                std::vector<int>(std::begin(post), std::end(post)),
+                std::vector<int>(std::begin(level), std::end(level)),
+            };
+        };
+        for (layout_order order : {layout_order::pre_order, layout_order::level_order, layout_order::van_emde_boas}) {
+            forward_tree t;
+            build(t);
+            auto before = forward_sequences(t);
+            t.relayout(order);
+            REQUIRE(forward_sequences(t) == before);
+        }
+
+        forward_tree wide;
+        pre_order_view view{wide};
+        auto child = wide.append_child(wide.insert(insertion::vert, std::begin(view), -1), 0);
+        for (int i = 1; i < 100000; i++) {
+            child = wide.insert_after(child, i);
+        }
+        auto before = forward_sequences(wide);
+        wide.relayout();
+        REQUIRE(forward_sequences(wide) == before);
+        REQUIRE(wide.size() == 100001);
+    }
+}
+
+TEST_CASE("Subtree hashes follow every mutation", "[tree][subtree_hash]") {
+    // with subtree sizes for the splices between the trees
+    using sized_hashed_links = links<
+        node_link::parent,
+        node_link::prev_sibling,
+        node_link::next_sibling,
+        node_link::first_child,
+        node_link::last_child,
+        node_link::subtree_hash,
+        node_link::subtree_size>;
+    using hashed_tree = tree<int, std::allocator<tree_node<int, sized_hashed_links>>>;
+    using iterator = pre_order_view<int, hashed_tree::allocator_type>::iterator;
+
+    hashed_tree a;
+    hashed_tree b;
+    pre_order_view view_a{a};
+    pre_order_view view_b{b};
+
+    auto nodes = [](auto& view) {
+        std::vector<iterator> result;
+        for (auto it = std::begin(view); it != std::end(view); ++it) {
+            result.push_back(it);
+        }
+        return result;
+    };
+
+    unsigned state = 17;
+    auto next = [&state](unsigned bound) {
+        state = state * 1103515245u + 12345u;
+        return (state >> 16) % bound;
+    };
+
+    // a copy starts without hashes, so its hashes are computed from scratch;
+    // the const calls compute the missing ones without storing them
+    auto consistent = [](hashed_tree& t) {
+        if (t.empty()) {
+            return true;
+        }
+        hashed_tree fresh{t};
+        auto root = std::begin(pre_order_view{t});
+        auto fresh_root = std::begin(pre_order_view{fresh});
+        std::uint64_t hash = std::as_const(t).subtree_hash(root);
+        return hash == std::as_const(fresh).subtree_hash(fresh_root)
+            && hash == t.subtree_hash(root)
+            && hash == fresh.subtree_hash(fresh_root);
+    };
+
+    int value = 0;
+    for (int step = 0; step < 2000; step++) {
+        bool on_a = next(2) == 0;
+        hashed_tree& t = on_a ? a : b;
+        hashed_tree& other = on_a ? b : a;
+        auto& view = on_a ? view_a : view_b;
+        auto& other_view = on_a ? view_b : view_a;
+
+        if (t.empty()) {
+            t.insert(insertion::vert, std::end(view), value++);
+            continue;
+        }
+        // every node gets its hash, so a stale one would show below
+        t.subtree_hash(std::begin(view));
+
+        auto all = nodes(view);
+        auto node = all[next(static_cast<unsigned>(all.size()))];
+        bool is_root = node == std::begin(view);
+        switch (next(10)) {
+        case 0: t.insert(insertion::vert, node, value++); break;
+        case 1: t.insert(insertion::vert, std::end(view), value++); break;
+        case 2:
+            if (!is_root) {
+                t.insert(insertion::hor, node, value++);
+            }
+            break;
+        case 3: t.append_child(node, value++); break;
+        case 4: t.prepend_child(node, value++); break;
+        case 5:
+            if (next(4) == 0) {
+                t.erase_subtree(node);
+            }
+            break;
+        case 6:
+            if (!other.empty()) {
+                auto dest = nodes(other_view);
+                other.splice(insertion::vert, dest[next(static_cast<unsigned>(dest.size()))], t, node);
+                REQUIRE(consistent(other));
+            }
+            break;
+        case 7: {
+            auto dest = all[next(static_cast<unsigned>(all.size()))];
+            auto up = dest.as_traverser();
+            bool inside = &up.value() == &*node;
+            while (!inside && up.to_parent()) {
+                inside = &up.value() == &*node;
+            }
+            if (!inside) {
+                t.splice_child(dest, t, node);
+            }
+            break;
+        }
+        case 8:
+            *node = value++;
+            t.value_changed(node);
+            break;
+        case 9:
+            if (next(4) == 0) {
+                other = t;
+                REQUIRE(consistent(other));
+            } else if (next(2) == 0) {
+                t.relayout();
+            }
+            break;
+        }
+        REQUIRE(consistent(t));
+        if (t.size() > 150) {
+            t.clear();
+        }
+    }
+}
+
+TEST_CASE("Subtree sizes follow every mutation", "[tree][subtree_size]") {
+    using sized_tree = tree<int, std::allocator<tree_node<int, sized_links>>>;
+    using iterator = pre_order_view<int, sized_tree::allocator_type>::iterator;
+
+    sized_tree a;
+    sized_tree b;
+    pre_order_view view_a{a};
+    pre_order_view view_b{b};
+
+    auto nodes = [](auto& view) {
+        std::vector<iterator> result;
+        for (auto it = std::begin(view); it != std::end(view); ++it) {
+            result.push_back(it);
+        }
+        return result;
+    };
+
+    unsigned state = 23;
+    auto next = [&state](unsigned bound) {
+        state = state * 1103515245u + 12345u;
+        return (state >> 16) % bound;
+    };
+
+    // a copy counts its sizes from scratch
+    auto consistent = [&nodes](sized_tree& t) {
+        if (t.empty()) {
+            return t.size() == 0;
+        }
+        sized_tree fresh{t};
+        pre_order_view view{t};
+        pre_order_view fresh_view{fresh};
+        auto all = nodes(view);
+        auto fresh_all = nodes(fresh_view);
+        if (t.subtree_size(all.front()) != t.size() || all.size() != t.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < all.size(); i++) {
+            if (t.subtree_size(all[i]) != fresh.subtree_size(fresh_all[i])) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    int value = 0;
+    for (int step = 0; step < 2000; step++) {
+        bool on_a = next(2) == 0;
+        sized_tree& t = on_a ? a : b;
+        sized_tree& other = on_a ? b : a;
+        auto& view = on_a ? view_a : view_b;
+        auto& other_view = on_a ? view_b : view_a;
+
+        if (t.empty()) {
+            t.insert(insertion::vert, std::end(view), value++);
+            continue;
+        }
+
+        auto all = nodes(view);
+        auto node = all[next(static_cast<unsigned>(all.size()))];
+        bool is_root = node == std::begin(view);
+        switch (next(9)) {
+        case 0: t.insert(insertion::vert, node, value++); break;
+        case 1: t.insert(insertion::vert, std::end(view), value++); break;
+        case 2:
+            if (!is_root) {
+                if (next(2) == 0) {
+                    t.insert(insertion::hor, node, value++);
+                } else {
+                    t.insert_after(node, value++);
+                }
+            }
+            break;
+        case 3: t.append_child(node, value++); break;
+        case 4: t.prepend_child(node, value++); break;
+        case 5:
+            if (next(4) == 0) {
+                t.erase_subtree(node);
+            }
+            break;
+        case 6:
+            if (!other.empty()) {
+                auto dest = nodes(other_view);
+                if (next(2) == 0) {
+                    other.splice(insertion::vert, dest[next(static_cast<unsigned>(dest.size()))], t, node);
+                } else {
+                    other.splice_child(dest[next(static_cast<unsigned>(dest.size()))], t, node);
+                }
+                REQUIRE(consistent(other));
+            }
+            break;
+        case 7: {
+            auto dest = all[next(static_cast<unsigned>(all.size()))];
+            auto up = dest.as_traverser();
+            bool inside = &up.value() == &*node;
+            while (!inside && up.to_parent()) {
+                inside = &up.value() == &*node;
+            }
+            if (!inside && dest != std::begin(view)) {
+                t.splice(insertion::hor, dest, t, node);
+            } else if (!inside) {
+                t.splice_child(dest, t, node);
+            }
+            break;
+        }
+        case 8:
+            // copies and relayouts make node blocks, which splices then share
+            if (next(4) == 0) {
+                other = t;
+                REQUIRE(consistent(other));
+            } else if (next(2) == 0) {
+                t.relayout();
+            }
+            break;
+        }
+        REQUIRE(consistent(t));
+        if (t.size() > 150) {
+            t.clear();
+        }
+    }
+}
+
+struct colliding {
+    int value;
+
+    bool operator == (const colliding& other) const noexcept {
+        return value == other.value;
+    }
+};
+
+template <>
+struct std::hash<colliding> {
+    size_t operator () (const colliding&) const noexcept {
+        return 0;
+    }
+};
+
+TEST_CASE("Trees and subtrees are compared and diffed", "[tree][subtree_hash]") {
+    auto check = [](auto& t) {
+        using tree_type = std::remove_reference_t<decltype(t)>;
+        pre_order_view view{t};
+        using iterator = decltype(std::begin(view));
+
+        // 0 (1 (2 3) 4 (2 3) 5)
+        auto root = t.insert(insertion::vert, std::begin(view), 0);
+        auto _1 = t.append_child(root, 1);
+        t.append_child(_1, 2);
+        t.append_child(_1, 3);
+        auto _4 = t.append_child(root, 4);
+        t.append_child(_4, 2);
+        auto _4_3 = t.append_child(_4, 3);
+        t.append_child(root, 5);
+
+        REQUIRE(t.subtree_equal(std::next(_1), std::next(_4)));
+        REQUIRE_FALSE(t.subtree_equal(_1, _4));
+        REQUIRE(t.subtree_equal(root, root));
+
+        tree_type copy{t};
+        REQUIRE(t == copy);
+        REQUIRE_FALSE(t == tree_type{});
+        REQUIRE(tree_type{} == tree_type{});
+
+        std::vector<std::pair<int, int>> differences;
+        auto record = [&differences](iterator lhs, iterator rhs) {
+            differences.emplace_back(*lhs, *rhs);
+        };
+        pre_order_view copy_view{copy};
+        t.diff(std::begin(view), std::begin(copy_view), record);
+        REQUIRE(differences.empty());
+
+        // a value written through an iterator drops the hashes above it
+        *_4_3 = 6;
+        REQUIRE_FALSE(t == copy);
+        if constexpr (tree_type::links_type::template has<node_link::subtree_hash>) {
+            REQUIRE_FALSE(t.probably_equal(copy));
+        }
+
+        // a changed value and an extra child are reported where they occur
+        t.append_child(std::next(_1), 7);
+        REQUIRE_FALSE(t == copy);
+        if constexpr (tree_type::links_type::template has<node_link::subtree_hash>) {
+            REQUIRE_FALSE(t.probably_equal(std::begin(view), std::begin(copy_view)));
+            REQUIRE_FALSE(t.probably_equal(copy));
+            REQUIRE_FALSE(t.probably_equal(std::next(std::begin(view)), std::next(std::begin(copy_view))));
+            REQUIRE(t.probably_equal(std::find(std::begin(view), std::end(view), 5),
+                                     std::find(std::begin(copy_view), std::end(copy_view), 5)));
+        }
+        t.diff(std::begin(view), std::begin(copy_view), record);
+        REQUIRE(differences == std::vector<std::pair<int, int>>{{2, 2}, {6, 3}});
+
+        t.erase_subtree(std::find(std::begin(view), std::end(view), 7));
+        _4_3.as_traverser().value() = 3;
+        if constexpr (tree_type::links_type::template has<node_link::subtree_hash>) {
+            REQUIRE(t.probably_equal(copy));
+            REQUIRE(copy.probably_equal(t));
+            REQUIRE_FALSE(t.probably_equal(tree_type{}));
+        }
+        REQUIRE(t == copy);
+    };
+
+    tree<int> plain;
+    check(plain);
+    tree<int, std::allocator<tree_node<int, hashed_links>>> hashed;
+    check(hashed);
+
+    // every value hashes alike, so the hashes of equally shaped trees collide
+    tree<colliding, std::allocator<tree_node<colliding, hashed_links>>> lhs;
+    tree<colliding, std::allocator<tree_node<colliding, hashed_links>>> rhs;
+    pre_order_view lhs_view{lhs};
+    pre_order_view rhs_view{rhs};
+    lhs.append_child(lhs.insert(insertion::vert, std::begin(lhs_view), colliding{0}), colliding{1});
+    rhs.append_child(rhs.insert(insertion::vert, std::begin(rhs_view), colliding{0}), colliding{2});
+    REQUIRE(lhs.probably_equal(std::begin(lhs_view), std::begin(rhs_view)));
+    REQUIRE(lhs.probably_equal(rhs));
+    REQUIRE_FALSE(lhs == rhs);
+    REQUIRE_FALSE(lhs.subtree_equal(std::begin(lhs_view), std::begin(rhs_view)));
+}
@@ -0,0 +1,180 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "tree_index.h"
+#include <string>
+#include <vector>
+
+namespace {
+    // joins the labels in path order, so a wrong order or direction shows
+    struct concat_monoid {
+        using value_type = std::string;
+
+        std::string identity() const {
+            return {};
+        }
+
+        std::string operator () (const std::string& lhs, const std::string& rhs) const {
+            return lhs + rhs;
+        }
+    };
+
+    using index_type = tree_index<int>::index_type;
+
+    struct naive_tree {
+        std::vector<index_type> parents;
+
+        index_type depth(index_type node) const {
+            index_type result = 0;
+            for (; parents[node] != tree_index<int>::npos; node = parents[node]) {
+                result++;
+            }
+            return result;
+        }
+
+        index_type lca(index_type a, index_type b) const {
+            while (depth(a) > depth(b)) {
+                a = parents[a];
+            }
+            while (depth(b) > depth(a)) {
+                b = parents[b];
+            }
+            while (a != b) {
+                a = parents[a];
+                b = parents[b];
+            }
+            return a;
+        }
+
+        template <typename Label>
+        std::string path(index_type a, index_type b, Label label) const {
+            index_type top = lca(a, b);
+            std::string up;
+            for (; a != top; a = parents[a]) {
+                up += label(a);
+            }
+            up += label(top);
+            std::string down;
+            for (; b != top; b = parents[b]) {
+                down = label(b) + down;
+            }
+            return up + down;
+        }
+    };
+}
+
+TEST_CASE("tree_index answers depth, lca and path queries", "[tree_index]") {
+    tree<int> _1;
+    pre_order_view view{_1};
+    REQUIRE(tree_index<int>{_1}.empty());
+
+    // values are the pre-order indices the index will give the nodes
+    _1.insert(insertion::vert, std::begin(view), 0);
+    auto _2 = _1.append_child(std::begin(view), 1);
+    _1.append_child(_2, 2);
+    auto _4 = _1.append_child(_2, 3);
+    _1.append_child(_4, 4);
+    auto _6 = _1.append_child(std::begin(view), 5);
+    _1.append_child(_6, 6);
+
+    tree_index index{_1};
+    REQUIRE(index.size() == 7);
+    REQUIRE(index.root() == 0);
+    REQUIRE(index.index_of(*_4) == 3);
+    REQUIRE(index.index_of(3) == tree_index<int>::npos);
+    REQUIRE(index[3] == 3);
+
+    REQUIRE(index.depth(0) == 0);
+    REQUIRE(index.depth(4) == 3);
+    REQUIRE(index.parent(4) == 3);
+    REQUIRE(index.subtree_size(1) == 4);
+    REQUIRE(index.is_ancestor(1, 4));
+    REQUIRE_FALSE(index.is_ancestor(4, 1));
+    REQUIRE_FALSE(index.is_ancestor(1, 5));
+
+    REQUIRE(index.lca(2, 4) == 1);
+    REQUIRE(index.lca(4, 6) == 0);
+    REQUIRE(index.lca(3, 4) == 3);
+    REQUIRE(index.lca(4, 3) == 3);
+    REQUIRE(index.lca(5, 5) == 5);
+    REQUIRE(index.distance(4, 6) == 5);
+
+    REQUIRE(index.path_from_root(4) == 0 + 1 + 3 + 4);
+    REQUIRE(index.path(4, 6) == 4 + 3 + 1 + 0 + 5 + 6);
+    REQUIRE(index.path(2, 2) == 2);
+
+    // the weights are projected from the values
+    tree_index doubled{_1, [](int value) { return 2 * value; }};
+    REQUIRE(doubled.path(2, 4) == 2 * (2 + 1 + 3 + 4));
+
+    // rebuilt after the tree changes
+    _1.erase_subtree(_2);
+    index.rebuild(_1);
+    REQUIRE(index.size() == 3);
+    REQUIRE(index.lca(1, 2) == 1);
+    REQUIRE(index.path_from_root(2) == 0 + 5 + 6);
+}
+
+TEST_CASE("tree_index agrees with parent walks on random trees", "[tree_index]") {
+    unsigned state = 7;
+    auto next = [&state](unsigned bound) {
+        state = state * 1103515245u + 12345u;
+        return (state >> 16) % bound;
+    };
+
+    for (unsigned nodes : {1u, 2u, 63u, 64u, 65u, 300u, 2000u}) {
+        tree<int> t;
+        pre_order_view view{t};
+        std::vector<pre_order_view<int>::iterator> inserted;
+        inserted.push_back(t.insert(insertion::vert, std::begin(view), 0));
+        for (unsigned i = 1; i < nodes; i++) {
+            // every other node goes deep, so that chains are long
+            auto parent = next(2) == 0 ? inserted.back() : inserted[next(i)];
+            inserted.push_back(t.append_child(parent, static_cast<int>(i)));
+        }
+
+        auto label = [](int value) { return "<" + std::to_string(value) + ">"; };
+        tree_index<int, concat_monoid> index{t, label};
+
+        naive_tree naive;
+        std::vector<int> by_index;
+        for (auto it = std::begin(view); it != std::end(view); ++it) {
+            REQUIRE(index.index_of(*it) == by_index.size());
+            by_index.push_back(*it);
+        }
+        for (index_type i = 0; i < nodes; i++) {
+            naive.parents.push_back(index.parent(i));
+        }
+        auto naive_label = [&](index_type node) { return label(by_index[node]); };
+
+        for (index_type i = 0; i < nodes; i++) {
+            REQUIRE(index.depth(i) == naive.depth(i));
+            REQUIRE(index.path_from_root(i) == naive.path(0, i, naive_label));
+        }
+        for (int query = 0; query < 500; query++) {
+            index_type a = next(nodes);
+            index_type b = next(nodes);
+            REQUIRE(index.lca(a, b) == naive.lca(a, b));
+            REQUIRE(index.path(a, b) == naive.path(a, b, naive_label));
+        }
+    }
+}
+
+TEST_CASE("tree_index handles chains deeper than a block", "[tree_index]") {
+    tree<int> chain;
+    pre_order_view view{chain};
+    auto last = chain.insert(insertion::vert, std::begin(view), 0);
+    for (int i = 1; i < 1000; i++) {
+        last = chain.append_child(last, i);
+    }
+    // a second branch off the middle of the chain
+    auto branch = chain.append_child(std::find(std::begin(view), std::end(view), 500), 1000);
+
+    tree_index<int, sum_monoid<long long>> index{chain};
+    index_type tip = index.index_of(*last);
+    index_type side = index.index_of(*branch);
+    REQUIRE(index.depth(tip) == 999);
+    REQUIRE(index[index.lca(tip, side)] == 500);
+    REQUIRE(index.path_from_root(tip) == 999LL * 1000 / 2);
+    REQUIRE(index.path(tip, side) == (999LL * 1000 / 2 - 499LL * 500 / 2) + 1000);
+}
@@ -0,0 +1,142 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "tree_stats.h"
+#include "arena_allocator.h"
+#include <vector>
+
+TEST_CASE("stats_allocator counts node allocations and frees", "[tree_stats]") {
+    using stats_tree = tree<int, stats_allocator<std::allocator<tree_node<int>>>>;
+    stats_tree t;
+    pre_order_view view{t};
+    auto root = t.insert(insertion::vert, std::begin(view), 0);
+    auto child = t.append_child(root, 1);
+    t.append_child(child, 2);
+    t.append_child(root, 3);
+
+    const allocation_stats& stats = t.get_allocator().stats();
+    REQUIRE(stats.allocations == 4);
+    REQUIRE(stats.allocated_nodes == 4);
+    REQUIRE(stats.live_nodes() == 4);
+
+    t.erase_subtree(child);
+    REQUIRE(stats.freed_nodes == 2);
+    REQUIRE(stats.live_nodes() == 2);
+    REQUIRE(stats.peak_live_nodes == 4);
+
+    // the copy is one block and counts separately
+    stats_tree copy{t};
+    const allocation_stats& copy_stats = copy.get_allocator().stats();
+    REQUIRE(&copy_stats != &stats);
+    REQUIRE(copy_stats.allocations == 1);
+    REQUIRE(copy_stats.allocated_nodes == 2);
+
+    t.clear();
+    REQUIRE(stats.live_nodes() == 0);
+    REQUIRE(stats.peak_live_nodes == 4);
+}
+
+TEST_CASE("stats_allocator passes bulk release through", "[tree_stats]") {
+    using arena_tree = tree<int, stats_allocator<arena_allocator<tree_node<int>>>>;
+    arena_tree t;
+    pre_order_view view{t};
+    auto root = t.insert(insertion::vert, std::begin(view), 0);
+    for (int i = 1; i < 100; i++) {
+        t.append_child(root, i);
+    }
+    REQUIRE(t.get_allocator().stats().live_nodes() == 100);
+
+    const allocation_stats& stats = t.get_allocator().stats();
+    t.clear();
+    REQUIRE(stats.live_nodes() == 0);
+    REQUIRE(stats.deallocations == 1);
+}
+
+TEST_CASE("A moved-into tree releases its arena in bulk", "[tree_stats]") {
+    using arena_tree = tree<int, stats_allocator<arena_allocator<tree_node<int>>>>;
+    arena_tree source;
+    pre_order_view view{source};
+    auto root = source.insert(insertion::vert, std::begin(view), 0);
+    for (int i = 1; i <= 1000; i++) {
+        source.append_child(root, i);
+    }
+
+    // source is still alive, but no longer shares the arena
+    arena_tree moved{std::move(source)};
+    REQUIRE(source.get_allocator() != moved.get_allocator());
+    const allocation_stats& stats = moved.get_allocator().stats();
+    REQUIRE(stats.live_nodes() == 1001);
+    moved.clear();
+    REQUIRE(stats.live_nodes() == 0);
+    REQUIRE(stats.deallocations == 1);
+
+    arena_tree assigned;
+    pre_order_view assigned_view{assigned};
+    root = assigned.insert(insertion::vert, std::begin(assigned_view), 0);
+    for (int i = 1; i <= 1000; i++) {
+        assigned.append_child(root, i);
+    }
+    moved = std::move(assigned);
+    REQUIRE(assigned.get_allocator() != moved.get_allocator());
+    const allocation_stats& assigned_stats = moved.get_allocator().stats();
+    moved.clear();
+    REQUIRE(assigned_stats.deallocations == 1);
+
+    // the moved-from tree can be used again
+    root = source.insert(insertion::vert, std::begin(view), 0);
+    source.append_child(root, 1);
+    REQUIRE(source.size() == 2);
+}
+
+TEST_CASE("memory_footprint follows nodes and copy blocks", "[tree_stats]") {
+    tree<int> t;
+    REQUIRE(t.memory_footprint() == sizeof(t));
+
+    pre_order_view view{t};
+    auto root = t.insert(insertion::vert, std::begin(view), 0);
+    for (int i = 1; i < 10; i++) {
+        t.append_child(root, i);
+    }
+    REQUIRE(t.memory_footprint() == sizeof(t) + 10 * sizeof(tree_node<int>));
+
+    // erased nodes of a copy block are held until the whole block goes
+    tree<int> copy{t};
+    size_t copy_footprint = copy.memory_footprint();
+    REQUIRE(copy_footprint >= sizeof(copy) + 10 * sizeof(tree_node<int>));
+    pre_order_view copy_view{copy};
+    copy.erase_subtree(std::next(std::begin(copy_view)));
+    REQUIRE(copy.memory_footprint() == copy_footprint);
+}
+
+TEST_CASE("shape_stats reports depth and fan-out histograms", "[tree_stats]") {
+    tree<int> t;
+    REQUIRE(t.shape_stats().nodes == 0);
+
+    // 0 has children 1 and 2, 1 has 3, 4 and 5, 5 has 6
+    pre_order_view view{t};
+    auto root = t.insert(insertion::vert, std::begin(view), 0);
+    auto first = t.append_child(root, 1);
+    t.append_child(root, 2);
+    t.append_child(first, 3);
+    t.append_child(first, 4);
+    auto last = t.append_child(first, 5);
+    t.append_child(last, 6);
+
+    tree_shape_stats stats = t.shape_stats();
+    REQUIRE(stats.nodes == 7);
+    REQUIRE(stats.leaves == 4);
+    REQUIRE(stats.height == 3);
+    REQUIRE(stats.max_fanout == 3);
+    REQUIRE(stats.depth_histogram == std::vector<size_t>{1, 2, 3, 1});
+    REQUIRE(stats.fanout_histogram == std::vector<size_t>{4, 1, 1, 1});
+
+    // a chain deeper than any stack
+    tree<int> chain;
+    pre_order_view chain_view{chain};
+    auto it = chain.insert(insertion::vert, std::begin(chain_view), 0);
+    for (int i = 1; i < 100000; i++) {
+        it = chain.append_child(it, i);
+    }
+    REQUIRE(chain.shape_stats().height == 99999);
+    REQUIRE(chain.shape_stats().fanout_histogram == std::vector<size_t>{1, 99999});
+}
@@ -0,0 +1,133 @@
+#include <catch2/catch.hpp>
+
+#include "tree.h"
+#include "tree_stream.h"
+#include "../bench/shapes.h"
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    template <typename Tree>
+    bool same_tree(const Tree& lhs, const Tree& rhs) {
+        pre_order_view lhs_pre{lhs};
+        pre_order_view rhs_pre{rhs};
+        post_order_view lhs_post{lhs};
+        post_order_view rhs_post{rhs};
+        return lhs.size() == rhs.size()
+            && std::equal(std::begin(lhs_pre), std::end(lhs_pre), std::begin(rhs_pre), std::end(rhs_pre))
+            && std::equal(std::begin(lhs_post), std::end(lhs_post), std::begin(rhs_post), std::end(rhs_post));
+    }
+
+    // encodes with `chunk_size` and feeds the decoder `feed_size` bytes at a time
+    template <typename T>
+    tree<T> round_trip(const tree<T>& source, size_t chunk_size, size_t feed_size) {
+        std::vector<std::byte> stream;
+        size_t largest_chunk = 0;
+        encode_tree(source, [&](std::span<const std::byte> chunk) {
+            largest_chunk = std::max(largest_chunk, chunk.size());
+            stream.insert(stream.end(), chunk.begin(), chunk.end());
+        }, chunk_size);
+        REQUIRE(largest_chunk <= chunk_size);
+
+        tree_decoder<T> decoder;
+        for (size_t i = 0; i < stream.size(); i += feed_size) {
+            REQUIRE(!decoder.done());
+            decoder.feed(std::span<const std::byte>{stream}.subspan(i, std::min(feed_size, stream.size() - i)));
+        }
+        REQUIRE(decoder.done());
+        return decoder.take();
+    }
+}
+
+TEST_CASE("Trees survive a stream round trip", "[tree_stream]") {
+    tree<int> empty;
+    REQUIRE(round_trip(empty, 16, 1).empty());
+
+    auto ints = shapes::random_tree<tree<int>>(5000, [](size_t i) { return static_cast<int>(i * 7); });
+    for (size_t chunk_size : {size_t{1}, size_t{7}, default_stream_chunk_size}) {
+        for (size_t feed_size : {size_t{1}, size_t{5}, size_t{4096}, size_t{1} << 20}) {
+            REQUIRE(same_tree(ints, round_trip(ints, chunk_size, feed_size)));
+        }
+    }
+
+    auto strings = shapes::random_tree<tree<std::string>>(2000, [](size_t i) { return std::string(i % 300, static_cast<char>('a' + i % 26)); });
+    for (size_t feed_size : {size_t{1}, size_t{13}, size_t{1} << 20}) {
+        REQUIRE(same_tree(strings, round_trip(strings, 64, feed_size)));
+    }
+
+    // a chain closes every subtree at once at the end
+    tree<int> chain;
+    {
+        pre_order_view view{chain};
+        auto it = chain.insert(insertion::vert, std::begin(view), 0);
+        for (int i = 1; i < 1000; i++) {
+            it = chain.append_child(it, i);
+        }
+    }
+    REQUIRE(same_tree(chain, round_trip(chain, 32, 3)));
+}
+
+TEST_CASE("tree_decoder rejects malformed streams", "[tree_stream]") {
+    auto bytes = [](std::initializer_list<int> values) {
+        std::vector<std::byte> result;
+        for (int value : values) {
+            result.push_back(static_cast<std::byte>(value));
+        }
+        return result;
+    };
+    auto decode = [](const std::vector<std::byte>& stream) {
+        tree_decoder<std::uint8_t> decoder;
+        decoder.feed(stream);
+        return decoder.take();
+    };
+
+    // root 1 with children 2 and 3
+    REQUIRE(decode(bytes({'T', 'R', 'S', 1, 1, 1, 1, 2, 2, 3, 0})).size() == 3);
+
+    REQUIRE_THROWS_AS(decode(bytes({'T', 'R', 'X', 1, 0})), std::runtime_error);
+    // a second root
+    REQUIRE_THROWS_AS(decode(bytes({'T', 'R', 'S', 1, 1, 1, 2, 2, 0})), std::runtime_error);
+    // the first node cannot close anything
+    REQUIRE_THROWS_AS(decode(bytes({'T', 'R', 'S', 1, 2, 1, 0})), std::runtime_error);
+    // cut short
+    REQUIRE_THROWS_AS(decode(bytes({'T', 'R', 'S', 1, 1, 1, 1})), std::runtime_error);
+    // bytes after the end
+    REQUIRE_THROWS_AS(decode(bytes({'T', 'R', 'S', 1, 0, 0})), std::runtime_error);
+    // a token of 2^64 - 1 still fits, one more bit does not, nor an eleventh byte
+    REQUIRE_THROWS_WITH(decode(bytes({'T', 'R', 'S', 1, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01, 1, 0})),
+                        Catch::Contains("more subtrees"));
+    REQUIRE_THROWS_WITH(decode(bytes({'T', 'R', 'S', 1, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02, 1, 0})),
+                        Catch::Contains("64 bits"));
+    REQUIRE_THROWS_WITH(decode(bytes({'T', 'R', 'S', 1, 0x81, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 1, 0})),
+                        Catch::Contains("too long"));
+}
+
+TEST_CASE("tree_decoder appends in O(1) without last_child links", "[tree_stream]") {
+    using forward_tree = tree<int, std::allocator<tree_node<int, forward_links>>>;
+    tree<int> source;
+    {
+        pre_order_view view{source};
+        auto root = source.insert(insertion::vert, std::begin(view), 0);
+        for (int i = 1; i < 20000; i++) {
+            auto child = source.append_child(root, i);
+            if (i % 100 == 0) {
+                source.append_child(child, -i);
+            }
+        }
+    }
+    std::vector<std::byte> stream;
+    encode_tree(source, [&](std::span<const std::byte> chunk) {
+        stream.insert(stream.end(), chunk.begin(), chunk.end());
+    });
+
+    tree_decoder<int, forward_tree::allocator_type> decoder;
+    decoder.feed(stream);
+    forward_tree decoded = decoder.take();
+    pre_order_view source_view{source};
+    pre_order_view decoded_view{decoded};
+    REQUIRE(decoded.size() == source.size());
+    REQUIRE(std::equal(std::begin(source_view), std::end(source_view), std::begin(decoded_view), std::end(decoded_view)));
+}